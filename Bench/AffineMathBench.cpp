@@ -0,0 +1,61 @@
+#include "Bench.h"
+#include "AffineMath.h"
+#include <random>
+#include <vector>
+
+using namespace DirectX;
+using namespace std;
+
+
+void BenchAffineTransforms()
+{
+	// World matrices composed from a local and a parent transform and brought into
+	// the upload layout: full matrices multiplied then transposed with
+	// XMMatrixTranspose, against the 3x4 kernels that work in that layout directly.
+	for (size_t s = 0; s < sizeof(BenchSizes) / sizeof(BenchSizes[0]); ++s)
+	{
+		const uint32_t count = BenchSizes[s];
+
+		mt19937 random(1234);
+		uniform_real_distribution<float> position(-500.0f, 500.0f);
+		uniform_real_distribution<float> angle(0.0f, XM_2PI);
+
+		vector<XMFLOAT4X4> locals4(count), parents4(count), uploads4(count);
+		vector<XMFLOAT3X4> locals3(count), parents3(count), uploads3(count);
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			XMMATRIX local = XMMatrixRotationY(angle(random))*XMMatrixTranslation(position(random), 0.0f, position(random));
+			XMMATRIX parent = XMMatrixRotationX(angle(random))*XMMatrixTranslation(position(random), position(random), 0.0f);
+			XMStoreFloat4x4(&locals4[i], local);
+			XMStoreFloat4x4(&parents4[i], parent);
+			XMStoreFloat3x4(&locals3[i], local);
+			XMStoreFloat3x4(&parents3[i], parent);
+		}
+
+		Stopwatch watch;
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			XMMATRIX world = XMMatrixMultiply(XMLoadFloat4x4(&locals4[i]), XMLoadFloat4x4(&parents4[i]));
+			XMStoreFloat4x4(&uploads4[i], XMMatrixTranspose(world));
+		}
+		double compose4 = watch.Microseconds();
+
+		watch.Restart();
+		AffineComposeBatch(locals3.data(), parents3.data(), uploads3.data(), count);
+		double compose3 = watch.Microseconds();
+
+		// Only the transpose, from matrices built on the CPU.
+		watch.Restart();
+		for (uint32_t i = 0; i < count; ++i)
+			XMStoreFloat4x4(&uploads4[i], XMMatrixTranspose(XMLoadFloat4x4(&locals4[i])));
+		double transpose4 = watch.Microseconds();
+
+		watch.Restart();
+		AffineFromMatrixBatch(locals4.data(), uploads3.data(), count);
+		double transpose3 = watch.Microseconds();
+
+		printf("  %s matrices: compose %d us (4x4) / %d us (3x4), transpose %d us (4x4) / %d us (3x4), %zuK / %zuK\n",
+			BenchSizeNames[s], (int)compose4, (int)compose3, (int)transpose4, (int)transpose3,
+			sizeof(XMFLOAT4X4)*count / 1024, sizeof(XMFLOAT3X4)*count / 1024);
+	}
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+
+using namespace std;
+
+
+// Benchmarks of the engine modules, run by MiniProjectBench. Every benchmark
+// builds its own data and prints one line per measurement.
+void BenchSceneStore();
+void BenchRenderQueue();
+void BenchTransformHierarchy();
+void BenchAffineTransforms();
+void BenchVisibilityCache();
+void BenchPotentiallyVisibleSet();
+void BenchSceneFile();
+void BenchIndirectDraws();
+void BenchBvh();
+void BenchOcclusionCulling();
+
+// Time since construction or the last Restart.
+class Stopwatch
+{
+public:
+
+	Stopwatch() : m_start(chrono::high_resolution_clock::now()) { }
+
+	void Restart() { m_start = chrono::high_resolution_clock::now(); }
+
+	double Milliseconds()const { return chrono::duration<double, milli>(chrono::high_resolution_clock::now() - m_start).count(); }
+	double Microseconds()const { return chrono::duration<double, micro>(chrono::high_resolution_clock::now() - m_start).count(); }
+
+private:
+
+	chrono::high_resolution_clock::time_point m_start;
+};
+
+// Item counts the scaling benchmarks run at, and their labels.
+const uint32_t BenchSizes[] = { 10000, 100000, 1000000 };
+const char* const BenchSizeNames[] = { "10k", "100k", "1M" };
@@ -0,0 +1,59 @@
+#include "Bench.h"
+#include <cstring>
+
+using namespace std;
+
+namespace
+{
+	struct Benchmark
+	{
+		const char* Name;
+		void(*Run)();
+	};
+
+	const Benchmark Benchmarks[] =
+	{
+		{ "SceneStore", BenchSceneStore },
+		{ "RenderQueue", BenchRenderQueue },
+		{ "TransformHierarchy", BenchTransformHierarchy },
+		{ "AffineTransforms", BenchAffineTransforms },
+		{ "VisibilityCache", BenchVisibilityCache },
+		{ "PotentiallyVisibleSet", BenchPotentiallyVisibleSet },
+		{ "SceneFile", BenchSceneFile },
+		{ "IndirectDraws", BenchIndirectDraws },
+		{ "Bvh", BenchBvh },
+		{ "OcclusionCulling", BenchOcclusionCulling },
+	};
+}
+
+
+// Runs the benchmarks named on the command line, or all of them.
+int main(int argc, char** argv)
+{
+	int run = 0;
+	for (const Benchmark& benchmark : Benchmarks)
+	{
+		bool selected = argc == 1;
+		for (int a = 1; a < argc; ++a)
+			selected = selected || strcmp(argv[a], benchmark.Name) == 0;
+
+		if (!selected)
+			continue;
+
+		printf("%s\n", benchmark.Name);
+		benchmark.Run();
+		fflush(stdout);
+		run++;
+	}
+
+	if (run == 0)
+	{
+		printf("No benchmark named so. Benchmarks:");
+		for (const Benchmark& benchmark : Benchmarks)
+			printf(" %s", benchmark.Name);
+		printf("\n");
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,104 @@
+#include "Bench.h"
+#include "Bvh.h"
+#include "CameraDynamic.h"
+#include "FrustumCulling.h"
+#include <cmath>
+#include <random>
+
+using namespace DirectX;
+using namespace std;
+
+
+void BenchBvh()
+{
+	// Boxes spread over a square that grows with the count, so every query finds
+	// about as many items at every size and only the cost of reaching them grows.
+	// The frustum queries run against the linear SIMD culler over the same boxes.
+	const uint32_t queries = 200;
+
+	for (size_t s = 0; s < sizeof(BenchSizes) / sizeof(BenchSizes[0]); ++s)
+	{
+		const uint32_t count = BenchSizes[s];
+		const float side = 300.0f*sqrtf(count / 10000.0f);
+
+		mt19937 random(2468);
+		uniform_real_distribution<float> position(0.0f, side);
+		uniform_real_distribution<float> size(0.2f, 2.0f);
+		uniform_real_distribution<float> angle(0.0f, XM_2PI);
+
+		Bvh bvh;
+		BoundsSoA bounds;
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			XMFLOAT3 center(position(random), 2.0f*size(random), position(random));
+			XMFLOAT3 extents(size(random), size(random), size(random));
+			bvh.SetItem(i, center, extents);
+
+			bounds.CenterX.push_back(center.x);
+			bounds.CenterY.push_back(center.y);
+			bounds.CenterZ.push_back(center.z);
+			bounds.ExtentX.push_back(extents.x);
+			bounds.ExtentY.push_back(extents.y);
+			bounds.ExtentZ.push_back(extents.z);
+		}
+
+		Stopwatch watch;
+		bvh.Rebuild();
+		double buildMilliseconds = watch.Milliseconds();
+
+		FrustumCuller culler;
+		vector<uint32_t> ids;
+		double frustumMicroseconds = 0.0, linearMicroseconds = 0.0;
+		double aabbMicroseconds = 0.0, sphereMicroseconds = 0.0, rayMicroseconds = 0.0;
+		uint64_t found = 0, nodes = 0, hits = 0;
+
+		for (uint32_t q = 0; q < queries; ++q)
+		{
+			XMFLOAT3 at(position(random), 1.7f, position(random));
+
+			Camera camera;
+			camera.SetFrustum(XM_PIDIV4, 16.0f / 9.0f, 1.0f, 100.0f);
+			camera.SetPosition(at.x, at.y, at.z);
+			camera.Yaw(angle(random));
+			camera.UpdateViewMatrix();
+
+			XMFLOAT4 planes[6];
+			camera.GetFrustumPlanes(planes);
+
+			ids.clear();
+			watch.Restart();
+			bvh.QueryFrustum(planes, ids);
+			frustumMicroseconds += watch.Microseconds();
+			found += ids.size();
+			nodes += bvh.GetStats().NodesVisited;
+
+			watch.Restart();
+			culler.SetPlanes(planes);
+			culler.Cull(bounds, count, ids);
+			linearMicroseconds += watch.Microseconds();
+
+			ids.clear();
+			watch.Restart();
+			bvh.QueryAabb(at, XMFLOAT3(10.0f, 10.0f, 10.0f), ids);
+			aabbMicroseconds += watch.Microseconds();
+
+			ids.clear();
+			watch.Restart();
+			bvh.QuerySphere(at, 10.0f, ids);
+			sphereMicroseconds += watch.Microseconds();
+
+			XMFLOAT3 look = camera.GetLook();
+			uint32_t id;
+			float dist;
+			watch.Restart();
+			hits += bvh.RayCast(at, look, 1000.0f, id, dist) ? 1 : 0;
+			rayMicroseconds += watch.Microseconds();
+		}
+
+		printf("  %4s: build %d ms, %u nodes; frustum %.1f us (linear %.1f us), %llu items, %llu nodes visited\n",
+			BenchSizeNames[s], (int)buildMilliseconds, bvh.GetStats().NodeCount, frustumMicroseconds / queries, linearMicroseconds / queries,
+			(unsigned long long)(found / queries), (unsigned long long)(nodes / queries));
+		printf("        aabb %.2f us, sphere %.2f us, ray %.2f us (%llu%% hit)\n",
+			aabbMicroseconds / queries, sphereMicroseconds / queries, rayMicroseconds / queries, (unsigned long long)(100 * hits / queries));
+	}
+}
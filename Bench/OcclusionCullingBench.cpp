@@ -0,0 +1,103 @@
+#include "Bench.h"
+#include "CameraDynamic.h"
+#include "OcclusionCulling.h"
+#include <random>
+
+using namespace DirectX;
+using namespace std;
+
+
+void BenchOcclusionCulling()
+{
+	// A street of 32 building blocks, the engine's occluder budget, and small
+	// boxes spread behind and between them, seen by the app's camera walking down
+	// the street. Each frame rasterizes the blocks into the 256 x 128 buffer and
+	// tests every box, with the AVX2 and the scalar rasterizer.
+	const uint32_t blocks = 32;
+	const uint32_t frames = 100;
+
+	vector<XMFLOAT3> positions;
+	for (int i = 0; i < 8; ++i)
+		positions.push_back(XMFLOAT3((i & 1) ? 1.0f : -1.0f, (i & 2) ? 1.0f : -1.0f, (i & 4) ? 1.0f : -1.0f));
+
+	const uint32_t faces[6][4] = { { 0, 2, 3, 1 }, { 4, 5, 7, 6 }, { 0, 1, 5, 4 }, { 2, 6, 7, 3 }, { 0, 4, 6, 2 }, { 1, 3, 7, 5 } };
+	vector<uint32_t> indices;
+	for (const uint32_t* face : faces)
+	{
+		const uint32_t corners[6] = { face[0], face[1], face[2], face[0], face[2], face[3] };
+		indices.insert(indices.end(), corners, corners + 6);
+	}
+
+	// Blocks on both sides of a street along z, 12 m wide.
+	mt19937 random(4321);
+	uniform_real_distribution<float> unit(0.0f, 1.0f);
+	vector<XMFLOAT3X4> worlds;
+	for (uint32_t b = 0; b < blocks; ++b)
+	{
+		float side = (b % 2) ? 1.0f : -1.0f;
+		XMFLOAT3 extents(4.0f + 4.0f*unit(random), 5.0f + 10.0f*unit(random), 6.0f + 4.0f*unit(random));
+		XMFLOAT3 center(side*(6.0f + extents.x), extents.y, (b / 2)*22.0f + 10.0f);
+
+		XMFLOAT3X4 world;
+		XMStoreFloat3x4(&world, XMMatrixMultiply(XMMatrixScaling(extents.x, extents.y, extents.z), XMMatrixTranslation(center.x, center.y, center.z)));
+		worlds.push_back(world);
+	}
+
+	const char* paths[] = { "avx2", "scalar" };
+	for (size_t s = 0; s < sizeof(BenchSizes) / sizeof(BenchSizes[0]); ++s)
+	{
+		const uint32_t count = BenchSizes[s];
+
+		BoundsSoA bounds;
+		vector<uint32_t> all(count);
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			bounds.CenterX.push_back(-150.0f + 300.0f*unit(random));
+			bounds.CenterY.push_back(0.5f + 3.0f*unit(random));
+			bounds.CenterZ.push_back(350.0f*unit(random));
+			bounds.ExtentX.push_back(0.3f + unit(random));
+			bounds.ExtentY.push_back(0.3f + unit(random));
+			bounds.ExtentZ.push_back(0.3f + unit(random));
+			all[i] = i;
+		}
+
+		for (int path = 0; path < 2; ++path)
+		{
+			OcclusionCuller culler;
+			culler.SetUseAvx2(path == 0);
+			if (path == 0 && !culler.GetUseAvx2())
+				continue;
+
+			uint32_t mesh = culler.AddOccluderMesh(positions, indices);
+
+			double rasterMicroseconds = 0.0, testMicroseconds = 0.0;
+			uint64_t occluded = 0;
+			vector<uint32_t> items;
+			for (uint32_t f = 0; f < frames; ++f)
+			{
+				Camera camera;
+				camera.SetFrustum(XM_PIDIV4, 16.0f / 9.0f, 1.0f, 1000.0f);
+				camera.SetPosition(0.0f, 1.7f, -20.0f + f*2.0f);
+				camera.UpdateViewMatrix();
+
+				XMFLOAT4X4 viewProj;
+				XMStoreFloat4x4(&viewProj, XMMatrixMultiply(camera.GetView(), camera.GetProj()));
+				culler.BeginFrame(viewProj);
+				for (const XMFLOAT3X4& world : worlds)
+					culler.AddOccluder(mesh, world);
+
+				culler.RasterizeOccluders();
+
+				items = all;
+				culler.CullOccludees(bounds, items);
+
+				rasterMicroseconds += culler.GetStats().RasterMicroseconds;
+				testMicroseconds += culler.GetStats().TestMicroseconds;
+				occluded += culler.GetStats().Occluded;
+			}
+
+			printf("  %4s %-6s: raster %d us, test %d us, %d%% occluded\n", BenchSizeNames[s], paths[path],
+				(int)(rasterMicroseconds / frames), (int)(testMicroseconds / frames), (int)(100 * occluded / ((uint64_t)count*frames)));
+		}
+	}
+}
@@ -0,0 +1,137 @@
+#include "Bench.h"
+#include "CameraDynamic.h"
+#include "FrustumCulling.h"
+#include "PotentiallyVisibleSet.h"
+#include <random>
+
+using namespace DirectX;
+using namespace std;
+
+
+void BenchPotentiallyVisibleSet()
+{
+	// A 16x16 grid of 10m rooms built from boxes: a floor, walls with a doorway
+	// to every neighbor, and a few props each. The walls are occluders. The items
+	// of a room are consecutive, so the coded sets have long runs of zeros.
+	const uint32_t rooms = 16;
+	const float roomSize = 10.0f;
+	const float wallHeight = 3.0f;
+	const float wallThickness = 0.2f;
+	const float doorWidth = 1.5f;
+	const float doorHeight = 2.2f;
+	const uint32_t propsPerRoom = 6;
+	const uint32_t views = 1000;
+
+	mt19937 random(5678);
+	uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+	BoundsSoA bounds;
+	vector<uint8_t> occluders;
+	auto addBox = [&](const XMFLOAT3& min, const XMFLOAT3& max, bool occluder)
+	{
+		bounds.CenterX.push_back(0.5f*(min.x + max.x));
+		bounds.CenterY.push_back(0.5f*(min.y + max.y));
+		bounds.CenterZ.push_back(0.5f*(min.z + max.z));
+		bounds.ExtentX.push_back(0.5f*(max.x - min.x));
+		bounds.ExtentY.push_back(0.5f*(max.y - min.y));
+		bounds.ExtentZ.push_back(0.5f*(max.z - min.z));
+		occluders.push_back(occluder ? 1 : 0);
+	};
+
+	// Wall along z at x if alongZ, along x at z otherwise, from a to b.
+	auto addWall = [&](bool alongZ, float at, float a, float b, float bottom, float top)
+	{
+		float t = 0.5f*wallThickness;
+		if (alongZ)
+			addBox(XMFLOAT3(at - t, bottom, a), XMFLOAT3(at + t, top, b), true);
+		else
+			addBox(XMFLOAT3(a, bottom, at - t), XMFLOAT3(b, top, at + t), true);
+	};
+
+	for (uint32_t rz = 0; rz < rooms; ++rz)
+	{
+		for (uint32_t rx = 0; rx < rooms; ++rx)
+		{
+			float x0 = rx*roomSize;
+			float z0 = rz*roomSize;
+			addBox(XMFLOAT3(x0, -0.2f, z0), XMFLOAT3(x0 + roomSize, 0.0f, z0 + roomSize), false);
+
+			// The west and south walls, with a doorway unless on the outside.
+			for (int side = 0; side < 2; ++side)
+			{
+				bool alongZ = side == 0;
+				float at = alongZ ? x0 : z0;
+				float start = alongZ ? z0 : x0;
+				if ((alongZ ? rx : rz) == 0)
+				{
+					addWall(alongZ, at, start, start + roomSize, 0.0f, wallHeight);
+					continue;
+				}
+
+				float door = start + 1.5f + unit(random)*(roomSize - 3.0f - doorWidth);
+				addWall(alongZ, at, start, door, 0.0f, wallHeight);
+				addWall(alongZ, at, door + doorWidth, start + roomSize, 0.0f, wallHeight);
+				addWall(alongZ, at, door, door + doorWidth, doorHeight, wallHeight);
+			}
+
+			if (rx == rooms - 1)
+				addWall(true, x0 + roomSize, z0, z0 + roomSize, 0.0f, wallHeight);
+			if (rz == rooms - 1)
+				addWall(false, z0 + roomSize, x0, x0 + roomSize, 0.0f, wallHeight);
+
+			for (uint32_t p = 0; p < propsPerRoom; ++p)
+			{
+				float x = x0 + 1.0f + unit(random)*(roomSize - 2.0f);
+				float z = z0 + 1.0f + unit(random)*(roomSize - 2.0f);
+				float s = 0.2f + 0.5f*unit(random);
+				addBox(XMFLOAT3(x - s, 0.0f, z - s), XMFLOAT3(x + s, 2.0f*s, z + s), false);
+			}
+		}
+	}
+
+	uint32_t count = (uint32_t)occluders.size();
+
+	// One layer of cells from the floor to below the top of the walls.
+	PotentiallyVisibleSet pvs;
+	pvs.SetGrid(XMFLOAT3(-1.0f, 0.0f, -1.0f), XMFLOAT3(rooms*roomSize + 1.0f, 2.5f, rooms*roomSize + 1.0f), 2.5f);
+	pvs.Build(bounds, occluders.data(), count);
+
+	// Random views from eye height inside the maze. Every view changes cells, so
+	// the PVS cull includes decoding the set.
+	FrustumCuller culler;
+	vector<uint32_t> visible;
+	double frustumMicroseconds = 0.0;
+	double pvsMicroseconds = 0.0;
+	uint64_t frustumVisible = 0;
+	uint64_t pvsVisible = 0;
+
+	for (uint32_t v = 0; v < views; ++v)
+	{
+		Camera camera;
+		camera.SetFrustum(XM_PIDIV4, 16.0f / 9.0f, 1.0f, 1000.0f);
+		camera.SetPosition(0.5f + unit(random)*(rooms*roomSize - 1.0f), 1.7f, 0.5f + unit(random)*(rooms*roomSize - 1.0f));
+		camera.Yaw(XM_2PI*unit(random));
+		camera.UpdateViewMatrix();
+
+		XMFLOAT4 planes[6];
+		camera.GetFrustumPlanes(planes);
+
+		Stopwatch watch;
+		culler.SetPlanes(planes);
+		culler.Cull(bounds, count, visible);
+		frustumMicroseconds += watch.Microseconds();
+		frustumVisible += visible.size();
+
+		pvs.Cull(camera.GetPosition(), planes, bounds, count, visible);
+		pvsMicroseconds += pvs.GetStats().CullMicroseconds;
+		pvsVisible += visible.size();
+	}
+
+	const PvsStats& stats = pvs.GetStats();
+	printf("  %u cells, %u items built in %d ms (%lluM rays), %zu/%zu KB coded, %d items per set\n",
+		stats.Cells, count, (int)stats.BuildMilliseconds, (unsigned long long)(stats.RaysCast / 1000000),
+		stats.EncodedBytes / 1024, stats.RawBytes / 1024, (int)stats.AverageSetSize);
+	printf("  cull %d us (frustum) / %d us (pvs), drawn %llu / %llu\n",
+		(int)(frustumMicroseconds / views), (int)(pvsMicroseconds / views),
+		(unsigned long long)(frustumVisible / views), (unsigned long long)(pvsVisible / views));
+}
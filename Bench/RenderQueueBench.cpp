@@ -0,0 +1,46 @@
+#include "Bench.h"
+#include "RenderQueue.h"
+#include <random>
+
+using namespace DirectX;
+using namespace std;
+
+
+void BenchRenderQueue()
+{
+	// Sorts random items with the same layout as the scene arrays.
+	for (size_t s = 0; s < sizeof(BenchSizes) / sizeof(BenchSizes[0]); ++s)
+	{
+		const uint32_t count = BenchSizes[s];
+
+		mt19937 random(1234);
+		uniform_real_distribution<float> position(-500.0f, 500.0f);
+		uniform_int_distribution<uint32_t> state(0, 15);
+
+		vector<DrawKey> drawKeys(count);
+		BoundsSoA bounds;
+		bounds.CenterX.resize(count);
+		bounds.CenterY.resize(count);
+		bounds.CenterZ.resize(count);
+		vector<uint32_t> items(count);
+
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			drawKeys[i].Pso = state(random) & 3;
+			drawKeys[i].Geometry = state(random);
+			drawKeys[i].Material = state(random);
+			bounds.CenterX[i] = position(random);
+			bounds.CenterY[i] = position(random);
+			bounds.CenterZ[i] = position(random);
+			items[i] = i;
+		}
+
+		RenderQueue queue;
+		queue.Build(items, drawKeys.data(), bounds, XMFLOAT3(0.0f, 0.0f, -600.0f), XMFLOAT3(0.0f, 0.0f, 1.0f), 1.0f, 1200.0f);
+		queue.Sort();
+
+		const RenderQueueStats& stats = queue.GetStats();
+		printf("  %s items: build %d us, sort %d us, %u state changes\n",
+			BenchSizeNames[s], (int)stats.BuildMicroseconds, (int)stats.SortMicroseconds, stats.StateChanges);
+	}
+}
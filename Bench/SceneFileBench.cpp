@@ -0,0 +1,99 @@
+#include "Bench.h"
+#include "SceneFile.h"
+#include "SceneStore.h"
+#include <random>
+
+using namespace DirectX;
+using namespace std;
+
+
+void BenchSceneFile()
+{
+	// Boxes and spheres scattered over the ground, written to a file and loaded
+	// back into a scene store. Loading is mapping the file and adding its arrays.
+	const char* path = "Benchmark.scene";
+
+	for (size_t s = 0; s < sizeof(BenchSizes) / sizeof(BenchSizes[0]); ++s)
+	{
+		const uint32_t count = BenchSizes[s];
+
+		mt19937 random(2468);
+		uniform_real_distribution<float> position(-500.0f, 500.0f);
+		uniform_real_distribution<float> scale(0.5f, 2.0f);
+
+		SceneFileContents contents;
+		uint32_t meshes[] = { AddSceneFileMesh(contents, "shapeGeo", "box"), AddSceneFileMesh(contents, "shapeGeo", "sphere0") };
+		BoundingBox bounds[] = { BoundingBox(XMFLOAT3(0.0f, 0.0f, 0.0f), XMFLOAT3(0.5f, 0.5f, 0.5f)), BoundingBox(XMFLOAT3(0.0f, 0.0f, 0.0f), XMFLOAT3(1.0f, 1.0f, 1.0f)) };
+
+		contents.Worlds.resize(count);
+		contents.LocalBounds.resize(count);
+		contents.Colors.assign(count, XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f));
+		contents.MeshIds.resize(count);
+		contents.MaterialIds.resize(count);
+		contents.Parents.assign(count, UINT32_MAX);
+		contents.Flags.assign(count, 0);
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			float k = scale(random);
+			XMStoreFloat3x4(&contents.Worlds[i], XMMatrixScaling(k, k, k)*XMMatrixTranslation(position(random), 0.5f*k, position(random)));
+			contents.LocalBounds[i] = bounds[i % 2];
+			contents.MeshIds[i] = meshes[i % 2];
+			contents.MaterialIds[i] = i % 8;
+		}
+
+		Stopwatch watch;
+		bool written = WriteSceneFile(path, contents);
+		double writeMilliseconds = watch.Milliseconds();
+
+		if (!written)
+		{
+			printf("  could not write %s\n", path);
+			return;
+		}
+
+		// One draw per mesh, as the engine resolves them against its geometries.
+		vector<DrawKey> draws(contents.Meshes.size());
+		vector<uint32_t> lodGroups(contents.Meshes.size(), UINT32_MAX);
+		for (size_t m = 0; m < draws.size(); ++m)
+			draws[m].Geometry = (uint32_t)m;
+
+		SceneStore scene(3);
+		double mapMilliseconds = 0.0;
+		double addMilliseconds = 0.0;
+		size_t fileBytes = 0;
+
+		{
+			SceneFile file;
+
+			watch.Restart();
+			bool opened = file.Open(path);
+			mapMilliseconds = watch.Milliseconds();
+
+			if (opened)
+			{
+				RenderItemRange range;
+				range.Count = file.GetItemCount();
+				range.Worlds = file.Worlds();
+				range.LocalBounds = file.LocalBounds();
+				for (int c = 0; c < 6; ++c)
+					range.WorldBounds[c] = file.WorldBounds(c);
+				range.Colors = file.Colors();
+				range.DrawIds = file.MeshIds();
+				range.Materials = file.MaterialIds();
+				range.Draws = draws.data();
+				range.DrawLodGroups = lodGroups.data();
+
+				watch.Restart();
+				scene.AddRange(range);
+				addMilliseconds = watch.Milliseconds();
+			}
+
+			fileBytes = file.GetSize();
+		}
+
+		remove(path);
+
+		printf("  %s items: %u loaded, %zu KB, write %.2f ms, map and check %.2f ms, add %.2f ms\n",
+			BenchSizeNames[s], scene.Size(), fileBytes >> 10, writeMilliseconds, mapMilliseconds, addMilliseconds);
+	}
+}
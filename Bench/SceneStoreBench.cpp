@@ -0,0 +1,203 @@
+#include "Bench.h"
+#include "SceneStore.h"
+#include <algorithm>
+#include <memory>
+#include <random>
+#include <vector>
+
+using namespace DirectX;
+using namespace std;
+
+namespace
+{
+	// Layout of the engine's ObjectData, written into a plain array standing in
+	// for the mapped object buffer.
+	struct ObjectData
+	{
+		XMFLOAT3X4 World;
+		XMFLOAT4 Color;
+	};
+
+	// A render item as it was before the scene store: one heap node per item,
+	// visited every frame to find the dirty ones.
+	struct HeapRenderItem
+	{
+		XMFLOAT4X4 World;
+		int NumFramesDirty = 0;
+		uint32_t ObjCBIndex = 0;
+		void* Geo = nullptr;
+		uint32_t PrimitiveType = 4;
+		uint32_t IndexCount = 0;
+		uint32_t StartIndexLocation = 0;
+		int32_t BaseVertexLocation = 0;
+	};
+
+	const int FrameResources = 3;
+
+	// Uploads the dirty slots of frame resource 0 as UpdateObjectBuffer does.
+	uint32_t UploadDirty(SceneStore& scene, vector<ObjectData>& objects)
+	{
+		objects.resize(scene.SlotCount());
+
+		uint32_t uploaded = 0;
+		for (uint32_t slot : scene.DirtySlots(0))
+		{
+			uint32_t denseIndex = scene.SlotToDense(slot);
+			if (denseIndex == UINT32_MAX)
+				continue;
+
+			objects[slot].World = scene.Worlds()[denseIndex];
+			objects[slot].Color = scene.Colors()[denseIndex];
+			uploaded++;
+		}
+
+		scene.ClearDirty(0);
+		return uploaded;
+	}
+
+	uint32_t UploadDirty(vector<unique_ptr<HeapRenderItem>>& items, vector<ObjectData>& objects)
+	{
+		objects.resize(items.size());
+
+		uint32_t uploaded = 0;
+		for (auto& item : items)
+		{
+			if (item->NumFramesDirty == 0)
+				continue;
+
+			XMStoreFloat3x4(&objects[item->ObjCBIndex].World, XMLoadFloat4x4(&item->World));
+			item->NumFramesDirty--;
+			uploaded++;
+		}
+
+		return uploaded;
+	}
+}
+
+
+void BenchSceneStore()
+{
+	// Unit boxes scattered over a square kilometer, added one by one and as a
+	// range, uploaded whole, then with 1% of them moved, then half of them
+	// removed in random order.
+	for (size_t s = 0; s < sizeof(BenchSizes) / sizeof(BenchSizes[0]); ++s)
+	{
+		const uint32_t count = BenchSizes[s];
+
+		mt19937 random(1234);
+		uniform_real_distribution<float> position(-500.0f, 500.0f);
+
+		vector<RenderItem> items(count);
+		for (RenderItem& item : items)
+		{
+			XMStoreFloat3x4(&item.World, XMMatrixTranslation(position(random), 0.5f, position(random)));
+			item.LocalBounds = BoundingBox(XMFLOAT3(0.0f, 0.0f, 0.0f), XMFLOAT3(0.5f, 0.5f, 0.5f));
+			item.Draw.IndexCount = 36;
+		}
+
+		SceneStore scene(FrameResources);
+		vector<RenderItemHandle> handles(count);
+
+		Stopwatch watch;
+		for (uint32_t i = 0; i < count; ++i)
+			handles[i] = scene.Add(items[i]);
+		double addMilliseconds = watch.Milliseconds();
+
+		// The same items as arrays, with their world bounds computed beforehand as
+		// a scene file stores them.
+		vector<XMFLOAT3X4> worlds(count);
+		vector<BoundingBox> localBounds(count);
+		vector<XMFLOAT4> colors(count);
+		vector<float> worldBounds[6];
+		vector<uint32_t> drawIds(count, 0);
+		vector<uint32_t> materials(count, 0);
+		for (int c = 0; c < 6; ++c)
+			worldBounds[c].resize(count);
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			uint32_t denseIndex = scene.DenseIndex(handles[i]);
+			worlds[i] = items[i].World;
+			localBounds[i] = items[i].LocalBounds;
+			colors[i] = items[i].Color;
+			worldBounds[0][i] = scene.WorldBounds().CenterX[denseIndex];
+			worldBounds[1][i] = scene.WorldBounds().CenterY[denseIndex];
+			worldBounds[2][i] = scene.WorldBounds().CenterZ[denseIndex];
+			worldBounds[3][i] = scene.WorldBounds().ExtentX[denseIndex];
+			worldBounds[4][i] = scene.WorldBounds().ExtentY[denseIndex];
+			worldBounds[5][i] = scene.WorldBounds().ExtentZ[denseIndex];
+		}
+
+		DrawKey draw = items[0].Draw;
+		uint32_t noLodGroup = UINT32_MAX;
+
+		RenderItemRange range;
+		range.Count = count;
+		range.Worlds = worlds.data();
+		range.LocalBounds = localBounds.data();
+		for (int c = 0; c < 6; ++c)
+			range.WorldBounds[c] = worldBounds[c].data();
+		range.Colors = colors.data();
+		range.DrawIds = drawIds.data();
+		range.Materials = materials.data();
+		range.Draws = &draw;
+		range.DrawLodGroups = &noLodGroup;
+
+		SceneStore rangeScene(FrameResources);
+		watch.Restart();
+		rangeScene.AddRange(range);
+		double addRangeMilliseconds = watch.Milliseconds();
+
+		// Every slot is dirty after adding.
+		vector<ObjectData> objects;
+		watch.Restart();
+		uint32_t uploadedAll = UploadDirty(scene, objects);
+		double uploadAllMilliseconds = watch.Milliseconds();
+
+		uniform_int_distribution<uint32_t> pick(0, count - 1);
+		vector<uint32_t> moved(count / 100);
+		for (uint32_t& item : moved)
+			item = pick(random);
+
+		watch.Restart();
+		for (uint32_t item : moved)
+		{
+			XMFLOAT3X4 world = scene.GetWorld(handles[item]);
+			world.m[1][3] += 1.0f;
+			scene.SetWorld(handles[item], world);
+		}
+		double moveMilliseconds = watch.Milliseconds();
+
+		watch.Restart();
+		uint32_t uploadedMoved = UploadDirty(scene, objects);
+		double uploadMovedMilliseconds = watch.Milliseconds();
+
+		// The same frame with heap nodes: all of them visited for 1% dirty ones.
+		vector<unique_ptr<HeapRenderItem>> heapItems(count);
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			heapItems[i] = make_unique<HeapRenderItem>();
+			XMStoreFloat4x4(&heapItems[i]->World, XMLoadFloat3x4(&items[i].World));
+			heapItems[i]->ObjCBIndex = i;
+		}
+		for (uint32_t item : moved)
+			heapItems[item]->NumFramesDirty = 1;
+
+		// Shuffled, as nodes allocated over a session would be.
+		shuffle(heapItems.begin(), heapItems.end(), random);
+
+		watch.Restart();
+		UploadDirty(heapItems, objects);
+		double uploadHeapMilliseconds = watch.Milliseconds();
+
+		shuffle(handles.begin(), handles.end(), random);
+		watch.Restart();
+		for (uint32_t i = 0; i < count / 2; ++i)
+			scene.Remove(handles[i]);
+		double removeMilliseconds = watch.Milliseconds();
+
+		printf("  %s items: add %.2f ms, add range %.2f ms, upload all %.2f ms (%u), move 1%% %.2f ms, "
+			"upload moved %.3f ms (%u) vs %.3f ms on heap items, remove half %.2f ms\n",
+			BenchSizeNames[s], addMilliseconds, addRangeMilliseconds, uploadAllMilliseconds, uploadedAll, moveMilliseconds,
+			uploadMovedMilliseconds, uploadedMoved, uploadHeapMilliseconds, removeMilliseconds);
+	}
+}
@@ -0,0 +1,49 @@
+#include "Bench.h"
+#include "TransformHierarchy.h"
+
+using namespace DirectX;
+using namespace std;
+
+
+void BenchTransformHierarchy()
+{
+	// A chain of 100k nodes and a root with 100k children, updated after moving
+	// the root and after moving 1% of the nodes.
+	const uint32_t count = 100000;
+
+	XMFLOAT3X4 local;
+	XMStoreFloat3x4(&local, XMMatrixTranslation(0.001f, 0.0f, 0.0f));
+
+	RenderItemHandle item;
+	item.Index = 0;
+
+	for (int deep = 1; deep >= 0; --deep)
+	{
+		TransformHierarchy hierarchy;
+		uint32_t root = hierarchy.AddNode(TransformHierarchy::InvalidNode, local);
+		uint32_t parent = root;
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			uint32_t node = hierarchy.AddNode(deep ? parent : root, local, item);
+			parent = node;
+		}
+
+		uint32_t changed = 0;
+		auto setWorld = [&changed](RenderItemHandle, const XMFLOAT3X4&) { changed++; };
+		hierarchy.Update(setWorld);
+
+		XMFLOAT3X4 moved;
+		XMStoreFloat3x4(&moved, XMMatrixTranslation(0.002f, 0.0f, 0.0f));
+
+		hierarchy.SetLocal(root, moved);
+		hierarchy.Update(setWorld);
+		double all = hierarchy.GetStats().UpdateMicroseconds;
+
+		for (uint32_t i = 0; i < count; i += 100)
+			hierarchy.SetLocal(count - i, moved);
+		hierarchy.Update(setWorld);
+		double some = hierarchy.GetStats().UpdateMicroseconds;
+
+		printf("  %s 100k nodes: root moved %d us, 1%% moved %d us\n", deep ? "deep" : "wide", (int)all, (int)some);
+	}
+}
@@ -0,0 +1,98 @@
+#include "Bench.h"
+#include "CameraDynamic.h"
+#include "FrustumCulling.h"
+#include "VisibilityCache.h"
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+using namespace DirectX;
+using namespace std;
+
+
+void BenchVisibilityCache()
+{
+	// A camera flies through one million random boxes for 600 frames, forward at
+	// a steady pace: straight, slowly turning, and spinning fast enough for the
+	// cache to fall back. Every frame is culled by the SIMD test and by the
+	// visibility cache, the frames that fill the cache included. Frames where the
+	// two disagree are counted.
+	const uint32_t count = 1000000;
+	const uint32_t frames = 600;
+
+	mt19937 random(1234);
+	uniform_real_distribution<float> position(-500.0f, 500.0f);
+	uniform_real_distribution<float> height(-50.0f, 50.0f);
+	uniform_real_distribution<float> extent(0.5f, 3.0f);
+
+	BoundsSoA bounds;
+	bounds.CenterX.resize(count);
+	bounds.CenterY.resize(count);
+	bounds.CenterZ.resize(count);
+	bounds.ExtentX.resize(count);
+	bounds.ExtentY.resize(count);
+	bounds.ExtentZ.resize(count);
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		bounds.CenterX[i] = position(random);
+		bounds.CenterY[i] = height(random);
+		bounds.CenterZ[i] = position(random);
+		bounds.ExtentX[i] = extent(random);
+		bounds.ExtentY[i] = extent(random);
+		bounds.ExtentZ[i] = extent(random);
+	}
+
+	FrustumCuller culler;
+	vector<uint32_t> full;
+	vector<uint32_t> cached;
+	uint32_t mismatched = 0;
+
+	const float turns[] = { 0.0f, 0.004f, 0.1f };
+	const char* names[] = { "straight", "turning", "spinning" };
+	for (int flight = 0; flight < 3; ++flight)
+	{
+		// The app's camera in a 16:9 window.
+		Camera camera;
+		camera.SetFrustum(XM_PIDIV4, 16.0f / 9.0f, 1.0f, 1000.0f);
+		camera.SetPosition(-100.0f, 5.0f, -300.0f);
+
+		VisibilityCache cache;
+		double fullMicroseconds = 0.0;
+		double cacheMicroseconds = 0.0;
+		double worstMicroseconds = 0.0;
+		uint64_t retested = 0;
+		uint32_t fellBack = 0;
+
+		for (uint32_t frame = 0; frame < frames; ++frame)
+		{
+			camera.ForwardAndBackward(0.25f);
+			camera.Yaw(turns[flight]*sinf(0.01f*frame));
+			camera.UpdateViewMatrix();
+
+			XMFLOAT4 planes[6];
+			camera.GetFrustumPlanes(planes);
+
+			Stopwatch watch;
+			culler.SetPlanes(planes);
+			culler.Cull(bounds, count, full);
+			double microseconds = watch.Microseconds();
+
+			cache.Cull(planes, camera.GetPosition(), bounds, count, cached);
+
+			fullMicroseconds += microseconds;
+			cacheMicroseconds += cache.GetStats().CullMicroseconds;
+			worstMicroseconds = max(worstMicroseconds, cache.GetStats().CullMicroseconds);
+			retested += cache.GetStats().Retested;
+			fellBack += cache.GetStats().FellBack ? 1 : 0;
+
+			if (cached != full)
+				mismatched++;
+		}
+
+		printf("  1M items %-8s: %d us (simd) / %d us (cached, %llu retested, worst frame %d us, %u fallbacks)\n", names[flight],
+			(int)(fullMicroseconds / frames), (int)(cacheMicroseconds / frames), (unsigned long long)(retested / frames),
+			(int)worstMicroseconds, fellBack);
+	}
+
+	printf("  mismatched frames: %u\n", mismatched);
+}
@@ -0,0 +1,47 @@
+
+#include "AffineMath.h"
+
+using namespace DirectX;
+
+
+namespace
+{
+	// Rows of the transposed product: row i of (local*parent)^T is parent^T row i
+	// times local^T, whose implicit fourth row is (0,0,0,1).
+	inline void Compose(const XMFLOAT3X4& local, const XMFLOAT3X4& parent, XMFLOAT3X4& world)
+	{
+		XMVECTOR l0 = XMLoadFloat4((const XMFLOAT4*)local.m[0]);
+		XMVECTOR l1 = XMLoadFloat4((const XMFLOAT4*)local.m[1]);
+		XMVECTOR l2 = XMLoadFloat4((const XMFLOAT4*)local.m[2]);
+
+		for (int i = 0; i < 3; ++i)
+		{
+			XMVECTOR p = XMLoadFloat4((const XMFLOAT4*)parent.m[i]);
+
+			XMVECTOR row = XMVectorMultiply(p, g_XMIdentityR3);
+			row = XMVectorMultiplyAdd(XMVectorSplatX(p), l0, row);
+			row = XMVectorMultiplyAdd(XMVectorSplatY(p), l1, row);
+			row = XMVectorMultiplyAdd(XMVectorSplatZ(p), l2, row);
+
+			XMStoreFloat4((XMFLOAT4*)world.m[i], row);
+		}
+	}
+}
+
+
+void AffineCompose(const XMFLOAT3X4& local, const XMFLOAT3X4& parent, XMFLOAT3X4& world)
+{
+	Compose(local, parent, world);
+}
+
+void AffineComposeBatch(const XMFLOAT3X4* locals, const XMFLOAT3X4* parents, XMFLOAT3X4* worlds, uint32_t count)
+{
+	for (uint32_t i = 0; i < count; ++i)
+		Compose(locals[i], parents[i], worlds[i]);
+}
+
+void AffineFromMatrixBatch(const XMFLOAT4X4* matrices, XMFLOAT3X4* affines, uint32_t count)
+{
+	for (uint32_t i = 0; i < count; ++i)
+		XMStoreFloat3x4(&affines[i], XMLoadFloat4x4(&matrices[i]));
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstdint>
+#include <DirectXMath.h>
+
+using namespace DirectX;
+
+
+// Affine transforms are kept as XMFLOAT3X4: the first three columns of a
+// DirectXMath (row vector) matrix, stored transposed, one row per output
+// component with the translation in w. The fourth column of an affine matrix is
+// always (0,0,0,1), so it is not stored. XMLoadFloat3x4 and XMStoreFloat3x4
+// convert to and from XMMATRIX, and the layout is what the shaders read into a
+// float3x4 and multiply column vectors with, so uploads are plain copies.
+
+inline XMFLOAT3X4 Identity3x4()
+{
+	return XMFLOAT3X4(
+		1.0f, 0.0f, 0.0f, 0.0f,
+		0.0f, 1.0f, 0.0f, 0.0f,
+		0.0f, 0.0f, 1.0f, 0.0f);
+}
+
+// world = local * parent, without expanding to 4x4 matrices.
+void AffineCompose(const XMFLOAT3X4& local, const XMFLOAT3X4& parent, XMFLOAT3X4& world);
+
+// worlds[i] = locals[i] * parents[i].
+void AffineComposeBatch(const XMFLOAT3X4* locals, const XMFLOAT3X4* parents, XMFLOAT3X4* worlds, uint32_t count);
+
+// Transposes full matrices into the 3x4 layout, dropping the fourth column.
+void AffineFromMatrixBatch(const XMFLOAT4X4* matrices, XMFLOAT3X4* affines, uint32_t count);
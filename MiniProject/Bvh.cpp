@@ -0,0 +1,644 @@
+
+#include "Bvh.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cfloat>
+
+using namespace DirectX;
+using namespace std;
+
+namespace
+{
+	const uint32_t kInvalid = UINT32_MAX;
+
+	// Stack entries with this bit set are subtrees known to be fully inside the query volume.
+	const uint32_t kAcceptAll = 0x80000000u;
+
+	const uint32_t kBinCount = 12;
+	const uint32_t kMaxLeafItems = 4;
+
+	// Leaves larger than this are split even when the SAH says it is not worth it.
+	const uint32_t kMaxSahLeafItems = 16;
+
+	const size_t kMaxPendingItems = 256;
+
+	enum Overlap
+	{
+		Outside = 0,
+		Intersects = 1,
+		Inside = 2
+	};
+
+	float Axis(const XMFLOAT3& v, int axis)
+	{
+		return (&v.x)[axis];
+	}
+
+	float HalfArea(const XMFLOAT3& mn, const XMFLOAT3& mx)
+	{
+		float dx = mx.x - mn.x;
+		float dy = mx.y - mn.y;
+		float dz = mx.z - mn.z;
+		return dx*dy + dy*dz + dz*dx;
+	}
+
+	void Grow(XMFLOAT3& mn, XMFLOAT3& mx, const XMFLOAT3& bmin, const XMFLOAT3& bmax)
+	{
+		mn = XMFLOAT3(min(mn.x, bmin.x), min(mn.y, bmin.y), min(mn.z, bmin.z));
+		mx = XMFLOAT3(max(mx.x, bmax.x), max(mx.y, bmax.y), max(mx.z, bmax.z));
+	}
+
+	void EmptyBounds(XMFLOAT3& mn, XMFLOAT3& mx)
+	{
+		mn = XMFLOAT3(FLT_MAX, FLT_MAX, FLT_MAX);
+		mx = XMFLOAT3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+	}
+
+	// Slab test; returns the entry distance or FLT_MAX on a miss.
+	float RayBox(const XMFLOAT3& origin, const XMFLOAT3& invDir, const XMFLOAT3& mn, const XMFLOAT3& mx, float maxDist)
+	{
+		float tx1 = (mn.x - origin.x)*invDir.x, tx2 = (mx.x - origin.x)*invDir.x;
+		float ty1 = (mn.y - origin.y)*invDir.y, ty2 = (mx.y - origin.y)*invDir.y;
+		float tz1 = (mn.z - origin.z)*invDir.z, tz2 = (mx.z - origin.z)*invDir.z;
+
+		float tmin = max(max(min(tx1, tx2), min(ty1, ty2)), max(min(tz1, tz2), 0.0f));
+		float tmax = min(min(max(tx1, tx2), max(ty1, ty2)), min(max(tz1, tz2), maxDist));
+
+		return tmin <= tmax ? tmin : FLT_MAX;
+	}
+}
+
+Bvh::Bvh()
+{
+}
+
+Bvh::~Bvh()
+{
+	if (m_rebuilding)
+		m_rebuild.wait();
+}
+
+void Bvh::SetItem(uint32_t id, const XMFLOAT3& center, const XMFLOAT3& extents)
+{
+	if (id >= m_items.Alive.size())
+	{
+		m_items.Min.resize(id + 1);
+		m_items.Max.resize(id + 1);
+		m_items.Alive.resize(id + 1, 0);
+	}
+
+	bool wasAlive = m_items.Alive[id] != 0;
+
+	m_items.Min[id] = XMFLOAT3(center.x - extents.x, center.y - extents.y, center.z - extents.z);
+	m_items.Max[id] = XMFLOAT3(center.x + extents.x, center.y + extents.y, center.z + extents.z);
+	m_items.Alive[id] = 1;
+
+	if (m_rebuilding)
+		m_changedDuringRebuild.push_back(id);
+
+	if (id < m_tree.ItemLeaf.size() && m_tree.ItemLeaf[id] != kInvalid)
+		Refit(id);
+	else if (!wasAlive)
+		m_pending.push_back(id);
+}
+
+void Bvh::RemoveItem(uint32_t id)
+{
+	if (id >= m_items.Alive.size() || !m_items.Alive[id])
+		return;
+
+	m_items.Alive[id] = 0;
+
+	if (m_rebuilding)
+		m_changedDuringRebuild.push_back(id);
+
+	if (id < m_tree.ItemLeaf.size() && m_tree.ItemLeaf[id] != kInvalid)
+		Refit(id);
+	else
+		m_pending.erase(remove(m_pending.begin(), m_pending.end(), id), m_pending.end());
+}
+
+void Bvh::Clear()
+{
+	if (m_rebuilding)
+	{
+		m_rebuild.wait();
+		m_rebuilding = false;
+	}
+
+	m_items = ItemBounds();
+	m_tree = Tree();
+	m_pending.clear();
+	m_changedDuringRebuild.clear();
+	m_refitsSinceBuild = 0;
+	m_framesSinceBuild = 0;
+
+	m_stats.NodeCount = 0;
+	m_stats.PendingItems = 0;
+}
+
+void Bvh::Rebuild()
+{
+	// A background build started earlier is stale now.
+	if (m_rebuilding)
+	{
+		m_rebuild.wait();
+		m_rebuilding = false;
+	}
+
+	Tree tree;
+	BuildTree(m_items, tree);
+
+	m_changedDuringRebuild.clear();
+	InstallTree(tree);
+}
+
+void Bvh::Tick()
+{
+	if (m_rebuilding && m_rebuild.wait_for(chrono::seconds(0)) == future_status::ready)
+	{
+		Tree tree = m_rebuild.get();
+		m_rebuilding = false;
+		InstallTree(tree);
+	}
+
+	if (!m_rebuilding)
+	{
+		++m_framesSinceBuild;
+
+		bool refitted = m_refitsSinceBuild > 0 && m_framesSinceBuild >= m_rebuildInterval;
+		if (refitted || m_pending.size() > kMaxPendingItems)
+			StartBackgroundRebuild();
+	}
+}
+
+void Bvh::SetRebuildInterval(uint32_t frames)
+{
+	m_rebuildInterval = frames;
+}
+
+void Bvh::QueryFrustum(const XMFLOAT4 planes[6], vector<uint32_t>& ids)
+{
+	auto classify = [planes](const XMFLOAT3& mn, const XMFLOAT3& mx)
+	{
+		XMFLOAT3 c(0.5f*(mn.x + mx.x), 0.5f*(mn.y + mx.y), 0.5f*(mn.z + mx.z));
+		XMFLOAT3 e(0.5f*(mx.x - mn.x), 0.5f*(mx.y - mn.y), 0.5f*(mx.z - mn.z));
+
+		int result = Inside;
+		for (int p = 0; p < 6; ++p)
+		{
+			float d = planes[p].x*c.x + planes[p].y*c.y + planes[p].z*c.z + planes[p].w;
+			float r = fabsf(planes[p].x)*e.x + fabsf(planes[p].y)*e.y + fabsf(planes[p].z)*e.z;
+
+			if (d + r < 0.0f)
+				return (int)Outside;
+			if (d - r < 0.0f)
+				result = Intersects;
+		}
+		return result;
+	};
+
+	Query(classify, ids);
+}
+
+void Bvh::QueryAabb(const XMFLOAT3& center, const XMFLOAT3& extents, vector<uint32_t>& ids)
+{
+	XMFLOAT3 qmin(center.x - extents.x, center.y - extents.y, center.z - extents.z);
+	XMFLOAT3 qmax(center.x + extents.x, center.y + extents.y, center.z + extents.z);
+
+	auto classify = [qmin, qmax](const XMFLOAT3& mn, const XMFLOAT3& mx)
+	{
+		if (mx.x < qmin.x || mn.x > qmax.x || mx.y < qmin.y || mn.y > qmax.y || mx.z < qmin.z || mn.z > qmax.z)
+			return (int)Outside;
+
+		if (mn.x >= qmin.x && mx.x <= qmax.x && mn.y >= qmin.y && mx.y <= qmax.y && mn.z >= qmin.z && mx.z <= qmax.z)
+			return (int)Inside;
+
+		return (int)Intersects;
+	};
+
+	Query(classify, ids);
+}
+
+void Bvh::QuerySphere(const XMFLOAT3& center, float radius, vector<uint32_t>& ids)
+{
+	float radiusSq = radius*radius;
+
+	auto classify = [center, radiusSq](const XMFLOAT3& mn, const XMFLOAT3& mx)
+	{
+		// Squared distance to the nearest point and to the farthest corner of the box.
+		float nearSq = 0.0f, farSq = 0.0f;
+		for (int a = 0; a < 3; ++a)
+		{
+			float c = Axis(center, a);
+			float lo = Axis(mn, a), hi = Axis(mx, a);
+
+			float dn = c < lo ? lo - c : (c > hi ? c - hi : 0.0f);
+			float df = max(fabsf(c - lo), fabsf(c - hi));
+			nearSq += dn*dn;
+			farSq += df*df;
+		}
+
+		if (nearSq > radiusSq)
+			return (int)Outside;
+
+		return farSq <= radiusSq ? (int)Inside : (int)Intersects;
+	};
+
+	Query(classify, ids);
+}
+
+bool Bvh::RayCast(const XMFLOAT3& origin, const XMFLOAT3& direction, float maxDist, uint32_t& id, float& dist)
+{
+	XMFLOAT3 invDir(1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z);
+
+	float best = maxDist;
+	uint32_t bestId = kInvalid;
+
+	m_stats.NodesVisited = 0;
+	m_stats.ItemsTested = 0;
+
+	m_stack.clear();
+	if (!m_tree.Nodes.empty())
+		m_stack.push_back(0);
+
+	while (!m_stack.empty())
+	{
+		const BvhNode& node = m_tree.Nodes[m_stack.back()];
+		m_stack.pop_back();
+		m_stats.NodesVisited++;
+
+		if (RayBox(origin, invDir, node.Min, node.Max, best) == FLT_MAX)
+			continue;
+
+		if (node.Count > 0)
+		{
+			for (uint32_t i = node.LeftOrFirst; i < node.LeftOrFirst + node.Count; ++i)
+			{
+				uint32_t item = m_tree.ItemIds[i];
+				m_stats.ItemsTested++;
+
+				if (!m_items.Alive[item])
+					continue;
+
+				float t = RayBox(origin, invDir, m_items.Min[item], m_items.Max[item], best);
+				if (t < best)
+				{
+					best = t;
+					bestId = item;
+				}
+			}
+		}
+		else
+		{
+			// Visit the nearer child first so that farther subtrees get pruned by best.
+			const BvhNode& left = m_tree.Nodes[node.LeftOrFirst];
+			const BvhNode& right = m_tree.Nodes[node.LeftOrFirst + 1];
+			float tl = RayBox(origin, invDir, left.Min, left.Max, best);
+			float tr = RayBox(origin, invDir, right.Min, right.Max, best);
+
+			uint32_t nearChild = tl <= tr ? node.LeftOrFirst : node.LeftOrFirst + 1;
+			uint32_t farChild = tl <= tr ? node.LeftOrFirst + 1 : node.LeftOrFirst;
+			if (max(tl, tr) != FLT_MAX)
+				m_stack.push_back(farChild);
+			if (min(tl, tr) != FLT_MAX)
+				m_stack.push_back(nearChild);
+		}
+	}
+
+	for (uint32_t item : m_pending)
+	{
+		m_stats.ItemsTested++;
+
+		float t = RayBox(origin, invDir, m_items.Min[item], m_items.Max[item], best);
+		if (t < best)
+		{
+			best = t;
+			bestId = item;
+		}
+	}
+
+	if (bestId == kInvalid)
+		return false;
+
+	id = bestId;
+	dist = best;
+	return true;
+}
+
+const BvhStats& Bvh::GetStats()const
+{
+	return m_stats;
+}
+
+void Bvh::BuildTree(const ItemBounds& items, Tree& tree)
+{
+	tree.Nodes.clear();
+	tree.ItemIds.clear();
+	tree.ItemLeaf.assign(items.Alive.size(), kInvalid);
+
+	for (uint32_t id = 0; id < (uint32_t)items.Alive.size(); ++id)
+	{
+		if (items.Alive[id])
+			tree.ItemIds.push_back(id);
+	}
+
+	if (tree.ItemIds.empty())
+		return;
+
+	auto centroid = [&items](uint32_t id, int axis)
+	{
+		return 0.5f*(Axis(items.Min[id], axis) + Axis(items.Max[id], axis));
+	};
+
+	auto computeBounds = [&items, &tree](BvhNode& node)
+	{
+		EmptyBounds(node.Min, node.Max);
+		for (uint32_t i = node.LeftOrFirst; i < node.LeftOrFirst + node.Count; ++i)
+			Grow(node.Min, node.Max, items.Min[tree.ItemIds[i]], items.Max[tree.ItemIds[i]]);
+	};
+
+	BvhNode root;
+	root.LeftOrFirst = 0;
+	root.Count = (uint32_t)tree.ItemIds.size();
+	root.Parent = kInvalid;
+	computeBounds(root);
+	tree.Nodes.push_back(root);
+
+	vector<uint32_t> stack;
+	stack.push_back(0);
+
+	while (!stack.empty())
+	{
+		uint32_t nodeIndex = stack.back();
+		stack.pop_back();
+
+		BvhNode node = tree.Nodes[nodeIndex];
+		if (node.Count <= kMaxLeafItems)
+			continue;
+
+		uint32_t first = node.LeftOrFirst;
+		uint32_t last = first + node.Count;
+
+		// Bounds of the item centroids decide the bin placement.
+		float cmin[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+		float cmax[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+		for (uint32_t i = first; i < last; ++i)
+		{
+			for (int a = 0; a < 3; ++a)
+			{
+				float c = centroid(tree.ItemIds[i], a);
+				cmin[a] = min(cmin[a], c);
+				cmax[a] = max(cmax[a], c);
+			}
+		}
+
+		// Evaluate the SAH at every bin boundary of every axis.
+		int bestAxis = -1;
+		uint32_t bestSplit = 0;
+		float bestCost = FLT_MAX;
+
+		for (int a = 0; a < 3; ++a)
+		{
+			float extent = cmax[a] - cmin[a];
+			if (extent <= 0.0f)
+				continue;
+
+			float scale = kBinCount / extent;
+
+			uint32_t binCount[kBinCount] = {};
+			XMFLOAT3 binMin[kBinCount], binMax[kBinCount];
+			for (uint32_t b = 0; b < kBinCount; ++b)
+				EmptyBounds(binMin[b], binMax[b]);
+
+			for (uint32_t i = first; i < last; ++i)
+			{
+				uint32_t id = tree.ItemIds[i];
+				uint32_t b = min(kBinCount - 1, (uint32_t)((centroid(id, a) - cmin[a])*scale));
+				binCount[b]++;
+				Grow(binMin[b], binMax[b], items.Min[id], items.Max[id]);
+			}
+
+			// Sweep from the left storing the area and count left of every boundary.
+			float leftArea[kBinCount - 1];
+			uint32_t leftCount[kBinCount - 1];
+			XMFLOAT3 mn, mx;
+			EmptyBounds(mn, mx);
+			uint32_t count = 0;
+			for (uint32_t b = 0; b < kBinCount - 1; ++b)
+			{
+				count += binCount[b];
+				Grow(mn, mx, binMin[b], binMax[b]);
+				leftCount[b] = count;
+				leftArea[b] = count > 0 ? HalfArea(mn, mx) : 0.0f;
+			}
+
+			EmptyBounds(mn, mx);
+			count = 0;
+			for (uint32_t b = kBinCount - 1; b > 0; --b)
+			{
+				count += binCount[b];
+				Grow(mn, mx, binMin[b], binMax[b]);
+				float rightArea = count > 0 ? HalfArea(mn, mx) : 0.0f;
+
+				float cost = leftCount[b - 1]*leftArea[b - 1] + count*rightArea;
+				if (leftCount[b - 1] > 0 && count > 0 && cost < bestCost)
+				{
+					bestCost = cost;
+					bestAxis = a;
+					bestSplit = b;
+				}
+			}
+		}
+
+		uint32_t mid;
+		if (bestAxis < 0)
+		{
+			// All centroids coincide; split the list in half.
+			mid = first + node.Count / 2;
+		}
+		else
+		{
+			float leafCost = node.Count*HalfArea(node.Min, node.Max);
+			if (bestCost >= leafCost && node.Count <= kMaxSahLeafItems)
+				continue;
+
+			float scale = kBinCount / (cmax[bestAxis] - cmin[bestAxis]);
+			float origin = cmin[bestAxis];
+			auto isLeft = [&](uint32_t id)
+			{
+				return min(kBinCount - 1, (uint32_t)((centroid(id, bestAxis) - origin)*scale)) < bestSplit;
+			};
+
+			mid = (uint32_t)(partition(tree.ItemIds.begin() + first, tree.ItemIds.begin() + last, isLeft) - tree.ItemIds.begin());
+			if (mid == first || mid == last)
+				mid = first + node.Count / 2;
+		}
+
+		BvhNode left;
+		left.LeftOrFirst = first;
+		left.Count = mid - first;
+		left.Parent = nodeIndex;
+		computeBounds(left);
+
+		BvhNode right;
+		right.LeftOrFirst = mid;
+		right.Count = last - mid;
+		right.Parent = nodeIndex;
+		computeBounds(right);
+
+		uint32_t leftIndex = (uint32_t)tree.Nodes.size();
+		tree.Nodes.push_back(left);
+		tree.Nodes.push_back(right);
+
+		tree.Nodes[nodeIndex].LeftOrFirst = leftIndex;
+		tree.Nodes[nodeIndex].Count = 0;
+
+		stack.push_back(leftIndex);
+		stack.push_back(leftIndex + 1);
+	}
+
+	for (uint32_t n = 0; n < (uint32_t)tree.Nodes.size(); ++n)
+	{
+		const BvhNode& node = tree.Nodes[n];
+		for (uint32_t i = node.LeftOrFirst; node.Count > 0 && i < node.LeftOrFirst + node.Count; ++i)
+			tree.ItemLeaf[tree.ItemIds[i]] = n;
+	}
+}
+
+void Bvh::Refit(uint32_t id)
+{
+	uint32_t nodeIndex = m_tree.ItemLeaf[id];
+
+	// Recompute the leaf from its live items, then merge children up to the root.
+	BvhNode& leaf = m_tree.Nodes[nodeIndex];
+	EmptyBounds(leaf.Min, leaf.Max);
+	for (uint32_t i = leaf.LeftOrFirst; i < leaf.LeftOrFirst + leaf.Count; ++i)
+	{
+		uint32_t item = m_tree.ItemIds[i];
+		if (m_items.Alive[item])
+			Grow(leaf.Min, leaf.Max, m_items.Min[item], m_items.Max[item]);
+	}
+
+	nodeIndex = leaf.Parent;
+	while (nodeIndex != kInvalid)
+	{
+		BvhNode& node = m_tree.Nodes[nodeIndex];
+		const BvhNode& left = m_tree.Nodes[node.LeftOrFirst];
+		const BvhNode& right = m_tree.Nodes[node.LeftOrFirst + 1];
+
+		node.Min = left.Min;
+		node.Max = left.Max;
+		Grow(node.Min, node.Max, right.Min, right.Max);
+
+		nodeIndex = node.Parent;
+	}
+
+	m_stats.Refits++;
+	m_refitsSinceBuild++;
+}
+
+void Bvh::InstallTree(Tree& tree)
+{
+	m_tree = move(tree);
+	m_tree.ItemLeaf.resize(m_items.Alive.size(), kInvalid);
+
+	// Everything alive when the build started is in the tree now.
+	m_pending.clear();
+	m_refitsSinceBuild = 0;
+	m_framesSinceBuild = 0;
+
+	// Replay what changed while the tree was being built.
+	sort(m_changedDuringRebuild.begin(), m_changedDuringRebuild.end());
+	m_changedDuringRebuild.erase(unique(m_changedDuringRebuild.begin(), m_changedDuringRebuild.end()), m_changedDuringRebuild.end());
+
+	for (uint32_t id : m_changedDuringRebuild)
+	{
+		if (m_tree.ItemLeaf[id] != kInvalid)
+			Refit(id);
+		else if (m_items.Alive[id])
+			m_pending.push_back(id);
+	}
+	m_changedDuringRebuild.clear();
+
+	m_stats.Rebuilds++;
+	m_stats.NodeCount = (uint32_t)m_tree.Nodes.size();
+	m_stats.PendingItems = (uint32_t)m_pending.size();
+}
+
+void Bvh::StartBackgroundRebuild()
+{
+	// The worker builds from a snapshot, so the live bounds can keep changing.
+	ItemBounds snapshot = m_items;
+	m_rebuild = async(launch::async, [snapshot]()
+	{
+		Tree tree;
+		BuildTree(snapshot, tree);
+		return tree;
+	});
+
+	m_rebuilding = true;
+	m_changedDuringRebuild.clear();
+	m_refitsSinceBuild = 0;
+	m_framesSinceBuild = 0;
+}
+
+template<typename Classify>
+void Bvh::Query(Classify classify, vector<uint32_t>& ids)
+{
+	m_stats.NodesVisited = 0;
+	m_stats.ItemsTested = 0;
+
+	m_stack.clear();
+	if (!m_tree.Nodes.empty())
+		m_stack.push_back(0);
+
+	while (!m_stack.empty())
+	{
+		uint32_t entry = m_stack.back();
+		m_stack.pop_back();
+
+		bool acceptAll = (entry & kAcceptAll) != 0;
+		const BvhNode& node = m_tree.Nodes[entry & ~kAcceptAll];
+		m_stats.NodesVisited++;
+
+		if (!acceptAll)
+		{
+			int overlap = classify(node.Min, node.Max);
+			if (overlap == Outside)
+				continue;
+
+			acceptAll = overlap == Inside;
+		}
+
+		if (node.Count > 0)
+		{
+			for (uint32_t i = node.LeftOrFirst; i < node.LeftOrFirst + node.Count; ++i)
+			{
+				uint32_t item = m_tree.ItemIds[i];
+				if (!m_items.Alive[item])
+					continue;
+
+				m_stats.ItemsTested += acceptAll ? 0 : 1;
+				if (acceptAll || classify(m_items.Min[item], m_items.Max[item]) != Outside)
+					ids.push_back(item);
+			}
+		}
+		else
+		{
+			uint32_t flag = acceptAll ? kAcceptAll : 0;
+			m_stack.push_back(node.LeftOrFirst | flag);
+			m_stack.push_back((node.LeftOrFirst + 1) | flag);
+		}
+	}
+
+	for (uint32_t item : m_pending)
+	{
+		m_stats.ItemsTested++;
+		if (classify(m_items.Min[item], m_items.Max[item]) != Outside)
+			ids.push_back(item);
+	}
+
+	m_stats.PendingItems = (uint32_t)m_pending.size();
+}
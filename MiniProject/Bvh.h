@@ -0,0 +1,127 @@
+#pragma once
+
+#include <cstdint>
+#include <future>
+#include <vector>
+#include <DirectXMath.h>
+
+using namespace DirectX;
+using namespace std;
+
+
+struct BvhNode
+{
+	XMFLOAT3 Min;
+	// First child for inner nodes (the second child follows it), first item for leaves.
+	uint32_t LeftOrFirst;
+
+	XMFLOAT3 Max;
+	// Number of items for leaves, 0 for inner nodes.
+	uint32_t Count;
+
+	uint32_t Parent;
+};
+
+struct BvhStats
+{
+	uint32_t NodeCount = 0;
+	uint32_t PendingItems = 0;
+	uint32_t Rebuilds = 0;
+	uint32_t Refits = 0;
+
+	// Nodes and items visited by the last query.
+	uint32_t NodesVisited = 0;
+	uint32_t ItemsTested = 0;
+};
+
+// Bounding volume hierarchy over axis aligned boxes identified by small integer ids
+// (the scene uses render item slots). The tree is built with a binned surface area
+// heuristic. Moving an item refits the path from its leaf to the root, new items are
+// kept in a pending list tested linearly, and both are folded back into the tree by
+// a rebuild that runs on a background thread.
+class Bvh
+{
+public:
+
+	Bvh();
+	Bvh(const Bvh& rhs) = delete;
+	Bvh& operator=(const Bvh& rhs) = delete;
+	~Bvh();
+
+	// Inserts the item or refits the tree after it moved.
+	void SetItem(uint32_t id, const XMFLOAT3& center, const XMFLOAT3& extents);
+	void RemoveItem(uint32_t id);
+
+	// Removes every item and drops the tree.
+	void Clear();
+
+	// Rebuilds the tree on the calling thread.
+	void Rebuild();
+
+	// Call once per frame. Installs a finished background rebuild and starts a new
+	// one when the tree has been refitted for RebuildInterval frames or too many
+	// items are pending.
+	void Tick();
+
+	void SetRebuildInterval(uint32_t frames);
+
+	// Queries append the ids of the items whose box overlaps the volume.
+	// Frustum planes are (a, b, c, d) with normals pointing inside.
+	void QueryFrustum(const XMFLOAT4 planes[6], vector<uint32_t>& ids);
+	void QueryAabb(const XMFLOAT3& center, const XMFLOAT3& extents, vector<uint32_t>& ids);
+	void QuerySphere(const XMFLOAT3& center, float radius, vector<uint32_t>& ids);
+
+	// Finds the nearest item whose box is hit by the ray within maxDist.
+	bool RayCast(const XMFLOAT3& origin, const XMFLOAT3& direction, float maxDist, uint32_t& id, float& dist);
+
+	const BvhStats& GetStats()const;
+
+private:
+
+	struct Tree
+	{
+		vector<BvhNode> Nodes;
+		vector<uint32_t> ItemIds;
+		// Leaf of each item id, UINT32_MAX if the id is not in the tree.
+		vector<uint32_t> ItemLeaf;
+	};
+
+	struct ItemBounds
+	{
+		vector<XMFLOAT3> Min;
+		vector<XMFLOAT3> Max;
+		vector<uint8_t> Alive;
+	};
+
+	static void BuildTree(const ItemBounds& items, Tree& tree);
+
+	void Refit(uint32_t id);
+	void InstallTree(Tree& tree);
+	void StartBackgroundRebuild();
+
+	// Classify returns 0 when a box is outside the volume, 1 when it intersects it
+	// and 2 when it is fully inside.
+	template<typename Classify>
+	void Query(Classify classify, vector<uint32_t>& ids);
+
+private:
+
+	ItemBounds m_items;
+	Tree m_tree;
+
+	// Items added since the last rebuild; they are not in the tree yet.
+	vector<uint32_t> m_pending;
+
+	// Background rebuild and the ids changed while it was running.
+	future<Tree> m_rebuild;
+	bool m_rebuilding = false;
+	vector<uint32_t> m_changedDuringRebuild;
+
+	uint32_t m_rebuildInterval = 120;
+	uint32_t m_framesSinceBuild = 0;
+	uint32_t m_refitsSinceBuild = 0;
+
+	BvhStats m_stats;
+
+	vector<uint32_t> m_stack;
+};
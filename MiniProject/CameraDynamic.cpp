@@ -5,7 +5,7 @@ using namespace DirectX;
 
 Camera::Camera()
 {
-	SetFrustum(0.25f*UtilMath::Pi, 1.0f, 1.0f, 1000.0f);
+	SetFrustum(XM_PIDIV4, 1.0f, 1.0f, 1000.0f);
 }
 
 Camera::~Camera()
@@ -106,6 +106,27 @@ XMMATRIX Camera::GetProj()const
 	return XMLoadFloat4x4(&projMatrix);
 }
 
+void Camera::GetFrustumPlanes(XMFLOAT4 planes[6])const
+{
+	// Extract the planes from the columns of the view-projection matrix, so they
+	// come out directly in world space. For a point p inside the frustum the clip
+	// coordinates satisfy -w <= x <= w, -w <= y <= w and 0 <= z <= w.
+	XMFLOAT4X4 m;
+	XMStoreFloat4x4(&m, XMMatrixMultiply(GetView(), GetProj()));
+
+	XMVECTOR col0 = XMVectorSet(m(0, 0), m(1, 0), m(2, 0), m(3, 0));
+	XMVECTOR col1 = XMVectorSet(m(0, 1), m(1, 1), m(2, 1), m(3, 1));
+	XMVECTOR col2 = XMVectorSet(m(0, 2), m(1, 2), m(2, 2), m(3, 2));
+	XMVECTOR col3 = XMVectorSet(m(0, 3), m(1, 3), m(2, 3), m(3, 3));
+
+	XMStoreFloat4(&planes[0], XMPlaneNormalize(XMVectorAdd(col3, col0)));
+	XMStoreFloat4(&planes[1], XMPlaneNormalize(XMVectorSubtract(col3, col0)));
+	XMStoreFloat4(&planes[2], XMPlaneNormalize(XMVectorAdd(col3, col1)));
+	XMStoreFloat4(&planes[3], XMPlaneNormalize(XMVectorSubtract(col3, col1)));
+	XMStoreFloat4(&planes[4], XMPlaneNormalize(col2));
+	XMStoreFloat4(&planes[5], XMPlaneNormalize(XMVectorSubtract(col3, col2)));
+}
+
 
 void Camera::LeftAndRight(float d)
 {
@@ -156,27 +177,10 @@ void Camera::UpdateViewMatrix()
 		up = XMVector3Normalize(XMVector3Cross(look, right));
 		right = XMVector3Cross(up, look);
 
-		std::wstring text11 =
-			L"POSITION = " + std::to_wstring(XMVectorGetY(up)) + L" \n";
-
-		::OutputDebugString(text11.c_str());
-
-		// viewMatrix entries.
-		std::wstring text =
-			L"POSITION = " + std::to_wstring(XMVectorGetY(position)) + L" \n";
-
-		::OutputDebugString(text.c_str());
-
-
 		float x = -XMVectorGetX(XMVector3Dot(position, right));
 		float y = -XMVectorGetX(XMVector3Dot(position, up));
 		float z = -XMVectorGetX(XMVector3Dot(position, look));
 
-		std::wstring text2 =
-			L"POSITION 2 = " + std::to_wstring(y) + L" \n";
-
-		::OutputDebugString(text2.c_str());
-
 		viewMatrix(0, 0) = XMVectorGetX(right);
 		viewMatrix(1, 0) = XMVectorGetY(right);
 		viewMatrix(2, 0) = XMVectorGetZ(right);
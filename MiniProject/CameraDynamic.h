@@ -1,7 +1,7 @@
 
 #pragma once
 
-#include "Util.h"
+#include <DirectXMath.h>
 
 using namespace DirectX;
 
@@ -38,6 +38,10 @@ public:
 	XMMATRIX GetView()const;
 	XMMATRIX GetProj()const;
 
+	// Get the six world space frustum planes (left, right, bottom, top, near, far).
+	// Plane normals point inside the frustum.
+	void GetFrustumPlanes(XMFLOAT4 planes[6])const;
+
 	void LeftAndRight(float d);
 	void ForwardAndBackward(float d);
 	void Pitch(float alpha);
@@ -54,8 +58,17 @@ private:
 	XMFLOAT3 m_up = { 0.0f, 1.0f, 0.0f };
 	XMFLOAT3 m_look = { 0.0f, 0.0f, 1.0f };
 
-	XMFLOAT4X4 viewMatrix = UtilMath::Identity4x4();
-	XMFLOAT4X4 projMatrix = UtilMath::Identity4x4();
+	// Identity until UpdateViewMatrix and SetFrustum run.
+	XMFLOAT4X4 viewMatrix = XMFLOAT4X4(
+		1.0f, 0.0f, 0.0f, 0.0f,
+		0.0f, 1.0f, 0.0f, 0.0f,
+		0.0f, 0.0f, 1.0f, 0.0f,
+		0.0f, 0.0f, 0.0f, 1.0f);
+	XMFLOAT4X4 projMatrix = XMFLOAT4X4(
+		1.0f, 0.0f, 0.0f, 0.0f,
+		0.0f, 1.0f, 0.0f, 0.0f,
+		0.0f, 0.0f, 1.0f, 0.0f,
+		0.0f, 0.0f, 0.0f, 1.0f);
 
 	// frustum properties.
 	float m_near;
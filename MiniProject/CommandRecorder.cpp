@@ -0,0 +1,274 @@
+
+#include "CommandRecorder.h"
+#include <cassert>
+
+using namespace std;
+
+
+uint32_t RecorderStats::TotalEmitted()const
+{
+	uint32_t total = 0;
+	for (uint32_t count : Emitted)
+		total += count;
+	return total;
+}
+
+uint32_t RecorderStats::TotalElided()const
+{
+	uint32_t total = 0;
+	for (uint32_t count : Elided)
+		total += count;
+	return total;
+}
+
+CommandRecorder::CommandRecorder(CommandBackend* backend) : m_backend(backend)
+{
+	Begin();
+}
+
+void CommandRecorder::SetBackend(CommandBackend* backend)
+{
+	m_backend = backend;
+}
+
+void CommandRecorder::Begin()
+{
+	m_pso = nullptr;
+	for (uint32_t i = 0; i < MaxVertexBufferSlots; ++i)
+		m_vertexBufferBound[i] = false;
+	m_indexBufferBound = false;
+	m_topology = UINT32_MAX;
+	for (uint32_t i = 0; i < MaxRootParameters; ++i)
+	{
+		m_rootTables[i] = 0;
+		m_rootCbvs[i] = 0;
+		m_rootSrvs[i] = 0;
+		for (uint32_t c = 0; c < MaxRootConstants; ++c)
+			m_rootConstantBound[i][c] = false;
+	}
+
+	m_stats = RecorderStats();
+}
+
+void CommandRecorder::SetPipelineState(const void* pso)
+{
+	bool emit = pso != m_pso;
+	if (emit)
+	{
+		m_pso = pso;
+		m_backend->SetPipelineState(pso);
+	}
+	Count(CommandType::SetPipelineState, emit);
+}
+
+void CommandRecorder::SetVertexBuffers(uint32_t startSlot, uint32_t count, const VertexBufferBinding* views)
+{
+	assert(startSlot + count <= MaxVertexBufferSlots);
+
+	bool emit = false;
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		uint32_t slot = startSlot + i;
+		if (!m_vertexBufferBound[slot] || !(m_vertexBuffers[slot] == views[i]))
+		{
+			m_vertexBuffers[slot] = views[i];
+			m_vertexBufferBound[slot] = true;
+			emit = true;
+		}
+	}
+
+	if (emit)
+		m_backend->SetVertexBuffers(startSlot, count, views);
+	Count(CommandType::SetVertexBuffers, emit);
+}
+
+void CommandRecorder::SetIndexBuffer(const IndexBufferBinding& view)
+{
+	bool emit = !m_indexBufferBound || !(m_indexBuffer == view);
+	if (emit)
+	{
+		m_indexBuffer = view;
+		m_indexBufferBound = true;
+		m_backend->SetIndexBuffer(view);
+	}
+	Count(CommandType::SetIndexBuffer, emit);
+}
+
+void CommandRecorder::SetPrimitiveTopology(uint32_t topology)
+{
+	bool emit = topology != m_topology;
+	if (emit)
+	{
+		m_topology = topology;
+		m_backend->SetPrimitiveTopology(topology);
+	}
+	Count(CommandType::SetPrimitiveTopology, emit);
+}
+
+void CommandRecorder::SetRootDescriptorTable(uint32_t rootIndex, uint64_t gpuHandle)
+{
+	assert(rootIndex < MaxRootParameters);
+
+	bool emit = gpuHandle != m_rootTables[rootIndex];
+	if (emit)
+	{
+		m_rootTables[rootIndex] = gpuHandle;
+		m_backend->SetRootDescriptorTable(rootIndex, gpuHandle);
+	}
+	Count(CommandType::SetRootDescriptorTable, emit);
+}
+
+void CommandRecorder::SetRootConstantBufferView(uint32_t rootIndex, uint64_t gpuAddress)
+{
+	assert(rootIndex < MaxRootParameters);
+
+	bool emit = gpuAddress != m_rootCbvs[rootIndex];
+	if (emit)
+	{
+		m_rootCbvs[rootIndex] = gpuAddress;
+		m_backend->SetRootConstantBufferView(rootIndex, gpuAddress);
+	}
+	Count(CommandType::SetRootConstantBufferView, emit);
+}
+
+void CommandRecorder::SetRootShaderResourceView(uint32_t rootIndex, uint64_t gpuAddress)
+{
+	assert(rootIndex < MaxRootParameters);
+
+	bool emit = gpuAddress != m_rootSrvs[rootIndex];
+	if (emit)
+	{
+		m_rootSrvs[rootIndex] = gpuAddress;
+		m_backend->SetRootShaderResourceView(rootIndex, gpuAddress);
+	}
+	Count(CommandType::SetRootShaderResourceView, emit);
+}
+
+void CommandRecorder::SetRoot32BitConstant(uint32_t rootIndex, uint32_t value, uint32_t destOffset)
+{
+	assert(rootIndex < MaxRootParameters && destOffset < MaxRootConstants);
+
+	bool emit = !m_rootConstantBound[rootIndex][destOffset] || value != m_rootConstants[rootIndex][destOffset];
+	if (emit)
+	{
+		m_rootConstants[rootIndex][destOffset] = value;
+		m_rootConstantBound[rootIndex][destOffset] = true;
+		m_backend->SetRoot32BitConstant(rootIndex, value, destOffset);
+	}
+	Count(CommandType::SetRoot32BitConstant, emit);
+}
+
+void CommandRecorder::DrawIndexedInstanced(uint32_t indexCount, uint32_t instanceCount, uint32_t startIndexLocation,
+	int32_t baseVertexLocation, uint32_t startInstanceLocation)
+{
+	m_backend->DrawIndexedInstanced(indexCount, instanceCount, startIndexLocation, baseVertexLocation, startInstanceLocation);
+	Count(CommandType::DrawIndexedInstanced, true);
+}
+
+void CommandRecorder::ExecuteIndirect(const void* signature, uint32_t maxCommandCount, const void* argumentBuffer, uint64_t argumentOffset)
+{
+	m_backend->ExecuteIndirect(signature, maxCommandCount, argumentBuffer, argumentOffset);
+	Count(CommandType::ExecuteIndirect, true);
+
+	for (uint32_t i = 0; i < MaxRootParameters; ++i)
+	{
+		for (uint32_t c = 0; c < MaxRootConstants; ++c)
+			m_rootConstantBound[i][c] = false;
+	}
+}
+
+const RecorderStats& CommandRecorder::GetStats()const
+{
+	return m_stats;
+}
+
+void CommandRecorder::Count(CommandType type, bool emitted)
+{
+	if (emitted)
+		m_stats.Emitted[(uint32_t)type]++;
+	else
+		m_stats.Elided[(uint32_t)type]++;
+}
+
+///////// RecordingBackend
+
+void RecordingBackend::SetPipelineState(const void* pso)
+{
+	Push(CommandType::SetPipelineState, (uint64_t)(uintptr_t)pso);
+}
+
+void RecordingBackend::SetVertexBuffers(uint32_t startSlot, uint32_t count, const VertexBufferBinding* views)
+{
+	// Only the buffer locations of the first two slots are kept.
+	Push(CommandType::SetVertexBuffers, startSlot, count,
+		count > 0 ? views[0].BufferLocation : 0,
+		count > 1 ? views[1].BufferLocation : 0);
+}
+
+void RecordingBackend::SetIndexBuffer(const IndexBufferBinding& view)
+{
+	Push(CommandType::SetIndexBuffer, view.BufferLocation, view.SizeInBytes, view.Format);
+}
+
+void RecordingBackend::SetPrimitiveTopology(uint32_t topology)
+{
+	Push(CommandType::SetPrimitiveTopology, topology);
+}
+
+void RecordingBackend::SetRootDescriptorTable(uint32_t rootIndex, uint64_t gpuHandle)
+{
+	Push(CommandType::SetRootDescriptorTable, rootIndex, gpuHandle);
+}
+
+void RecordingBackend::SetRootConstantBufferView(uint32_t rootIndex, uint64_t gpuAddress)
+{
+	Push(CommandType::SetRootConstantBufferView, rootIndex, gpuAddress);
+}
+
+void RecordingBackend::SetRootShaderResourceView(uint32_t rootIndex, uint64_t gpuAddress)
+{
+	Push(CommandType::SetRootShaderResourceView, rootIndex, gpuAddress);
+}
+
+void RecordingBackend::SetRoot32BitConstant(uint32_t rootIndex, uint32_t value, uint32_t destOffset)
+{
+	Push(CommandType::SetRoot32BitConstant, rootIndex, value, destOffset);
+}
+
+void RecordingBackend::DrawIndexedInstanced(uint32_t indexCount, uint32_t instanceCount, uint32_t startIndexLocation,
+	int32_t baseVertexLocation, uint32_t startInstanceLocation)
+{
+	Push(CommandType::DrawIndexedInstanced, indexCount, instanceCount, startIndexLocation, (uint64_t)(int64_t)baseVertexLocation, startInstanceLocation);
+}
+
+void RecordingBackend::ExecuteIndirect(const void* signature, uint32_t maxCommandCount, const void* argumentBuffer, uint64_t argumentOffset)
+{
+	Push(CommandType::ExecuteIndirect, (uint64_t)(uintptr_t)signature, maxCommandCount, (uint64_t)(uintptr_t)argumentBuffer, argumentOffset);
+}
+
+void RecordingBackend::Clear()
+{
+	m_commands.clear();
+}
+
+const vector<RecordingBackend::Command>& RecordingBackend::GetCommands()const
+{
+	return m_commands;
+}
+
+uint32_t RecordingBackend::CountOf(CommandType type)const
+{
+	uint32_t count = 0;
+	for (const Command& command : m_commands)
+	{
+		if (command.Type == type)
+			count++;
+	}
+	return count;
+}
+
+void RecordingBackend::Push(CommandType type, uint64_t a0, uint64_t a1, uint64_t a2, uint64_t a3, uint64_t a4)
+{
+	Command command = { type, { a0, a1, a2, a3, a4 } };
+	m_commands.push_back(command);
+}
@@ -0,0 +1,184 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+using namespace std;
+
+
+enum class CommandType : uint32_t
+{
+	SetPipelineState,
+	SetVertexBuffers,
+	SetIndexBuffer,
+	SetPrimitiveTopology,
+	SetRootDescriptorTable,
+	SetRootConstantBufferView,
+	SetRootShaderResourceView,
+	SetRoot32BitConstant,
+	DrawIndexedInstanced,
+	ExecuteIndirect,
+	Count
+};
+
+// API independent copies of D3D12_VERTEX_BUFFER_VIEW and D3D12_INDEX_BUFFER_VIEW.
+struct VertexBufferBinding
+{
+	uint64_t BufferLocation = 0;
+	uint32_t SizeInBytes = 0;
+	uint32_t StrideInBytes = 0;
+
+	bool operator==(const VertexBufferBinding& rhs)const
+	{
+		return BufferLocation == rhs.BufferLocation && SizeInBytes == rhs.SizeInBytes && StrideInBytes == rhs.StrideInBytes;
+	}
+};
+
+struct IndexBufferBinding
+{
+	uint64_t BufferLocation = 0;
+	uint32_t SizeInBytes = 0;
+
+	// DXGI_FORMAT value.
+	uint32_t Format = 0;
+
+	bool operator==(const IndexBufferBinding& rhs)const
+	{
+		return BufferLocation == rhs.BufferLocation && SizeInBytes == rhs.SizeInBytes && Format == rhs.Format;
+	}
+};
+
+// The commands the recorder forwards. Implemented on top of a D3D12 command list
+// by D3D12CommandBackend and by RecordingBackend for tests without a device.
+class CommandBackend
+{
+public:
+
+	virtual ~CommandBackend() { }
+
+	virtual void SetPipelineState(const void* pso) = 0;
+	virtual void SetVertexBuffers(uint32_t startSlot, uint32_t count, const VertexBufferBinding* views) = 0;
+	virtual void SetIndexBuffer(const IndexBufferBinding& view) = 0;
+	virtual void SetPrimitiveTopology(uint32_t topology) = 0;
+	virtual void SetRootDescriptorTable(uint32_t rootIndex, uint64_t gpuHandle) = 0;
+	virtual void SetRootConstantBufferView(uint32_t rootIndex, uint64_t gpuAddress) = 0;
+	virtual void SetRootShaderResourceView(uint32_t rootIndex, uint64_t gpuAddress) = 0;
+	virtual void SetRoot32BitConstant(uint32_t rootIndex, uint32_t value, uint32_t destOffset) = 0;
+	virtual void DrawIndexedInstanced(uint32_t indexCount, uint32_t instanceCount, uint32_t startIndexLocation,
+		int32_t baseVertexLocation, uint32_t startInstanceLocation) = 0;
+
+	// Runs up to maxCommandCount commands of the signature read from the argument
+	// buffer (an ID3D12Resource on D3D12) at argumentOffset.
+	virtual void ExecuteIndirect(const void* signature, uint32_t maxCommandCount, const void* argumentBuffer, uint64_t argumentOffset) = 0;
+};
+
+struct RecorderStats
+{
+	uint32_t Emitted[(uint32_t)CommandType::Count] = {};
+	uint32_t Elided[(uint32_t)CommandType::Count] = {};
+
+	uint32_t TotalEmitted()const;
+	uint32_t TotalElided()const;
+};
+
+// Forwards commands to a backend, dropping the state changes that would set what
+// is already bound. Begin forgets the bound state, call it whenever the command
+// list is reset or the root signature changes.
+class CommandRecorder
+{
+public:
+
+	static const uint32_t MaxVertexBufferSlots = 4;
+	static const uint32_t MaxRootParameters = 8;
+	static const uint32_t MaxRootConstants = 4;
+
+	explicit CommandRecorder(CommandBackend* backend = nullptr);
+
+	void SetBackend(CommandBackend* backend);
+
+	// Forgets the bound state and clears the statistics.
+	void Begin();
+
+	void SetPipelineState(const void* pso);
+	void SetVertexBuffers(uint32_t startSlot, uint32_t count, const VertexBufferBinding* views);
+	void SetIndexBuffer(const IndexBufferBinding& view);
+	void SetPrimitiveTopology(uint32_t topology);
+	void SetRootDescriptorTable(uint32_t rootIndex, uint64_t gpuHandle);
+	void SetRootConstantBufferView(uint32_t rootIndex, uint64_t gpuAddress);
+	void SetRootShaderResourceView(uint32_t rootIndex, uint64_t gpuAddress);
+	void SetRoot32BitConstant(uint32_t rootIndex, uint32_t value, uint32_t destOffset);
+	void DrawIndexedInstanced(uint32_t indexCount, uint32_t instanceCount, uint32_t startIndexLocation,
+		int32_t baseVertexLocation, uint32_t startInstanceLocation);
+
+	// Root constants set by the commands are unknown afterwards.
+	void ExecuteIndirect(const void* signature, uint32_t maxCommandCount, const void* argumentBuffer, uint64_t argumentOffset);
+
+	const RecorderStats& GetStats()const;
+
+private:
+
+	void Count(CommandType type, bool emitted);
+
+private:
+
+	CommandBackend* m_backend;
+
+	const void* m_pso;
+	VertexBufferBinding m_vertexBuffers[MaxVertexBufferSlots];
+	bool m_vertexBufferBound[MaxVertexBufferSlots];
+	IndexBufferBinding m_indexBuffer;
+	bool m_indexBufferBound;
+	uint32_t m_topology;
+	uint64_t m_rootTables[MaxRootParameters];
+	uint64_t m_rootCbvs[MaxRootParameters];
+	uint64_t m_rootSrvs[MaxRootParameters];
+	uint32_t m_rootConstants[MaxRootParameters][MaxRootConstants];
+	bool m_rootConstantBound[MaxRootParameters][MaxRootConstants];
+
+	RecorderStats m_stats;
+};
+
+// Backend that stores the commands it receives, for checking recorded streams.
+class RecordingBackend : public CommandBackend
+{
+public:
+
+	struct Command
+	{
+		CommandType Type;
+
+		// Arguments in declaration order; pointers and bindings are stored by value.
+		uint64_t Args[5];
+
+		bool operator==(const Command& rhs)const
+		{
+			return Type == rhs.Type && Args[0] == rhs.Args[0] && Args[1] == rhs.Args[1] && Args[2] == rhs.Args[2] &&
+				Args[3] == rhs.Args[3] && Args[4] == rhs.Args[4];
+		}
+	};
+
+	virtual void SetPipelineState(const void* pso)override;
+	virtual void SetVertexBuffers(uint32_t startSlot, uint32_t count, const VertexBufferBinding* views)override;
+	virtual void SetIndexBuffer(const IndexBufferBinding& view)override;
+	virtual void SetPrimitiveTopology(uint32_t topology)override;
+	virtual void SetRootDescriptorTable(uint32_t rootIndex, uint64_t gpuHandle)override;
+	virtual void SetRootConstantBufferView(uint32_t rootIndex, uint64_t gpuAddress)override;
+	virtual void SetRootShaderResourceView(uint32_t rootIndex, uint64_t gpuAddress)override;
+	virtual void SetRoot32BitConstant(uint32_t rootIndex, uint32_t value, uint32_t destOffset)override;
+	virtual void DrawIndexedInstanced(uint32_t indexCount, uint32_t instanceCount, uint32_t startIndexLocation,
+		int32_t baseVertexLocation, uint32_t startInstanceLocation)override;
+	virtual void ExecuteIndirect(const void* signature, uint32_t maxCommandCount, const void* argumentBuffer, uint64_t argumentOffset)override;
+
+	void Clear();
+
+	const vector<Command>& GetCommands()const;
+	uint32_t CountOf(CommandType type)const;
+
+private:
+
+	void Push(CommandType type, uint64_t a0 = 0, uint64_t a1 = 0, uint64_t a2 = 0, uint64_t a3 = 0, uint64_t a4 = 0);
+
+private:
+
+	vector<Command> m_commands;
+};
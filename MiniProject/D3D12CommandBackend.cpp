@@ -0,0 +1,80 @@
+
+#include "D3D12CommandBackend.h"
+
+
+D3D12CommandBackend::D3D12CommandBackend(ID3D12GraphicsCommandList* cmdList) : m_cmdList(cmdList)
+{
+}
+
+void D3D12CommandBackend::SetCommandList(ID3D12GraphicsCommandList* cmdList)
+{
+	m_cmdList = cmdList;
+}
+
+void D3D12CommandBackend::SetPipelineState(const void* pso)
+{
+	m_cmdList->SetPipelineState((ID3D12PipelineState*)pso);
+}
+
+void D3D12CommandBackend::SetVertexBuffers(uint32_t startSlot, uint32_t count, const VertexBufferBinding* views)
+{
+	D3D12_VERTEX_BUFFER_VIEW d3dViews[CommandRecorder::MaxVertexBufferSlots];
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		d3dViews[i].BufferLocation = views[i].BufferLocation;
+		d3dViews[i].SizeInBytes = views[i].SizeInBytes;
+		d3dViews[i].StrideInBytes = views[i].StrideInBytes;
+	}
+
+	m_cmdList->IASetVertexBuffers(startSlot, count, d3dViews);
+}
+
+void D3D12CommandBackend::SetIndexBuffer(const IndexBufferBinding& view)
+{
+	D3D12_INDEX_BUFFER_VIEW d3dView;
+	d3dView.BufferLocation = view.BufferLocation;
+	d3dView.SizeInBytes = view.SizeInBytes;
+	d3dView.Format = (DXGI_FORMAT)view.Format;
+
+	m_cmdList->IASetIndexBuffer(&d3dView);
+}
+
+void D3D12CommandBackend::SetPrimitiveTopology(uint32_t topology)
+{
+	m_cmdList->IASetPrimitiveTopology((D3D12_PRIMITIVE_TOPOLOGY)topology);
+}
+
+void D3D12CommandBackend::SetRootDescriptorTable(uint32_t rootIndex, uint64_t gpuHandle)
+{
+	D3D12_GPU_DESCRIPTOR_HANDLE handle;
+	handle.ptr = gpuHandle;
+
+	m_cmdList->SetGraphicsRootDescriptorTable(rootIndex, handle);
+}
+
+void D3D12CommandBackend::SetRootConstantBufferView(uint32_t rootIndex, uint64_t gpuAddress)
+{
+	m_cmdList->SetGraphicsRootConstantBufferView(rootIndex, gpuAddress);
+}
+
+void D3D12CommandBackend::SetRootShaderResourceView(uint32_t rootIndex, uint64_t gpuAddress)
+{
+	m_cmdList->SetGraphicsRootShaderResourceView(rootIndex, gpuAddress);
+}
+
+void D3D12CommandBackend::SetRoot32BitConstant(uint32_t rootIndex, uint32_t value, uint32_t destOffset)
+{
+	m_cmdList->SetGraphicsRoot32BitConstant(rootIndex, value, destOffset);
+}
+
+void D3D12CommandBackend::DrawIndexedInstanced(uint32_t indexCount, uint32_t instanceCount, uint32_t startIndexLocation,
+	int32_t baseVertexLocation, uint32_t startInstanceLocation)
+{
+	m_cmdList->DrawIndexedInstanced(indexCount, instanceCount, startIndexLocation, baseVertexLocation, startInstanceLocation);
+}
+
+void D3D12CommandBackend::ExecuteIndirect(const void* signature, uint32_t maxCommandCount, const void* argumentBuffer, uint64_t argumentOffset)
+{
+	// No count buffer: the CPU knows how many commands it packed.
+	m_cmdList->ExecuteIndirect((ID3D12CommandSignature*)signature, maxCommandCount, (ID3D12Resource*)argumentBuffer, argumentOffset, nullptr, 0);
+}
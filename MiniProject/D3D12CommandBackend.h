@@ -0,0 +1,49 @@
+#pragma once
+
+#include "Util.h"
+#include "CommandRecorder.h"
+
+
+// Forwards recorder commands to a D3D12 graphics command list.
+class D3D12CommandBackend : public CommandBackend
+{
+public:
+
+	explicit D3D12CommandBackend(ID3D12GraphicsCommandList* cmdList = nullptr);
+
+	void SetCommandList(ID3D12GraphicsCommandList* cmdList);
+
+	virtual void SetPipelineState(const void* pso)override;
+	virtual void SetVertexBuffers(uint32_t startSlot, uint32_t count, const VertexBufferBinding* views)override;
+	virtual void SetIndexBuffer(const IndexBufferBinding& view)override;
+	virtual void SetPrimitiveTopology(uint32_t topology)override;
+	virtual void SetRootDescriptorTable(uint32_t rootIndex, uint64_t gpuHandle)override;
+	virtual void SetRootConstantBufferView(uint32_t rootIndex, uint64_t gpuAddress)override;
+	virtual void SetRootShaderResourceView(uint32_t rootIndex, uint64_t gpuAddress)override;
+	virtual void SetRoot32BitConstant(uint32_t rootIndex, uint32_t value, uint32_t destOffset)override;
+	virtual void DrawIndexedInstanced(uint32_t indexCount, uint32_t instanceCount, uint32_t startIndexLocation,
+		int32_t baseVertexLocation, uint32_t startInstanceLocation)override;
+	virtual void ExecuteIndirect(const void* signature, uint32_t maxCommandCount, const void* argumentBuffer, uint64_t argumentOffset)override;
+
+private:
+
+	ID3D12GraphicsCommandList* m_cmdList;
+};
+
+inline VertexBufferBinding ToBinding(const D3D12_VERTEX_BUFFER_VIEW& view)
+{
+	VertexBufferBinding binding;
+	binding.BufferLocation = view.BufferLocation;
+	binding.SizeInBytes = view.SizeInBytes;
+	binding.StrideInBytes = view.StrideInBytes;
+	return binding;
+}
+
+inline IndexBufferBinding ToBinding(const D3D12_INDEX_BUFFER_VIEW& view)
+{
+	IndexBufferBinding binding;
+	binding.BufferLocation = view.BufferLocation;
+	binding.SizeInBytes = view.SizeInBytes;
+	binding.Format = (uint32_t)view.Format;
+	return binding;
+}
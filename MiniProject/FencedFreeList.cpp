@@ -0,0 +1,57 @@
+
+#include "FencedFreeList.h"
+
+using namespace std;
+
+
+uint32_t FencedFreeList::Allocate()
+{
+	if (!m_free.empty())
+	{
+		uint32_t index = m_free.back();
+		m_free.pop_back();
+		return index;
+	}
+
+	return m_size++;
+}
+
+void FencedFreeList::Free(uint32_t index)
+{
+	m_freedThisFrame.push_back(index);
+}
+
+void FencedFreeList::FinishFrame(uint64_t fenceValue)
+{
+	for (uint32_t index : m_freedThisFrame)
+	{
+		Retired retired = { fenceValue, index };
+		m_retired.push_back(retired);
+	}
+	m_freedThisFrame.clear();
+}
+
+void FencedFreeList::Reclaim(uint64_t completedFenceValue)
+{
+	// Fence values only grow, so the completed frames are at the front.
+	while (!m_retired.empty() && m_retired.front().Fence <= completedFenceValue)
+	{
+		m_free.push_back(m_retired.front().Index);
+		m_retired.pop_front();
+	}
+}
+
+uint32_t FencedFreeList::Size()const
+{
+	return m_size;
+}
+
+uint32_t FencedFreeList::FreeCount()const
+{
+	return (uint32_t)m_free.size();
+}
+
+uint32_t FencedFreeList::RetiredCount()const
+{
+	return (uint32_t)(m_retired.size() + m_freedThisFrame.size());
+}
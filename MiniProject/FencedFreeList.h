@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+using namespace std;
+
+
+// Hands out indices into a GPU-visible table (constant buffer slots, descriptors)
+// and takes them back only once the GPU can no longer read them. Freed indices
+// are retired with the frame they were freed in; FinishFrame tags that frame with
+// its fence value and Reclaim makes the indices of completed frames reusable.
+// Like RingAllocator it only keeps the books, so a fake fence can drive it.
+class FencedFreeList
+{
+public:
+
+	// A reclaimed index if there is one, otherwise Size() grows by one.
+	uint32_t Allocate();
+
+	// Retires index with the current frame.
+	void Free(uint32_t index);
+
+	void FinishFrame(uint64_t fenceValue);
+
+	// Makes the indices of frames whose fence value is at most
+	// completedFenceValue available to Allocate.
+	void Reclaim(uint64_t completedFenceValue);
+
+	// Number of indices ever handed out.
+	uint32_t Size()const;
+
+	uint32_t FreeCount()const;
+
+	// Indices freed but still waiting for their fence.
+	uint32_t RetiredCount()const;
+
+private:
+
+	struct Retired
+	{
+		uint64_t Fence;
+		uint32_t Index;
+	};
+
+	uint32_t m_size = 0;
+	vector<uint32_t> m_free;
+
+	// Freed since the last FinishFrame.
+	vector<uint32_t> m_freedThisFrame;
+	deque<Retired> m_retired;
+};
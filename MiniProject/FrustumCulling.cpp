@@ -0,0 +1,167 @@
+
+#include "FrustumCulling.h"
+#include <chrono>
+#include <cmath>
+#include <immintrin.h>
+
+using namespace DirectX;
+using namespace std;
+
+
+FrustumCuller::FrustumCuller()
+{
+	// Until planes are set every box is visible.
+	for (int i = 0; i < 6; ++i)
+		m_planes[i] = XMFLOAT4(0.0f, 0.0f, 0.0f, 1.0f);
+}
+
+void FrustumCuller::SetPlanes(const XMFLOAT4 planes[6])
+{
+	for (int i = 0; i < 6; ++i)
+		m_planes[i] = planes[i];
+}
+
+void FrustumCuller::Cull(const BoundsSoA& bounds, uint32_t count, vector<uint32_t>& visible)
+{
+	auto start = chrono::high_resolution_clock::now();
+
+	// Every item may be visible, so size for all of them and trim afterwards.
+	visible.resize(count);
+	uint32_t visibleCount = CullSimd(bounds, count, visible.data());
+	visible.resize(visibleCount);
+
+	auto end = chrono::high_resolution_clock::now();
+
+	m_stats.Tested = count;
+	m_stats.Visible = visibleCount;
+	m_stats.NsPerItem = count > 0 ? chrono::duration<double, nano>(end - start).count() / count : 0.0;
+}
+
+bool FrustumCuller::IsVisible(const XMFLOAT3& center, const XMFLOAT3& extents)const
+{
+	for (int p = 0; p < 6; ++p)
+	{
+		const XMFLOAT4& plane = m_planes[p];
+
+		// Signed distance of the center plus the radius of the box projected on the plane normal.
+		float d = plane.x*center.x + plane.y*center.y + plane.z*center.z + plane.w;
+		float r = fabsf(plane.x)*extents.x + fabsf(plane.y)*extents.y + fabsf(plane.z)*extents.z;
+
+		if (d + r < 0.0f)
+			return false;
+	}
+
+	return true;
+}
+
+const CullStats& FrustumCuller::GetStats()const
+{
+	return m_stats;
+}
+
+uint32_t FrustumCuller::CullSimd(const BoundsSoA& bounds, uint32_t count, uint32_t* visible)const
+{
+	const float* cx = bounds.CenterX.data();
+	const float* cy = bounds.CenterY.data();
+	const float* cz = bounds.CenterZ.data();
+	const float* ex = bounds.ExtentX.data();
+	const float* ey = bounds.ExtentY.data();
+	const float* ez = bounds.ExtentZ.data();
+
+	uint32_t visibleCount = 0;
+	uint32_t i = 0;
+
+#if defined(__AVX__)
+	{
+		__m256 px[6], py[6], pz[6], pw[6], ax[6], ay[6], az[6];
+		for (int p = 0; p < 6; ++p)
+		{
+			px[p] = _mm256_set1_ps(m_planes[p].x);
+			py[p] = _mm256_set1_ps(m_planes[p].y);
+			pz[p] = _mm256_set1_ps(m_planes[p].z);
+			pw[p] = _mm256_set1_ps(m_planes[p].w);
+			ax[p] = _mm256_set1_ps(fabsf(m_planes[p].x));
+			ay[p] = _mm256_set1_ps(fabsf(m_planes[p].y));
+			az[p] = _mm256_set1_ps(fabsf(m_planes[p].z));
+		}
+
+		const __m256 zero = _mm256_setzero_ps();
+
+		for (; i + 8 <= count; i += 8)
+		{
+			__m256 x = _mm256_loadu_ps(cx + i);
+			__m256 y = _mm256_loadu_ps(cy + i);
+			__m256 z = _mm256_loadu_ps(cz + i);
+			__m256 sx = _mm256_loadu_ps(ex + i);
+			__m256 sy = _mm256_loadu_ps(ey + i);
+			__m256 sz = _mm256_loadu_ps(ez + i);
+
+			__m256 inside = _mm256_cmp_ps(zero, zero, _CMP_EQ_OQ);
+			for (int p = 0; p < 6; ++p)
+			{
+				__m256 d = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(px[p], x), _mm256_mul_ps(py[p], y)), _mm256_add_ps(_mm256_mul_ps(pz[p], z), pw[p]));
+				__m256 r = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ax[p], sx), _mm256_mul_ps(ay[p], sy)), _mm256_mul_ps(az[p], sz));
+				inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_add_ps(d, r), zero, _CMP_GE_OQ));
+			}
+
+			// Branchless compaction: always write the index, only advance on visible items.
+			int mask = _mm256_movemask_ps(inside);
+			for (uint32_t k = 0; k < 8; ++k)
+			{
+				visible[visibleCount] = i + k;
+				visibleCount += (mask >> k) & 1;
+			}
+		}
+	}
+#endif
+
+	{
+		__m128 px[6], py[6], pz[6], pw[6], ax[6], ay[6], az[6];
+		for (int p = 0; p < 6; ++p)
+		{
+			px[p] = _mm_set1_ps(m_planes[p].x);
+			py[p] = _mm_set1_ps(m_planes[p].y);
+			pz[p] = _mm_set1_ps(m_planes[p].z);
+			pw[p] = _mm_set1_ps(m_planes[p].w);
+			ax[p] = _mm_set1_ps(fabsf(m_planes[p].x));
+			ay[p] = _mm_set1_ps(fabsf(m_planes[p].y));
+			az[p] = _mm_set1_ps(fabsf(m_planes[p].z));
+		}
+
+		const __m128 zero = _mm_setzero_ps();
+
+		for (; i + 4 <= count; i += 4)
+		{
+			__m128 x = _mm_loadu_ps(cx + i);
+			__m128 y = _mm_loadu_ps(cy + i);
+			__m128 z = _mm_loadu_ps(cz + i);
+			__m128 sx = _mm_loadu_ps(ex + i);
+			__m128 sy = _mm_loadu_ps(ey + i);
+			__m128 sz = _mm_loadu_ps(ez + i);
+
+			__m128 inside = _mm_cmpeq_ps(zero, zero);
+			for (int p = 0; p < 6; ++p)
+			{
+				__m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(px[p], x), _mm_mul_ps(py[p], y)), _mm_add_ps(_mm_mul_ps(pz[p], z), pw[p]));
+				__m128 r = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax[p], sx), _mm_mul_ps(ay[p], sy)), _mm_mul_ps(az[p], sz));
+				inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(d, r), zero));
+			}
+
+			int mask = _mm_movemask_ps(inside);
+			for (uint32_t k = 0; k < 4; ++k)
+			{
+				visible[visibleCount] = i + k;
+				visibleCount += (mask >> k) & 1;
+			}
+		}
+	}
+
+	// Remaining items one at a time.
+	for (; i < count; ++i)
+	{
+		if (IsVisible(XMFLOAT3(cx[i], cy[i], cz[i]), XMFLOAT3(ex[i], ey[i], ez[i])))
+			visible[visibleCount++] = i;
+	}
+
+	return visibleCount;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <DirectXMath.h>
+#include "SceneStore.h"
+
+using namespace DirectX;
+using namespace std;
+
+
+// Counters of the last Cull call.
+struct CullStats
+{
+	uint32_t Tested = 0;
+	uint32_t Visible = 0;
+	double NsPerItem = 0.0;
+};
+
+// Tests world space bounding boxes against the six frustum planes. The boxes are
+// read from BoundsSoA, so one iteration tests 8 items with AVX or 4 with SSE.
+class FrustumCuller
+{
+public:
+
+	FrustumCuller();
+
+	// World space planes (a, b, c, d) with normals pointing inside the frustum.
+	void SetPlanes(const XMFLOAT4 planes[6]);
+
+	// Fills visible with the dense indices of the first count items that intersect the frustum.
+	void Cull(const BoundsSoA& bounds, uint32_t count, vector<uint32_t>& visible);
+
+	// Tests a single box.
+	bool IsVisible(const XMFLOAT3& center, const XMFLOAT3& extents)const;
+
+	const CullStats& GetStats()const;
+
+private:
+
+	uint32_t CullSimd(const BoundsSoA& bounds, uint32_t count, uint32_t* visible)const;
+
+private:
+
+	XMFLOAT4 m_planes[6];
+
+	CullStats m_stats;
+};
@@ -0,0 +1,126 @@
+#include "GeometryRegistry.h"
+
+using namespace std;
+
+
+GeometryRegistry::GeometryRegistry()
+{
+	for (atomic<Chunk*>& chunk : m_chunks)
+		chunk.store(nullptr, memory_order_relaxed);
+}
+
+GeometryRegistry::~GeometryRegistry()
+{
+	for (atomic<Chunk*>& chunk : m_chunks)
+		delete chunk.load(memory_order_relaxed);
+}
+
+uint32_t GeometryRegistry::Publish(GeometryRecord record)
+{
+	lock_guard<mutex> lock(m_mutex);
+
+	if (record.Name.IsValid() && m_names.Contains(record.Name))
+		return InvalidId;
+	if (m_ids.FreeCount() == 0 && m_ids.Size() == MaxChunks*ChunkSize)
+		return InvalidId;
+
+	uint32_t id = m_ids.Allocate();
+	if (id >= (uint32_t)m_records.size())
+		m_records.resize(id + 1);
+
+	// Chunks are only added under the lock and never freed before the registry,
+	// so readers can hold on to them.
+	Chunk* chunk = m_chunks[id / ChunkSize].load(memory_order_relaxed);
+	if (chunk == nullptr)
+	{
+		chunk = new Chunk;
+		for (atomic<const GeometryRecord*>& slot : chunk->Records)
+			slot.store(nullptr, memory_order_relaxed);
+		m_chunks[id / ChunkSize].store(chunk, memory_order_release);
+	}
+
+	m_records[id] = make_unique<GeometryRecord>(move(record));
+	if (m_records[id]->Name.IsValid())
+		m_names[m_records[id]->Name] = id;
+
+	// The record is complete before a reader can see it.
+	chunk->Records[id % ChunkSize].store(m_records[id].get(), memory_order_release);
+
+	m_stats.Published++;
+	return id;
+}
+
+uint32_t GeometryRegistry::Find(StringId name)const
+{
+	lock_guard<mutex> lock(m_mutex);
+
+	const uint32_t* id = m_names.Find(name);
+	return id != nullptr ? *id : InvalidId;
+}
+
+const GeometryRecord* GeometryRegistry::Get(uint32_t id)const
+{
+	if (id >= MaxChunks*ChunkSize)
+		return nullptr;
+
+	const Chunk* chunk = m_chunks[id / ChunkSize].load(memory_order_acquire);
+	if (chunk == nullptr)
+		return nullptr;
+
+	return chunk->Records[id % ChunkSize].load(memory_order_acquire);
+}
+
+void GeometryRegistry::Release(uint32_t id)
+{
+	lock_guard<mutex> lock(m_mutex);
+
+	if (id >= (uint32_t)m_records.size() || m_records[id] == nullptr)
+		return;
+
+	m_chunks[id / ChunkSize].load(memory_order_relaxed)->Records[id % ChunkSize].store(nullptr, memory_order_release);
+	if (m_records[id]->Name.IsValid())
+		m_names.Erase(m_records[id]->Name);
+
+	m_releasedThisFrame.push_back(move(m_records[id]));
+	m_ids.Free(id);
+
+	m_stats.Released++;
+}
+
+void GeometryRegistry::FinishFrame(uint64_t fenceValue)
+{
+	lock_guard<mutex> lock(m_mutex);
+
+	for (unique_ptr<GeometryRecord>& record : m_releasedThisFrame)
+		m_retired.push_back({ fenceValue, move(record) });
+	m_releasedThisFrame.clear();
+
+	m_ids.FinishFrame(fenceValue);
+}
+
+void GeometryRegistry::Reclaim(uint64_t completedFenceValue)
+{
+	// The records are destroyed, and their buffers with them, outside the lock.
+	vector<unique_ptr<GeometryRecord>> completed;
+	{
+		lock_guard<mutex> lock(m_mutex);
+
+		while (!m_retired.empty() && m_retired.front().Fence <= completedFenceValue)
+		{
+			completed.push_back(move(m_retired.front().Record));
+			m_retired.pop_front();
+		}
+
+		m_ids.Reclaim(completedFenceValue);
+	}
+}
+
+GeometryRegistryStats GeometryRegistry::GetStats()const
+{
+	lock_guard<mutex> lock(m_mutex);
+
+	GeometryRegistryStats stats = m_stats;
+	stats.Live = m_stats.Published - m_stats.Released;
+	stats.Retired = (uint32_t)(m_retired.size() + m_releasedThisFrame.size());
+	return stats;
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "CommandRecorder.h"
+#include "FencedFreeList.h"
+#include "StringId.h"
+
+using namespace std;
+
+
+struct MeshGeometry;
+
+// A published geometry with the buffer bindings its draws use. Records are not
+// changed once published.
+struct GeometryRecord
+{
+	StringId Name;
+	shared_ptr<MeshGeometry> Geometry;
+	VertexBufferBinding VertexBuffer;
+	IndexBufferBinding IndexBuffer;
+};
+
+struct GeometryRegistryStats
+{
+	uint32_t Live = 0;
+
+	// Released, waiting for the fence of the frame they were released in.
+	uint32_t Retired = 0;
+
+	uint32_t Published = 0;
+	uint32_t Released = 0;
+};
+
+// Geometries shared by loader threads and the render thread, indexed by the ids
+// draw keys hold. Ids address a table of fixed-size chunks that never move, so
+// Get is two acquire loads without a lock, from any thread, while other threads
+// publish. Publish, Find and Release take a lock that only they contend for.
+//
+// A released record is retired with the current frame like the indices of a
+// FencedFreeList: Get stops returning it at once, but it is only destroyed and
+// its id reused once Reclaim sees the frame's fence complete, so the commands
+// recorded with it and pointers taken before the release stay valid until then.
+class GeometryRegistry
+{
+public:
+
+	static const uint32_t InvalidId = UINT32_MAX;
+
+	// Records per chunk, and chunks of the table.
+	static const uint32_t ChunkSize = 256;
+	static const uint32_t MaxChunks = 256;
+
+	GeometryRegistry();
+	GeometryRegistry(const GeometryRegistry& rhs) = delete;
+	GeometryRegistry& operator=(const GeometryRegistry& rhs) = delete;
+	~GeometryRegistry();
+
+	// Publishes record under its name and returns its id. A record without a
+	// name is anonymous and only reachable by its id. InvalidId if the name is
+	// taken or the table is full.
+	uint32_t Publish(GeometryRecord record);
+
+	// Id of the geometry published under name, or InvalidId. Anonymous records
+	// are never found.
+	uint32_t Find(StringId name)const;
+
+	// Record of id, or null if it is not published.
+	const GeometryRecord* Get(uint32_t id)const;
+
+	// Unpublishes id. Its draws must be gone by the end of the frame.
+	void Release(uint32_t id);
+
+	// Render thread only, once per frame, as for FencedFreeList.
+	void FinishFrame(uint64_t fenceValue);
+	void Reclaim(uint64_t completedFenceValue);
+
+	GeometryRegistryStats GetStats()const;
+
+private:
+
+	struct Chunk
+	{
+		atomic<const GeometryRecord*> Records[ChunkSize];
+	};
+
+	struct Retired
+	{
+		uint64_t Fence;
+		unique_ptr<GeometryRecord> Record;
+	};
+
+private:
+
+	atomic<Chunk*> m_chunks[MaxChunks];
+
+	// Everything below is guarded by m_mutex.
+	mutable mutex m_mutex;
+
+	// Owners of the published records, by id.
+	vector<unique_ptr<GeometryRecord>> m_records;
+	StringIdTable<uint32_t> m_names;
+	FencedFreeList m_ids;
+
+	vector<unique_ptr<GeometryRecord>> m_releasedThisFrame;
+	deque<Retired> m_retired;
+
+	GeometryRegistryStats m_stats;
+};
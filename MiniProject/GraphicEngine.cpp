@@ -474,6 +474,8 @@ LRESULT GraphicEngine::MsgProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam
 		}
 		else if((int)wParam == VK_F2)
 			Set4xMsaaState(!m4xMsaaState);
+		else
+			OnKeyUp(wParam);
 
 		return 0;
 	}
@@ -680,7 +682,7 @@ void GraphicEngine::CalculateFrameStats()
 
 		wstring fpsStr = to_wstring(fps);
 
-		wstring windowText = mMainWndCaption + L"    fps: " + fpsStr;
+		wstring windowText = mMainWndCaption + L"    fps: " + fpsStr + GetFrameStatsText();
 		SetWindowText(mhMainWnd, windowText.c_str());
 
 		// Reset for next average.
@@ -51,6 +51,10 @@ protected:
 	virtual void OnMouseDown(WPARAM btnState, int x, int y) { }
 	virtual void OnMouseUp(WPARAM btnState, int x, int y) { }
 	virtual void OnMouseMove(WPARAM btnState, int x, int y) { }
+	virtual void OnKeyUp(WPARAM key) { }
+
+	// Extra statistics appended to the fps counter in the window caption.
+	virtual wstring GetFrameStatsText()const { return L""; }
 
 protected:
 
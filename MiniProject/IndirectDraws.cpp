@@ -0,0 +1,182 @@
+
+#include "IndirectDraws.h"
+#include "Parallel.h"
+#include <chrono>
+#include <cstring>
+
+using namespace DirectX;
+using namespace std;
+
+namespace
+{
+	uint32_t ArgumentSize(const IndirectArgument& argument)
+	{
+		if (argument.Type == IndirectArgumentType::Constant)
+			return 4*argument.Num32BitValuesToSet;
+
+		return (uint32_t)sizeof(DrawIndexedArguments);
+	}
+}
+
+
+uint32_t IndirectSignatureLayout::OffsetOf(uint32_t argument)const
+{
+	uint32_t offset = 0;
+	for (uint32_t i = 0; i < argument; ++i)
+		offset += ArgumentSize(Arguments[i]);
+	return offset;
+}
+
+bool IndirectSignatureLayout::Validate(string& error)const
+{
+	if (Arguments.empty() || Arguments.back().Type != IndirectArgumentType::DrawIndexed)
+	{
+		error = "the last argument must be the draw";
+		return false;
+	}
+
+	for (size_t i = 0; i + 1 < Arguments.size(); ++i)
+	{
+		const IndirectArgument& argument = Arguments[i];
+		if (argument.Type == IndirectArgumentType::DrawIndexed)
+		{
+			error = "only one draw per command";
+			return false;
+		}
+
+		if (argument.Num32BitValuesToSet == 0 || argument.RootParameterIndex >= CommandRecorder::MaxRootParameters ||
+			argument.DestOffsetIn32BitValues + argument.Num32BitValuesToSet > CommandRecorder::MaxRootConstants)
+		{
+			error = "constant argument " + to_string(i) + " is out of the root parameters";
+			return false;
+		}
+	}
+
+	uint32_t size = OffsetOf((uint32_t)Arguments.size());
+	if (ByteStride < size || ByteStride % 4 != 0)
+	{
+		error = "the stride must be 4-byte aligned and at least " + to_string(size) + " bytes";
+		return false;
+	}
+
+	return true;
+}
+
+IndirectSignatureLayout ObjectDrawSignature(uint32_t rootIndex)
+{
+	IndirectSignatureLayout layout;
+	layout.ByteStride = sizeof(IndirectCommand);
+
+	IndirectArgument object;
+	object.Type = IndirectArgumentType::Constant;
+	object.RootParameterIndex = rootIndex;
+	object.DestOffsetIn32BitValues = 0;
+	object.Num32BitValuesToSet = 1;
+	layout.Arguments.push_back(object);
+
+	IndirectArgument draw;
+	draw.Type = IndirectArgumentType::DrawIndexed;
+	layout.Arguments.push_back(draw);
+
+	return layout;
+}
+
+void ReplayIndirect(const IndirectSignatureLayout& layout, const void* arguments, uint32_t count, CommandRecorder& recorder)
+{
+	const uint8_t* command = (const uint8_t*)arguments;
+	for (uint32_t c = 0; c < count; ++c, command += layout.ByteStride)
+	{
+		// Read through memcpy, the layout does not promise any alignment beyond 4 bytes.
+		const uint8_t* argument = command;
+		for (const IndirectArgument& desc : layout.Arguments)
+		{
+			if (desc.Type == IndirectArgumentType::Constant)
+			{
+				for (uint32_t v = 0; v < desc.Num32BitValuesToSet; ++v)
+				{
+					uint32_t value;
+					memcpy(&value, argument + 4*v, 4);
+					recorder.SetRoot32BitConstant(desc.RootParameterIndex, value, desc.DestOffsetIn32BitValues + v);
+				}
+			}
+			else
+			{
+				DrawIndexedArguments draw;
+				memcpy(&draw, argument, sizeof(draw));
+				recorder.DrawIndexedInstanced(draw.IndexCountPerInstance, draw.InstanceCount, draw.StartIndexLocation,
+					draw.BaseVertexLocation, draw.StartInstanceLocation);
+			}
+
+			argument += ArgumentSize(desc);
+		}
+	}
+}
+
+void IndirectDrawPacker::Pack(const vector<uint32_t>& items, const DrawKey* drawKeys, const XMFLOAT3X4* worlds, const XMFLOAT4* colors,
+	IndirectCommand* commands, IndirectDrawData* drawData)
+{
+	auto start = chrono::high_resolution_clock::now();
+
+	const uint32_t count = (uint32_t)items.size();
+
+	// Every command is independent of the others; write them in parallel chunks,
+	// each a stream of stores into the (write-combined) upload buffers.
+	ParallelFor(count, 4096, [&](uint32_t begin, uint32_t end)
+	{
+		for (uint32_t i = begin; i < end; ++i)
+		{
+			const uint32_t item = items[i];
+			const DrawKey& key = drawKeys[item];
+
+			IndirectCommand command;
+			command.ObjectIndex = i;
+			command.Draw.IndexCountPerInstance = key.IndexCount;
+			command.Draw.InstanceCount = 1;
+			command.Draw.StartIndexLocation = key.StartIndexLocation;
+			command.Draw.BaseVertexLocation = key.BaseVertexLocation;
+			command.Draw.StartInstanceLocation = 0;
+			commands[i] = command;
+
+			IndirectDrawData data;
+			data.World = worlds[item];
+			data.Color = colors[item];
+			drawData[i] = data;
+		}
+	});
+
+	// Cut the command stream where the state the signature cannot set changes.
+	m_batches.clear();
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		const DrawKey& key = drawKeys[items[i]];
+
+		if (m_batches.empty() || m_batches.back().Pso != key.Pso || m_batches.back().Geometry != key.Geometry ||
+			m_batches.back().PrimitiveType != key.PrimitiveType)
+		{
+			IndirectBatch batch;
+			batch.Pso = key.Pso;
+			batch.Geometry = key.Geometry;
+			batch.PrimitiveType = key.PrimitiveType;
+			batch.FirstCommand = i;
+			m_batches.push_back(batch);
+		}
+
+		m_batches.back().CommandCount++;
+	}
+
+	auto end = chrono::high_resolution_clock::now();
+
+	m_stats.Commands = count;
+	m_stats.Batches = (uint32_t)m_batches.size();
+	m_stats.PackMicroseconds = chrono::duration<double, micro>(end - start).count();
+}
+
+const vector<IndirectBatch>& IndirectDrawPacker::GetBatches()const
+{
+	return m_batches;
+}
+
+const IndirectPackStats& IndirectDrawPacker::GetStats()const
+{
+	return m_stats;
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <DirectXMath.h>
+#include "SceneStore.h"
+#include "CommandRecorder.h"
+
+using namespace DirectX;
+using namespace std;
+
+
+// Same layout as D3D12_DRAW_INDEXED_ARGUMENTS.
+struct DrawIndexedArguments
+{
+	uint32_t IndexCountPerInstance;
+	uint32_t InstanceCount;
+	uint32_t StartIndexLocation;
+	int32_t BaseVertexLocation;
+	uint32_t StartInstanceLocation;
+};
+
+// One record of the indirect argument buffer: the object index root constant
+// followed by the draw. The object index addresses the per-draw data.
+struct IndirectCommand
+{
+	uint32_t ObjectIndex;
+	DrawIndexedArguments Draw;
+};
+
+static_assert(offsetof(IndirectCommand, Draw) == 4 && sizeof(IndirectCommand) == 24, "IndirectCommand must be tightly packed");
+
+// Per-draw data, parallel to the commands. Same layout as ObjectData in Util.h.
+struct IndirectDrawData
+{
+	XMFLOAT3X4 World;
+	XMFLOAT4 Color;
+};
+
+// Stand-ins for D3D12_INDIRECT_ARGUMENT_DESC and D3D12_COMMAND_SIGNATURE_DESC, so
+// the layout can be checked and the argument buffer replayed without a device.
+enum class IndirectArgumentType : uint32_t
+{
+	Constant,
+	DrawIndexed
+};
+
+struct IndirectArgument
+{
+	IndirectArgumentType Type = IndirectArgumentType::DrawIndexed;
+
+	// Constant only.
+	uint32_t RootParameterIndex = 0;
+	uint32_t DestOffsetIn32BitValues = 0;
+	uint32_t Num32BitValuesToSet = 0;
+};
+
+struct IndirectSignatureLayout
+{
+	uint32_t ByteStride = 0;
+	vector<IndirectArgument> Arguments;
+
+	// Byte offset of every argument in a command, in order.
+	uint32_t OffsetOf(uint32_t argument)const;
+
+	// Checks the rules D3D12 puts on a graphics command signature: a single draw as
+	// the last argument, constants within the root parameters, and a 4-byte aligned
+	// stride covering all the arguments. Returns false with a reason otherwise.
+	bool Validate(string& error)const;
+};
+
+// Layout of IndirectCommand: the object index at rootIndex, then the draw.
+IndirectSignatureLayout ObjectDrawSignature(uint32_t rootIndex);
+
+// Issues through the recorder the commands ExecuteIndirect would, reading count
+// commands laid out as described by the layout.
+void ReplayIndirect(const IndirectSignatureLayout& layout, const void* arguments, uint32_t count, CommandRecorder& recorder);
+
+// Commands sharing the state an ExecuteIndirect call cannot change: pipeline,
+// geometry buffers and topology. One ExecuteIndirect per batch.
+struct IndirectBatch
+{
+	uint32_t Pso = 0;
+	uint32_t Geometry = 0;
+	uint32_t PrimitiveType = 0;
+	uint32_t FirstCommand = 0;
+	uint32_t CommandCount = 0;
+};
+
+struct IndirectPackStats
+{
+	uint32_t Commands = 0;
+	uint32_t Batches = 0;
+
+	double PackMicroseconds = 0.0;
+};
+
+// Packs the items to draw into an indirect argument buffer and the per-draw data
+// buffer next to it, command i reading data i. Items keep their order, so a sorted
+// draw list becomes a few batches of consecutive commands.
+class IndirectDrawPacker
+{
+public:
+
+	// Writes items.size() commands and data elements, in parallel chunks. Both
+	// buffers are usually mapped upload memory.
+	void Pack(const vector<uint32_t>& items, const DrawKey* drawKeys, const XMFLOAT3X4* worlds, const XMFLOAT4* colors,
+		IndirectCommand* commands, IndirectDrawData* drawData);
+
+	const vector<IndirectBatch>& GetBatches()const;
+
+	const IndirectPackStats& GetStats()const;
+
+private:
+
+	vector<IndirectBatch> m_batches;
+
+	IndirectPackStats m_stats;
+};
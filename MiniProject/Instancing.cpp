@@ -0,0 +1,99 @@
+
+#include "Instancing.h"
+
+using namespace DirectX;
+using namespace std;
+
+
+bool InstanceBatcher::BatchKey::operator==(const BatchKey& rhs)const
+{
+	return Geometry == rhs.Geometry &&
+		StartIndexLocation == rhs.StartIndexLocation &&
+		IndexCount == rhs.IndexCount &&
+		BaseVertexLocation == rhs.BaseVertexLocation &&
+		PrimitiveType == rhs.PrimitiveType &&
+		Pass == rhs.Pass &&
+		Pso == rhs.Pso &&
+		Material == rhs.Material;
+}
+
+size_t InstanceBatcher::BatchKeyHash::operator()(const BatchKey& key)const
+{
+	// FNV-1a over the key fields.
+	const uint32_t fields[] = { key.Geometry, key.StartIndexLocation, key.IndexCount, (uint32_t)key.BaseVertexLocation,
+		key.PrimitiveType, key.Pass, key.Pso, key.Material };
+
+	uint64_t hash = 14695981039346656037ull;
+	for (uint32_t field : fields)
+	{
+		hash ^= field;
+		hash *= 1099511628211ull;
+	}
+	return (size_t)hash;
+}
+
+void InstanceBatcher::Build(const vector<uint32_t>& items, const DrawKey* drawKeys, const XMFLOAT3X4* worlds, const XMFLOAT4* colors)
+{
+	m_batchLookup.clear();
+	m_batches.clear();
+	m_itemBatches.resize(items.size());
+
+	// Assign every item to a batch and count the instances per batch.
+	for (size_t i = 0; i < items.size(); ++i)
+	{
+		const DrawKey& draw = drawKeys[items[i]];
+
+		BatchKey key = { draw.Geometry, draw.StartIndexLocation, draw.IndexCount, draw.BaseVertexLocation,
+			draw.PrimitiveType, draw.Pass, draw.Pso, draw.Material };
+
+		auto it = m_batchLookup.find(key);
+		if (it == m_batchLookup.end())
+		{
+			it = m_batchLookup.emplace(key, (uint32_t)m_batches.size()).first;
+
+			InstanceBatch batch;
+			batch.Draw = draw;
+			m_batches.push_back(batch);
+		}
+
+		m_itemBatches[i] = it->second;
+		m_batches[it->second].InstanceCount++;
+	}
+
+	uint32_t first = 0;
+	for (InstanceBatch& batch : m_batches)
+	{
+		batch.FirstInstance = first;
+		first += batch.InstanceCount;
+		batch.InstanceCount = 0;
+	}
+
+	// Scatter the instances into their batch ranges.
+	m_instances.resize(items.size());
+	for (size_t i = 0; i < items.size(); ++i)
+	{
+		InstanceBatch& batch = m_batches[m_itemBatches[i]];
+
+		InstanceData& instance = m_instances[batch.FirstInstance + batch.InstanceCount++];
+		instance.World = worlds[items[i]];
+		instance.Color = colors[items[i]];
+	}
+
+	m_stats.Items = (uint32_t)items.size();
+	m_stats.Batches = (uint32_t)m_batches.size();
+}
+
+const vector<InstanceData>& InstanceBatcher::GetInstances()const
+{
+	return m_instances;
+}
+
+const vector<InstanceBatch>& InstanceBatcher::GetBatches()const
+{
+	return m_batches;
+}
+
+const InstancingStats& InstanceBatcher::GetStats()const
+{
+	return m_stats;
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include <DirectXMath.h>
+#include "SceneStore.h"
+
+using namespace DirectX;
+using namespace std;
+
+
+// Per-instance vertex stream element. World is the 3x4 affine layout, one row per
+// WORLD semantic, so the shader can rebuild the matrix from the rows directly.
+struct InstanceData
+{
+	XMFLOAT3X4 World;
+	XMFLOAT4 Color;
+};
+
+// One instanced draw: InstanceCount instances of Draw, read from the instance
+// buffer starting at FirstInstance.
+struct InstanceBatch
+{
+	DrawKey Draw;
+	uint32_t FirstInstance = 0;
+	uint32_t InstanceCount = 0;
+};
+
+struct InstancingStats
+{
+	uint32_t Items = 0;
+	uint32_t Batches = 0;
+
+	// Draw calls saved compared to one draw per item.
+	uint32_t DrawsSaved()const { return Items - Batches; }
+};
+
+// Groups the items to draw by submesh and state and gathers their world matrices
+// and colors into one contiguous instance array. Batches keep the order in which
+// their first item appears, and instances keep the order of the items, so a
+// sorted draw list stays sorted by state and by depth within every batch.
+class InstanceBatcher
+{
+public:
+
+	void Build(const vector<uint32_t>& items, const DrawKey* drawKeys, const XMFLOAT3X4* worlds, const XMFLOAT4* colors);
+
+	const vector<InstanceData>& GetInstances()const;
+	const vector<InstanceBatch>& GetBatches()const;
+
+	const InstancingStats& GetStats()const;
+
+private:
+
+	struct BatchKey
+	{
+		uint32_t Geometry;
+		uint32_t StartIndexLocation;
+		uint32_t IndexCount;
+		int32_t BaseVertexLocation;
+		uint32_t PrimitiveType;
+		uint32_t Pass;
+		uint32_t Pso;
+		uint32_t Material;
+
+		bool operator==(const BatchKey& rhs)const;
+	};
+
+	struct BatchKeyHash
+	{
+		size_t operator()(const BatchKey& key)const;
+	};
+
+	unordered_map<BatchKey, uint32_t, BatchKeyHash> m_batchLookup;
+
+	// Batch of every item, parallel to the item list.
+	vector<uint32_t> m_itemBatches;
+
+	vector<InstanceData> m_instances;
+	vector<InstanceBatch> m_batches;
+
+	InstancingStats m_stats;
+};
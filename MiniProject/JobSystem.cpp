@@ -0,0 +1,274 @@
+
+#include "JobSystem.h"
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+
+using namespace std;
+
+namespace
+{
+	// Worker index of the current thread in the system it belongs to.
+	thread_local const JobSystem* tSystem = nullptr;
+	thread_local uint32_t tWorker = 0;
+
+	uint64_t NowNs()
+	{
+		return (uint64_t)chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+	}
+}
+
+
+JobSystem& JobSystem::Get()
+{
+	static JobSystem system(max(1u, thread::hardware_concurrency()));
+	return system;
+}
+
+JobSystem::JobSystem(uint32_t workerCount) : m_queuedJobs(0), m_quit(false)
+{
+	workerCount = max(1u, workerCount);
+
+	for (uint32_t i = 0; i < workerCount; ++i)
+		m_queues.push_back(make_unique<WorkerQueue>());
+
+	tSystem = this;
+	tWorker = 0;
+
+	for (uint32_t i = 1; i < workerCount; ++i)
+		m_threads.emplace_back(&JobSystem::WorkerLoop, this, i);
+}
+
+JobSystem::~JobSystem()
+{
+	{
+		lock_guard<mutex> lock(m_sleepMutex);
+		m_quit = true;
+	}
+	m_wake.notify_all();
+
+	for (auto& t : m_threads)
+		t.join();
+
+	if (tSystem == this)
+		tSystem = nullptr;
+}
+
+uint32_t JobSystem::GetWorkerCount()const
+{
+	return (uint32_t)m_queues.size();
+}
+
+void JobSystem::Run(const char* name, const JobFunc& job, JobCounter* counter, JobCounter* dependency)
+{
+	if (counter)
+		counter->m_count.fetch_add(1, memory_order_relaxed);
+
+	Job queued = { name, job, counter };
+
+	if (dependency)
+	{
+		// Park the job on the dependency unless it has already finished.
+		lock_guard<mutex> lock(dependency->m_waitingMutex);
+		if (!dependency->IsDone())
+		{
+			dependency->m_waiting.push_back([this, queued]() { Push(queued); });
+			return;
+		}
+	}
+
+	Push(queued);
+}
+
+void JobSystem::Wait(JobCounter* counter)
+{
+	uint32_t worker = CurrentWorker();
+
+	while (!counter->IsDone())
+	{
+		Job job;
+		if (PopOrSteal(worker, job))
+			Execute(worker, job);
+		else
+			this_thread::yield();
+	}
+
+	// The last job may still hold the lock it released the waiting jobs under;
+	// let it go before the caller destroys the counter.
+	lock_guard<mutex> lock(counter->m_waitingMutex);
+}
+
+void JobSystem::ParallelFor(const char* name, uint32_t count, uint32_t minChunk, const function<void(uint32_t, uint32_t)>& body)
+{
+	if (count == 0)
+		return;
+
+	// A few chunks per worker so that stealing can even out uneven ranges.
+	uint32_t targetChunks = GetWorkerCount() * 4;
+	uint32_t chunkSize = max(max(1u, minChunk), (count + targetChunks - 1) / targetChunks);
+	uint32_t chunkCount = (count + chunkSize - 1) / chunkSize;
+
+	if (chunkCount <= 1 || GetWorkerCount() == 1)
+	{
+		body(0, count);
+		return;
+	}
+
+	JobCounter counter;
+	for (uint32_t c = 1; c < chunkCount; ++c)
+	{
+		uint32_t begin = c*chunkSize;
+		uint32_t end = min(count, begin + chunkSize);
+		Run(name, [&body, begin, end]() { body(begin, end); }, &counter);
+	}
+
+	// The calling thread takes the first range itself.
+	body(0, min(count, chunkSize));
+
+	Wait(&counter);
+}
+
+void JobSystem::SetTraceCallback(const TraceFunc& trace)
+{
+	m_trace = trace;
+}
+
+void JobSystem::SampleWorkerStats(vector<WorkerStats>& stats)
+{
+	stats.resize(m_queues.size());
+	for (size_t i = 0; i < m_queues.size(); ++i)
+	{
+		lock_guard<mutex> lock(m_queues[i]->StatsMutex);
+		stats[i] = m_queues[i]->Stats;
+		m_queues[i]->Stats = WorkerStats();
+	}
+}
+
+void JobSystem::Push(Job job)
+{
+	// Threads outside the system feed the queue of worker 0.
+	uint32_t worker = CurrentWorker();
+	if (worker >= m_queues.size())
+		worker = 0;
+
+	m_queuedJobs.fetch_add(1, memory_order_release);
+	{
+		lock_guard<mutex> lock(m_queues[worker]->Mutex);
+		m_queues[worker]->Jobs.push_back(move(job));
+	}
+
+	{
+		lock_guard<mutex> lock(m_sleepMutex);
+	}
+	m_wake.notify_one();
+}
+
+bool JobSystem::PopOrSteal(uint32_t worker, Job& job)
+{
+	uint32_t count = (uint32_t)m_queues.size();
+
+	// Own work first, newest job first while it is still in the cache.
+	if (worker < count)
+	{
+		WorkerQueue& queue = *m_queues[worker];
+		lock_guard<mutex> lock(queue.Mutex);
+		if (!queue.Jobs.empty())
+		{
+			job = move(queue.Jobs.back());
+			queue.Jobs.pop_back();
+			m_queuedJobs.fetch_sub(1, memory_order_relaxed);
+			return true;
+		}
+	}
+
+	// Steal the oldest job of another worker, which tends to be the largest.
+	for (uint32_t i = 1; i <= count; ++i)
+	{
+		uint32_t victim = (worker + i) % count;
+		if (victim == worker)
+			continue;
+
+		WorkerQueue& queue = *m_queues[victim];
+		lock_guard<mutex> lock(queue.Mutex);
+		if (!queue.Jobs.empty())
+		{
+			job = move(queue.Jobs.front());
+			queue.Jobs.pop_front();
+			m_queuedJobs.fetch_sub(1, memory_order_relaxed);
+
+			if (worker < count)
+			{
+				lock_guard<mutex> statsLock(m_queues[worker]->StatsMutex);
+				m_queues[worker]->Stats.Steals++;
+			}
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void JobSystem::Execute(uint32_t worker, Job& job)
+{
+	uint64_t start = NowNs();
+	job.Func();
+	uint64_t end = NowNs();
+
+	if (worker < m_queues.size())
+	{
+		lock_guard<mutex> lock(m_queues[worker]->StatsMutex);
+		m_queues[worker]->Stats.Jobs++;
+		m_queues[worker]->Stats.BusyMicroseconds += (end - start) / 1000.0;
+	}
+
+	if (m_trace)
+	{
+		JobTraceEvent event = { job.Name, worker, start, end };
+		m_trace(event);
+	}
+
+	if (job.Counter)
+		Finish(job.Counter);
+}
+
+void JobSystem::Finish(JobCounter* counter)
+{
+	// Decrement under the lock, so Wait cannot return and the counter cannot go
+	// away while it is still in use here.
+	// The last job of the group queues the jobs that were waiting for it.
+	vector<function<void()>> waiting;
+	{
+		lock_guard<mutex> lock(counter->m_waitingMutex);
+		if (counter->m_count.fetch_sub(1, memory_order_acq_rel) == 1)
+			waiting.swap(counter->m_waiting);
+	}
+
+	for (auto& release : waiting)
+		release();
+}
+
+void JobSystem::WorkerLoop(uint32_t worker)
+{
+	tSystem = this;
+	tWorker = worker;
+
+	while (true)
+	{
+		Job job;
+		if (PopOrSteal(worker, job))
+		{
+			Execute(worker, job);
+			continue;
+		}
+
+		unique_lock<mutex> lock(m_sleepMutex);
+		m_wake.wait(lock, [this]() { return m_quit || m_queuedJobs.load(memory_order_acquire) > 0; });
+		if (m_quit)
+			return;
+	}
+}
+
+uint32_t JobSystem::CurrentWorker()const
+{
+	return tSystem == this ? tWorker : UINT32_MAX;
+}
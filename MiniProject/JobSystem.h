@@ -0,0 +1,132 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+
+// Counts the unfinished jobs of a group. Jobs can be made to wait for a counter,
+// and any thread can wait for it while helping with the queued jobs. Go through
+// JobSystem::Wait before destroying a counter that jobs were counted on.
+class JobCounter
+{
+public:
+
+	JobCounter() : m_count(0) { }
+	JobCounter(const JobCounter&) = delete;
+	JobCounter& operator=(const JobCounter&) = delete;
+
+	bool IsDone()const { return m_count.load(memory_order_acquire) == 0; }
+
+private:
+
+	friend class JobSystem;
+
+	atomic<uint32_t> m_count;
+
+	// Jobs that start once the count drops to zero.
+	mutex m_waitingMutex;
+	vector<function<void()>> m_waiting;
+};
+
+// One finished job, passed to the trace callback.
+struct JobTraceEvent
+{
+	const char* Name;
+	uint32_t Worker;
+	uint64_t StartNs;
+	uint64_t EndNs;
+};
+
+struct WorkerStats
+{
+	uint32_t Jobs = 0;
+	uint32_t Steals = 0;
+	double BusyMicroseconds = 0.0;
+};
+
+// Work-stealing job system. Every worker thread owns a deque: it pushes and pops
+// jobs at the back, idle workers steal from the front of the others. The thread
+// that creates the system is worker 0 and runs jobs while it waits for a counter.
+class JobSystem
+{
+public:
+
+	typedef function<void()> JobFunc;
+	typedef function<void(const JobTraceEvent& event)> TraceFunc;
+
+	// System shared by the engine, created on first use on the calling thread.
+	static JobSystem& Get();
+
+	explicit JobSystem(uint32_t workerCount);
+	JobSystem(const JobSystem&) = delete;
+	JobSystem& operator=(const JobSystem&) = delete;
+	~JobSystem();
+
+	// Worker threads plus the creating thread.
+	uint32_t GetWorkerCount()const;
+
+	// Queues a job. counter, if any, counts it until it has run. When dependency
+	// is given the job is only queued once that counter reaches zero.
+	void Run(const char* name, const JobFunc& job, JobCounter* counter = nullptr, JobCounter* dependency = nullptr);
+
+	// Runs queued jobs until counter reaches zero.
+	void Wait(JobCounter* counter);
+
+	// Calls body(begin, end) over ranges of [0, count) of at least minChunk items
+	// and returns when all of them have run.
+	void ParallelFor(const char* name, uint32_t count, uint32_t minChunk, const function<void(uint32_t, uint32_t)>& body);
+
+	// Called on the worker thread after every job. Set it while no job is running.
+	void SetTraceCallback(const TraceFunc& trace);
+
+	// Statistics of every worker since the last call, which resets them.
+	void SampleWorkerStats(vector<WorkerStats>& stats);
+
+private:
+
+	struct Job
+	{
+		const char* Name;
+		JobFunc Func;
+		JobCounter* Counter;
+	};
+
+	struct WorkerQueue
+	{
+		mutex Mutex;
+		deque<Job> Jobs;
+
+		mutex StatsMutex;
+		WorkerStats Stats;
+	};
+
+	void Push(Job job);
+	bool PopOrSteal(uint32_t worker, Job& job);
+	void Execute(uint32_t worker, Job& job);
+	void Finish(JobCounter* counter);
+	void WorkerLoop(uint32_t worker);
+
+	uint32_t CurrentWorker()const;
+
+private:
+
+	vector<unique_ptr<WorkerQueue>> m_queues;
+	vector<thread> m_threads;
+
+	// Sleeping workers wake up when jobs are queued.
+	mutex m_sleepMutex;
+	condition_variable m_wake;
+	atomic<uint32_t> m_queuedJobs;
+	atomic<bool> m_quit;
+
+	TraceFunc m_trace;
+};
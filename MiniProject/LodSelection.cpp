@@ -0,0 +1,180 @@
+#include "LodSelection.h"
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <immintrin.h>
+
+using namespace DirectX;
+using namespace std;
+
+const uint32_t LodSelector::NoGroup;
+
+
+uint32_t LodSelector::AddGroup(const LodGroup& group)
+{
+	assert(group.LevelCount > 0 && group.LevelCount <= LodGroup::MaxLevels);
+
+	m_groups.push_back(group);
+	m_thresholds.push_back(Thresholds());
+	return (uint32_t)m_groups.size() - 1;
+}
+
+const LodGroup& LodSelector::GetGroup(uint32_t group)const
+{
+	return m_groups[group];
+}
+
+void LodSelector::SetBias(float bias)
+{
+	m_bias = bias;
+}
+
+float LodSelector::GetBias()const
+{
+	return m_bias;
+}
+
+void LodSelector::SetHysteresis(float hysteresis)
+{
+	m_hysteresis = hysteresis;
+}
+
+void LodSelector::Select(const BoundsSoA& bounds, const uint32_t* groups, uint8_t* levels, uint32_t count,
+	const XMFLOAT3& eyePos, float fovY, float viewportHeight, vector<uint32_t>& changed)
+{
+	auto start = chrono::high_resolution_clock::now();
+
+	// The sizes are compared squared, so are the thresholds.
+	float down = 1.0f - m_hysteresis;
+	float up = 1.0f + m_hysteresis;
+	for (size_t g = 0; g < m_groups.size(); ++g)
+	{
+		const LodGroup& group = m_groups[g];
+		for (uint32_t l = 0; l < group.LevelCount; ++l)
+		{
+			float size = group.MinScreenSize[l];
+			m_thresholds[g].Down[l] = l + 1 < group.LevelCount ? size*size*down*down : 0.0f;
+			m_thresholds[g].Up[l] = size*size*up*up;
+		}
+	}
+
+	// A sphere of radius r at distance d covers r/d * height/tan(fovY/2) pixels
+	// across, so the squared size is scale^2 * r^2/d^2.
+	float scale = m_bias*viewportHeight / tanf(0.5f*fovY);
+
+	const float* cx = bounds.CenterX.data();
+	const float* cy = bounds.CenterY.data();
+	const float* cz = bounds.CenterZ.data();
+	const float* ex = bounds.ExtentX.data();
+	const float* ey = bounds.ExtentY.data();
+	const float* ez = bounds.ExtentZ.data();
+
+	const __m128 eyeX = _mm_set1_ps(eyePos.x);
+	const __m128 eyeY = _mm_set1_ps(eyePos.y);
+	const __m128 eyeZ = _mm_set1_ps(eyePos.z);
+	const __m128 scale2 = _mm_set1_ps(scale*scale);
+
+	// Keeps the eye inside a bounding sphere, or on its center, from dividing by zero.
+	const __m128 minDistance2 = _mm_set1_ps(1e-6f);
+
+	changed.clear();
+	uint32_t items = 0;
+
+	alignas(16) float sizes2[4];
+	for (uint32_t i = 0; i < count; i += 4)
+	{
+		if (i + 4 <= count)
+		{
+			__m128 dx = _mm_sub_ps(_mm_loadu_ps(cx + i), eyeX);
+			__m128 dy = _mm_sub_ps(_mm_loadu_ps(cy + i), eyeY);
+			__m128 dz = _mm_sub_ps(_mm_loadu_ps(cz + i), eyeZ);
+			__m128 sx = _mm_loadu_ps(ex + i);
+			__m128 sy = _mm_loadu_ps(ey + i);
+			__m128 sz = _mm_loadu_ps(ez + i);
+
+			// Bounding sphere of the box: the radius is the length of the extents.
+			__m128 radius2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, sx), _mm_mul_ps(sy, sy)), _mm_mul_ps(sz, sz));
+			__m128 distance2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+			distance2 = _mm_max_ps(distance2, minDistance2);
+
+			_mm_store_ps(sizes2, _mm_div_ps(_mm_mul_ps(scale2, radius2), distance2));
+		}
+		else
+		{
+			for (uint32_t k = 0; i + k < count; ++k)
+			{
+				uint32_t j = i + k;
+				float dx = cx[j] - eyePos.x;
+				float dy = cy[j] - eyePos.y;
+				float dz = cz[j] - eyePos.z;
+				float radius2 = ex[j]*ex[j] + ey[j]*ey[j] + ez[j]*ez[j];
+				float distance2 = max(dx*dx + dy*dy + dz*dz, 1e-6f);
+				sizes2[k] = scale*scale*radius2 / distance2;
+			}
+		}
+
+		uint32_t end = min(count, i + 4);
+		for (uint32_t j = i; j < end; ++j)
+		{
+			if (groups[j] == NoGroup)
+				continue;
+
+			items++;
+
+			uint32_t level = SelectLevel(groups[j], levels[j], sizes2[j - i]);
+			if (level != levels[j])
+			{
+				levels[j] = (uint8_t)level;
+				changed.push_back(j);
+			}
+		}
+	}
+
+	auto end = chrono::high_resolution_clock::now();
+
+	m_stats.Items = items;
+	m_stats.Changed = (uint32_t)changed.size();
+	m_stats.SelectMicroseconds = chrono::duration<double, micro>(end - start).count();
+}
+
+void LodSelector::CountTriangles(const vector<uint32_t>& items, const DrawKey* drawKeys, const uint32_t* groups)
+{
+	uint64_t before = 0;
+	uint64_t after = 0;
+	for (uint32_t item : items)
+	{
+		uint32_t indexCount = drawKeys[item].IndexCount;
+		after += indexCount / 3;
+
+		if (groups[item] != NoGroup)
+			indexCount = m_groups[groups[item]].Levels[0].IndexCount;
+		before += indexCount / 3;
+	}
+
+	m_stats.TrianglesBefore = before;
+	m_stats.TrianglesAfter = after;
+}
+
+const LodStats& LodSelector::GetStats()const
+{
+	return m_stats;
+}
+
+uint32_t LodSelector::SelectLevel(uint32_t group, uint32_t level, float size2)const
+{
+	const Thresholds& thresholds = m_thresholds[group];
+	uint32_t levelCount = m_groups[group].LevelCount;
+
+	level = min(level, levelCount - 1);
+
+	// Coarser while the item is clearly smaller than its level allows, finer while
+	// it is clearly larger than the next finer level requires. The margins do not
+	// overlap, so an item never goes one way and then back.
+	while (level + 1 < levelCount && size2 < thresholds.Down[level])
+		level++;
+	while (level > 0 && size2 > thresholds.Up[level - 1])
+		level--;
+
+	return level;
+}
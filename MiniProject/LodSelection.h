@@ -0,0 +1,99 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <DirectXMath.h>
+#include "SceneStore.h"
+
+using namespace DirectX;
+using namespace std;
+
+
+// Draw arguments of one level of detail of a mesh.
+struct LodLevel
+{
+	uint32_t IndexCount = 0;
+	uint32_t StartIndexLocation = 0;
+	int32_t BaseVertexLocation = 0;
+};
+
+// The levels of one mesh, finest first. Level i is drawn while the projected
+// diameter of the item is at least MinScreenSize[i] pixels; the coarsest level has
+// no minimum. Sizes must decrease from one level to the next.
+struct LodGroup
+{
+	static const uint32_t MaxLevels = 4;
+
+	uint32_t LevelCount = 0;
+	LodLevel Levels[MaxLevels];
+	float MinScreenSize[MaxLevels] = {};
+};
+
+struct LodStats
+{
+	uint32_t Items = 0;
+
+	// Items whose level changed in the last Select.
+	uint32_t Changed = 0;
+
+	// Triangles of the counted items at their finest level and at their selected level.
+	uint64_t TrianglesBefore = 0;
+	uint64_t TrianglesAfter = 0;
+
+	double SelectMicroseconds = 0.0;
+};
+
+// Picks the level of detail of every item from the size of its bounding sphere
+// projected on the screen. The sizes are computed from BoundsSoA four items at a
+// time. A level only changes once the size crossed its threshold by the hysteresis
+// margin, so items sitting on a threshold do not pop back and forth.
+class LodSelector
+{
+public:
+
+	static const uint32_t NoGroup = UINT32_MAX;
+
+	uint32_t AddGroup(const LodGroup& group);
+	const LodGroup& GetGroup(uint32_t group)const;
+
+	// Scales the projected sizes; above 1 keeps the finer levels for longer.
+	void SetBias(float bias);
+	float GetBias()const;
+
+	// Fraction of a threshold the size must pass it by before the level changes.
+	void SetHysteresis(float hysteresis);
+
+	// Updates the levels of the items [0, count) whose group is not NoGroup, seen
+	// from eyePos with a vertical field of view fovY over viewportHeight pixels.
+	// Fills changed with the dense indices of the items whose level changed.
+	void Select(const BoundsSoA& bounds, const uint32_t* groups, uint8_t* levels, uint32_t count,
+		const XMFLOAT3& eyePos, float fovY, float viewportHeight, vector<uint32_t>& changed);
+
+	// Counts the triangles of the given items, drawn as triangle lists, at their
+	// finest level and as they are drawn now.
+	void CountTriangles(const vector<uint32_t>& items, const DrawKey* drawKeys, const uint32_t* groups);
+
+	const LodStats& GetStats()const;
+
+private:
+
+	uint32_t SelectLevel(uint32_t group, uint32_t level, float size2)const;
+
+private:
+
+	vector<LodGroup> m_groups;
+
+	// Squared thresholds with the hysteresis applied: a level is left for the next
+	// coarser one below Down[level], and for the next finer one above Up[level].
+	struct Thresholds
+	{
+		float Down[LodGroup::MaxLevels];
+		float Up[LodGroup::MaxLevels];
+	};
+	vector<Thresholds> m_thresholds;
+
+	float m_bias = 1.0f;
+	float m_hysteresis = 0.1f;
+
+	LodStats m_stats;
+};
@@ -3,6 +3,35 @@
 #include "Util.h"
 #include "ObjectBuilder.h"
 #include "CameraDynamic.h"
+#include "SceneStore.h"
+#include "FrustumCulling.h"
+#include "Bvh.h"
+#include "OcclusionCulling.h"
+#include "RenderQueue.h"
+#include "D3D12CommandBackend.h"
+#include "ParallelRecorder.h"
+#include "TransformHierarchy.h"
+#include "Parallel.h"
+#include "JobSystem.h"
+#include "UploadRing.h"
+#include "StaticBatching.h"
+#include "IndirectDraws.h"
+#include "LodSelection.h"
+#include "VisibilityCache.h"
+#include "PotentiallyVisibleSet.h"
+#include "SceneFile.h"
+#include "GeometryRegistry.h"
+#include "StringId.h"
+#include "StressScene.h"
+#include "WorldPartition.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <random>
+#include <thread>
 
 
 using namespace Microsoft::WRL;
@@ -12,38 +41,66 @@ using namespace std;
 
 const int gNumFrameResources = 3;
 
-// Lightweight structure stores parameters to draw a shape. This will vary from app-to-app.
-struct RenderItem
-{
-	// World matrix of the shape that describes the object's local space
-	// relative to the world space, which defines the position, orientation,
-	// and scale of the object in the world.
-	XMFLOAT4X4 World = UtilMath::Identity4x4();
-
-	// Dirty flag indicating the object data has changed and we need to update the constant buffer.
-	// Because we have an object cbuffer for each FrameResource, we have to apply the
-	// update to each FrameResource.  Thus, when we modify obect data we should set 
-	// NumFramesDirty = gNumFrameResources so that each frame resource gets the update.
-	int NumFramesDirty = gNumFrameResources;
-
-	// Index into GPU constant buffer corresponding to the ObjectCB for this render item.
-	UINT ObjCBIndex = -1;
-
-	MeshGeometry* Geo = nullptr;
-
-	// Primitive topology.
-	D3D12_PRIMITIVE_TOPOLOGY PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-
-	// DrawIndexedInstanced parameters.
-	UINT IndexCount = 0;
-	UINT StartIndexLocation = 0;
-	int BaseVertexLocation = 0;
-};
+// Upper bound of the threads recording scene draws, and the fewest draws worth a thread.
+const UINT gMaxRecordingThreads = 8;
+const UINT gMinDrawsPerRecordingThread = 256;
+
+// Object constant slots allocated up front; the buffers double when the scene outgrows them.
+const UINT gInitialObjectCapacity = 1024;
+
+// Static scenery: objects per side of the square field, their spacing, and the
+// distances beyond which clusters and groups of clusters are drawn as proxies.
+const UINT gStaticSceneryPerSide = 96;
+const float gStaticScenerySpacing = 6.0f;
+const float gClusterProxyDistance = 150.0f;
+const float gGroupProxyDistance = 300.0f;
+
+// Sphere levels of detail, finest first: slices and stacks of every level, and the
+// projected diameter in pixels below which the next coarser level is drawn.
+const UINT gSphereLodCount = 4;
+const UINT gSphereLodSlices[gSphereLodCount] = { 32, 16, 10, 6 };
+const UINT gSphereLodStacks[gSphereLodCount] = { 16, 12, 8, 4 };
+const float gSphereLodMinScreenSize[gSphereLodCount - 1] = { 160.0f, 64.0f, 24.0f };
+
+// Potentially visible sets built with 'P': side of the grid cells, sample points
+// per cell along each axis, and rays cast from every point.
+const float gPvsCellSize = 4.0f;
+const UINT gPvsSamplePoints = 2;
+const UINT gPvsRaysPerPoint = 512;
+
+// Stress scenes added with 'N': items per scene, and the seed of the first one.
+const UINT gStressSceneItems = 100000;
+const UINT gStressSceneSeed = 1;
+
+// World partition streamed with 'C': cells per side and their size, the radii cells
+// are loaded within and kept within, the bytes the loaded cells may take, the
+// seconds of movement loaded ahead, and the cells loading at once.
+const UINT gWorldCellsPerSide = 128;
+const float gWorldCellSize = 32.0f;
+const float gWorldLoadRadius = 64.0f;
+const float gWorldUnloadRadius = 96.0f;
+const UINT64 gWorldMemoryBudget = 3 << 20;
+const float gWorldPrefetchSeconds = 2.0f;
+const UINT gWorldMaxLoadsInFlight = 4;
+
+// Items of a world cell. At spacing 1 they cover 31.6 units, just under a cell.
+const UINT gWorldItemsPerCell = 600;
+const float gWorldItemSpacing = 1.0f;
+
+// Directory under the temporary one the cell files are cached in, written the
+// first time a cell loads, and the geometry name scene files give a geometry of
+// their own, resolved to the one passed with them.
+const char* const gWorldCacheDirectory = "MiniProjectWorld";
+const char* const gLocalGeometryName = "localGeo";
+
+// Items spawned and despawned per frame while streaming, and the size of the streamed set.
+const UINT gStreamedItemsPerFrame = 64;
+const UINT gMaxStreamedItems = 20000;
 
 class MyEngine : public GraphicEngine
 {
 public:
-	MyEngine(HINSTANCE hInstance);
+	MyEngine(HINSTANCE hInstance, const string& scenePath);
 	MyEngine(const MyEngine& rhs) = delete;
 	MyEngine& operator=(const MyEngine& rhs) = delete;
 	~MyEngine();
@@ -58,21 +115,72 @@ private:
 	virtual void OnMouseDown(WPARAM btnState, int x, int y)override;
 	virtual void OnMouseUp(WPARAM btnState, int x, int y)override;
 	virtual void OnMouseMove(WPARAM btnState, int x, int y)override;
+	virtual void OnKeyUp(WPARAM key)override;
+
+	virtual wstring GetFrameStatsText()const override;
 
 	void OnKeyboardInput(const Timer& m_timer);
-	void UpdateObjectCBs();
+	void UpdateObjectBuffer();
 	void UpdateMainPassCB(const Timer& m_timer);
+	void CullRenderItems();
+	void OcclusionCullRenderItems();
+	void SelectLods();
+	void SortRenderItems();
+	void BuildInstances();
+	void PackIndirectDraws();
+	bool AllocateUpload(UINT64 size, UINT64 alignment, uint32_t step, UploadAllocation& allocation);
+	void RetryFailedUploads(const Timer& timer);
+	void WaitForFence(UINT64 fenceValue);
+	void AddStressScene();
+	void BuildPvs();
+	void ToggleWorldStreaming();
+	void StreamWorldCells(const Timer& timer);
+	void StopWorldLoader();
+	void WorldLoaderLoop();
+	void LoadWorldCell(uint32_t cell);
+	bool WriteWorldCell(uint32_t cell, const string& path, const BoundingBox& rockBounds)const;
+	void PlaceWorldCell(uint32_t cell);
+	void UnloadWorldCell(uint32_t cell);
+	void PickRenderItem(int x, int y);
 
-	void BuildDescriptorHeaps();
-	void BuildConstantBufferViews();
 	void BuildRootSignature();
+	void BuildCommandSignature();
 	void BuildShaders();
 	void BuildInputLayout();
 	void BuildShapeGeometry();
+	uint32_t PublishGeometry(unique_ptr<MeshGeometry> geo);
+	const MeshGeometry* GetGeometry(uint32_t id)const;
+	ComPtr<ID3D12Resource> CreateUploadHeapBuffer(const void* data, UINT64 byteSize);
+	void ToggleLoadedGeometry();
+	void LoadGeometry();
+	void PlaceLoadedGeometry();
+	void BuildStaticScenery();
 	void BuildPSO();
 	void BuildFrameResources();
+	void BuildUploadRing();
+	void GrowObjectCapacity();
 	void BuildRenderItems();
-	void DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const vector<RenderItem*>& ritems);
+	SceneFileContents BuiltInScene()const;
+	bool LoadScene(const string& path);
+	bool AddScene(const SceneFileContents& scene);
+	uint32_t AddSceneItems(const RenderItemRange& range, const uint32_t* parents, const uint32_t* flags);
+	bool MakeSceneDraws(const SceneFileMesh* meshes, uint32_t meshCount, uint32_t localGeometry, vector<DrawKey>& draws, vector<uint32_t>& lodGroups)const;
+	bool MakeSceneRange(const SceneFile& file, vector<DrawKey>& draws, vector<uint32_t>& lodGroups, RenderItemRange& range,
+		uint32_t localGeometry = GeometryRegistry::InvalidId)const;
+	void MoveDynamicItems(const Timer& timer);
+	RenderItemHandle AddRenderItem(const XMFLOAT3X4& world, UINT geometry, StringId submesh, uint32_t lodGroup = LodSelector::NoGroup);
+	void RemoveRenderItem(RenderItemHandle handle);
+	void StreamRenderItems();
+	void StopStreaming();
+	void SetRenderItemWorld(RenderItemHandle handle, const XMFLOAT3X4& world);
+	void UpdateBvhItem(uint32_t denseIndex);
+	void RebuildBvh();
+	void InvalidateVisibility(uint32_t denseIndex);
+	void DrawRenderItems(CommandRecorder& recorder, const vector<uint32_t>& items, uint32_t begin, uint32_t end);
+	void DrawInstanceBatches(CommandRecorder& recorder, uint32_t begin, uint32_t end);
+	void DrawIndirectBatches(CommandRecorder& recorder, uint32_t begin, uint32_t end);
+	void SelectStaticBatches();
+	void DrawStaticBatches(CommandRecorder& recorder);
 
 private:
 
@@ -81,25 +189,202 @@ private:
 	int m_currentResourceIndex = 0;
 
 	ComPtr<ID3D12RootSignature> m_rootSignature = nullptr;
-	ComPtr<ID3D12DescriptorHeap> m_cbvHeap = nullptr;
+
+	// Object slots the object buffers have room for. Draws pass the slot as a
+	// root constant and the shader indexes the buffer with it.
+	UINT m_objectCapacity = 0;
+
+	// Buffers and ring replaced by GrowObjectCapacity, kept alive until the
+	// frames that were submitted with them have completed.
+	struct RetiredResources
+	{
+		UINT64 Fence = 0;
+		vector<unique_ptr<UploadBuffer<ObjectData>>> ObjectBuffers;
+		unique_ptr<UploadRing> Ring;
+	};
+	deque<RetiredResources> m_retiredResources;
 
 	ComPtr<ID3D12DescriptorHeap> m_srvDescriptorHeap = nullptr;
 
-	unordered_map<string, unique_ptr<MeshGeometry>> m_geometries;
-	unordered_map<string, ComPtr<ID3DBlob>> m_shaders;
+	// Geometries indexed by DrawKey::Geometry, with their buffer views. Loaders
+	// publish into it from any thread; draws read it without locking.
+	GeometryRegistry m_geometries;
+
+	// Geometry built while frames go on ('U'), and the items drawn with it once
+	// it is published. The load runs on a thread of its own: as a job, the
+	// frame's Wait would pick it up and run it inline. The loader sets
+	// m_geometryLoadDone last, with or without the geometry.
+	thread m_geometryLoader;
+	atomic<bool> m_geometryLoadDone{ false };
+	wstring m_geometryLoadError;
+	double m_geometryLoadMilliseconds = 0.0;
+	uint32_t m_loadedGeometry = GeometryRegistry::InvalidId;
+	vector<RenderItemHandle> m_loadedItems;
+
+	StringIdTable<ComPtr<ID3DBlob>> m_shaders;
 	ComPtr<ID3D12PipelineState> m_PSO;
+	ComPtr<ID3D12PipelineState> m_instancedPSO;
 
 	vector<D3D12_INPUT_ELEMENT_DESC> m_inputLayout;
+	vector<D3D12_INPUT_ELEMENT_DESC> m_instancedInputLayout;
+
+	// All the render items.
+	SceneStore m_scene;
+
+	// While streaming ('T') boxes and spheres are spawned and despawned every frame.
+	bool m_streaming = false;
+	deque<RenderItemHandle> m_streamedItems;
+	mt19937 m_streamRandom;
+	UINT m_streamGeometry = 0;
+
+	// Object data written by the last UpdateObjectBuffer.
+	uint32_t m_uploadedObjects = 0;
+	uint64_t m_uploadedBytes = 0;
+
+	// Transforms of the render items. Items get their world matrix from their node.
+	TransformHierarchy m_hierarchy;
 
-	// List of all the render items.
-	vector<unique_ptr<RenderItem>> m_renderItems;
+	// Roots of the dynamic items of the scene, turned about their vertical axis
+	// every frame, with their world matrix when added.
+	struct DynamicNode
+	{
+		uint32_t Node = 0;
+		XMFLOAT3X4 Base;
+	};
+	vector<DynamicNode> m_dynamicNodes;
+
+	// Stress scenes added with 'N', alternating Poisson disk and clustered ones.
+	StressSceneGenerator m_stressScene;
+	uint32_t m_stressSeed = gStressSceneSeed;
+
+	// A cell of the world partition: its anonymous geometry, its file and the
+	// range of items read from it, its items once placed, and the bytes it takes.
+	// The file is closed once the items are in the scene.
+	struct WorldCell
+	{
+		SceneFile File;
+		vector<DrawKey> Draws;
+		vector<uint32_t> LodGroups;
+		RenderItemRange Range;
+		uint32_t Geometry = GeometryRegistry::InvalidId;
+		vector<RenderItemHandle> Items;
+		uint64_t Bytes = 0;
+	};
 
-	// Render items divided by PSO.
-	vector<RenderItem*> m_opaqueRenderItems;
+	// While streaming the world ('C') the cells around the camera are built on a
+	// loader thread of their own, so the workers the frame's jobs run on are never
+	// held up by them. Update queues the cells in m_worldLoadQueue and places the
+	// ones handed back through m_worldLoaded; m_worldLoaderMutex guards both.
+	WorldPartition m_worldPartition;
+	bool m_streamWorld = false;
+	string m_worldCachePath;
+	vector<unique_ptr<WorldCell>> m_worldCells;
+	thread m_worldLoader;
+	mutex m_worldLoaderMutex;
+	condition_variable m_worldLoaderWake;
+	bool m_worldLoaderQuit = false;
+	deque<uint32_t> m_worldLoadQueue;
+	vector<pair<uint32_t, unique_ptr<WorldCell>>> m_worldLoaded;
+	vector<uint32_t> m_worldCellLoads;
+	vector<uint32_t> m_worldCellUnloads;
+
+	// Dense indices of the render items to draw this frame.
+	vector<uint32_t> m_drawList;
+
+	FrustumCuller m_frustumCuller;
+
+	// Spatial index over the render item slots. Culling and picking go through it
+	// unless m_useBvh is toggled off, in which case every item is tested linearly
+	// and the index is not kept up to date; it is built again when turned on.
+	Bvh m_bvh;
+	bool m_useBvh = true;
+	vector<uint32_t> m_visibleSlots;
+
+	// With m_useVisibilityCache ('V') the linear test only runs on the items
+	// whose result may have changed since the last frames. Items are invalidated
+	// as they move, are added or take the place of a removed one.
+	VisibilityCache m_visibilityCache;
+	bool m_useVisibilityCache = false;
+
+	// With m_usePvs ('P') only the items in the precomputed set of the camera's
+	// cell are tested. The sets are built from the scene when it is turned on;
+	// items moved or added since are tested from every cell.
+	PotentiallyVisibleSet m_pvs;
+	bool m_usePvs = false;
+
+	// Software occlusion culling of the frustum culled items. Occluder meshes are
+	// looked up by geometry and start index of the submesh they were built from.
+	OcclusionCuller m_occlusionCuller;
+	bool m_useOcclusion = true;
+	unordered_map<uint64_t, uint32_t> m_occluderMeshes;
+	vector<pair<float, uint32_t>> m_occluderCandidates;
+
+	// Level of detail of the items with several levels, picked every frame from
+	// their size on screen. '+' and '-' scale the bias.
+	LodSelector m_lodSelector;
+	vector<uint32_t> m_lodChanges;
+	uint32_t m_sphereLods = LodSelector::NoGroup;
+
+	// Draw order of the visible items.
+	RenderQueue m_renderQueue;
+
+	// Items sharing a submesh are drawn with one instanced draw unless
+	// m_useInstancing is toggled off.
+	InstanceBatcher m_instanceBatcher;
+	bool m_useInstancing = true;
+
+	// In indirect mode ('X') the visible items are packed into an argument buffer
+	// and a per-draw data buffer in the upload ring, and drawn with one
+	// ExecuteIndirect per run of items sharing a geometry.
+	IndirectDrawPacker m_indirectPacker;
+	ComPtr<ID3D12CommandSignature> m_commandSignature;
+	UploadAllocation m_indirectArguments;
+	D3D12_GPU_VIRTUAL_ADDRESS m_indirectDataAddress = 0;
+	bool m_useIndirect = false;
+
+	// Static scenery merged into world space meshes per cluster, with proxies for
+	// far clusters. Drawn from one geometry with an identity object ('G' toggles).
+	StaticBatcher m_staticBatcher;
+	vector<HlodDraw> m_staticDraws;
+	UINT m_staticGeometry = 0;
+	D3D12_GPU_VIRTUAL_ADDRESS m_staticObjectAddress = 0;
+	bool m_drawStatic = true;
+
+	// Result of the last action taken with a key, shown in the window caption.
+	wstring m_statusText;
+
+	// Scene file named on the command line, loaded in place of the built-in scene.
+	string m_scenePath;
+
+	// Scene draws are recorded in parallel into the worker command lists of the
+	// frame resource, one backend per list. Every chunk recorder drops redundant
+	// state changes.
+	ParallelRecorder m_parallelRecorder;
+	vector<D3D12CommandBackend> m_workerBackends;
+	vector<ID3D12CommandList*> m_submitLists;
+
+	// Slot of the item under the cursor after the last right click.
+	uint32_t m_pickedSlot = UINT32_MAX;
 
 	PassConstants m_mainPassCB;
 
-	UINT m_passCbvOffset = 0;
+	// Per-frame memory: the pass constants and the instance stream are written
+	// into the ring every frame, and given back once the frame's fence completes.
+	unique_ptr<UploadRing> m_uploadRing;
+	D3D12_GPU_VIRTUAL_ADDRESS m_passCBAddress = 0;
+	D3D12_GPU_VIRTUAL_ADDRESS m_instanceBufferAddress = 0;
+
+	// The frame's jobs allocate from the ring without waiting for the GPU. A step
+	// that found the ring full sets its bit and Update runs it again once older
+	// frames have given their memory back.
+	enum UploadStep : uint32_t
+	{
+		UploadPassConstants = 1,
+		UploadStaticObject = 2,
+		UploadInstances = 4,
+		UploadIndirectDraws = 8
+	};
+	atomic<uint32_t> m_failedUploads{ 0 };
 
 	Camera m_Camera;
 
@@ -110,7 +395,12 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE prevInstance, PSTR cmdLine, in
 {
 	try
 	{
-		MyEngine theApp(hInstance);
+		// The command line is an optional scene file, possibly quoted.
+		string scenePath = cmdLine;
+		scenePath.erase(0, scenePath.find_first_not_of(" \""));
+		scenePath.erase(scenePath.find_last_not_of(" \"") + 1);
+
+		MyEngine theApp(hInstance, scenePath);
 		if (!theApp.Initialize())
 			return 0;
 
@@ -123,12 +413,16 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE prevInstance, PSTR cmdLine, in
 	}
 }
 
-MyEngine::MyEngine(HINSTANCE hInstance) : GraphicEngine(hInstance)
+MyEngine::MyEngine(HINSTANCE hInstance, const string& scenePath) : GraphicEngine(hInstance), m_scene(gNumFrameResources), m_scenePath(scenePath)
 {
 }
 
 MyEngine::~MyEngine()
 {
+	if (m_geometryLoader.joinable())
+		m_geometryLoader.join();
+	StopWorldLoader();
+
 	if (md3dDevice != nullptr)
 		FlushCommandQueue();
 }
@@ -144,13 +438,14 @@ bool MyEngine::Initialize()
 	m_Camera.SetPosition(0.0f, 5.0f, -30.0f);
 
 	BuildRootSignature();
+	BuildCommandSignature();
 	BuildShaders();
 	BuildInputLayout();
 	BuildShapeGeometry();
+	BuildStaticScenery();
 	BuildRenderItems();
+	m_bvh.Rebuild();
 	BuildFrameResources();
-	BuildDescriptorHeaps();
-	BuildConstantBufferViews();
 	BuildPSO();
 
 	// Execute the initialization commands.
@@ -182,16 +477,68 @@ void MyEngine::Update(const Timer& m_timer)
 
 	// Has the GPU finished processing the commands of the current frame resource?
 	// If not, wait until the GPU has completed commands up to this fence point.
-	if (m_currentResource->Fence != 0 && mFence->GetCompletedValue() < m_currentResource->Fence)
+	WaitForFence(m_currentResource->Fence);
+
+	// Give back the ring memory, object slots and replaced buffers of every frame
+	// the GPU is done with.
+	UINT64 completedFence = mFence->GetCompletedValue();
+	m_uploadRing->Reclaim(completedFence);
+	m_scene.Reclaim(completedFence);
+	m_geometries.Reclaim(completedFence);
+	while (!m_retiredResources.empty() && m_retiredResources.front().Fence <= completedFence)
+		m_retiredResources.pop_front();
+
+	if (m_streaming)
+		StreamRenderItems();
+
+	if (m_geometryLoader.joinable() && m_geometryLoadDone)
 	{
-		HANDLE eventHandle = CreateEventEx(nullptr, false, false, EVENT_ALL_ACCESS);
-		ThrowIfFailed(mFence->SetEventOnCompletion(m_currentResource->Fence, eventHandle));
-		WaitForSingleObject(eventHandle, INFINITE);
-		CloseHandle(eventHandle);
+		m_geometryLoader.join();
+		PlaceLoadedGeometry();
 	}
 
-	UpdateObjectCBs();
-	UpdateMainPassCB(m_timer);
+	if (m_streamWorld)
+		StreamWorldCells(m_timer);
+
+	MoveDynamicItems(m_timer);
+	m_hierarchy.Update([this](RenderItemHandle item, const XMFLOAT3X4& world) { SetRenderItemWorld(item, world); });
+
+	if (m_scene.SlotCount() > m_objectCapacity)
+		GrowObjectCapacity();
+
+	// The constant uploads and the visibility chain read the scene without writing
+	// it, so they run side by side. The level of detail selection rewrites the draw
+	// arguments occlusion culling reads, so culling waits for it, and sorting waits
+	// for culling through its counter.
+	JobSystem& jobs = JobSystem::Get();
+	JobCounter uploaded, selected, culled, sorted;
+
+	jobs.Run("UpdateObjectBuffer", [this]() { UpdateObjectBuffer(); }, &uploaded);
+	jobs.Run("UpdateMainPassCB", [this, &m_timer]() { UpdateMainPassCB(m_timer); }, &uploaded);
+	if (m_drawStatic)
+		jobs.Run("SelectStaticBatches", [this]() { SelectStaticBatches(); }, &uploaded);
+	jobs.Run("SelectLods", [this]() { SelectLods(); }, &selected);
+	jobs.Run("CullRenderItems", [this]()
+	{
+		if (m_useBvh)
+			m_bvh.Tick();
+		CullRenderItems();
+	}, &culled, &selected);
+	jobs.Run("SortRenderItems", [this]()
+	{
+		SortRenderItems();
+		m_lodSelector.CountTriangles(m_drawList, m_scene.DrawKeys(), m_scene.LodGroups());
+
+		if (m_useIndirect)
+			PackIndirectDraws();
+		else if (m_useInstancing)
+			BuildInstances();
+	}, &sorted, &culled);
+
+	jobs.Wait(&uploaded);
+	jobs.Wait(&sorted);
+
+	RetryFailedUploads(m_timer);
 }
 
 void MyEngine::Draw(const Timer& m_timer)
@@ -204,11 +551,8 @@ void MyEngine::Draw(const Timer& m_timer)
 
 	// A command list can be reset after it has been added to the command queue via ExecuteCommandList.
 	// Reusing the command list reuses memory.
-	ThrowIfFailed(mCommandList->Reset(cmdListAlloc.Get(), m_PSO.Get()));
-
-
-	mCommandList->RSSetViewports(1, &mScreenViewport);
-	mCommandList->RSSetScissorRects(1, &mScissorRect);
+	// The main list only clears the targets, the scene goes into the worker lists.
+	ThrowIfFailed(mCommandList->Reset(cmdListAlloc.Get(), nullptr));
 
 	// Indicate a state transition on the resource usage.
 	mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(CurrentBackBuffer(), D3D12_RESOURCE_STATE_PRESENT, D3D12_RESOURCE_STATE_RENDER_TARGET));
@@ -217,30 +561,73 @@ void MyEngine::Draw(const Timer& m_timer)
 	mCommandList->ClearRenderTargetView(CurrentBackBufferView(), Colors::LightGray, 0, nullptr);
 	mCommandList->ClearDepthStencilView(DepthStencilView(), D3D12_CLEAR_FLAG_DEPTH | D3D12_CLEAR_FLAG_STENCIL, 1.0f, 0, 0, nullptr);
 
-	// Specify the buffers we are going to render to.
-	mCommandList->OMSetRenderTargets(1, &CurrentBackBufferView(), true, &DepthStencilView());
-
-	ID3D12DescriptorHeap* descriptorHeaps[] = { m_cbvHeap.Get() };
-	mCommandList->SetDescriptorHeaps(_countof(descriptorHeaps), descriptorHeaps);
-
-	mCommandList->SetGraphicsRootSignature(m_rootSignature.Get());
-
-	int passCbvIndex = m_passCbvOffset + m_currentResourceIndex;
-	auto passCbvHandle = CD3DX12_GPU_DESCRIPTOR_HANDLE(m_cbvHeap->GetGPUDescriptorHandleForHeapStart());
-	passCbvHandle.Offset(passCbvIndex, mCbvSrvUavDescriptorSize);
-	mCommandList->SetGraphicsRootDescriptorTable(1, passCbvHandle);
+	ThrowIfFailed(mCommandList->Close());
 
-	DrawRenderItems(mCommandList.Get(), m_opaqueRenderItems);
+	// Split the draws over the worker command lists of this frame resource.
+	const vector<uint32_t>& sortedItems = m_renderQueue.GetSortedItems();
+	uint32_t drawCount = (uint32_t)sortedItems.size();
+	if (m_useIndirect)
+		drawCount = (uint32_t)m_indirectPacker.GetBatches().size();
+	else if (m_useInstancing)
+		drawCount = (uint32_t)m_instanceBatcher.GetBatches().size();
+	m_parallelRecorder.Plan(drawCount, (uint32_t)m_currentResource->WorkerCmdLists.size(), gMinDrawsPerRecordingThread);
+
+	const uint32_t lastChunk = (uint32_t)m_parallelRecorder.GetChunks().size() - 1;
+	const D3D12_GPU_VIRTUAL_ADDRESS objectBufferAddress = m_currentResource->ObjectBuffer->GetUploadBuffer()->GetGPUVirtualAddress();
+	const D3D12_CPU_DESCRIPTOR_HANDLE backBufferView = CurrentBackBufferView();
+	const D3D12_CPU_DESCRIPTOR_HANDLE depthStencilView = DepthStencilView();
+
+	m_parallelRecorder.Record(
+		[&](uint32_t chunk) -> CommandBackend*
+		{
+			ID3D12CommandAllocator* alloc = m_currentResource->WorkerCmdListAllocs[chunk].Get();
+			ID3D12GraphicsCommandList* cmdList = m_currentResource->WorkerCmdLists[chunk].Get();
+			ThrowIfFailed(alloc->Reset());
+			ThrowIfFailed(cmdList->Reset(alloc, nullptr));
+
+			// Command lists inherit no state from the lists submitted before them.
+			cmdList->RSSetViewports(1, &mScreenViewport);
+			cmdList->RSSetScissorRects(1, &mScissorRect);
+			cmdList->OMSetRenderTargets(1, &backBufferView, true, &depthStencilView);
+
+			cmdList->SetGraphicsRootSignature(m_rootSignature.Get());
+
+			m_workerBackends[chunk].SetCommandList(cmdList);
+			return &m_workerBackends[chunk];
+		},
+		[&](uint32_t chunk, CommandRecorder& recorder, uint32_t begin, uint32_t end)
+		{
+			recorder.SetRootConstantBufferView(1, m_passCBAddress);
+			recorder.SetRootShaderResourceView(2, objectBufferAddress);
+
+			if (m_useIndirect)
+				DrawIndirectBatches(recorder, begin, end);
+			else if (m_useInstancing)
+				DrawInstanceBatches(recorder, begin, end);
+			else
+				DrawRenderItems(recorder, sortedItems, begin, end);
+
+			if (chunk == lastChunk && m_drawStatic)
+				DrawStaticBatches(recorder);
+		},
+		[&](uint32_t chunk)
+		{
+			ID3D12GraphicsCommandList* cmdList = m_currentResource->WorkerCmdLists[chunk].Get();
 
-	// Indicate a state transition on the resource usage.
-	mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(CurrentBackBuffer(), D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_PRESENT));
+			// Indicate a state transition on the resource usage.
+			if (chunk == lastChunk)
+				cmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(CurrentBackBuffer(), D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_PRESENT));
 
-	// Done recording commands.
-	ThrowIfFailed(mCommandList->Close());
+			// Done recording commands.
+			ThrowIfFailed(cmdList->Close());
+		});
 
-	// Add the command list to the queue for execution.
-	ID3D12CommandList* cmdsLists[] = { mCommandList.Get() };
-	mCommandQueue->ExecuteCommandLists(_countof(cmdsLists), cmdsLists);
+	// Add the command lists to the queue for execution, in draw order after the clear.
+	m_submitLists.clear();
+	m_submitLists.push_back(mCommandList.Get());
+	for (uint32_t c = 0; c <= lastChunk; ++c)
+		m_submitLists.push_back(m_currentResource->WorkerCmdLists[c].Get());
+	mCommandQueue->ExecuteCommandLists((UINT)m_submitLists.size(), m_submitLists.data());
 
 	// Swap the back and front buffers
 	ThrowIfFailed(mSwapChain->Present(0, 0));
@@ -253,35 +640,106 @@ void MyEngine::Draw(const Timer& m_timer)
 	// Because we are on the GPU timeline, the new fence point won't be 
 	// set until the GPU finishes processing all the commands prior to this Signal().
 	mCommandQueue->Signal(mFence.Get(), mCurrentFence);
+
+	// Everything allocated from the ring, and the slots and geometries removed
+	// this frame, are free once the fence passes.
+	m_uploadRing->FinishFrame(mCurrentFence);
+	m_scene.FinishFrame(mCurrentFence);
+	m_geometries.FinishFrame(mCurrentFence);
 }
 
-void MyEngine::UpdateObjectCBs()
+bool MyEngine::AllocateUpload(UINT64 size, UINT64 alignment, uint32_t step, UploadAllocation& allocation)
 {
+	// Called from jobs, so a full ring is only reported; reclaiming is left to
+	// the main thread.
+	if (m_uploadRing->Allocate(size, alignment, allocation))
+		return true;
 
-	//std::wstring text = L"/////// NON ANCORA CAMBIATO\n";
-	//::OutputDebugString(text.c_str());
+	m_failedUploads.fetch_or(step);
+	return false;
+}
 
-	auto currObjectCB = m_currentResource->ObjectCB.get();
-	for (auto& e : m_renderItems)
+void MyEngine::RetryFailedUploads(const Timer& timer)
+{
+	// The jobs have finished. While a step did not fit, wait for the oldest
+	// frame still reading the ring and run the step again.
+	uint32_t failed;
+	while ((failed = m_failedUploads.exchange(0)) != 0)
 	{
-		// Only update the cbuffer data if the constants have changed.  
-		// This needs to be tracked per frame resource.
-		if (e->NumFramesDirty > 0)
-		{
-			XMMATRIX world = XMLoadFloat4x4(&e->World);
+		UINT64 oldestFence = m_uploadRing->OldestFence();
+
+		// This frame alone does not fit.
+		if (oldestFence == 0)
+			ThrowIfFailed(E_OUTOFMEMORY);
+
+		WaitForFence(oldestFence);
+		m_uploadRing->Reclaim(mFence->GetCompletedValue());
+
+		if (failed & UploadPassConstants)
+			UpdateMainPassCB(timer);
+		if (failed & UploadStaticObject)
+			SelectStaticBatches();
+		if (failed & UploadInstances)
+			BuildInstances();
+		if (failed & UploadIndirectDraws)
+			PackIndirectDraws();
+	}
+}
+
+void MyEngine::WaitForFence(UINT64 fenceValue)
+{
+	// Has the GPU finished processing the commands up to this fence point?
+	// If not, wait until it has.
+	if (fenceValue != 0 && mFence->GetCompletedValue() < fenceValue)
+	{
+		HANDLE eventHandle = CreateEventEx(nullptr, false, false, EVENT_ALL_ACCESS);
+		ThrowIfFailed(mFence->SetEventOnCompletion(fenceValue, eventHandle));
+		WaitForSingleObject(eventHandle, INFINITE);
+		CloseHandle(eventHandle);
+	}
+}
+
+void MyEngine::UpdateObjectBuffer()
+{
+	auto currObjectBuffer = m_currentResource->ObjectBuffer.get();
+
+	// Only the slots changed since this frame resource was last uploaded are
+	// visited, so static items cost nothing.
+	const vector<uint32_t>& dirtySlots = m_scene.DirtySlots(m_currentResourceIndex);
+	const XMFLOAT3X4* worlds = m_scene.Worlds();
+	const XMFLOAT4* colors = m_scene.Colors();
+	const SceneStore& scene = m_scene;
 
-			ObjectConstants objConstants;
-			XMStoreFloat4x4(&objConstants.World, DirectX::XMMatrixTranspose(world));
+	atomic<uint32_t> uploaded(0);
 
-			currObjectCB->CopyData(e->ObjCBIndex, objConstants);
+	// Slots are listed once, so the chunks write disjoint constants.
+	ParallelFor((uint32_t)dirtySlots.size(), 4096, [&](uint32_t begin, uint32_t end)
+	{
+		uint32_t chunkUploaded = 0;
+		for (uint32_t i = begin; i < end; ++i)
+		{
+			uint32_t slot = dirtySlots[i];
+			uint32_t denseIndex = scene.SlotToDense(slot);
 
-			// Next FrameResource need to be updated too.
-			e->NumFramesDirty--;
+			// Removed since it was flagged.
+			if (denseIndex == UINT32_MAX)
+				continue;
 
-			//std::wstring text2 = L"/////// CAMBIATO\n";
-			//::OutputDebugString(text2.c_str());
+			// Worlds are kept in the layout the shader reads, no transpose needed.
+			ObjectData objData;
+			objData.World = worlds[denseIndex];
+			objData.Color = colors[denseIndex];
+
+			currObjectBuffer->CopyData(slot, objData);
+			chunkUploaded++;
 		}
-	}
+		uploaded += chunkUploaded;
+	});
+
+	m_scene.ClearDirty(m_currentResourceIndex);
+
+	m_uploadedObjects = uploaded;
+	m_uploadedBytes = (uint64_t)uploaded*sizeof(ObjectData);
 }
 
 void MyEngine::UpdateMainPassCB(const Timer& m_timer)
@@ -317,99 +775,526 @@ void MyEngine::UpdateMainPassCB(const Timer& m_timer)
 	m_mainPassCB.FalloffEnd = 15.0f;
 	m_mainPassCB.Position = { 0.0f, 2.5f, 0.0f };
 
-	auto currPassCB = m_currentResource->PassCB.get();
-	currPassCB->CopyData(0, m_mainPassCB);
+	UploadAllocation passCB;
+	if (!AllocateUpload(sizeof(PassConstants), D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT, UploadPassConstants, passCB))
+		return;
+
+	memcpy(passCB.CpuAddress, &m_mainPassCB, sizeof(PassConstants));
+	m_passCBAddress = passCB.GpuAddress;
 }
 
-void MyEngine::BuildDescriptorHeaps()
+void MyEngine::CullRenderItems()
 {
-	UINT objCount = (UINT)m_opaqueRenderItems.size();
+	// Only the items intersecting the camera frustum reach the draw list.
+	XMFLOAT4 planes[6];
+	m_Camera.GetFrustumPlanes(planes);
 
-	// Need a CBV descriptor for each object for each frame resource,
-	// +1 for the perPass CBV for each frame resource.
-	UINT numDescriptors = (objCount + 1) * gNumFrameResources;
+	if (m_usePvs)
+	{
+		m_pvs.Cull(m_Camera.GetPosition(), planes, m_scene.WorldBounds(), m_scene.Size(), m_drawList);
+	}
+	else if (m_useVisibilityCache)
+	{
+		m_visibilityCache.Cull(planes, m_Camera.GetPosition(), m_scene.WorldBounds(), m_scene.Size(), m_drawList);
+	}
+	else if (m_useBvh)
+	{
+		m_visibleSlots.clear();
+		m_bvh.QueryFrustum(planes, m_visibleSlots);
 
-	// Save an offset to the start of the pass CBVs.  These are the last 3 descriptors.
-	m_passCbvOffset = objCount * gNumFrameResources;
+		m_drawList.resize(m_visibleSlots.size());
+		for (size_t i = 0; i < m_visibleSlots.size(); ++i)
+			m_drawList[i] = m_scene.SlotToDense(m_visibleSlots[i]);
+	}
+	else
+	{
+		m_frustumCuller.SetPlanes(planes);
+		m_frustumCuller.Cull(m_scene.WorldBounds(), m_scene.Size(), m_drawList);
+	}
 
-	D3D12_DESCRIPTOR_HEAP_DESC cbvHeapDesc;
-	cbvHeapDesc.NumDescriptors = numDescriptors;
-	cbvHeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
-	cbvHeapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE;
-	cbvHeapDesc.NodeMask = 0;
-	ThrowIfFailed(md3dDevice->CreateDescriptorHeap(&cbvHeapDesc, IID_PPV_ARGS(&m_cbvHeap)));
+	if (m_useOcclusion)
+		OcclusionCullRenderItems();
 }
 
-void MyEngine::BuildConstantBufferViews()
+void MyEngine::OcclusionCullRenderItems()
 {
-	UINT objCBByteSize = Util::CalcConstantBufferByteSize(sizeof(ObjectConstants));
+	const UINT maxOccluders = 32;
+	const float minOccluderSize = 0.05f;
+
+	XMFLOAT4X4 viewProj;
+	XMStoreFloat4x4(&viewProj, XMMatrixMultiply(m_Camera.GetView(), m_Camera.GetProj()));
+	m_occlusionCuller.BeginFrame(viewProj);
+
+	// Rank the visible items that have an occluder mesh by their bounding radius
+	// over their distance, and rasterize the ones covering the most screen.
+	const DrawKey* drawKeys = m_scene.DrawKeys();
+	const BoundsSoA& bounds = m_scene.WorldBounds();
+	XMFLOAT3 eyePos = m_Camera.GetPosition();
+	XMVECTOR eye = XMLoadFloat3(&eyePos);
+
+	m_occluderCandidates.clear();
+	for (uint32_t i : m_drawList)
+	{
+		uint64_t key = ((uint64_t)drawKeys[i].Geometry << 32) | drawKeys[i].StartIndexLocation;
+		if (m_occluderMeshes.find(key) == m_occluderMeshes.end())
+			continue;
+
+		XMVECTOR center = XMVectorSet(bounds.CenterX[i], bounds.CenterY[i], bounds.CenterZ[i], 0.0f);
+		XMVECTOR extents = XMVectorSet(bounds.ExtentX[i], bounds.ExtentY[i], bounds.ExtentZ[i], 0.0f);
+		float radius = XMVectorGetX(XMVector3Length(extents));
+		float distance = max(XMVectorGetX(XMVector3Length(XMVectorSubtract(center, eye))), m_Camera.GetNearZ());
+
+		float size = radius / distance;
+		if (size > minOccluderSize)
+			m_occluderCandidates.push_back(make_pair(size, i));
+	}
 
-	UINT objCount = (UINT)m_opaqueRenderItems.size();
+	UINT occluderCount = min(maxOccluders, (UINT)m_occluderCandidates.size());
+	partial_sort(m_occluderCandidates.begin(), m_occluderCandidates.begin() + occluderCount, m_occluderCandidates.end(),
+		[](const pair<float, uint32_t>& a, const pair<float, uint32_t>& b) { return a.first > b.first; });
 
-	// Need a CBV descriptor for each object for each frame resource.
-	for (int frameIndex = 0; frameIndex < gNumFrameResources; ++frameIndex)
+	const XMFLOAT3X4* worlds = m_scene.Worlds();
+	for (UINT i = 0; i < occluderCount; ++i)
 	{
-		auto objectCB = m_resources[frameIndex]->ObjectCB->GetUploadBuffer();
-		for (UINT i = 0; i < objCount; ++i)
-		{
-			D3D12_GPU_VIRTUAL_ADDRESS cbAddress = objectCB->GetGPUVirtualAddress();
+		uint32_t item = m_occluderCandidates[i].second;
+		uint64_t key = ((uint64_t)drawKeys[item].Geometry << 32) | drawKeys[item].StartIndexLocation;
+		m_occlusionCuller.AddOccluder(m_occluderMeshes[key], worlds[item]);
+	}
+
+	m_occlusionCuller.RasterizeOccluders();
+	m_occlusionCuller.CullOccludees(bounds, m_drawList);
+}
+
+void MyEngine::SelectLods()
+{
+	m_lodSelector.Select(m_scene.WorldBounds(), m_scene.LodGroups(), m_scene.LodLevels(), m_scene.Size(),
+		m_Camera.GetPosition(), m_Camera.GetFovY(), (float)mClientHeight, m_lodChanges);
+
+	// Point the items that changed level at the submesh of their new level.
+	const uint32_t* groups = m_scene.LodGroups();
+	const uint8_t* levels = m_scene.LodLevels();
+	for (uint32_t item : m_lodChanges)
+	{
+		const LodLevel& level = m_lodSelector.GetGroup(groups[item]).Levels[levels[item]];
+		m_scene.SetDrawArgs(item, level.IndexCount, level.StartIndexLocation, level.BaseVertexLocation);
+	}
+}
+
+void MyEngine::SortRenderItems()
+{
+	// Group the visible items by state and draw each group front to back.
+	m_renderQueue.Build(m_drawList, m_scene.DrawKeys(), m_scene.WorldBounds(),
+		m_Camera.GetPosition(), m_Camera.GetLook(), m_Camera.GetNearZ(), m_Camera.GetFarZ());
+	m_renderQueue.Sort();
+}
+
+void MyEngine::BuildInstances()
+{
+	m_instanceBatcher.Build(m_renderQueue.GetSortedItems(), m_scene.DrawKeys(), m_scene.Worlds(), m_scene.Colors());
+
+	const vector<InstanceData>& instances = m_instanceBatcher.GetInstances();
+	if (!instances.empty())
+	{
+		UINT64 byteSize = sizeof(InstanceData)*instances.size();
+		UploadAllocation instanceBuffer;
+		if (!AllocateUpload(byteSize, 16, UploadInstances, instanceBuffer))
+			return;
+
+		memcpy(instanceBuffer.CpuAddress, instances.data(), byteSize);
+		m_instanceBufferAddress = instanceBuffer.GpuAddress;
+	}
+}
+
+void MyEngine::PackIndirectDraws()
+{
+	static_assert(sizeof(IndirectDrawData) == sizeof(ObjectData), "IndirectDrawData must match ObjectData");
+
+	const vector<uint32_t>& items = m_renderQueue.GetSortedItems();
+
+	// Both buffers live in the ring for this frame only; the object index of
+	// every command is its position, so the data does not go through the slots.
+	UploadAllocation drawData;
+	if (!items.empty())
+	{
+		if (!AllocateUpload(sizeof(IndirectCommand)*items.size(), sizeof(uint32_t), UploadIndirectDraws, m_indirectArguments) ||
+			!AllocateUpload(sizeof(IndirectDrawData)*items.size(), 16, UploadIndirectDraws, drawData))
+			return;
+	}
+
+	m_indirectPacker.Pack(items, m_scene.DrawKeys(), m_scene.Worlds(), m_scene.Colors(),
+		(IndirectCommand*)m_indirectArguments.CpuAddress, (IndirectDrawData*)drawData.CpuAddress);
+	m_indirectDataAddress = drawData.GpuAddress;
+}
+
+void MyEngine::AddStressScene()
+{
+	// Boxes, pyramids, grids and spheres, a quarter of the stacks dynamic and
+	// stacks three deep. Every press adds another scene with the next seed.
+	if (m_stressSeed == gStressSceneSeed)
+	{
+		const MeshGeometry* shapes = GetGeometry(m_streamGeometry);
+		for (const char* submesh : { "box", "pyr", "grid", "sphere0" })
+			m_stressScene.AddMesh(shapes->Name, submesh, shapes->DrawArgs.At(StringTable::Get().Intern(submesh)).Bounds);
+
+		m_stressScene.SetSpacing(4.0f);
+		m_stressScene.SetClusters(64, 24.0f);
+		m_stressScene.SetDynamicFraction(0.25f);
+		m_stressScene.SetHierarchyDepth(3);
+	}
+
+	uint32_t seed = m_stressSeed++;
+	bool clustered = (seed - gStressSceneSeed) % 2 == 1;
+	m_stressScene.SetDistribution(clustered ? StressDistribution::Clustered : StressDistribution::PoissonDisk);
+
+	SceneFileContents scene;
+	m_stressScene.Generate(gStressSceneItems, seed, scene);
+
+	auto start = chrono::high_resolution_clock::now();
+	AddScene(scene);
+	auto end = chrono::high_resolution_clock::now();
+	double addMilliseconds = chrono::duration<double, milli>(end - start).count();
+
+	const StressSceneStats& stats = m_stressScene.GetStats();
+	m_statusText = L"    stress scene " + to_wstring(seed) + (clustered ? L" (clustered): " : L" (poisson): ") + to_wstring(stats.Items) +
+		L" items, " + to_wstring(stats.DynamicItems) + L" dynamic, " + to_wstring((int)stats.Extent) + L" m wide, generate ms: " +
+		to_wstring((int)stats.GenerateMilliseconds) + L", add ms: " + to_wstring((int)addMilliseconds) + L", scene: " + to_wstring(m_scene.Size());
+}
+
+void MyEngine::BuildPvs()
+{
+	// The grid covers the scene as it is now. Boxes of the shapes geometry that
+	// are not rotated fill their bounds, so they are the occluders rays stop at.
+	const BoundsSoA& bounds = m_scene.WorldBounds();
+	const DrawKey* drawKeys = m_scene.DrawKeys();
+	const XMFLOAT3X4* worlds = m_scene.Worlds();
+	const uint32_t count = m_scene.Size();
+
+	const SubmeshGeometry& box = GetGeometry(m_streamGeometry)->DrawArgs.At(STRING_ID("box"));
+
+	XMFLOAT3 lo(0.0f, 0.0f, 0.0f);
+	XMFLOAT3 hi(0.0f, 0.0f, 0.0f);
+	vector<uint8_t> occluders(count, 0);
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		XMFLOAT3 itemLo(bounds.CenterX[i] - bounds.ExtentX[i], bounds.CenterY[i] - bounds.ExtentY[i], bounds.CenterZ[i] - bounds.ExtentZ[i]);
+		XMFLOAT3 itemHi(bounds.CenterX[i] + bounds.ExtentX[i], bounds.CenterY[i] + bounds.ExtentY[i], bounds.CenterZ[i] + bounds.ExtentZ[i]);
+		lo = i == 0 ? itemLo : XMFLOAT3(min(lo.x, itemLo.x), min(lo.y, itemLo.y), min(lo.z, itemLo.z));
+		hi = i == 0 ? itemHi : XMFLOAT3(max(hi.x, itemHi.x), max(hi.y, itemHi.y), max(hi.z, itemHi.z));
+
+		if (drawKeys[i].Geometry != m_streamGeometry || drawKeys[i].StartIndexLocation != box.StartIndexLocation)
+			continue;
+
+		// At most one axis feeds each world axis: scaled and mirrored, not rotated.
+		bool axisAligned = true;
+		for (int r = 0; r < 3; ++r)
+			axisAligned = axisAligned && (worlds[i].m[r][0] != 0.0f) + (worlds[i].m[r][1] != 0.0f) + (worlds[i].m[r][2] != 0.0f) <= 1;
+		occluders[i] = axisAligned ? 1 : 0;
+	}
+
+	m_pvs.SetGrid(lo, hi, gPvsCellSize);
+	m_pvs.SetSampling(gPvsSamplePoints, gPvsRaysPerPoint);
+	m_pvs.Build(bounds, occluders.data(), count);
+
+	const PvsStats& stats = m_pvs.GetStats();
+	m_statusText = L"    pvs: " + to_wstring(stats.Cells) + L" cells of " + to_wstring(m_pvs.GetCellSize()) + L" m, " +
+		to_wstring(stats.Items) + L" items, build ms: " + to_wstring((int)stats.BuildMilliseconds) + L", items per set: " +
+		to_wstring((int)stats.AverageSetSize) + L", coded KB: " + to_wstring(stats.EncodedBytes / 1024);
+}
+
+void MyEngine::ToggleWorldStreaming()
+{
+	if (!m_streamWorld)
+	{
+		// The grid is centered on the origin.
+		float side = gWorldCellsPerSide*gWorldCellSize;
+		m_worldPartition.SetGrid(XMFLOAT2(-0.5f*side, -0.5f*side), gWorldCellSize, gWorldCellsPerSide, gWorldCellsPerSide);
+		m_worldPartition.SetRadii(gWorldLoadRadius, gWorldUnloadRadius);
+		m_worldPartition.SetMemoryBudget(gWorldMemoryBudget);
+		// A cell that never loaded is taken for 128 KB, a little over what one weighs.
+		m_worldPartition.SetCellEstimate(128 << 10);
+		m_worldPartition.SetPrefetchTime(gWorldPrefetchSeconds);
+		m_worldPartition.SetMaxLoadsInFlight(gWorldMaxLoadsInFlight);
+
+		// Cell files are kept out of the working directory.
+		char temp[MAX_PATH + 1];
+		DWORD length = GetTempPathA(MAX_PATH + 1, temp);
+		m_worldCachePath = string(temp, length) + gWorldCacheDirectory + "\\";
+		CreateDirectoryA(m_worldCachePath.c_str(), nullptr);
+
+		m_worldCells.resize(m_worldPartition.GetCellCount());
+		m_worldLoader = thread([this]() { WorldLoaderLoop(); });
+		m_streamWorld = true;
+		return;
+	}
+
+	// Loads in flight are finished and dropped with the rest.
+	StopWorldLoader();
+
+	for (uint32_t cell = 0; cell < (uint32_t)m_worldCells.size(); ++cell)
+		UnloadWorldCell(cell);
+
+	m_streamWorld = false;
+}
+
+void MyEngine::StreamWorldCells(const Timer& timer)
+{
+	m_worldPartition.Update(m_Camera.GetPosition(), timer.DTime(), m_worldCellLoads, m_worldCellUnloads);
+
+	for (uint32_t cell : m_worldCellUnloads)
+		UnloadWorldCell(cell);
 
-			// Offset to the ith object constant buffer in the buffer.
-			cbAddress += i*objCBByteSize;
+	vector<pair<uint32_t, unique_ptr<WorldCell>>> loaded;
+	{
+		lock_guard<mutex> lock(m_worldLoaderMutex);
+		m_worldLoadQueue.insert(m_worldLoadQueue.end(), m_worldCellLoads.begin(), m_worldCellLoads.end());
+		loaded.swap(m_worldLoaded);
+	}
+	if (!m_worldCellLoads.empty())
+		m_worldLoaderWake.notify_one();
+
+	for (pair<uint32_t, unique_ptr<WorldCell>>& cell : loaded)
+	{
+		m_worldCells[cell.first] = move(cell.second);
+		PlaceWorldCell(cell.first);
+	}
+}
+
+void MyEngine::StopWorldLoader()
+{
+	if (!m_worldLoader.joinable())
+		return;
 
-			// Offset to the object cbv in the descriptor heap.
-			int heapIndex = frameIndex*objCount + i;
-			auto handle = CD3DX12_CPU_DESCRIPTOR_HANDLE(m_cbvHeap->GetCPUDescriptorHandleForHeapStart());
-			handle.Offset(heapIndex, mCbvSrvUavDescriptorSize);
+	{
+		lock_guard<mutex> lock(m_worldLoaderMutex);
+		m_worldLoaderQuit = true;
+	}
+	m_worldLoaderWake.notify_one();
+	m_worldLoader.join();
+
+	// The cells still queued are forgotten, the ones built are released.
+	m_worldLoaderQuit = false;
+	m_worldLoadQueue.clear();
+	for (pair<uint32_t, unique_ptr<WorldCell>>& loaded : m_worldLoaded)
+		m_geometries.Release(loaded.second->Geometry);
+	m_worldLoaded.clear();
+}
+
+void MyEngine::WorldLoaderLoop()
+{
+	unique_lock<mutex> lock(m_worldLoaderMutex);
+	for (;;)
+	{
+		m_worldLoaderWake.wait(lock, [this]() { return m_worldLoaderQuit || !m_worldLoadQueue.empty(); });
+		if (m_worldLoaderQuit)
+			return;
 
-			D3D12_CONSTANT_BUFFER_VIEW_DESC cbvDesc;
-			cbvDesc.BufferLocation = cbAddress;
-			cbvDesc.SizeInBytes = objCBByteSize;
+		uint32_t cell = m_worldLoadQueue.front();
+		m_worldLoadQueue.pop_front();
+		lock.unlock();
 
-			md3dDevice->CreateConstantBufferView(&cbvDesc, handle);
+		// A cell whose buffers could not be created is handed over empty, so the
+		// partition still sees it finish.
+		try
+		{
+			LoadWorldCell(cell);
+		}
+		catch (DxException&)
+		{
+			lock_guard<mutex> failedLock(m_worldLoaderMutex);
+			m_worldLoaded.push_back(make_pair(cell, make_unique<WorldCell>()));
 		}
+
+		lock.lock();
 	}
+}
+
+void MyEngine::LoadWorldCell(uint32_t cell)
+{
+	// Runs on the loader thread. The grid does not change while cells load.
+
+	// The cell's own mesh, a rock built from the cell index: a sphere with its
+	// radius swelled by a few waves, so every cell has a different one.
+	mt19937 random(cell);
+	float waves[6];
+	for (float& wave : waves)
+		wave = (random() >> 8) / 16777216.0f;
 
-	UINT passCBByteSize = Util::CalcConstantBufferByteSize(sizeof(PassConstants));
+	ObjectBuilder geoGen;
+	ObjectBuilder::MeshData rock = geoGen.CreateSphere(1.0f, 12, 8);
+	XMFLOAT4 color(0.4f + 0.3f*waves[0], 0.35f + 0.2f*waves[1], 0.3f + 0.2f*waves[2], 1.0f);
 
-	// Last three descriptors are the pass CBVs for each frame resource.
-	for (int frameIndex = 0; frameIndex < gNumFrameResources; ++frameIndex)
+	vector<Vertex> vertices(rock.Vertices.size());
+	for (size_t i = 0; i < rock.Vertices.size(); ++i)
 	{
-		auto passCB = m_resources[frameIndex]->PassCB->GetUploadBuffer();
-		D3D12_GPU_VIRTUAL_ADDRESS cbAddress = passCB->GetGPUVirtualAddress();
+		XMFLOAT3 p = rock.Vertices[i].Position;
+		float radius = 1.0f + 0.2f*sinf((2.0f + 3.0f*waves[3])*p.x + 6.0f*waves[4])*cosf((2.0f + 3.0f*waves[5])*p.z) + 0.1f*p.y*waves[0];
+
+		XMStoreFloat3(&rock.Vertices[i].Position, XMVectorScale(XMLoadFloat3(&p), radius));
+		vertices[i].Pos = rock.Vertices[i].Position;
+		vertices[i].Normal = rock.Vertices[i].Normal;
+		vertices[i].Color = color;
+	}
+
+	const UINT vertexBuff_size = (UINT)vertices.size() * sizeof(Vertex);
+	const UINT indexBuff_size = (UINT)rock.Indices32.size() * sizeof(uint32_t);
+
+	// No name: the rock is only drawn by the cell's items, which know its id.
+	auto geo = make_unique<MeshGeometry>();
+	geo->VertexBufferGPU = CreateUploadHeapBuffer(vertices.data(), vertexBuff_size);
+	geo->IndexBufferGPU = CreateUploadHeapBuffer(rock.Indices32.data(), indexBuff_size);
+	geo->VertexByteStride = sizeof(Vertex);
+	geo->VertexBufferByteSize = vertexBuff_size;
+	geo->IndexFormat = DXGI_FORMAT_R32_UINT;
+	geo->IndexBufferByteSize = indexBuff_size;
+
+	SubmeshGeometry submesh;
+	submesh.IndexCount = (UINT)rock.Indices32.size();
+	BoundingBox::CreateFromPoints(submesh.Bounds, rock.Vertices.size(), &rock.Vertices[0].Position, sizeof(ObjectBuilder::Vertex));
+	geo->DrawArgs[STRING_ID("rock")] = submesh;
+
+	auto data = make_unique<WorldCell>();
+	data->Geometry = PublishGeometry(move(geo));
+
+	// The items come from the cell's file, written the first time the cell loads.
+	// A cell whose file could not be written or read stays empty.
+	string path = m_worldCachePath + "cell" + to_string(cell) + ".scene";
+	if (!data->File.Open(path) && WriteWorldCell(cell, path, submesh.Bounds))
+		data->File.Open(path);
+	if (data->File.IsOpen() && !MakeSceneRange(data->File, data->Draws, data->LodGroups, data->Range, data->Geometry))
+		data->File.Close();
 
-		// Offset to the pass cbv in the descriptor heap.
-		int heapIndex = m_passCbvOffset + frameIndex;
-		auto handle = CD3DX12_CPU_DESCRIPTOR_HANDLE(m_cbvHeap->GetCPUDescriptorHandleForHeapStart());
-		handle.Offset(heapIndex, mCbvSrvUavDescriptorSize);
+	data->Bytes = data->File.GetSize() + vertexBuff_size + indexBuff_size;
+
+	lock_guard<mutex> lock(m_worldLoaderMutex);
+	m_worldLoaded.push_back(make_pair(cell, move(data)));
+}
+
+bool MyEngine::WriteWorldCell(uint32_t cell, const string& path, const BoundingBox& rockBounds)const
+{
+	// Rocks, boxes and pyramids without hierarchy: items with nodes could not be
+	// taken out of the transform hierarchy when the cell unloads. The rock is the
+	// cell's own geometry, named by the local placeholder. The seed is the cell,
+	// so a cell comes back the same whenever its file is written.
+	StressSceneGenerator generator;
+	generator.AddMesh(gLocalGeometryName, "rock", rockBounds);
+
+	const MeshGeometry* shapes = GetGeometry(m_streamGeometry);
+	for (const char* submesh : { "box", "pyr" })
+		generator.AddMesh(shapes->Name, submesh, shapes->DrawArgs.At(StringTable::Get().Intern(submesh)).Bounds);
+
+	generator.SetSpacing(gWorldItemSpacing);
+	generator.SetMaterialCount(8);
+	generator.SetDynamicFraction(0.0f);
+	generator.SetHierarchyDepth(1);
+	SceneFileContents scene;
+	generator.Generate(gWorldItemsPerCell, cell + 1, scene);
+
+	// The generator centers the items on the origin.
+	XMFLOAT2 min, max;
+	m_worldPartition.GetCellBounds(cell, min, max);
+	XMMATRIX offset = XMMatrixTranslation(0.5f*(min.x + max.x), 0.0f, 0.5f*(min.y + max.y));
+	for (XMFLOAT3X4& world : scene.Worlds)
+		XMStoreFloat3x4(&world, XMLoadFloat3x4(&world)*offset);
+
+	return WriteSceneFile(path, scene);
+}
 
-		D3D12_CONSTANT_BUFFER_VIEW_DESC cbvDesc;
-		cbvDesc.BufferLocation = cbAddress;
-		cbvDesc.SizeInBytes = passCBByteSize;
+void MyEngine::PlaceWorldCell(uint32_t cell)
+{
+	WorldCell& data = *m_worldCells[cell];
 
-		md3dDevice->CreateConstantBufferView(&cbvDesc, handle);
+	// A cell whose geometry or file could not be made stays empty.
+	if (data.File.IsOpen())
+	{
+		uint32_t first = AddSceneItems(data.Range, data.File.Parents(), data.File.Flags());
+		for (uint32_t i = 0; i < data.Range.Count; ++i)
+			data.Items.push_back(m_scene.HandleAt(first + i));
 	}
+
+	// The scene has its own copy of the items.
+	data.File.Close();
+	data.Draws = vector<DrawKey>();
+	data.LodGroups = vector<uint32_t>();
+	data.Range = RenderItemRange();
+
+	m_worldPartition.FinishLoad(cell, data.Bytes);
 }
 
-void MyEngine::BuildRootSignature()
+void MyEngine::UnloadWorldCell(uint32_t cell)
+{
+	unique_ptr<WorldCell>& data = m_worldCells[cell];
+	if (data == nullptr)
+		return;
+
+	// As for the loaded geometry, the slots and the geometry are kept until the
+	// frames that drew them have completed.
+	for (RenderItemHandle handle : data->Items)
+		RemoveRenderItem(handle);
+	m_geometries.Release(data->Geometry);
+
+	data.reset();
+}
+
+void MyEngine::PickRenderItem(int x, int y)
 {
-	CD3DX12_DESCRIPTOR_RANGE cbv0;
-	cbv0.Init(D3D12_DESCRIPTOR_RANGE_TYPE_CBV, 1, 0);
+	// Compute the picking ray in view space.
+	XMFLOAT4X4 proj;
+	XMStoreFloat4x4(&proj, m_Camera.GetProj());
+
+	float vx = (+2.0f*x / mClientWidth - 1.0f) / proj(0, 0);
+	float vy = (-2.0f*y / mClientHeight + 1.0f) / proj(1, 1);
+
+	// Transform the ray direction to world space.
+	XMMATRIX view = m_Camera.GetView();
+	XMMATRIX invView = DirectX::XMMatrixInverse(&DirectX::XMMatrixDeterminant(view), view);
+
+	XMFLOAT3 origin = m_Camera.GetPosition();
+	XMFLOAT3 direction;
+	XMStoreFloat3(&direction, XMVector3Normalize(XMVector3TransformNormal(XMVectorSet(vx, vy, 1.0f, 0.0f), invView)));
 
-	CD3DX12_DESCRIPTOR_RANGE cbv1;
-	cbv1.Init(D3D12_DESCRIPTOR_RANGE_TYPE_CBV, 1, 1);
+	float dist;
+	if (m_useBvh)
+	{
+		if (!m_bvh.RayCast(origin, direction, m_Camera.GetFarZ(), m_pickedSlot, dist))
+			m_pickedSlot = UINT32_MAX;
+		return;
+	}
+
+	// Without the BVH every item is tested, nearest hit first.
+	const BoundsSoA& bounds = m_scene.WorldBounds();
+	XMVECTOR rayOrigin = XMLoadFloat3(&origin);
+	XMVECTOR rayDirection = XMLoadFloat3(&direction);
+	float nearest = m_Camera.GetFarZ();
+
+	m_pickedSlot = UINT32_MAX;
+	for (uint32_t i = 0; i < m_scene.Size(); ++i)
+	{
+		BoundingBox box(XMFLOAT3(bounds.CenterX[i], bounds.CenterY[i], bounds.CenterZ[i]),
+			XMFLOAT3(bounds.ExtentX[i], bounds.ExtentY[i], bounds.ExtentZ[i]));
+		if (box.Intersects(rayOrigin, rayDirection, dist) && dist < nearest)
+		{
+			nearest = dist;
+			m_pickedSlot = m_scene.Slots()[i];
+		}
+	}
+}
 
+void MyEngine::BuildRootSignature()
+{
 	// Root parameter can be a table, root descriptor or root constants.
-	CD3DX12_ROOT_PARAMETER rootParameter[2];
+	CD3DX12_ROOT_PARAMETER rootParameter[3];
 
-	// Create root CBVs.
-	rootParameter[0].InitAsDescriptorTable(1, &cbv0);
-	rootParameter[1].InitAsDescriptorTable(1, &cbv1);
+	// The object slot as a root constant, a root CBV for the pass constants in the
+	// upload ring and a root SRV for the object buffer of the frame resource. No
+	// descriptor heap is needed.
+	rootParameter[0].InitAsConstants(1, 0);
+	rootParameter[1].InitAsConstantBufferView(1);
+	rootParameter[2].InitAsShaderResourceView(0);
 
 	// A root signature is an array of root parameters.
-	CD3DX12_ROOT_SIGNATURE_DESC rootSigDesc(2, rootParameter, 0, nullptr, D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT);
+	CD3DX12_ROOT_SIGNATURE_DESC rootSigDesc(3, rootParameter, 0, nullptr, D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT);
 
-	// create a root signature with a single slot which points to a descriptor range consisting of a single constant buffer
+	// create a root signature from the parameters above
 	ComPtr<ID3DBlob> serializedRootSignature = nullptr;
 	ComPtr<ID3DBlob> errorBlob = nullptr;
 	HRESULT hr = D3D12SerializeRootSignature(&rootSigDesc, D3D_ROOT_SIGNATURE_VERSION_1, serializedRootSignature.GetAddressOf(), errorBlob.GetAddressOf());
@@ -427,10 +1312,49 @@ void MyEngine::BuildRootSignature()
 		IID_PPV_ARGS(m_rootSignature.GetAddressOf())));
 }
 
+void MyEngine::BuildCommandSignature()
+{
+	// The object index root constant then the draw, laid out as IndirectCommand.
+	IndirectSignatureLayout layout = ObjectDrawSignature(0);
+
+	string error;
+	if (!layout.Validate(error))
+	{
+		::OutputDebugStringA(error.c_str());
+		ThrowIfFailed(E_INVALIDARG);
+	}
+
+	vector<D3D12_INDIRECT_ARGUMENT_DESC> arguments(layout.Arguments.size());
+	for (size_t i = 0; i < arguments.size(); ++i)
+	{
+		const IndirectArgument& argument = layout.Arguments[i];
+		if (argument.Type == IndirectArgumentType::Constant)
+		{
+			arguments[i].Type = D3D12_INDIRECT_ARGUMENT_TYPE_CONSTANT;
+			arguments[i].Constant.RootParameterIndex = argument.RootParameterIndex;
+			arguments[i].Constant.DestOffsetIn32BitValues = argument.DestOffsetIn32BitValues;
+			arguments[i].Constant.Num32BitValuesToSet = argument.Num32BitValuesToSet;
+		}
+		else
+		{
+			arguments[i].Type = D3D12_INDIRECT_ARGUMENT_TYPE_DRAW_INDEXED;
+		}
+	}
+
+	D3D12_COMMAND_SIGNATURE_DESC desc = {};
+	desc.ByteStride = layout.ByteStride;
+	desc.NumArgumentDescs = (UINT)arguments.size();
+	desc.pArgumentDescs = arguments.data();
+
+	// Signatures that change root arguments are tied to the root signature.
+	ThrowIfFailed(md3dDevice->CreateCommandSignature(&desc, m_rootSignature.Get(), IID_PPV_ARGS(&m_commandSignature)));
+}
+
 void MyEngine::BuildShaders()
 {
-	m_shaders["standardVS"] = Util::CompileShader(L"Shaders\\color.hlsl", nullptr, "VS", "vs_5_1");
-	m_shaders["opaquePS"] = Util::CompileShader(L"Shaders\\color.hlsl", nullptr, "PS", "ps_5_1");
+	m_shaders[STRING_ID("standardVS")] = Util::CompileShader(L"Shaders\\color.hlsl", nullptr, "VS", "vs_5_1");
+	m_shaders[STRING_ID("instancedVS")] = Util::CompileShader(L"Shaders\\color.hlsl", nullptr, "VSInstanced", "vs_5_1");
+	m_shaders[STRING_ID("opaquePS")] = Util::CompileShader(L"Shaders\\color.hlsl", nullptr, "PS", "ps_5_1");
 }
 
 void MyEngine::BuildInputLayout()
@@ -441,14 +1365,33 @@ void MyEngine::BuildInputLayout()
 		{ "NORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 12, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
 		{ "COLOR", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 0, 24, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
 	};
+
+	// Same vertices plus the InstanceData stream in slot 1.
+	m_instancedInputLayout = m_inputLayout;
+	m_instancedInputLayout.insert(m_instancedInputLayout.end(),
+	{
+		{ "WORLD", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 0, D3D12_INPUT_CLASSIFICATION_PER_INSTANCE_DATA, 1 },
+		{ "WORLD", 1, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 16, D3D12_INPUT_CLASSIFICATION_PER_INSTANCE_DATA, 1 },
+		{ "WORLD", 2, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 32, D3D12_INPUT_CLASSIFICATION_PER_INSTANCE_DATA, 1 },
+		{ "INSTANCECOLOR", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 48, D3D12_INPUT_CLASSIFICATION_PER_INSTANCE_DATA, 1 },
+	});
 }
 
 void MyEngine::BuildShapeGeometry()
 {
+	// Generate the meshes in parallel; the builder keeps no state.
 	ObjectBuilder geoGen;
-	ObjectBuilder::MeshData box = geoGen.CreateBox(1.5f, 1.5f, 1.5f);
-	ObjectBuilder::MeshData grid = geoGen.CreateGrid(50.0f, 50.0f, 10, 10);
-	ObjectBuilder::MeshData pyr = geoGen.CreatePyramid(2.0f, 2.0f, 4.0f);
+	ObjectBuilder::MeshData box, grid, pyr;
+	ObjectBuilder::MeshData sphere[gSphereLodCount];
+
+	JobSystem& jobs = JobSystem::Get();
+	JobCounter generated;
+	jobs.Run("CreateBox", [&]() { box = geoGen.CreateBox(1.5f, 1.5f, 1.5f); }, &generated);
+	jobs.Run("CreateGrid", [&]() { grid = geoGen.CreateGrid(50.0f, 50.0f, 10, 10); }, &generated);
+	jobs.Run("CreatePyramid", [&]() { pyr = geoGen.CreatePyramid(2.0f, 2.0f, 4.0f); }, &generated);
+	for (UINT l = 0; l < gSphereLodCount; ++l)
+		jobs.Run("CreateSphere", [&, l]() { sphere[l] = geoGen.CreateSphere(1.0f, gSphereLodSlices[l], gSphereLodStacks[l]); }, &generated);
+	jobs.Wait(&generated);
 
 	// We are concatenating all the geometry into one big vertex/index buffer. So we define the regions in the buffer each submesh covers.
 
@@ -462,6 +1405,17 @@ void MyEngine::BuildShapeGeometry()
 	UINT gridIndexOffset = (UINT)box.Indices32.size();
 	UINT pyrIndexOffset = gridIndexOffset + (UINT)grid.Indices32.size();
 
+	// The sphere levels follow, one submesh per level.
+	UINT sphereVertexOffset[gSphereLodCount];
+	UINT sphereIndexOffset[gSphereLodCount];
+	sphereVertexOffset[0] = pyrVertexOffset + (UINT)pyr.Vertices.size();
+	sphereIndexOffset[0] = pyrIndexOffset + (UINT)pyr.Indices32.size();
+	for (UINT l = 1; l < gSphereLodCount; ++l)
+	{
+		sphereVertexOffset[l] = sphereVertexOffset[l - 1] + (UINT)sphere[l - 1].Vertices.size();
+		sphereIndexOffset[l] = sphereIndexOffset[l - 1] + (UINT)sphere[l - 1].Indices32.size();
+	}
+
 	// Define the SubmeshGeometry that cover different regions of the vertex/index buffers.
 
 	SubmeshGeometry boxSubmesh;
@@ -479,11 +1433,37 @@ void MyEngine::BuildShapeGeometry()
 	pyrSubMesh.StartIndexLocation = pyrIndexOffset;
 	pyrSubMesh.BaseVertexLocation = pyrVertexOffset;
 
+	SubmeshGeometry sphereSubmesh[gSphereLodCount];
+	LodGroup sphereLods;
+	sphereLods.LevelCount = gSphereLodCount;
+	for (UINT l = 0; l < gSphereLodCount; ++l)
+	{
+		sphereSubmesh[l].IndexCount = (UINT)sphere[l].Indices32.size();
+		sphereSubmesh[l].StartIndexLocation = sphereIndexOffset[l];
+		sphereSubmesh[l].BaseVertexLocation = sphereVertexOffset[l];
+
+		sphereLods.Levels[l].IndexCount = sphereSubmesh[l].IndexCount;
+		sphereLods.Levels[l].StartIndexLocation = sphereSubmesh[l].StartIndexLocation;
+		sphereLods.Levels[l].BaseVertexLocation = sphereSubmesh[l].BaseVertexLocation;
+		if (l + 1 < gSphereLodCount)
+			sphereLods.MinScreenSize[l] = gSphereLodMinScreenSize[l];
+	}
+	m_sphereLods = m_lodSelector.AddGroup(sphereLods);
+
+	// Local space bounds of each submesh.
+	BoundingBox::CreateFromPoints(boxSubmesh.Bounds, box.Vertices.size(), &box.Vertices[0].Position, sizeof(ObjectBuilder::Vertex));
+	BoundingBox::CreateFromPoints(gridSubmesh.Bounds, grid.Vertices.size(), &grid.Vertices[0].Position, sizeof(ObjectBuilder::Vertex));
+	BoundingBox::CreateFromPoints(pyrSubMesh.Bounds, pyr.Vertices.size(), &pyr.Vertices[0].Position, sizeof(ObjectBuilder::Vertex));
+	for (UINT l = 0; l < gSphereLodCount; ++l)
+		BoundingBox::CreateFromPoints(sphereSubmesh[l].Bounds, sphere[l].Vertices.size(), &sphere[l].Vertices[0].Position, sizeof(ObjectBuilder::Vertex));
+
 
 	// Extract the vertex elements we are interested in and pack the
 	// vertices of all the meshes into one vertex buffer.
 
 	auto totalVertexCount = box.Vertices.size() + grid.Vertices.size() + pyr.Vertices.size();
+	for (UINT l = 0; l < gSphereLodCount; ++l)
+		totalVertexCount += sphere[l].Vertices.size();
 
 	// Resources Vertex struct
 	vector<Vertex> vertices(totalVertexCount);
@@ -510,10 +1490,22 @@ void MyEngine::BuildShapeGeometry()
 		vertices[k].Color = XMFLOAT4(DirectX::Colors::Coral);
 	}
 
+	for (UINT l = 0; l < gSphereLodCount; ++l)
+	{
+		for (size_t i = 0; i < sphere[l].Vertices.size(); ++i, ++k)
+		{
+			vertices[k].Pos = sphere[l].Vertices[i].Position;
+			vertices[k].Normal = sphere[l].Vertices[i].Normal;
+			vertices[k].Color = XMFLOAT4(DirectX::Colors::SteelBlue);
+		}
+	}
+
 	vector<uint32_t> indices;
 	indices.insert(indices.end(), begin(box.Indices32), end(box.Indices32));
 	indices.insert(indices.end(), begin(grid.Indices32), end(grid.Indices32));
 	indices.insert(indices.end(), begin(pyr.Indices32), end(pyr.Indices32));
+	for (UINT l = 0; l < gSphereLodCount; ++l)
+		indices.insert(indices.end(), begin(sphere[l].Indices32), end(sphere[l].Indices32));
 
 
 	const UINT vertexBuff_size = (UINT)vertices.size() * sizeof(Vertex);
@@ -537,28 +1529,262 @@ void MyEngine::BuildShapeGeometry()
 	geo->IndexFormat = DXGI_FORMAT_R32_UINT;
 	geo->IndexBufferByteSize = indexBuff_size;
 
-	geo->DrawArgs["box"] = boxSubmesh;
-	geo->DrawArgs["grid"] = gridSubmesh;
-	geo->DrawArgs["pyr"] = pyrSubMesh;
+	geo->DrawArgs[STRING_ID("box")] = boxSubmesh;
+	geo->DrawArgs[STRING_ID("grid")] = gridSubmesh;
+	geo->DrawArgs[STRING_ID("pyr")] = pyrSubMesh;
+	for (UINT l = 0; l < gSphereLodCount; ++l)
+		geo->DrawArgs[StringTable::Get().Intern("sphere" + to_string(l))] = sphereSubmesh[l];
 
-	m_geometries[geo->Name] = move(geo);
+	UINT geoIndex = PublishGeometry(move(geo));
+
+	// Boxes and pyramids are closed meshes, so they can hide what is behind them.
+	for (auto* mesh : { &box, &pyr })
+	{
+		vector<XMFLOAT3> positions;
+		for (auto& v : mesh->Vertices)
+			positions.push_back(v.Position);
+
+		UINT startIndex = mesh == &box ? boxIndexOffset : pyrIndexOffset;
+		m_occluderMeshes[((uint64_t)geoIndex << 32) | startIndex] = m_occlusionCuller.AddOccluderMesh(positions, mesh->Indices32);
+	}
 }
 
-void MyEngine::BuildPSO()
+uint32_t MyEngine::PublishGeometry(unique_ptr<MeshGeometry> geo)
 {
-	D3D12_GRAPHICS_PIPELINE_STATE_DESC opaquePsoDesc;
-	ZeroMemory(&opaquePsoDesc, sizeof(D3D12_GRAPHICS_PIPELINE_STATE_DESC));
-	opaquePsoDesc.InputLayout = { m_inputLayout.data(), (UINT)m_inputLayout.size() };
-	opaquePsoDesc.pRootSignature = m_rootSignature.Get();
-	opaquePsoDesc.VS =
-	{
-		static_cast<BYTE*>(m_shaders["standardVS"]->GetBufferPointer()), m_shaders["standardVS"]->GetBufferSize()
-	};
-	opaquePsoDesc.PS =
-	{
-		static_cast<BYTE*>(m_shaders["opaquePS"]->GetBufferPointer()), m_shaders["opaquePS"]->GetBufferSize()
-	};
-	opaquePsoDesc.RasterizerState = CD3DX12_RASTERIZER_DESC(D3D12_DEFAULT);
+	// Geometries without a name are published anonymously, reachable by id only.
+	GeometryRecord record;
+	if (!geo->Name.empty())
+		record.Name = StringTable::Get().Intern(geo->Name);
+	record.VertexBuffer = ToBinding(geo->VertexBufferView());
+	record.IndexBuffer = ToBinding(geo->IndexBufferView());
+	record.Geometry = move(geo);
+
+	return m_geometries.Publish(move(record));
+}
+
+const MeshGeometry* MyEngine::GetGeometry(uint32_t id)const
+{
+	return m_geometries.Get(id)->Geometry.get();
+}
+
+ComPtr<ID3D12Resource> MyEngine::CreateUploadHeapBuffer(const void* data, UINT64 byteSize)
+{
+	// Creating resources is free-threaded, so any thread can make a buffer the GPU
+	// reads straight from upload memory without going through a command list.
+	ComPtr<ID3D12Resource> buffer;
+	ThrowIfFailed(md3dDevice->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
+		D3D12_HEAP_FLAG_NONE,
+		&CD3DX12_RESOURCE_DESC::Buffer(byteSize),
+		D3D12_RESOURCE_STATE_GENERIC_READ,
+		nullptr,
+		IID_PPV_ARGS(&buffer)));
+
+	void* mapped = nullptr;
+	ThrowIfFailed(buffer->Map(0, nullptr, &mapped));
+	memcpy(mapped, data, (size_t)byteSize);
+	buffer->Unmap(0, nullptr);
+
+	return buffer;
+}
+
+void MyEngine::ToggleLoadedGeometry()
+{
+	if (m_geometryLoader.joinable())
+		return;
+
+	if (m_loadedGeometry == GeometryRegistry::InvalidId)
+	{
+		// A geometry whose buffers could not be created is not published, and
+		// PlaceLoadedGeometry reports why.
+		m_geometryLoadDone = false;
+		m_geometryLoadError.clear();
+		m_geometryLoader = thread([this]()
+		{
+			try
+			{
+				LoadGeometry();
+			}
+			catch (DxException& e)
+			{
+				m_geometryLoadError = e.ToString();
+			}
+
+			m_geometryLoadDone = true;
+		});
+		return;
+	}
+
+	// The items go first; the slots and the geometry are both kept until the
+	// frames that drew them have completed.
+	for (RenderItemHandle handle : m_loadedItems)
+		RemoveRenderItem(handle);
+	m_loadedItems.clear();
+
+	m_geometries.Release(m_loadedGeometry);
+	m_loadedGeometry = GeometryRegistry::InvalidId;
+
+	m_statusText = L"    loaded geometry released, " + to_wstring(m_geometries.GetStats().Retired) + L" waiting for their fence";
+}
+
+void MyEngine::LoadGeometry()
+{
+	// Runs on the geometry loader thread while frames are rendered. A dense
+	// sphere stands in for a mesh read from disk.
+	auto start = chrono::high_resolution_clock::now();
+
+	ObjectBuilder geoGen;
+	ObjectBuilder::MeshData sphere = geoGen.CreateSphere(1.0f, 256, 128);
+
+	vector<Vertex> vertices(sphere.Vertices.size());
+	for (size_t i = 0; i < sphere.Vertices.size(); ++i)
+	{
+		vertices[i].Pos = sphere.Vertices[i].Position;
+		vertices[i].Normal = sphere.Vertices[i].Normal;
+		vertices[i].Color = XMFLOAT4(DirectX::Colors::Gold);
+	}
+
+	const UINT vertexBuff_size = (UINT)vertices.size() * sizeof(Vertex);
+	const UINT indexBuff_size = (UINT)sphere.Indices32.size() * sizeof(uint32_t);
+
+	auto geo = make_unique<MeshGeometry>();
+	geo->Name = "loadedGeo";
+	geo->VertexBufferGPU = CreateUploadHeapBuffer(vertices.data(), vertexBuff_size);
+	geo->IndexBufferGPU = CreateUploadHeapBuffer(sphere.Indices32.data(), indexBuff_size);
+	geo->VertexByteStride = sizeof(Vertex);
+	geo->VertexBufferByteSize = vertexBuff_size;
+	geo->IndexFormat = DXGI_FORMAT_R32_UINT;
+	geo->IndexBufferByteSize = indexBuff_size;
+
+	SubmeshGeometry submesh;
+	submesh.IndexCount = (UINT)sphere.Indices32.size();
+	BoundingBox::CreateFromPoints(submesh.Bounds, sphere.Vertices.size(), &sphere.Vertices[0].Position, sizeof(ObjectBuilder::Vertex));
+	geo->DrawArgs[STRING_ID("sphere")] = submesh;
+
+	PublishGeometry(move(geo));
+
+	auto end = chrono::high_resolution_clock::now();
+	m_geometryLoadMilliseconds = chrono::duration<double, milli>(end - start).count();
+}
+
+void MyEngine::PlaceLoadedGeometry()
+{
+	m_loadedGeometry = m_geometries.Find(STRING_ID("loadedGeo"));
+	if (m_loadedGeometry == GeometryRegistry::InvalidId)
+	{
+		m_statusText = L"    loading geometry failed: " + m_geometryLoadError;
+		return;
+	}
+
+	// A ring of spheres around the grid.
+	for (UINT i = 0; i < 24; ++i)
+	{
+		float angle = 2.0f*UtilMath::Pi*i / 24;
+
+		XMFLOAT3X4 world;
+		XMStoreFloat3x4(&world, XMMatrixScaling(2.0f, 2.0f, 2.0f)*XMMatrixTranslation(30.0f*cosf(angle), 2.0f, 30.0f*sinf(angle)));
+		m_loadedItems.push_back(AddRenderItem(world, m_loadedGeometry, STRING_ID("sphere")));
+	}
+
+	m_statusText = L"    loaded geometry: " + to_wstring(GetGeometry(m_loadedGeometry)->DrawArgs.At(STRING_ID("sphere")).IndexCount / 3) +
+		L" triangles built and published on a loader thread in " + to_wstring((int)m_geometryLoadMilliseconds) + L" ms";
+}
+
+void MyEngine::BuildStaticScenery()
+{
+	static_assert(sizeof(BatchVertex) == sizeof(Vertex), "BatchVertex must match the engine Vertex");
+
+	// The box and pyramid submeshes, read back from the shape geometry.
+	const MeshGeometry* shapes = GetGeometry(m_geometries.Find(STRING_ID("shapeGeo")));
+	const Vertex* shapeVertices = (const Vertex*)shapes->VertexBufferCPU->GetBufferPointer();
+	const uint32_t* shapeIndices = (const uint32_t*)shapes->IndexBufferCPU->GetBufferPointer();
+
+	auto addMesh = [&](StringId submesh)
+	{
+		const SubmeshGeometry& args = shapes->DrawArgs.At(submesh);
+
+		vector<uint32_t> indices(shapeIndices + args.StartIndexLocation, shapeIndices + args.StartIndexLocation + args.IndexCount);
+		vector<BatchVertex> vertices(*max_element(indices.begin(), indices.end()) + 1);
+		memcpy(vertices.data(), shapeVertices + args.BaseVertexLocation, vertices.size()*sizeof(Vertex));
+
+		return m_staticBatcher.AddMesh(vertices, indices);
+	};
+
+	uint32_t meshes[] = { addMesh(STRING_ID("box")), addMesh(STRING_ID("pyr")) };
+
+	// A field of small shapes around the grid, each of them a draw if it were a render item.
+	mt19937 random(4321);
+	uniform_real_distribution<float> jitter(-1.5f, 1.5f);
+	uniform_real_distribution<float> scale(0.5f, 1.5f);
+	uniform_real_distribution<float> angle(0.0f, 2.0f*UtilMath::Pi);
+	uniform_real_distribution<float> shade(0.6f, 1.0f);
+
+	const float half = 0.5f*gStaticSceneryPerSide*gStaticScenerySpacing;
+	for (UINT x = 0; x < gStaticSceneryPerSide; ++x)
+	{
+		for (UINT z = 0; z < gStaticSceneryPerSide; ++z)
+		{
+			float px = x*gStaticScenerySpacing - half + jitter(random);
+			float pz = z*gStaticScenerySpacing - half + jitter(random);
+			if (fabs(px) < 30.0f && fabs(pz) < 30.0f)
+				continue;
+
+			float s = scale(random);
+
+			StaticInstance instance;
+			instance.Mesh = meshes[(x + z) & 1];
+			XMStoreFloat3x4(&instance.World, XMMatrixScaling(s, s, s)*XMMatrixRotationY(angle(random))*XMMatrixTranslation(px, 0.75f*s, pz));
+			instance.Color = XMFLOAT4(shade(random), shade(random), shade(random), 1.0f);
+			m_staticBatcher.AddInstance(instance);
+		}
+	}
+
+	m_staticBatcher.SetCellSize(32.0f);
+	m_staticBatcher.SetProxyDistances(gClusterProxyDistance, gGroupProxyDistance);
+	m_staticBatcher.Build();
+
+	const vector<BatchVertex>& vertices = m_staticBatcher.GetVertices();
+	const vector<uint32_t>& indices = m_staticBatcher.GetIndices();
+
+	const UINT vertexBuff_size = (UINT)vertices.size() * sizeof(Vertex);
+	const UINT indexBuff_size = (UINT)indices.size() * sizeof(uint32_t);
+
+	auto geo = make_unique<MeshGeometry>();
+	geo->Name = "staticGeo";
+
+	ThrowIfFailed(D3DCreateBlob(vertexBuff_size, &geo->VertexBufferCPU));
+	CopyMemory(geo->VertexBufferCPU->GetBufferPointer(), vertices.data(), vertexBuff_size);
+
+	ThrowIfFailed(D3DCreateBlob(indexBuff_size, &geo->IndexBufferCPU));
+	CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), indices.data(), indexBuff_size);
+
+	geo->VertexBufferGPU = Util::CreateDefaultBuffer(md3dDevice.Get(), mCommandList.Get(), vertices.data(), vertexBuff_size, geo->VertexBufferUploader);
+
+	geo->IndexBufferGPU = Util::CreateDefaultBuffer(md3dDevice.Get(), mCommandList.Get(), indices.data(), indexBuff_size, geo->IndexBufferUploader);
+
+	geo->VertexByteStride = sizeof(Vertex);
+	geo->VertexBufferByteSize = vertexBuff_size;
+	geo->IndexFormat = DXGI_FORMAT_R32_UINT;
+	geo->IndexBufferByteSize = indexBuff_size;
+
+	m_staticGeometry = PublishGeometry(move(geo));
+}
+
+void MyEngine::BuildPSO()
+{
+	D3D12_GRAPHICS_PIPELINE_STATE_DESC opaquePsoDesc;
+	ZeroMemory(&opaquePsoDesc, sizeof(D3D12_GRAPHICS_PIPELINE_STATE_DESC));
+	opaquePsoDesc.InputLayout = { m_inputLayout.data(), (UINT)m_inputLayout.size() };
+	opaquePsoDesc.pRootSignature = m_rootSignature.Get();
+	opaquePsoDesc.VS =
+	{
+		static_cast<BYTE*>(m_shaders[STRING_ID("standardVS")]->GetBufferPointer()), m_shaders[STRING_ID("standardVS")]->GetBufferSize()
+	};
+	opaquePsoDesc.PS =
+	{
+		static_cast<BYTE*>(m_shaders[STRING_ID("opaquePS")]->GetBufferPointer()), m_shaders[STRING_ID("opaquePS")]->GetBufferSize()
+	};
+	opaquePsoDesc.RasterizerState = CD3DX12_RASTERIZER_DESC(D3D12_DEFAULT);
 	opaquePsoDesc.RasterizerState.FillMode = D3D12_FILL_MODE_SOLID;
 	opaquePsoDesc.BlendState = CD3DX12_BLEND_DESC(D3D12_DEFAULT);
 	opaquePsoDesc.DepthStencilState = CD3DX12_DEPTH_STENCIL_DESC(D3D12_DEFAULT);
@@ -570,95 +1796,509 @@ void MyEngine::BuildPSO()
 	opaquePsoDesc.SampleDesc.Quality = m4xMsaaState ? (m4xMsaaQuality - 1) : 0;
 	opaquePsoDesc.DSVFormat = mDepthStencilFormat;
 	ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&opaquePsoDesc, IID_PPV_ARGS(&m_PSO)));
+
+	D3D12_GRAPHICS_PIPELINE_STATE_DESC instancedPsoDesc = opaquePsoDesc;
+	instancedPsoDesc.InputLayout = { m_instancedInputLayout.data(), (UINT)m_instancedInputLayout.size() };
+	instancedPsoDesc.VS =
+	{
+		static_cast<BYTE*>(m_shaders[STRING_ID("instancedVS")]->GetBufferPointer()), m_shaders[STRING_ID("instancedVS")]->GetBufferSize()
+	};
+	ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&instancedPsoDesc, IID_PPV_ARGS(&m_instancedPSO)));
 }
 
 void MyEngine::BuildFrameResources()
 {
+	UINT recordingThreads = min(gMaxRecordingThreads, WorkerThreadCount());
+
+	m_objectCapacity = max(gInitialObjectCapacity, m_scene.SlotCount());
+
 	for (int i = 0; i < gNumFrameResources; ++i)
 	{
-		m_resources.push_back(make_unique<Resource>(md3dDevice.Get(), 1, (UINT)m_renderItems.size()));
+		m_resources.push_back(make_unique<Resource>(md3dDevice.Get(), m_objectCapacity, recordingThreads));
 	}
+
+	BuildUploadRing();
+
+	m_workerBackends.resize(recordingThreads);
+}
+
+void MyEngine::BuildUploadRing()
+{
+	// Room for the pass constants, the static scenery object and either a full
+	// instance stream or full indirect buffers of every frame in flight, plus one
+	// frame lost to padding when the ring wraps.
+	UINT64 perObjectBytes = max(sizeof(InstanceData), sizeof(IndirectCommand) + sizeof(IndirectDrawData));
+	UINT64 frameBytes = Util::CalcConstantBufferByteSize(sizeof(PassConstants)) + sizeof(ObjectData) + perObjectBytes*m_objectCapacity + 3*16;
+	m_uploadRing = make_unique<UploadRing>(md3dDevice.Get(), frameBytes*(gNumFrameResources + 1));
+}
+
+void MyEngine::GrowObjectCapacity()
+{
+	UINT capacity = max(m_objectCapacity * 2, m_scene.SlotCount());
+
+	// The frames already submitted keep reading the old buffers and ring until
+	// their fence passes; this frame and the next ones use the new ones. Nothing
+	// waits for the GPU here.
+	RetiredResources retired;
+	retired.Fence = mCurrentFence;
+	for (auto& resource : m_resources)
+	{
+		retired.ObjectBuffers.push_back(move(resource->ObjectBuffer));
+		resource->ObjectBuffer = make_unique<UploadBuffer<ObjectData>>(md3dDevice.Get(), capacity, false);
+	}
+	retired.Ring = move(m_uploadRing);
+	m_retiredResources.push_back(move(retired));
+
+	m_objectCapacity = capacity;
+	BuildUploadRing();
+
+	// The new object buffers start out empty.
+	m_scene.MarkAllDirty();
 }
 
 void MyEngine::BuildRenderItems()
 {
-	auto boxRitem1 = make_unique<RenderItem>();
-	XMStoreFloat4x4(&boxRitem1->World, DirectX::XMMatrixScaling(2.0f, 2.0f, 2.0f)*DirectX::XMMatrixTranslation(-5.0f, 1.5f, -6.0f));
-	boxRitem1->ObjCBIndex = 0;
-	boxRitem1->Geo = m_geometries["shapeGeo"].get();
-	boxRitem1->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	boxRitem1->IndexCount = boxRitem1->Geo->DrawArgs["box"].IndexCount;
-	boxRitem1->StartIndexLocation = boxRitem1->Geo->DrawArgs["box"].StartIndexLocation;
-	boxRitem1->BaseVertexLocation = boxRitem1->Geo->DrawArgs["box"].BaseVertexLocation;
-	m_renderItems.push_back(move(boxRitem1));
+	m_streamGeometry = m_geometries.Find(STRING_ID("shapeGeo"));
+
+	// A scene file named on the command line replaces the built-in scene, which
+	// is shown instead when the file cannot be loaded.
+	if (!m_scenePath.empty())
+	{
+		if (LoadScene(m_scenePath))
+			return;
+
+		m_statusText = L"    could not load " + AnsiToWString(m_scenePath) + L", showing the built-in scene";
+	}
+
+	AddScene(BuiltInScene());
+}
+
+SceneFileContents MyEngine::BuiltInScene()const
+{
+	SceneFileContents scene;
+	const MeshGeometry* shapes = GetGeometry(m_streamGeometry);
+
+	auto addItem = [&](const XMFLOAT3X4& world, uint32_t mesh, uint32_t parent)
+	{
+		scene.Worlds.push_back(world);
+		scene.LocalBounds.push_back(shapes->DrawArgs.At(StringTable::Get().Find(scene.Meshes[mesh].Submesh)).Bounds);
+		scene.Colors.push_back(XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f));
+		scene.MeshIds.push_back(mesh);
+		scene.MaterialIds.push_back(0);
+		scene.Parents.push_back(parent);
+		scene.Flags.push_back(0);
+		return (uint32_t)scene.Worlds.size() - 1;
+	};
+
+	uint32_t grid = AddSceneFileMesh(scene, shapes->Name, "grid");
+	uint32_t box = AddSceneFileMesh(scene, shapes->Name, "box");
+	uint32_t pyramid = AddSceneFileMesh(scene, shapes->Name, "pyr");
+	uint32_t sphere = AddSceneFileMesh(scene, shapes->Name, "sphere0");
+
+	XMFLOAT3X4 world;
+
+	// The grid is the root; the shapes standing on it are its children, so they
+	// follow it when it moves.
+	uint32_t gridItem = addItem(Identity3x4(), grid, UINT32_MAX);
+
+	XMStoreFloat3x4(&world, DirectX::XMMatrixScaling(2.0f, 2.0f, 2.0f)*DirectX::XMMatrixTranslation(-5.0f, 1.5f, -6.0f));
+	addItem(world, box, gridItem);
+
+	XMStoreFloat3x4(&world, DirectX::XMMatrixScaling(3.0f, 3.0f, 3.0f)*DirectX::XMMatrixTranslation(5.0f, 2.0f, 6.0f));
+	addItem(world, box, gridItem);
+
+	XMStoreFloat3x4(&world, DirectX::XMMatrixTranslation(-4.0f, 0.0f, 6.0f));
+	addItem(world, pyramid, gridItem);
+
+	// A line of spheres going away from the camera, coarser the farther they are.
+	for (UINT i = 0; i < 16; ++i)
+	{
+		XMStoreFloat3x4(&world, DirectX::XMMatrixTranslation(12.0f, 1.0f, -20.0f + 12.0f*i));
+		addItem(world, sphere, gridItem);
+	}
+
+	return scene;
+}
+
+bool MyEngine::LoadScene(const string& path)
+{
+	SceneFile file;
+	if (!file.Open(path))
+		return false;
+
+	vector<DrawKey> draws;
+	vector<uint32_t> lodGroups;
+	RenderItemRange range;
+	if (!MakeSceneRange(file, draws, lodGroups, range))
+		return false;
+
+	AddSceneItems(range, file.Parents(), file.Flags());
+	return true;
+}
+
+bool MyEngine::AddScene(const SceneFileContents& scene)
+{
+	vector<DrawKey> draws;
+	vector<uint32_t> lodGroups;
+	if (!MakeSceneDraws(scene.Meshes.data(), (uint32_t)scene.Meshes.size(), GeometryRegistry::InvalidId, draws, lodGroups))
+		return false;
+
+	vector<float> worldBounds[6];
+	ComputeSceneWorldBounds(scene, worldBounds);
+
+	RenderItemRange range;
+	range.Count = (uint32_t)scene.Worlds.size();
+	range.Worlds = scene.Worlds.data();
+	range.LocalBounds = scene.LocalBounds.data();
+	for (int c = 0; c < 6; ++c)
+		range.WorldBounds[c] = worldBounds[c].data();
+	range.Colors = scene.Colors.data();
+	range.DrawIds = scene.MeshIds.data();
+	range.Materials = scene.MaterialIds.data();
+	range.Draws = draws.data();
+	range.DrawLodGroups = lodGroups.data();
+
+	AddSceneItems(range, scene.Parents.data(), scene.Flags.data());
+	return true;
+}
+
+uint32_t MyEngine::AddSceneItems(const RenderItemRange& range, const uint32_t* parents, const uint32_t* flags)
+{
+	uint32_t first = m_scene.AddRange(range);
+	for (uint32_t i = 0; i < range.Count; ++i)
+	{
+		UpdateBvhItem(first + i);
+		InvalidateVisibility(first + i);
+	}
+
+	// An item with a parent gets a node under the parent's node, with its world
+	// matrix made relative to the parent's. Dynamic roots get a node of their own
+	// for MoveDynamicItems to turn.
+	const XMFLOAT3X4* worlds = range.Worlds;
+	vector<uint32_t> nodes(range.Count, TransformHierarchy::InvalidNode);
+	for (uint32_t i = 0; i < range.Count; ++i)
+	{
+		uint32_t parent = parents[i];
+		if (parent == UINT32_MAX)
+		{
+			if (flags[i] & SceneItemDynamic)
+			{
+				nodes[i] = m_hierarchy.AddNode(TransformHierarchy::InvalidNode, worlds[i], m_scene.HandleAt(first + i));
+
+				DynamicNode dynamic;
+				dynamic.Node = nodes[i];
+				dynamic.Base = worlds[i];
+				m_dynamicNodes.push_back(dynamic);
+			}
+			continue;
+		}
+
+		if (nodes[parent] == TransformHierarchy::InvalidNode)
+			nodes[parent] = m_hierarchy.AddNode(TransformHierarchy::InvalidNode, worlds[parent], m_scene.HandleAt(first + parent));
+
+		XMMATRIX parentWorld = XMLoadFloat3x4(&worlds[parent]);
+		XMFLOAT3X4 local;
+		XMStoreFloat3x4(&local, XMMatrixMultiply(XMLoadFloat3x4(&worlds[i]), XMMatrixInverse(nullptr, parentWorld)));
+		nodes[i] = m_hierarchy.AddNode(nodes[parent], local, m_scene.HandleAt(first + i));
+	}
+
+	return first;
+}
+
+bool MyEngine::MakeSceneDraws(const SceneFileMesh* meshes, uint32_t meshCount, uint32_t localGeometry, vector<DrawKey>& draws, vector<uint32_t>& lodGroups)const
+{
+	// Every mesh becomes a draw of a published geometry, the local one for meshes
+	// named by the placeholder. The spheres are the only items with levels of
+	// detail.
+	draws.assign(meshCount, DrawKey());
+	lodGroups.assign(meshCount, LodSelector::NoGroup);
+	for (uint32_t m = 0; m < meshCount; ++m)
+	{
+		const SceneFileMesh& mesh = meshes[m];
+
+		// Names never interned cannot be those of a geometry or submesh, so the
+		// file's names are looked up without being interned.
+		UINT geometry = strcmp(mesh.Geometry, gLocalGeometryName) == 0 ? localGeometry : m_geometries.Find(StringTable::Get().Find(mesh.Geometry));
+		if (geometry == GeometryRegistry::InvalidId)
+			return false;
+
+		StringId submesh = StringTable::Get().Find(mesh.Submesh);
+		const SubmeshGeometry* args = GetGeometry(geometry)->DrawArgs.Find(submesh);
+		if (args == nullptr)
+			return false;
+
+		DrawKey& draw = draws[m];
+		draw.Geometry = geometry;
+		draw.PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+		draw.IndexCount = args->IndexCount;
+		draw.StartIndexLocation = args->StartIndexLocation;
+		draw.BaseVertexLocation = args->BaseVertexLocation;
+
+		if (submesh == STRING_ID("sphere0"))
+			lodGroups[m] = m_sphereLods;
+	}
+
+	return true;
+}
+
+bool MyEngine::MakeSceneRange(const SceneFile& file, vector<DrawKey>& draws, vector<uint32_t>& lodGroups, RenderItemRange& range,
+	uint32_t localGeometry)const
+{
+	if (!MakeSceneDraws(file.Meshes(), file.GetMeshCount(), localGeometry, draws, lodGroups))
+		return false;
+
+	range.Count = file.GetItemCount();
+	range.Worlds = file.Worlds();
+	range.LocalBounds = file.LocalBounds();
+	for (int c = 0; c < 6; ++c)
+		range.WorldBounds[c] = file.WorldBounds(c);
+	range.Colors = file.Colors();
+	range.DrawIds = file.MeshIds();
+	range.Materials = file.MaterialIds();
+	range.Draws = draws.data();
+	range.DrawLodGroups = lodGroups.data();
+
+	return true;
+}
+
+void MyEngine::MoveDynamicItems(const Timer& timer)
+{
+	// Every root turns in place at its own rate; its children follow through the
+	// hierarchy.
+	float time = timer.TotTime();
+	for (size_t i = 0; i < m_dynamicNodes.size(); ++i)
+	{
+		const DynamicNode& dynamic = m_dynamicNodes[i];
+
+		XMMATRIX world = XMLoadFloat3x4(&dynamic.Base);
+		XMVECTOR position = world.r[3];
+		world.r[3] = XMVectorSet(0.0f, 0.0f, 0.0f, 1.0f);
+		world = world*XMMatrixRotationY((0.5f + 0.1f*(i % 8))*time);
+		world.r[3] = position;
+
+		XMFLOAT3X4 local;
+		XMStoreFloat3x4(&local, world);
+		m_hierarchy.SetLocal(dynamic.Node, local);
+	}
+}
+
+RenderItemHandle MyEngine::AddRenderItem(const XMFLOAT3X4& world, UINT geometry, StringId submesh, uint32_t lodGroup)
+{
+	const SubmeshGeometry& args = GetGeometry(geometry)->DrawArgs.At(submesh);
+
+	RenderItem ritem;
+	ritem.World = world;
+	ritem.LocalBounds = args.Bounds;
+	ritem.Draw.Geometry = geometry;
+	ritem.Draw.PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+	ritem.Draw.IndexCount = args.IndexCount;
+	ritem.Draw.StartIndexLocation = args.StartIndexLocation;
+	ritem.Draw.BaseVertexLocation = args.BaseVertexLocation;
+	ritem.LodGroupId = lodGroup;
+
+	RenderItemHandle handle = m_scene.Add(ritem);
+	UpdateBvhItem(m_scene.DenseIndex(handle));
+	InvalidateVisibility(m_scene.DenseIndex(handle));
+
+	return handle;
+}
 
-	auto boxRitem2 = make_unique<RenderItem>();
-	XMStoreFloat4x4(&boxRitem2->World, DirectX::XMMatrixScaling(3.0f, 3.0f, 3.0f)*DirectX::XMMatrixTranslation(5.0f, 2.0f, 6.0f));
-	boxRitem2->ObjCBIndex = 1;
-	boxRitem2->Geo = m_geometries["shapeGeo"].get();
-	boxRitem2->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	boxRitem2->IndexCount = boxRitem2->Geo->DrawArgs["box"].IndexCount;
-	boxRitem2->StartIndexLocation = boxRitem2->Geo->DrawArgs["box"].StartIndexLocation;
-	boxRitem2->BaseVertexLocation = boxRitem2->Geo->DrawArgs["box"].BaseVertexLocation;
-	m_renderItems.push_back(move(boxRitem2));
+void MyEngine::RemoveRenderItem(RenderItemHandle handle)
+{
+	if (!m_scene.IsAlive(handle))
+		return;
+
+	// The scene holds the slot back until the frames drawing the item are done.
+	// The last item moves into its dense index.
+	if (m_useBvh)
+		m_bvh.RemoveItem(handle.Index);
+	InvalidateVisibility(m_scene.DenseIndex(handle));
+	m_scene.Remove(handle);
+}
 
-	auto gridRitem = make_unique<RenderItem>();
-	gridRitem->World = UtilMath::Identity4x4();
-	gridRitem->ObjCBIndex = 2;
-	gridRitem->Geo = m_geometries["shapeGeo"].get();
-	gridRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	gridRitem->IndexCount = gridRitem->Geo->DrawArgs["grid"].IndexCount;
-	gridRitem->StartIndexLocation = gridRitem->Geo->DrawArgs["grid"].StartIndexLocation;
-	gridRitem->BaseVertexLocation = gridRitem->Geo->DrawArgs["grid"].BaseVertexLocation;
-	m_renderItems.push_back(move(gridRitem));
+void MyEngine::StreamRenderItems()
+{
+	uniform_real_distribution<float> position(-100.0f, 100.0f);
 
-	auto pyrRitem = make_unique<RenderItem>();
-	XMStoreFloat4x4(&pyrRitem->World, DirectX::XMMatrixTranslation(-4.0f, 0.0f, 6.0f));
-	pyrRitem->ObjCBIndex = 3;
-	pyrRitem->Geo = m_geometries["shapeGeo"].get();
-	pyrRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	pyrRitem->IndexCount = pyrRitem->Geo->DrawArgs["pyr"].IndexCount;
-	pyrRitem->StartIndexLocation = pyrRitem->Geo->DrawArgs["pyr"].StartIndexLocation;
-	pyrRitem->BaseVertexLocation = pyrRitem->Geo->DrawArgs["pyr"].BaseVertexLocation;
-	m_renderItems.push_back(move(pyrRitem));
+	// Despawn the oldest items once the streamed set is full and spawn as many,
+	// boxes and spheres in turn.
+	for (UINT i = 0; i < gStreamedItemsPerFrame; ++i)
+	{
+		if (m_streamedItems.size() >= gMaxStreamedItems)
+		{
+			RemoveRenderItem(m_streamedItems.front());
+			m_streamedItems.pop_front();
+		}
 
+		XMFLOAT3X4 world;
+		XMStoreFloat3x4(&world, DirectX::XMMatrixTranslation(position(m_streamRandom), 0.5f, position(m_streamRandom)));
+		if (m_streamedItems.size() % 2)
+			m_streamedItems.push_back(AddRenderItem(world, m_streamGeometry, STRING_ID("sphere0"), m_sphereLods));
+		else
+			m_streamedItems.push_back(AddRenderItem(world, m_streamGeometry, STRING_ID("box")));
+	}
+}
+
+void MyEngine::StopStreaming()
+{
+	for (RenderItemHandle handle : m_streamedItems)
+		RemoveRenderItem(handle);
 
-	// All render items
-	for (auto& e : m_renderItems)
-		m_opaqueRenderItems.push_back(e.get());
+	m_streamedItems.clear();
+	m_streaming = false;
 }
 
-void MyEngine::DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const vector<RenderItem*>& ritems)
+void MyEngine::SetRenderItemWorld(RenderItemHandle handle, const XMFLOAT3X4& world)
 {
-	UINT objCBByteSize = Util::CalcConstantBufferByteSize(sizeof(ObjectConstants));
+	m_scene.SetWorld(handle, world);
+	UpdateBvhItem(m_scene.DenseIndex(handle));
+	InvalidateVisibility(m_scene.DenseIndex(handle));
+}
 
-	auto objectCB = m_currentResource->ObjectCB->GetUploadBuffer();
+void MyEngine::InvalidateVisibility(uint32_t denseIndex)
+{
+	// While the cache or the sets are off they are reset when turned back on
+	// instead.
+	if (m_useVisibilityCache)
+		m_visibilityCache.Invalidate(denseIndex);
+	if (m_usePvs)
+		m_pvs.Invalidate(denseIndex);
+}
 
-	// For each render item
-	for (size_t i = 0; i < ritems.size(); ++i)
+void MyEngine::UpdateBvhItem(uint32_t denseIndex)
+{
+	if (!m_useBvh)
+		return;
+
+	const BoundsSoA& bounds = m_scene.WorldBounds();
+
+	XMFLOAT3 center(bounds.CenterX[denseIndex], bounds.CenterY[denseIndex], bounds.CenterZ[denseIndex]);
+	XMFLOAT3 extents(bounds.ExtentX[denseIndex], bounds.ExtentY[denseIndex], bounds.ExtentZ[denseIndex]);
+	m_bvh.SetItem(m_scene.Slots()[denseIndex], center, extents);
+}
+
+void MyEngine::RebuildBvh()
+{
+	m_bvh.Clear();
+	for (uint32_t i = 0; i < m_scene.Size(); ++i)
+		UpdateBvhItem(i);
+	m_bvh.Rebuild();
+}
+
+void MyEngine::DrawRenderItems(CommandRecorder& recorder, const vector<uint32_t>& items, uint32_t begin, uint32_t end)
+{
+	const DrawKey* drawKeys = m_scene.DrawKeys();
+	const uint32_t* slots = m_scene.Slots();
+
+	recorder.SetPipelineState(m_PSO.Get());
+
+	// For each render item. The recorder skips the buffer and topology changes
+	// between items of the same geometry.
+	for (uint32_t i = begin; i < end; ++i)
 	{
-		auto ri = ritems[i];
+		const DrawKey& key = drawKeys[items[i]];
+		const GeometryRecord* geometry = m_geometries.Get(key.Geometry);
+
+		recorder.SetVertexBuffers(0, 1, &geometry->VertexBuffer);
+		recorder.SetIndexBuffer(geometry->IndexBuffer);
+		recorder.SetPrimitiveTopology(key.PrimitiveType);
+
+		// The shader reads the object data of this slot from the object buffer.
+		recorder.SetRoot32BitConstant(0, slots[items[i]], 0);
 
-		cmdList->IASetVertexBuffers(0, 1, &ri->Geo->VertexBufferView());
-		cmdList->IASetIndexBuffer(&ri->Geo->IndexBufferView());
-		cmdList->IASetPrimitiveTopology(ri->PrimitiveType);
+		recorder.DrawIndexedInstanced(key.IndexCount, 1, key.StartIndexLocation, key.BaseVertexLocation, 0);
+	}
+}
 
-		// Offset to the CBV in the descriptor heap for this object and for this frame resource.
-		UINT cbvIndex = m_currentResourceIndex*(UINT)m_opaqueRenderItems.size() + ri->ObjCBIndex;
-		auto cbvHandle = CD3DX12_GPU_DESCRIPTOR_HANDLE(m_cbvHeap->GetGPUDescriptorHandleForHeapStart());
-		cbvHandle.Offset(cbvIndex, mCbvSrvUavDescriptorSize);
+void MyEngine::DrawInstanceBatches(CommandRecorder& recorder, uint32_t begin, uint32_t end)
+{
+	recorder.SetPipelineState(m_instancedPSO.Get());
+
+	VertexBufferBinding instanceView;
+	instanceView.BufferLocation = m_instanceBufferAddress;
+	instanceView.StrideInBytes = sizeof(InstanceData);
+	instanceView.SizeInBytes = (UINT)(sizeof(InstanceData)*m_instanceBatcher.GetInstances().size());
+
+	// One draw per batch. StartInstanceLocation offsets the reads of the instance stream.
+	const vector<InstanceBatch>& batches = m_instanceBatcher.GetBatches();
+	for (uint32_t i = begin; i < end; ++i)
+	{
+		const InstanceBatch& batch = batches[i];
+		const DrawKey& key = batch.Draw;
+		const GeometryRecord* geometry = m_geometries.Get(key.Geometry);
 
-		cmdList->SetGraphicsRootDescriptorTable(0, cbvHandle);
+		VertexBufferBinding views[] = { geometry->VertexBuffer, instanceView };
+		recorder.SetVertexBuffers(0, _countof(views), views);
+		recorder.SetIndexBuffer(geometry->IndexBuffer);
+		recorder.SetPrimitiveTopology(key.PrimitiveType);
 
-		cmdList->DrawIndexedInstanced(ri->IndexCount, 1, ri->StartIndexLocation, ri->BaseVertexLocation, 0);
+		recorder.DrawIndexedInstanced(key.IndexCount, batch.InstanceCount, key.StartIndexLocation, key.BaseVertexLocation, batch.FirstInstance);
 	}
 }
 
+void MyEngine::DrawIndirectBatches(CommandRecorder& recorder, uint32_t begin, uint32_t end)
+{
+	recorder.SetPipelineState(m_PSO.Get());
+
+	// The object index of every command addresses the per-draw data of this frame.
+	recorder.SetRootShaderResourceView(2, m_indirectDataAddress);
+
+	const vector<IndirectBatch>& batches = m_indirectPacker.GetBatches();
+	for (uint32_t i = begin; i < end; ++i)
+	{
+		const IndirectBatch& batch = batches[i];
+		const GeometryRecord* geometry = m_geometries.Get(batch.Geometry);
+
+		recorder.SetVertexBuffers(0, 1, &geometry->VertexBuffer);
+		recorder.SetIndexBuffer(geometry->IndexBuffer);
+		recorder.SetPrimitiveTopology(batch.PrimitiveType);
+
+		recorder.ExecuteIndirect(m_commandSignature.Get(), batch.CommandCount, m_indirectArguments.Resource,
+			m_indirectArguments.Offset + sizeof(IndirectCommand)*batch.FirstCommand);
+	}
+}
+
+void MyEngine::SelectStaticBatches()
+{
+	XMFLOAT4 planes[6];
+	m_Camera.GetFrustumPlanes(planes);
+	m_staticBatcher.Select(m_Camera.GetPosition(), planes, m_staticDraws);
+
+	// The merged meshes are already in world space; they are drawn as one
+	// object with an identity transform.
+	ObjectData identity;
+	UploadAllocation object;
+	if (!AllocateUpload(sizeof(ObjectData), 16, UploadStaticObject, object))
+		return;
+
+	memcpy(object.CpuAddress, &identity, sizeof(ObjectData));
+	m_staticObjectAddress = object.GpuAddress;
+}
+
+void MyEngine::DrawStaticBatches(CommandRecorder& recorder)
+{
+	recorder.SetPipelineState(m_PSO.Get());
+	recorder.SetRootShaderResourceView(2, m_staticObjectAddress);
+	recorder.SetRoot32BitConstant(0, 0, 0);
+
+	const GeometryRecord* geometry = m_geometries.Get(m_staticGeometry);
+	recorder.SetVertexBuffers(0, 1, &geometry->VertexBuffer);
+	recorder.SetIndexBuffer(geometry->IndexBuffer);
+	recorder.SetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+
+	// The indices address the merged vertices directly.
+	for (const HlodDraw& draw : m_staticDraws)
+		recorder.DrawIndexedInstanced(draw.IndexCount, 1, draw.StartIndex, 0, 0);
+}
+
 void MyEngine::OnMouseDown(WPARAM btnState, int x, int y)
 {
 	m_mousePosition.x = x;
 	m_mousePosition.y = y;
 
+	if ((btnState & MK_RBUTTON) != 0)
+		PickRenderItem(x, y);
+
 	SetCapture(mhMainWnd);
 }
 
@@ -685,6 +2325,179 @@ void MyEngine::OnMouseMove(WPARAM btnState, int x, int y)
 	ReleaseCapture();
 }
 
+void MyEngine::OnKeyUp(WPARAM key)
+{
+	// B switches culling and picking between the BVH and linear tests. The BVH
+	// is dropped while off and built from the scene when turned back on.
+	if (key == 'B')
+	{
+		m_useBvh = !m_useBvh;
+		if (m_useBvh)
+			RebuildBvh();
+		else
+			m_bvh.Clear();
+	}
+
+	// O switches software occlusion culling on and off.
+	if (key == 'O')
+		m_useOcclusion = !m_useOcclusion;
+
+	// T starts and stops streaming boxes in and out of the scene.
+	if (key == 'T')
+	{
+		if (m_streaming)
+			StopStreaming();
+		else
+			m_streaming = true;
+	}
+
+	// I switches between instanced draws and one draw per item.
+	if (key == 'I')
+		m_useInstancing = !m_useInstancing;
+
+	// X switches indirect draws from packed argument buffers on and off.
+	if (key == 'X')
+		m_useIndirect = !m_useIndirect;
+
+	// + and - keep the finer levels of detail for longer or shorter.
+	if (key == VK_OEM_PLUS)
+		m_lodSelector.SetBias(m_lodSelector.GetBias()*1.25f);
+	if (key == VK_OEM_MINUS)
+		m_lodSelector.SetBias(m_lodSelector.GetBias() / 1.25f);
+
+	// V switches the visibility cache on and off. Moves while it was off are not
+	// tracked, so it starts over.
+	if (key == 'V')
+	{
+		m_useVisibilityCache = !m_useVisibilityCache;
+		m_visibilityCache.InvalidateAll();
+	}
+
+	// P switches culling through the potentially visible sets on and off. The
+	// sets are built again every time it is turned on.
+	if (key == 'P')
+	{
+		m_usePvs = !m_usePvs;
+		if (m_usePvs)
+			BuildPvs();
+	}
+
+	// N adds a generated stress scene to the scene.
+	if (key == 'N')
+		AddStressScene();
+
+	// C streams the world partition around the camera, or drops it again.
+	if (key == 'C')
+		ToggleWorldStreaming();
+
+	// U loads a geometry on a worker thread and shows it, or releases it again.
+	if (key == 'U')
+		ToggleLoadedGeometry();
+
+	// G shows and hides the static scenery.
+	if (key == 'G')
+		m_drawStatic = !m_drawStatic;
+}
+
+wstring MyEngine::GetFrameStatsText()const
+{
+	wstring text;
+
+	if (m_usePvs)
+	{
+		const PvsStats& pvs = m_pvs.GetStats();
+		text = L"    pvs visible: " + to_wstring(pvs.Visible) + L"/" + to_wstring(pvs.Candidates) + L"/" + to_wstring(m_scene.Size()) +
+			L"    cull us: " + to_wstring((int)pvs.CullMicroseconds);
+	}
+	else if (m_useVisibilityCache)
+	{
+		const VisibilityCacheStats& cache = m_visibilityCache.GetStats();
+		text = L"    cached visible: " + to_wstring(cache.Visible) + L"/" + to_wstring(cache.Items) +
+			L" (" + to_wstring(cache.Retested) + L" retested, " + to_wstring(cache.Uncached) + L" uncached)    cull us: " + to_wstring((int)cache.CullMicroseconds);
+	}
+	else if (m_useBvh)
+	{
+		const BvhStats& bvh = m_bvh.GetStats();
+		text = L"    bvh visible: " + to_wstring(m_drawList.size()) + L"/" + to_wstring(m_scene.Size()) +
+			L"    nodes visited: " + to_wstring(bvh.NodesVisited);
+	}
+	else
+	{
+		const CullStats& cull = m_frustumCuller.GetStats();
+		text = L"    visible: " + to_wstring(cull.Visible) + L"/" + to_wstring(cull.Tested) +
+			L"    cull ns/item: " + to_wstring(cull.NsPerItem);
+	}
+
+	if (m_useOcclusion)
+	{
+		const OcclusionStats& occlusion = m_occlusionCuller.GetStats();
+		text += L"    occluded: " + to_wstring(occlusion.Occluded) + L"/" + to_wstring(occlusion.Tested) +
+			L" (" + to_wstring((int)(100.0f*occlusion.CullRate())) + L"%)" +
+			L"    occlusion us: " + to_wstring((int)(occlusion.RasterMicroseconds + occlusion.TestMicroseconds));
+	}
+
+	if (m_useIndirect)
+	{
+		const IndirectPackStats& indirect = m_indirectPacker.GetStats();
+		text += L"    indirect: " + to_wstring(indirect.Commands) + L" commands in " + to_wstring(indirect.Batches) +
+			L" executes, pack us: " + to_wstring((int)indirect.PackMicroseconds);
+	}
+	else
+	{
+		uint32_t drawCalls = m_useInstancing ? m_instanceBatcher.GetStats().Batches : (uint32_t)m_drawList.size();
+		text += L"    draws: " + to_wstring(drawCalls) + L"/" + to_wstring(m_drawList.size());
+	}
+
+	const LodStats& lods = m_lodSelector.GetStats();
+	text += L"    lod tris: " + to_wstring(lods.TrianglesBefore) + L" -> " + to_wstring(lods.TrianglesAfter) +
+		L" (" + to_wstring(lods.Changed) + L"/" + to_wstring(lods.Items) + L" switched, bias " + to_wstring(m_lodSelector.GetBias()) + L")";
+
+	RecorderStats recorder = m_parallelRecorder.GetStats();
+	text += L"    commands: " + to_wstring(recorder.TotalEmitted()) + L" (" + to_wstring(recorder.TotalElided()) + L" elided)" +
+		L" on " + to_wstring(m_parallelRecorder.GetChunks().size()) + L" lists";
+
+	text += L"    slots: " + to_wstring(m_scene.SlotCount()) + L"/" + to_wstring(m_objectCapacity) +
+		L" (" + to_wstring(m_scene.RetiredSlotCount()) + L" retired)";
+	if (m_streaming)
+		text += L"    streamed: " + to_wstring(m_streamedItems.size()) + L" (+/-" + to_wstring(gStreamedItemsPerFrame) + L" per frame)";
+
+	if (m_streamWorld)
+	{
+		const WorldPartitionStats& world = m_worldPartition.GetStats();
+		text += L"    world cells: " + to_wstring(world.Resident) + L" (" + to_wstring(world.Loading) + L" loading), " +
+			to_wstring(world.UsedBytes >> 10) + L"/" + to_wstring(gWorldMemoryBudget >> 10) + L" KB, loads: " + to_wstring(world.Loads) +
+			L" (" + to_wstring(world.Prefetches) + L" ahead), evicted: " + to_wstring(world.Evictions);
+	}
+
+	if (m_drawStatic)
+	{
+		const StaticBatchStats& batches = m_staticBatcher.GetStats();
+		text += L"    static draws: " + to_wstring(batches.Draws) + L" (" + to_wstring(batches.ProxyDraws) + L" proxies) for " +
+			to_wstring(batches.Instances) + L" objects, tris: " + to_wstring(batches.TrianglesDrawn);
+	}
+
+	text += L"    uploaded: " + to_wstring(m_uploadedObjects) + L" (" + to_wstring(m_uploadedBytes) + L" bytes)" +
+		L"    ring: " + to_wstring(m_uploadRing->GetUsed() / 1024) + L"/" + to_wstring(m_uploadRing->GetCapacity() / 1024) + L" KB";
+
+	const RenderQueueStats& queue = m_renderQueue.GetStats();
+	text += L"    state changes: " + to_wstring(queue.StateChanges) +
+		L"    sort us: " + to_wstring((int)(queue.BuildMicroseconds + queue.SortMicroseconds));
+
+	if (m_pickedSlot != UINT32_MAX)
+		text += L"    picked: " + to_wstring(m_pickedSlot);
+
+	// Share of the last second every worker spent running jobs.
+	vector<WorkerStats> workers;
+	JobSystem::Get().SampleWorkerStats(workers);
+	text += L"    workers busy %:";
+	for (const WorkerStats& worker : workers)
+		text += L" " + to_wstring((int)(worker.BusyMicroseconds / 10000.0));
+
+	text += m_statusText;
+
+	return text;
+}
+
 void MyEngine::OnKeyboardInput(const Timer& m_timer)
 {
 	const float delta_time = m_timer.DTime();
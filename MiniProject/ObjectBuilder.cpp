@@ -1,6 +1,7 @@
 
 #include "ObjectBuilder.h"
 #include <algorithm>
+#include <cmath>
 
 using namespace DirectX;
 using namespace std;
@@ -153,6 +154,78 @@ ObjectBuilder::MeshData ObjectBuilder::CreatePyramid(float width, float depth, f
 }
 
 
+ObjectBuilder::MeshData ObjectBuilder::CreateSphere(float radius, uint32_t sliceCount, uint32_t stackCount)
+{
+	MeshData meshData;
+
+	//
+	// Create the vertices, stack by stack from the top pole to the bottom pole.
+	//
+
+	meshData.Vertices.push_back(Vertex(0.0f, +radius, 0.0f, 0.0f, +1.0f, 0.0f));
+
+	float phiStep = XM_PI / stackCount;
+	float thetaStep = 2.0f*XM_PI / sliceCount;
+
+	// The poles are single vertices, so the rings go from stack 1 to stackCount - 1.
+	for (uint32_t i = 1; i < stackCount; ++i)
+	{
+		float phi = i*phiStep;
+
+		// One extra vertex per ring closes the seam.
+		for (uint32_t j = 0; j <= sliceCount; ++j)
+		{
+			float theta = j*thetaStep;
+
+			XMFLOAT3 n(sinf(phi)*cosf(theta), cosf(phi), sinf(phi)*sinf(theta));
+			meshData.Vertices.push_back(Vertex(radius*n.x, radius*n.y, radius*n.z, n.x, n.y, n.z));
+		}
+	}
+
+	meshData.Vertices.push_back(Vertex(0.0f, -radius, 0.0f, 0.0f, -1.0f, 0.0f));
+
+	//
+	// Create the indices.
+	//
+
+	// Top cap: the top pole and the first ring.
+	for (uint32_t j = 1; j <= sliceCount; ++j)
+	{
+		meshData.Indices32.push_back(0);
+		meshData.Indices32.push_back(j + 1);
+		meshData.Indices32.push_back(j);
+	}
+
+	// Two triangles per quad between consecutive rings.
+	uint32_t baseIndex = 1;
+	uint32_t ringVertexCount = sliceCount + 1;
+	for (uint32_t i = 0; i < stackCount - 2; ++i)
+	{
+		for (uint32_t j = 0; j < sliceCount; ++j)
+		{
+			meshData.Indices32.push_back(baseIndex + i*ringVertexCount + j);
+			meshData.Indices32.push_back(baseIndex + i*ringVertexCount + j + 1);
+			meshData.Indices32.push_back(baseIndex + (i + 1)*ringVertexCount + j);
+
+			meshData.Indices32.push_back(baseIndex + (i + 1)*ringVertexCount + j);
+			meshData.Indices32.push_back(baseIndex + i*ringVertexCount + j + 1);
+			meshData.Indices32.push_back(baseIndex + (i + 1)*ringVertexCount + j + 1);
+		}
+	}
+
+	// Bottom cap: the last ring and the bottom pole.
+	uint32_t southPoleIndex = (uint32_t)meshData.Vertices.size() - 1;
+	baseIndex = southPoleIndex - ringVertexCount;
+	for (uint32_t j = 0; j < sliceCount; ++j)
+	{
+		meshData.Indices32.push_back(southPoleIndex);
+		meshData.Indices32.push_back(baseIndex + j);
+		meshData.Indices32.push_back(baseIndex + j + 1);
+	}
+
+	return meshData;
+}
+
 
 ObjectBuilder::MeshData ObjectBuilder::CreateGrid(float width, float depth, uint32_t m, uint32_t n)
 {
@@ -33,6 +33,10 @@ public:
 
 	MeshData CreatePyramid(float width, float depth, float height);
 
+	// Creates a sphere centered at the origin with the given radius, cut into slices around
+	// the Y axis and stacks from pole to pole. Fewer slices and stacks give coarser levels of detail.
+	MeshData CreateSphere(float radius, uint32_t sliceCount, uint32_t stackCount);
+
 	// Creates an MxN grid in the xz-plane with m rows and n columns, centered at the origin with the specified width and depth.
 	MeshData CreateGrid(float width, float depth, uint32_t m, uint32_t n);
 
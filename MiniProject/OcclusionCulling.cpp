@@ -0,0 +1,431 @@
+
+#include "OcclusionCulling.h"
+#include "OcclusionRaster.h"
+#include "Parallel.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+using namespace DirectX;
+using namespace std;
+
+namespace
+{
+	// Vertices closer than this to the eye plane are not projected.
+	const float kMinW = 1e-4f;
+
+	// True when the CPU runs AVX2 and the OS saves the AVX registers.
+	bool CpuSupportsAvx2()
+	{
+#if defined(_MSC_VER)
+		int info[4];
+		__cpuid(info, 0);
+		if (info[0] < 7)
+			return false;
+
+		// OSXSAVE and AVX, then the XMM and YMM state enabled in XCR0.
+		__cpuid(info, 1);
+		if ((info[2] & (1 << 27)) == 0 || (info[2] & (1 << 28)) == 0)
+			return false;
+		if ((_xgetbv(0) & 6) != 6)
+			return false;
+
+		__cpuidex(info, 7, 0);
+		return (info[1] & (1 << 5)) != 0;
+#elif defined(__GNUC__)
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("avx2") != 0;
+#else
+		return false;
+#endif
+	}
+}
+
+OcclusionCuller::OcclusionCuller(uint32_t width, uint32_t height)
+{
+	// Round up to whole coarse tiles so the rasterizer never needs partial rows of 8.
+	const uint32_t coarsePixels = TileSize*CoarseTiles;
+	m_width = max(coarsePixels, (width + coarsePixels - 1) / coarsePixels*coarsePixels);
+	m_height = max(coarsePixels, (height + coarsePixels - 1) / coarsePixels*coarsePixels);
+
+	m_tilesX = m_width / TileSize;
+	m_tilesY = m_height / TileSize;
+	m_coarseX = m_tilesX / CoarseTiles;
+	m_coarseY = m_tilesY / CoarseTiles;
+
+	m_depth.assign(m_width*m_height, 1.0f);
+	m_tileMaxDepth.assign(m_tilesX*m_tilesY, 1.0f);
+	m_coarseMaxDepth.assign(m_coarseX*m_coarseY, 1.0f);
+
+	XMStoreFloat4x4(&m_viewProj, XMMatrixIdentity());
+
+	SetUseAvx2(true);
+}
+
+uint32_t OcclusionCuller::AddOccluderMesh(const vector<XMFLOAT3>& positions, const vector<uint32_t>& indices)
+{
+	OccluderMesh mesh;
+	mesh.Positions = positions;
+	mesh.Indices = indices;
+	m_meshes.push_back(move(mesh));
+
+	return (uint32_t)m_meshes.size() - 1;
+}
+
+void OcclusionCuller::BeginFrame(const XMFLOAT4X4& viewProj)
+{
+	m_viewProj = viewProj;
+	m_occluders.clear();
+
+	fill(m_depth.begin(), m_depth.end(), 1.0f);
+	fill(m_tileMaxDepth.begin(), m_tileMaxDepth.end(), 1.0f);
+	fill(m_coarseMaxDepth.begin(), m_coarseMaxDepth.end(), 1.0f);
+
+	m_stats = OcclusionStats();
+}
+
+void OcclusionCuller::AddOccluder(uint32_t mesh, const XMFLOAT3X4& world)
+{
+	Occluder occluder;
+	occluder.Mesh = mesh;
+	occluder.World = world;
+	m_occluders.push_back(occluder);
+}
+
+void OcclusionCuller::RasterizeOccluders()
+{
+	auto start = chrono::high_resolution_clock::now();
+
+	SetupTriangles();
+
+	// Each band of coarse tile rows is rasterized by one thread, so no two threads
+	// ever write the same pixel or tile.
+	const uint32_t bandRows = TileSize*CoarseTiles;
+	ParallelFor(m_coarseY, 1, [this, bandRows](uint32_t begin, uint32_t end)
+	{
+		for (uint32_t band = begin; band < end; ++band)
+		{
+			RasterizeBand(band*bandRows, (band + 1)*bandRows);
+			BuildHierarchy(band*CoarseTiles, (band + 1)*CoarseTiles);
+		}
+	});
+
+	auto end = chrono::high_resolution_clock::now();
+
+	m_stats.Occluders = (uint32_t)m_occluders.size();
+	m_stats.Triangles = (uint32_t)m_triangles.size();
+	m_stats.RasterMicroseconds = chrono::duration<double, micro>(end - start).count();
+}
+
+void OcclusionCuller::CullOccludees(const BoundsSoA& bounds, vector<uint32_t>& items)
+{
+	auto start = chrono::high_resolution_clock::now();
+
+	m_occluded.resize(items.size());
+	ParallelFor((uint32_t)items.size(), 1024, [this, &bounds, &items](uint32_t begin, uint32_t end)
+	{
+		for (uint32_t i = begin; i < end; ++i)
+		{
+			uint32_t item = items[i];
+			XMFLOAT3 center(bounds.CenterX[item], bounds.CenterY[item], bounds.CenterZ[item]);
+			XMFLOAT3 extents(bounds.ExtentX[item], bounds.ExtentY[item], bounds.ExtentZ[item]);
+
+			m_occluded[i] = IsOccluded(center, extents) ? 1 : 0;
+		}
+	});
+
+	size_t visibleCount = 0;
+	for (size_t i = 0; i < items.size(); ++i)
+	{
+		if (!m_occluded[i])
+			items[visibleCount++] = items[i];
+	}
+
+	auto end = chrono::high_resolution_clock::now();
+
+	m_stats.Tested = (uint32_t)items.size();
+	m_stats.Occluded = (uint32_t)(items.size() - visibleCount);
+	m_stats.TestMicroseconds = chrono::duration<double, micro>(end - start).count();
+
+	items.resize(visibleCount);
+}
+
+bool OcclusionCuller::IsOccluded(const XMFLOAT3& center, const XMFLOAT3& extents)const
+{
+	XMMATRIX viewProj = XMLoadFloat4x4(&m_viewProj);
+
+	// The clip space corners are the projected center plus or minus the projected
+	// half axes, which saves seven matrix transforms.
+	XMVECTOR c = XMVector3Transform(XMLoadFloat3(&center), viewProj);
+	XMVECTOR ax = XMVectorScale(viewProj.r[0], extents.x);
+	XMVECTOR ay = XMVectorScale(viewProj.r[1], extents.y);
+	XMVECTOR az = XMVectorScale(viewProj.r[2], extents.z);
+
+	// Screen rectangle and nearest depth of the projected box corners.
+	float minX = 1.0f, maxX = -1.0f, minY = 1.0f, maxY = -1.0f, minZ = 1.0f;
+	for (int i = 0; i < 8; ++i)
+	{
+		XMVECTOR corner = c;
+		corner = (i & 1) ? XMVectorAdd(corner, ax) : XMVectorSubtract(corner, ax);
+		corner = (i & 2) ? XMVectorAdd(corner, ay) : XMVectorSubtract(corner, ay);
+		corner = (i & 4) ? XMVectorAdd(corner, az) : XMVectorSubtract(corner, az);
+
+		XMFLOAT4 clip;
+		XMStoreFloat4(&clip, corner);
+
+		// Boxes crossing the eye plane are always visible.
+		if (clip.w < kMinW)
+			return false;
+
+		float invW = 1.0f / clip.w;
+		minX = min(minX, clip.x*invW);
+		maxX = max(maxX, clip.x*invW);
+		minY = min(minY, clip.y*invW);
+		maxY = max(maxY, clip.y*invW);
+		minZ = min(minZ, clip.z*invW);
+	}
+
+	if (minZ <= 0.0f)
+		return false;
+
+	float x0 = (minX*0.5f + 0.5f)*m_width;
+	float x1 = (maxX*0.5f + 0.5f)*m_width;
+	float y0 = (0.5f - maxY*0.5f)*m_height;
+	float y1 = (0.5f - minY*0.5f)*m_height;
+
+	// Off screen boxes are left to the frustum culler.
+	if (x1 < 0.0f || y1 < 0.0f || x0 >= (float)m_width || y0 >= (float)m_height)
+		return false;
+
+	uint32_t tx0 = (uint32_t)max(0.0f, x0) / TileSize;
+	uint32_t ty0 = (uint32_t)max(0.0f, y0) / TileSize;
+	uint32_t tx1 = min(m_tilesX - 1, (uint32_t)min(x1, (float)m_width - 1.0f) / TileSize);
+	uint32_t ty1 = min(m_tilesY - 1, (uint32_t)min(y1, (float)m_height - 1.0f) / TileSize);
+
+	// Test the coarse level first and descend only into coarse tiles that may let the box through.
+	for (uint32_t cy = ty0 / CoarseTiles; cy <= ty1 / CoarseTiles; ++cy)
+	{
+		for (uint32_t cx = tx0 / CoarseTiles; cx <= tx1 / CoarseTiles; ++cx)
+		{
+			if (m_coarseMaxDepth[cy*m_coarseX + cx] < minZ)
+				continue;
+
+			uint32_t fy0 = max(ty0, cy*CoarseTiles), fy1 = min(ty1, cy*CoarseTiles + CoarseTiles - 1);
+			uint32_t fx0 = max(tx0, cx*CoarseTiles), fx1 = min(tx1, cx*CoarseTiles + CoarseTiles - 1);
+			for (uint32_t ty = fy0; ty <= fy1; ++ty)
+			{
+				for (uint32_t tx = fx0; tx <= fx1; ++tx)
+				{
+					if (m_tileMaxDepth[ty*m_tilesX + tx] >= minZ)
+						return false;
+				}
+			}
+		}
+	}
+
+	return true;
+}
+
+uint32_t OcclusionCuller::GetWidth()const
+{
+	return m_width;
+}
+
+uint32_t OcclusionCuller::GetHeight()const
+{
+	return m_height;
+}
+
+const float* OcclusionCuller::GetDepthBuffer()const
+{
+	return m_depth.data();
+}
+
+void OcclusionCuller::SetUseAvx2(bool enabled)
+{
+	static const bool avx2 = CpuSupportsAvx2();
+	m_useAvx2 = enabled && avx2;
+}
+
+bool OcclusionCuller::GetUseAvx2()const
+{
+	return m_useAvx2;
+}
+
+const OcclusionStats& OcclusionCuller::GetStats()const
+{
+	return m_stats;
+}
+
+void OcclusionCuller::SetupTriangles()
+{
+	m_triangles.clear();
+
+	XMMATRIX viewProj = XMLoadFloat4x4(&m_viewProj);
+	vector<XMFLOAT4> clip;
+
+	for (const Occluder& occluder : m_occluders)
+	{
+		const OccluderMesh& mesh = m_meshes[occluder.Mesh];
+		XMMATRIX worldViewProj = XMMatrixMultiply(XMLoadFloat3x4(&occluder.World), viewProj);
+
+		clip.resize(mesh.Positions.size());
+		for (size_t i = 0; i < mesh.Positions.size(); ++i)
+			XMStoreFloat4(&clip[i], XMVector3Transform(XMLoadFloat3(&mesh.Positions[i]), worldViewProj));
+
+		for (size_t i = 0; i + 2 < mesh.Indices.size(); i += 3)
+		{
+			ScreenTriangle tri;
+			bool clipped = false;
+			for (int k = 0; k < 3; ++k)
+			{
+				const XMFLOAT4& c = clip[mesh.Indices[i + k]];
+
+				// Occluders must never hide more than they cover, so triangles that
+				// would need near plane clipping are simply dropped.
+				if (c.w < kMinW || c.z < 0.0f)
+				{
+					clipped = true;
+					break;
+				}
+
+				float invW = 1.0f / c.w;
+				tri.V[k] = XMFLOAT3((c.x*invW*0.5f + 0.5f)*m_width, (0.5f - c.y*invW*0.5f)*m_height, c.z*invW);
+			}
+
+			if (clipped)
+				continue;
+
+			float minX = min(tri.V[0].x, min(tri.V[1].x, tri.V[2].x));
+			float maxX = max(tri.V[0].x, max(tri.V[1].x, tri.V[2].x));
+			float minY = min(tri.V[0].y, min(tri.V[1].y, tri.V[2].y));
+			float maxY = max(tri.V[0].y, max(tri.V[1].y, tri.V[2].y));
+			if (maxX < 0.0f || maxY < 0.0f || minX >= (float)m_width || minY >= (float)m_height)
+				continue;
+
+			m_triangles.push_back(tri);
+		}
+	}
+}
+
+void OcclusionCuller::RasterizeBand(uint32_t rowBegin, uint32_t rowEnd)
+{
+	for (const ScreenTriangle& tri : m_triangles)
+	{
+		float minY = min(tri.V[0].y, min(tri.V[1].y, tri.V[2].y));
+		float maxY = max(tri.V[0].y, max(tri.V[1].y, tri.V[2].y));
+		if (maxY < (float)rowBegin || minY >= (float)rowEnd)
+			continue;
+
+		RasterizeTriangle(tri, rowBegin, rowEnd);
+	}
+}
+
+void OcclusionCuller::RasterizeTriangle(const ScreenTriangle& tri, uint32_t rowBegin, uint32_t rowEnd)
+{
+	XMFLOAT3 v0 = tri.V[0];
+	XMFLOAT3 v1 = tri.V[1];
+	XMFLOAT3 v2 = tri.V[2];
+
+	// Both windings are rasterized; make the signed area positive.
+	float area = (v1.x - v0.x)*(v2.y - v0.y) - (v2.x - v0.x)*(v1.y - v0.y);
+	if (area < 0.0f)
+	{
+		swap(v1, v2);
+		area = -area;
+	}
+	if (area < 1e-6f)
+		return;
+
+	int minX = max(0, (int)floorf(min(v0.x, min(v1.x, v2.x))));
+	int maxX = min((int)m_width - 1, (int)ceilf(max(v0.x, max(v1.x, v2.x))));
+	int minY = max((int)rowBegin, (int)floorf(min(v0.y, min(v1.y, v2.y))));
+	int maxY = min((int)rowEnd - 1, (int)ceilf(max(v0.y, max(v1.y, v2.y))));
+	if (minX > maxX || minY > maxY)
+		return;
+
+	// Edge functions E(x, y) = A*x + B*y + C, non-negative inside the triangle.
+	auto edge = [](const XMFLOAT3& a, const XMFLOAT3& b, float& A, float& B, float& C)
+	{
+		A = -(b.y - a.y);
+		B = b.x - a.x;
+		C = a.x*(b.y - a.y) - a.y*(b.x - a.x);
+	};
+
+	float A0, B0, C0, A1, B1, C1, A2, B2, C2;
+	edge(v1, v2, A0, B0, C0);
+	edge(v2, v0, A1, B1, C1);
+	edge(v0, v1, A2, B2, C2);
+
+	// Depth plane through the three vertices. The pixel center value is pushed back
+	// by the largest change inside the pixel, so the written depth is never nearer
+	// than the occluder surface.
+	float dzdx = ((v1.z - v0.z)*(v2.y - v0.y) - (v2.z - v0.z)*(v1.y - v0.y)) / area;
+	float dzdy = ((v2.z - v0.z)*(v1.x - v0.x) - (v1.z - v0.z)*(v2.x - v0.x)) / area;
+	float zBias = 0.5f*(fabsf(dzdx) + fabsf(dzdy));
+	float z0 = v0.z - dzdx*v0.x - dzdy*v0.y + zBias;
+
+	int startX = minX & ~7;
+
+	if (m_useAvx2)
+	{
+		RasterTriangle raster = { { A0, A1, A2 }, { B0, B1, B2 }, { C0, C1, C2 }, z0, dzdx, dzdy };
+		RasterizeRowsAvx2(raster, m_depth.data(), m_width, startX, maxX, minY, maxY);
+		return;
+	}
+
+	// The sums are grouped as in RasterizeRowsAvx2, so both write the same depths.
+	for (int y = minY; y <= maxY; ++y)
+	{
+		float py = y + 0.5f;
+		float r0 = B0*py + C0;
+		float r1 = B1*py + C1;
+		float r2 = B2*py + C2;
+		float rz = z0 + dzdy*py;
+
+		float* row = &m_depth[y*m_width];
+		for (int x = startX; x <= maxX; ++x)
+		{
+			float px = x + 0.5f;
+			if (A0*px + r0 < 0.0f || A1*px + r1 < 0.0f || A2*px + r2 < 0.0f)
+				continue;
+
+			row[x] = min(row[x], dzdx*px + rz);
+		}
+	}
+}
+
+void OcclusionCuller::BuildHierarchy(uint32_t tileRowBegin, uint32_t tileRowEnd)
+{
+	for (uint32_t ty = tileRowBegin; ty < tileRowEnd; ++ty)
+	{
+		for (uint32_t tx = 0; tx < m_tilesX; ++tx)
+		{
+			float maxDepth = 0.0f;
+			for (uint32_t y = ty*TileSize; y < (ty + 1)*TileSize; ++y)
+			{
+				const float* row = &m_depth[y*m_width + tx*TileSize];
+				for (uint32_t x = 0; x < TileSize; ++x)
+					maxDepth = max(maxDepth, row[x]);
+			}
+			m_tileMaxDepth[ty*m_tilesX + tx] = maxDepth;
+		}
+	}
+
+	for (uint32_t cy = tileRowBegin / CoarseTiles; cy < tileRowEnd / CoarseTiles; ++cy)
+	{
+		for (uint32_t cx = 0; cx < m_coarseX; ++cx)
+		{
+			float maxDepth = 0.0f;
+			for (uint32_t ty = cy*CoarseTiles; ty < (cy + 1)*CoarseTiles; ++ty)
+			{
+				for (uint32_t tx = cx*CoarseTiles; tx < (cx + 1)*CoarseTiles; ++tx)
+					maxDepth = max(maxDepth, m_tileMaxDepth[ty*m_tilesX + tx]);
+			}
+			m_coarseMaxDepth[cy*m_coarseX + cx] = maxDepth;
+		}
+	}
+}
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <DirectXMath.h>
+#include "SceneStore.h"
+
+using namespace DirectX;
+using namespace std;
+
+
+struct OcclusionStats
+{
+	uint32_t Occluders = 0;
+	uint32_t Triangles = 0;
+	uint32_t Tested = 0;
+	uint32_t Occluded = 0;
+
+	double RasterMicroseconds = 0.0;
+	double TestMicroseconds = 0.0;
+
+	// Fraction of the tested items that were occluded.
+	float CullRate()const { return Tested > 0 ? (float)Occluded / Tested : 0.0f; }
+};
+
+// CPU occlusion culling. Occluder triangles are rasterized into a small depth buffer,
+// 8 pixels per iteration with a coverage mask on CPUs with AVX2 and one pixel at a
+// time on others, by several threads that each own a band of rows. The farthest
+// depth of every 8x8 tile, and of every 4x4 group of tiles, forms a two level
+// hierarchy that occludee bounds are tested against.
+// Depth follows the D3D convention: 0 at the near plane, 1 at the far plane.
+class OcclusionCuller
+{
+public:
+
+	static const uint32_t TileSize = 8;
+	static const uint32_t CoarseTiles = 4;
+
+	OcclusionCuller(uint32_t width = 256, uint32_t height = 128);
+
+	// Registers a closed triangle mesh in local space that items can use as occluder.
+	uint32_t AddOccluderMesh(const vector<XMFLOAT3>& positions, const vector<uint32_t>& indices);
+
+	// Clears the depth buffer and the occluder list for a new frame.
+	void BeginFrame(const XMFLOAT4X4& viewProj);
+	void AddOccluder(uint32_t mesh, const XMFLOAT3X4& world);
+
+	// Rasterizes the occluders added since BeginFrame and builds the hierarchy.
+	void RasterizeOccluders();
+
+	// Removes the items hidden behind the occluders from items (dense indices into bounds).
+	void CullOccludees(const BoundsSoA& bounds, vector<uint32_t>& items);
+
+	// Tests a world space box against the depth hierarchy.
+	bool IsOccluded(const XMFLOAT3& center, const XMFLOAT3& extents)const;
+
+	uint32_t GetWidth()const;
+	uint32_t GetHeight()const;
+	const float* GetDepthBuffer()const;
+
+	// The AVX2 loop rasterizes when enabled, the default, and the CPU runs it.
+	// Otherwise the scalar loop does, which writes the same depths.
+	void SetUseAvx2(bool enabled);
+	bool GetUseAvx2()const;
+
+	const OcclusionStats& GetStats()const;
+
+private:
+
+	struct OccluderMesh
+	{
+		vector<XMFLOAT3> Positions;
+		vector<uint32_t> Indices;
+	};
+
+	struct Occluder
+	{
+		uint32_t Mesh;
+		XMFLOAT3X4 World;
+	};
+
+	// A triangle in screen space: x, y in pixels and z in [0, 1].
+	struct ScreenTriangle
+	{
+		XMFLOAT3 V[3];
+	};
+
+	void SetupTriangles();
+	void RasterizeBand(uint32_t rowBegin, uint32_t rowEnd);
+	void RasterizeTriangle(const ScreenTriangle& tri, uint32_t rowBegin, uint32_t rowEnd);
+	void BuildHierarchy(uint32_t tileRowBegin, uint32_t tileRowEnd);
+
+private:
+
+	uint32_t m_width;
+	uint32_t m_height;
+	uint32_t m_tilesX;
+	uint32_t m_tilesY;
+	uint32_t m_coarseX;
+	uint32_t m_coarseY;
+
+	vector<float> m_depth;
+	vector<float> m_tileMaxDepth;
+	vector<float> m_coarseMaxDepth;
+
+	XMFLOAT4X4 m_viewProj;
+
+	vector<OccluderMesh> m_meshes;
+	vector<Occluder> m_occluders;
+	vector<ScreenTriangle> m_triangles;
+
+	vector<uint8_t> m_occluded;
+
+	// Rasterize with RasterizeRowsAvx2, chosen once from the CPU features.
+	bool m_useAvx2;
+
+	OcclusionStats m_stats;
+};
@@ -0,0 +1,39 @@
+#include "OcclusionRaster.h"
+#include <immintrin.h>
+
+
+void RasterizeRowsAvx2(const RasterTriangle& tri, float* depth, uint32_t width, int startX, int maxX, int minY, int maxY)
+{
+	const __m256 offsets = _mm256_setr_ps(0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f);
+	const __m256 a0 = _mm256_set1_ps(tri.A[0]), a1 = _mm256_set1_ps(tri.A[1]), a2 = _mm256_set1_ps(tri.A[2]);
+	const __m256 zdx = _mm256_set1_ps(tri.DzDx);
+	const __m256 zero = _mm256_setzero_ps();
+
+	for (int y = minY; y <= maxY; ++y)
+	{
+		float py = y + 0.5f;
+		__m256 r0 = _mm256_set1_ps(tri.B[0]*py + tri.C[0]);
+		__m256 r1 = _mm256_set1_ps(tri.B[1]*py + tri.C[1]);
+		__m256 r2 = _mm256_set1_ps(tri.B[2]*py + tri.C[2]);
+		__m256 rz = _mm256_set1_ps(tri.Z0 + tri.DzDy*py);
+
+		float* row = depth + y*width;
+		for (int x = startX; x <= maxX; x += 8)
+		{
+			__m256 px = _mm256_add_ps(_mm256_set1_ps((float)x), offsets);
+
+			__m256 e0 = _mm256_add_ps(_mm256_mul_ps(a0, px), r0);
+			__m256 e1 = _mm256_add_ps(_mm256_mul_ps(a1, px), r1);
+			__m256 e2 = _mm256_add_ps(_mm256_mul_ps(a2, px), r2);
+
+			// Coverage mask of the 8 pixels.
+			__m256 mask = _mm256_and_ps(_mm256_and_ps(_mm256_cmp_ps(e0, zero, _CMP_GE_OQ), _mm256_cmp_ps(e1, zero, _CMP_GE_OQ)), _mm256_cmp_ps(e2, zero, _CMP_GE_OQ));
+			if (_mm256_testz_ps(mask, mask))
+				continue;
+
+			__m256 z = _mm256_add_ps(_mm256_mul_ps(zdx, px), rz);
+			__m256 stored = _mm256_loadu_ps(row + x);
+			_mm256_storeu_ps(row + x, _mm256_blendv_ps(stored, _mm256_min_ps(stored, z), mask));
+		}
+	}
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstdint>
+
+
+// Row loops of the occlusion rasterizer. OcclusionCullingAvx2.cpp is the only file
+// built with AVX2 and OcclusionCuller calls into it after checking the CPU, so this
+// header and that file stay free of DirectXMath and standard library templates: an
+// inline function compiled there could be picked by the linker for every caller.
+
+// Edge functions E(x, y) = A*x + B*y + C, non-negative inside the triangle, and
+// the depth plane z = Z0 + DzDx*x + DzDy*y, in pixels.
+struct RasterTriangle
+{
+	float A[3];
+	float B[3];
+	float C[3];
+	float Z0;
+	float DzDx;
+	float DzDy;
+};
+
+// Keeps the nearer of the stored and the triangle depth in the covered pixels of
+// rows [minY, maxY], from startX, a multiple of 8, up to the group of 8 holding maxX.
+void RasterizeRowsAvx2(const RasterTriangle& tri, float* depth, uint32_t width, int startX, int maxX, int minY, int maxY);
@@ -0,0 +1,16 @@
+
+#include "Parallel.h"
+#include "JobSystem.h"
+
+using namespace std;
+
+
+uint32_t WorkerThreadCount()
+{
+	return JobSystem::Get().GetWorkerCount();
+}
+
+void ParallelFor(uint32_t count, uint32_t minChunk, const function<void(uint32_t, uint32_t)>& body)
+{
+	JobSystem::Get().ParallelFor("ParallelFor", count, minChunk, body);
+}
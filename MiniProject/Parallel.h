@@ -0,0 +1,15 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+
+using namespace std;
+
+
+// Number of threads ParallelFor spreads work over, including the calling thread.
+uint32_t WorkerThreadCount();
+
+// Splits [0, count) into contiguous ranges of at least minChunk elements and calls
+// body(begin, end) for each of them, possibly on several threads at once. Returns
+// when every range has been processed.
+void ParallelFor(uint32_t count, uint32_t minChunk, const function<void(uint32_t, uint32_t)>& body);
@@ -0,0 +1,61 @@
+
+#include "ParallelRecorder.h"
+#include "Parallel.h"
+#include <algorithm>
+
+using namespace std;
+
+
+void ParallelRecorder::Plan(uint32_t count, uint32_t maxChunks, uint32_t minDraws)
+{
+	// Only as many chunks as fit minDraws each, with the draws spread evenly so
+	// none of them falls short or is left empty.
+	uint32_t chunkCount = min(max(1u, maxChunks), max(1u, count / max(1u, minDraws)));
+
+	m_chunks.resize(chunkCount);
+	for (uint32_t c = 0; c < chunkCount; ++c)
+	{
+		m_chunks[c].Begin = (uint32_t)((uint64_t)count*c / chunkCount);
+		m_chunks[c].End = (uint32_t)((uint64_t)count*(c + 1) / chunkCount);
+	}
+}
+
+void ParallelRecorder::Record(const BeginChunkFunc& beginChunk, const RecordChunkFunc& recordChunk, const EndChunkFunc& endChunk)
+{
+	m_recorders.resize(m_chunks.size());
+
+	ParallelFor((uint32_t)m_chunks.size(), 1, [&](uint32_t begin, uint32_t end)
+	{
+		for (uint32_t c = begin; c < end; ++c)
+		{
+			// A new command list inherits no state, so every chunk starts from scratch.
+			CommandRecorder& recorder = m_recorders[c];
+			recorder.SetBackend(beginChunk(c));
+			recorder.Begin();
+
+			recordChunk(c, recorder, m_chunks[c].Begin, m_chunks[c].End);
+
+			endChunk(c);
+		}
+	});
+}
+
+const vector<RecordChunk>& ParallelRecorder::GetChunks()const
+{
+	return m_chunks;
+}
+
+RecorderStats ParallelRecorder::GetStats()const
+{
+	RecorderStats stats;
+	for (const CommandRecorder& recorder : m_recorders)
+	{
+		const RecorderStats& chunkStats = recorder.GetStats();
+		for (uint32_t i = 0; i < (uint32_t)CommandType::Count; ++i)
+		{
+			stats.Emitted[i] += chunkStats.Emitted[i];
+			stats.Elided[i] += chunkStats.Elided[i];
+		}
+	}
+	return stats;
+}
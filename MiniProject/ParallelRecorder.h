@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+#include "CommandRecorder.h"
+
+using namespace std;
+
+
+// A range [Begin, End) of draws recorded into one command list.
+struct RecordChunk
+{
+	uint32_t Begin = 0;
+	uint32_t End = 0;
+};
+
+// Records a draw stream into several command lists at once. The draws are split
+// into contiguous chunks, one per command list, and every chunk is recorded on a
+// worker thread with its own CommandRecorder. Submitting the lists in chunk order
+// reproduces the order of the stream.
+class ParallelRecorder
+{
+public:
+
+	// Called on the worker thread before and after recording a chunk. BeginChunk
+	// returns the backend of the chunk's command list, ready to take draws.
+	typedef function<CommandBackend*(uint32_t chunk)> BeginChunkFunc;
+	typedef function<void(uint32_t chunk, CommandRecorder& recorder, uint32_t begin, uint32_t end)> RecordChunkFunc;
+	typedef function<void(uint32_t chunk)> EndChunkFunc;
+
+	// Splits count draws into at most maxChunks chunks of at least minDraws draws.
+	// There is always at least one chunk, so a frame without draws still has a list.
+	void Plan(uint32_t count, uint32_t maxChunks, uint32_t minDraws);
+
+	void Record(const BeginChunkFunc& beginChunk, const RecordChunkFunc& recordChunk, const EndChunkFunc& endChunk);
+
+	const vector<RecordChunk>& GetChunks()const;
+
+	// Statistics of all the chunk recorders of the last Record.
+	RecorderStats GetStats()const;
+
+private:
+
+	vector<RecordChunk> m_chunks;
+	vector<CommandRecorder> m_recorders;
+};
@@ -0,0 +1,548 @@
+#include "PotentiallyVisibleSet.h"
+#include "Parallel.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+
+using namespace DirectX;
+using namespace std;
+
+namespace
+{
+	// Occluders are shrunk by this much, so rays grazing a face or starting on
+	// it are not stopped.
+	const float OccluderEpsilon = 1e-3f;
+
+	// Sample points are kept this far inside their cell, as a fraction of its size.
+	const float SampleInset = 0.01f;
+
+	struct Box
+	{
+		XMFLOAT3 Min;
+		XMFLOAT3 Max;
+	};
+
+	bool Contains(const Box& box, const XMFLOAT3& p)
+	{
+		return p.x > box.Min.x && p.x < box.Max.x &&
+			p.y > box.Min.y && p.y < box.Max.y &&
+			p.z > box.Min.z && p.z < box.Max.z;
+	}
+
+	// Distance along the ray to where it enters the box, 0 if it starts inside,
+	// or false if it misses it.
+	bool RayHitsBox(const XMFLOAT3& origin, const XMFLOAT3& invDir, const Box& box, float& t)
+	{
+		float tx1 = (box.Min.x - origin.x)*invDir.x;
+		float tx2 = (box.Max.x - origin.x)*invDir.x;
+		float ty1 = (box.Min.y - origin.y)*invDir.y;
+		float ty2 = (box.Max.y - origin.y)*invDir.y;
+		float tz1 = (box.Min.z - origin.z)*invDir.z;
+		float tz2 = (box.Max.z - origin.z)*invDir.z;
+
+		float enter = max(max(min(tx1, tx2), min(ty1, ty2)), min(tz1, tz2));
+		float leave = min(min(max(tx1, tx2), max(ty1, ty2)), max(tz1, tz2));
+		if (enter >= leave || leave <= 0.0f)
+			return false;
+
+		t = max(enter, 0.0f);
+		return true;
+	}
+
+	// Position of sample point i of count along an axis of a cell, as a fraction
+	// of the cell size.
+	float SampleFraction(uint32_t i, uint32_t count)
+	{
+		return count > 1 ? SampleInset + (1.0f - 2.0f*SampleInset)*i / (count - 1) : 0.5f;
+	}
+
+	// Directions spread evenly over the sphere on a Fibonacci spiral. No
+	// component is zero, so the inverse is finite.
+	void SphereDirections(uint32_t count, vector<XMFLOAT3>& directions)
+	{
+		const float goldenAngle = 2.39996323f;
+
+		directions.resize(count);
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			float y = 1.0f - 2.0f*(i + 0.5f) / count;
+			float r = sqrtf(max(0.0f, 1.0f - y*y));
+			float a = goldenAngle*i;
+
+			XMFLOAT3& d = directions[i];
+			d = XMFLOAT3(r*cosf(a), y, r*sinf(a));
+			d.x = fabsf(d.x) < 1e-6f ? 1e-6f : d.x;
+			d.y = fabsf(d.y) < 1e-6f ? 1e-6f : d.y;
+			d.z = fabsf(d.z) < 1e-6f ? 1e-6f : d.z;
+		}
+	}
+
+	// Appends the first count bits as bytes, runs of zero bytes as a zero and the
+	// length of the run, up to 255. A trailing run of zeros is left out.
+	void EncodeRuns(const vector<uint64_t>& bits, uint32_t count, vector<uint8_t>& bytes)
+	{
+		uint32_t byteCount = (count + 7) / 8;
+		uint32_t used = byteCount;
+		while (used > 0 && (uint8_t)(bits[(used - 1) / 8] >> ((used - 1) % 8 * 8)) == 0)
+			used--;
+
+		for (uint32_t i = 0; i < used; ++i)
+		{
+			uint8_t byte = (uint8_t)(bits[i / 8] >> (i % 8 * 8));
+			bytes.push_back(byte);
+			if (byte != 0)
+				continue;
+
+			uint8_t run = 1;
+			while (run < 255 && i + 1 < used && (uint8_t)(bits[(i + 1) / 8] >> ((i + 1) % 8 * 8)) == 0)
+			{
+				run++;
+				i++;
+			}
+			bytes.push_back(run);
+		}
+	}
+}
+
+
+void PotentiallyVisibleSet::SetGrid(const XMFLOAT3& min, const XMFLOAT3& max, float cellSize)
+{
+	m_min = min;
+	m_cellSize = cellSize;
+
+	for (;;)
+	{
+		float dims[3] =
+		{
+			std::max(1.0f, ceilf((max.x - min.x) / m_cellSize)),
+			std::max(1.0f, ceilf((max.y - min.y) / m_cellSize)),
+			std::max(1.0f, ceilf((max.z - min.z) / m_cellSize))
+		};
+
+		if (dims[0]*dims[1]*dims[2] <= (float)MaxCells)
+		{
+			m_dims[0] = (uint32_t)dims[0];
+			m_dims[1] = (uint32_t)dims[1];
+			m_dims[2] = (uint32_t)dims[2];
+			return;
+		}
+
+		m_cellSize *= 1.25f;
+	}
+}
+
+void PotentiallyVisibleSet::SetSampling(uint32_t pointsPerAxis, uint32_t raysPerPoint)
+{
+	m_pointsPerAxis = max(1u, pointsPerAxis);
+	m_raysPerPoint = max(1u, raysPerPoint);
+}
+
+void PotentiallyVisibleSet::Build(const BoundsSoA& bounds, const uint8_t* occluders, uint32_t count)
+{
+	auto start = chrono::high_resolution_clock::now();
+
+	const uint32_t cellCount = GetCellCount();
+
+	// Items and occluders of every cell they overlap, in two flat lists indexed
+	// by cell. The occluders are kept as shrunk boxes.
+	vector<uint32_t> itemStart(cellCount + 1, 0);
+	vector<uint32_t> occluderStart(cellCount + 1, 0);
+	vector<uint32_t> cellItems;
+	vector<Box> cellOccluders;
+
+	// Items outside the grid, which no cell can be sure not to see.
+	vector<uint32_t> outside;
+
+	for (int pass = 0; pass < 2; ++pass)
+	{
+		vector<uint32_t> itemFill(itemStart.begin(), itemStart.end() - 1);
+		vector<uint32_t> occluderFill(occluderStart.begin(), occluderStart.end() - 1);
+
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			XMFLOAT3 extents(bounds.ExtentX[i], bounds.ExtentY[i], bounds.ExtentZ[i]);
+			XMFLOAT3 lo(bounds.CenterX[i] - extents.x, bounds.CenterY[i] - extents.y, bounds.CenterZ[i] - extents.z);
+			XMFLOAT3 hi(bounds.CenterX[i] + extents.x, bounds.CenterY[i] + extents.y, bounds.CenterZ[i] + extents.z);
+
+			uint32_t first[3], last[3];
+			if (!CellRange(lo, hi, first, last))
+			{
+				if (pass == 0)
+					outside.push_back(i);
+				continue;
+			}
+
+			Box box;
+			box.Min = XMFLOAT3(lo.x + OccluderEpsilon, lo.y + OccluderEpsilon, lo.z + OccluderEpsilon);
+			box.Max = XMFLOAT3(hi.x - OccluderEpsilon, hi.y - OccluderEpsilon, hi.z - OccluderEpsilon);
+
+			for (uint32_t z = first[2]; z <= last[2]; ++z)
+			{
+				for (uint32_t y = first[1]; y <= last[1]; ++y)
+				{
+					for (uint32_t x = first[0]; x <= last[0]; ++x)
+					{
+						uint32_t cell = CellIndex(x, y, z);
+						if (pass == 0)
+						{
+							itemStart[cell + 1]++;
+							if (occluders[i])
+								occluderStart[cell + 1]++;
+						}
+						else
+						{
+							cellItems[itemFill[cell]++] = i;
+							if (occluders[i])
+								cellOccluders[occluderFill[cell]++] = box;
+						}
+					}
+				}
+			}
+		}
+
+		if (pass == 0)
+		{
+			for (uint32_t c = 0; c < cellCount; ++c)
+			{
+				itemStart[c + 1] += itemStart[c];
+				occluderStart[c + 1] += occluderStart[c];
+			}
+			cellItems.resize(itemStart[cellCount]);
+			cellOccluders.resize(occluderStart[cellCount]);
+		}
+	}
+
+	const uint32_t pointCount = m_pointsPerAxis*m_pointsPerAxis*m_pointsPerAxis;
+	vector<XMFLOAT3> directions;
+	SphereDirections(m_raysPerPoint, directions);
+
+	vector<XMFLOAT3> inverseDirections(directions.size());
+	for (size_t d = 0; d < directions.size(); ++d)
+		inverseDirections[d] = XMFLOAT3(1.0f / directions[d].x, 1.0f / directions[d].y, 1.0f / directions[d].z);
+
+	// The cells reached from every cell, one bit per cell.
+	const uint32_t words = (cellCount + 63) / 64;
+	vector<uint64_t> reachedBits((size_t)cellCount*words, 0);
+	atomic<uint64_t> raysCast(0);
+
+	ParallelFor(cellCount, 1, [&](uint32_t begin, uint32_t end)
+	{
+		uint64_t rays = 0;
+
+		for (uint32_t cell = begin; cell < end; ++cell)
+		{
+			uint64_t* reached = &reachedBits[(size_t)cell*words];
+			reached[cell / 64] |= 1ull << (cell % 64);
+
+			uint32_t cx = cell % m_dims[0];
+			uint32_t cy = cell / m_dims[0] % m_dims[1];
+			uint32_t cz = cell / (m_dims[0]*m_dims[1]);
+
+			// The points span the cell corner to corner, just inside it, as the eye
+			// sees the most from the edges of the cell.
+			for (uint32_t sample = 0; sample < pointCount; ++sample)
+			{
+				float fx = SampleFraction(sample % m_pointsPerAxis, m_pointsPerAxis);
+				float fy = SampleFraction(sample / m_pointsPerAxis % m_pointsPerAxis, m_pointsPerAxis);
+				float fz = SampleFraction(sample / (m_pointsPerAxis*m_pointsPerAxis), m_pointsPerAxis);
+				XMFLOAT3 origin(m_min.x + (cx + fx)*m_cellSize, m_min.y + (cy + fy)*m_cellSize, m_min.z + (cz + fz)*m_cellSize);
+
+				// The eye cannot be inside a wall.
+				bool buried = false;
+				for (uint32_t o = occluderStart[cell]; o < occluderStart[cell + 1] && !buried; ++o)
+					buried = Contains(cellOccluders[o], origin);
+				if (buried)
+					continue;
+
+				for (size_t d = 0; d < directions.size(); ++d)
+				{
+					const XMFLOAT3& dir = directions[d];
+					const XMFLOAT3& invDir = inverseDirections[d];
+					rays++;
+
+					// Walk the cells along the ray, and stop in the first one where it
+					// enters an occluder. tNext is where the ray leaves the cell on
+					// each axis.
+					int32_t at[3] = { (int32_t)cx, (int32_t)cy, (int32_t)cz };
+					int32_t step[3] = { dir.x > 0.0f ? 1 : -1, dir.y > 0.0f ? 1 : -1, dir.z > 0.0f ? 1 : -1 };
+					float originOf[3] = { origin.x - m_min.x, origin.y - m_min.y, origin.z - m_min.z };
+					float inverse[3] = { invDir.x, invDir.y, invDir.z };
+					float tNext[3];
+					float tDelta[3];
+					for (int a = 0; a < 3; ++a)
+					{
+						float boundary = (at[a] + (step[a] > 0 ? 1 : 0))*m_cellSize;
+						tNext[a] = (boundary - originOf[a])*inverse[a];
+						tDelta[a] = m_cellSize*fabsf(inverse[a]);
+					}
+
+					for (;;)
+					{
+						uint32_t current = CellIndex(at[0], at[1], at[2]);
+						reached[current / 64] |= 1ull << (current % 64);
+
+						int axis = tNext[0] < tNext[1] ? (tNext[0] < tNext[2] ? 0 : 2) : (tNext[1] < tNext[2] ? 1 : 2);
+						float tExit = tNext[axis];
+
+						bool blocked = false;
+						for (uint32_t o = occluderStart[current]; o < occluderStart[current + 1] && !blocked; ++o)
+						{
+							float t;
+							blocked = RayHitsBox(origin, invDir, cellOccluders[o], t) && t <= tExit;
+						}
+						if (blocked)
+							break;
+
+						at[axis] += step[axis];
+						if (at[axis] < 0 || at[axis] >= (int32_t)m_dims[axis])
+							break;
+						tNext[axis] += tDelta[axis];
+					}
+				}
+			}
+		}
+
+		raysCast += rays;
+	});
+
+	vector<vector<uint8_t>> cellRuns(cellCount);
+	atomic<uint64_t> setItems(0);
+
+	ParallelFor(cellCount, 1, [&](uint32_t begin, uint32_t end)
+	{
+		vector<uint64_t> reached(words);
+		vector<uint64_t> inSet((count + 63) / 64);
+		uint64_t items = 0;
+
+		for (uint32_t cell = begin; cell < end; ++cell)
+		{
+			const uint64_t* own = &reachedBits[(size_t)cell*words];
+			copy(own, own + words, reached.begin());
+
+			// What the neighbors it reached see is added, as the eye may stand
+			// anywhere between the sample points.
+			uint32_t cx = cell % m_dims[0];
+			uint32_t cy = cell / m_dims[0] % m_dims[1];
+			uint32_t cz = cell / (m_dims[0]*m_dims[1]);
+			for (uint32_t z = cz > 0 ? cz - 1 : 0; z <= min(cz + 1, m_dims[2] - 1); ++z)
+			{
+				for (uint32_t y = cy > 0 ? cy - 1 : 0; y <= min(cy + 1, m_dims[1] - 1); ++y)
+				{
+					for (uint32_t x = cx > 0 ? cx - 1 : 0; x <= min(cx + 1, m_dims[0] - 1); ++x)
+					{
+						uint32_t neighbor = CellIndex(x, y, z);
+						if (((own[neighbor / 64] >> (neighbor % 64)) & 1) == 0)
+							continue;
+
+						const uint64_t* seen = &reachedBits[(size_t)neighbor*words];
+						for (uint32_t w = 0; w < words; ++w)
+							reached[w] |= seen[w];
+					}
+				}
+			}
+
+			// Every item of a reached cell, and those outside the grid.
+			fill(inSet.begin(), inSet.end(), 0);
+			for (uint32_t i : outside)
+				inSet[i / 64] |= 1ull << (i % 64);
+			for (uint32_t c = 0; c < cellCount; ++c)
+			{
+				if (((reached[c / 64] >> (c % 64)) & 1) == 0)
+					continue;
+
+				for (uint32_t i = itemStart[c]; i < itemStart[c + 1]; ++i)
+					inSet[cellItems[i] / 64] |= 1ull << (cellItems[i] % 64);
+			}
+
+			for (uint64_t word : inSet)
+			{
+				for (uint64_t bits = word; bits != 0; bits &= bits - 1)
+					items++;
+			}
+
+			EncodeRuns(inSet, count, cellRuns[cell]);
+		}
+
+		setItems += items;
+	});
+
+	m_offsets.resize(cellCount + 1);
+	m_runs.clear();
+	for (uint32_t c = 0; c < cellCount; ++c)
+	{
+		m_offsets[c] = (uint32_t)m_runs.size();
+		m_runs.insert(m_runs.end(), cellRuns[c].begin(), cellRuns[c].end());
+	}
+	m_offsets[cellCount] = (uint32_t)m_runs.size();
+
+	m_count = count;
+	m_currentCell = UINT32_MAX;
+	m_invalid.assign(count, 0);
+	m_invalidItems.clear();
+
+	auto end = chrono::high_resolution_clock::now();
+
+	m_stats.Cells = cellCount;
+	m_stats.Items = count;
+	m_stats.RaysCast = raysCast;
+	m_stats.BuildMilliseconds = chrono::duration<double, milli>(end - start).count();
+	m_stats.EncodedBytes = m_runs.size() + m_offsets.size()*sizeof(uint32_t);
+	m_stats.RawBytes = (size_t)cellCount*((count + 7) / 8);
+	m_stats.AverageSetSize = (double)setItems / cellCount;
+}
+
+uint32_t PotentiallyVisibleSet::GetCellCount()const
+{
+	return m_dims[0]*m_dims[1]*m_dims[2];
+}
+
+float PotentiallyVisibleSet::GetCellSize()const
+{
+	return m_cellSize;
+}
+
+uint32_t PotentiallyVisibleSet::FindCell(const XMFLOAT3& position)const
+{
+	float p[3] = { position.x - m_min.x, position.y - m_min.y, position.z - m_min.z };
+
+	uint32_t at[3];
+	for (int a = 0; a < 3; ++a)
+	{
+		float cell = floorf(p[a] / m_cellSize);
+		if (cell < 0.0f || cell >= (float)m_dims[a])
+			return UINT32_MAX;
+		at[a] = (uint32_t)cell;
+	}
+
+	return CellIndex(at[0], at[1], at[2]);
+}
+
+void PotentiallyVisibleSet::Decode(uint32_t cell, vector<uint32_t>& items)const
+{
+	items.clear();
+
+	const uint8_t* bytes = m_runs.data() + m_offsets[cell];
+	const uint8_t* end = m_runs.data() + m_offsets[cell + 1];
+
+	uint32_t first = 0;
+	while (bytes < end)
+	{
+		uint8_t byte = *bytes++;
+		if (byte == 0)
+		{
+			first += 8*(*bytes++);
+			continue;
+		}
+
+		for (; byte != 0; byte &= byte - 1)
+		{
+			uint32_t bit = 0;
+			while (((byte >> bit) & 1) == 0)
+				bit++;
+			items.push_back(first + bit);
+		}
+		first += 8;
+	}
+}
+
+void PotentiallyVisibleSet::Invalidate(uint32_t item)
+{
+	// Items added since Build are tested anyway.
+	if (item >= m_count || m_invalid[item])
+		return;
+
+	m_invalid[item] = 1;
+	m_invalidItems.push_back(item);
+}
+
+void PotentiallyVisibleSet::Cull(const XMFLOAT3& eyePos, const XMFLOAT4 planes[6], const BoundsSoA& bounds, uint32_t count, vector<uint32_t>& visible)
+{
+	auto start = chrono::high_resolution_clock::now();
+
+	m_culler.SetPlanes(planes);
+
+	uint32_t cell = FindCell(eyePos);
+	if (cell == UINT32_MAX || m_offsets.empty())
+	{
+		m_culler.Cull(bounds, count, visible);
+		m_stats.Candidates = count;
+	}
+	else
+	{
+		if (cell != m_currentCell)
+		{
+			Decode(cell, m_candidates);
+			m_currentCell = cell;
+		}
+
+		auto test = [&](uint32_t item)
+		{
+			XMFLOAT3 center(bounds.CenterX[item], bounds.CenterY[item], bounds.CenterZ[item]);
+			XMFLOAT3 extents(bounds.ExtentX[item], bounds.ExtentY[item], bounds.ExtentZ[item]);
+			if (m_culler.IsVisible(center, extents))
+				visible.push_back(item);
+		};
+
+		// The set's items that are still where they were, items removed since
+		// Build skipped, then the invalidated and added ones.
+		visible.clear();
+		uint32_t candidates = 0;
+		for (uint32_t item : m_candidates)
+		{
+			if (item >= count || m_invalid[item])
+				continue;
+
+			test(item);
+			candidates++;
+		}
+
+		for (uint32_t item : m_invalidItems)
+		{
+			if (item >= count)
+				continue;
+
+			test(item);
+			candidates++;
+		}
+
+		for (uint32_t item = m_count; item < count; ++item)
+			test(item);
+
+		m_stats.Candidates = candidates + (count > m_count ? count - m_count : 0);
+	}
+
+	auto end = chrono::high_resolution_clock::now();
+
+	m_stats.Visible = (uint32_t)visible.size();
+	m_stats.CullMicroseconds = chrono::duration<double, micro>(end - start).count();
+}
+
+const PvsStats& PotentiallyVisibleSet::GetStats()const
+{
+	return m_stats;
+}
+
+bool PotentiallyVisibleSet::CellRange(const XMFLOAT3& min, const XMFLOAT3& max, uint32_t first[3], uint32_t last[3])const
+{
+	float lo[3] = { min.x - m_min.x, min.y - m_min.y, min.z - m_min.z };
+	float hi[3] = { max.x - m_min.x, max.y - m_min.y, max.z - m_min.z };
+
+	for (int a = 0; a < 3; ++a)
+	{
+		float firstCell = floorf(lo[a] / m_cellSize);
+		float lastCell = floorf(hi[a] / m_cellSize);
+		if (lastCell < 0.0f || firstCell >= (float)m_dims[a])
+			return false;
+
+		first[a] = (uint32_t)std::max(firstCell, 0.0f);
+		last[a] = (uint32_t)std::min(lastCell, (float)(m_dims[a] - 1));
+	}
+
+	return true;
+}
+
+uint32_t PotentiallyVisibleSet::CellIndex(uint32_t x, uint32_t y, uint32_t z)const
+{
+	return x + m_dims[0]*(y + m_dims[1]*z);
+}
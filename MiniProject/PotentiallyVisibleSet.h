@@ -0,0 +1,123 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <DirectXMath.h>
+#include "FrustumCulling.h"
+#include "SceneStore.h"
+
+using namespace DirectX;
+using namespace std;
+
+
+struct PvsStats
+{
+	uint32_t Cells = 0;
+	uint32_t Items = 0;
+	uint64_t RaysCast = 0;
+	double BuildMilliseconds = 0.0;
+
+	// Size of the run-length coded sets, offsets included, against one bit per
+	// item and cell.
+	size_t EncodedBytes = 0;
+	size_t RawBytes = 0;
+
+	// Items per set, averaged over the cells.
+	double AverageSetSize = 0.0;
+
+	// Of the last Cull: the items of the eye's set and the ones invalidated since
+	// Build, and of them the ones in the frustum.
+	uint32_t Candidates = 0;
+	uint32_t Visible = 0;
+	double CullMicroseconds = 0.0;
+};
+
+// Precomputed potentially visible sets over a uniform grid of cells. Build casts
+// rays from sample points spanning every cell, in a fixed set of directions, and
+// walks each of them through the grid until it enters an occluder box. A cell
+// also sees what the neighbors it reached see, as the eye may stand anywhere
+// between the sample points. Its set holds every item overlapping a cell seen,
+// so no item is missed for being small, but the sampling can miss cells seen
+// through narrow gaps far away. Items not overlapping the grid are in every set.
+// Cells are processed in parallel.
+//
+// Sets are indexed like the dense scene arrays. Items that move, and the item
+// moved into the place of a removed one, are invalidated and from then on
+// tested against the frustum from every cell, as are the items added since.
+//
+// A set is stored as a bitset of one bit per item, its bytes copied except runs
+// of zero bytes, which are coded as a zero followed by the length of the run.
+// Items that are close in space should have close indices, so the runs are long.
+class PotentiallyVisibleSet
+{
+public:
+
+	// Build keeps one bit per pair of cells for the cells each one reaches, so
+	// grids are limited to this many cells, 8 MB of bits.
+	static const uint32_t MaxCells = 8192;
+
+	// Box of the world covered by the grid, and the side of the cubic cells. The
+	// box is rounded up to whole cells from min, so the cells should end where
+	// the occluders do. The cells are made larger if there would be more than
+	// MaxCells of them. Occluders are only considered inside the grid, and an eye
+	// outside it sees every item.
+	void SetGrid(const XMFLOAT3& min, const XMFLOAT3& max, float cellSize);
+
+	// Sample points per cell along each axis, and rays cast from every point.
+	void SetSampling(uint32_t pointsPerAxis, uint32_t raysPerPoint);
+
+	// Computes the set of every cell for the first count items of bounds.
+	// occluders[i] is non-zero for the items that are solid boxes rays stop at.
+	void Build(const BoundsSoA& bounds, const uint8_t* occluders, uint32_t count);
+
+	uint32_t GetCellCount()const;
+	float GetCellSize()const;
+
+	// Cell containing position, UINT32_MAX outside the grid.
+	uint32_t FindCell(const XMFLOAT3& position)const;
+
+	// Replaces items with the set of cell, in index order.
+	void Decode(uint32_t cell, vector<uint32_t>& items)const;
+
+	void Invalidate(uint32_t item);
+
+	// Fills visible with the items among the first count of bounds that are in
+	// the eye's set or invalidated, and intersect the frustum. The set is only
+	// decoded again when the eye changes cells.
+	void Cull(const XMFLOAT3& eyePos, const XMFLOAT4 planes[6], const BoundsSoA& bounds, uint32_t count, vector<uint32_t>& visible);
+
+	const PvsStats& GetStats()const;
+
+private:
+
+	// Cells overlapped by a box, clamped to the grid. False if it is outside.
+	bool CellRange(const XMFLOAT3& min, const XMFLOAT3& max, uint32_t first[3], uint32_t last[3])const;
+	uint32_t CellIndex(uint32_t x, uint32_t y, uint32_t z)const;
+
+private:
+
+	XMFLOAT3 m_min = XMFLOAT3(0.0f, 0.0f, 0.0f);
+	float m_cellSize = 4.0f;
+	uint32_t m_dims[3] = { 1, 1, 1 };
+
+	uint32_t m_pointsPerAxis = 2;
+	uint32_t m_raysPerPoint = 2048;
+
+	// Items the sets were built for.
+	uint32_t m_count = 0;
+
+	// Coded sets, those of cell c in bytes [m_offsets[c], m_offsets[c + 1]).
+	vector<uint32_t> m_offsets;
+	vector<uint8_t> m_runs;
+
+	// Decoded set of the cell the eye was in at the last Cull.
+	uint32_t m_currentCell = UINT32_MAX;
+	vector<uint32_t> m_candidates;
+
+	// Items invalidated since Build, as flags by item and as a list.
+	vector<uint8_t> m_invalid;
+	vector<uint32_t> m_invalidItems;
+
+	FrustumCuller m_culler;
+	PvsStats m_stats;
+};
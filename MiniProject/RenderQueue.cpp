@@ -0,0 +1,184 @@
+
+#include "RenderQueue.h"
+#include "Parallel.h"
+#include <algorithm>
+#include <array>
+#include <chrono>
+
+using namespace DirectX;
+using namespace std;
+
+namespace
+{
+	const uint32_t kMinChunk = 16384;
+
+	const uint32_t kDepthShift = 0;
+	const uint32_t kMaterialShift = kDepthShift + RenderQueue::DepthBits;
+	const uint32_t kGeometryShift = kMaterialShift + RenderQueue::MaterialBits;
+	const uint32_t kPsoShift = kGeometryShift + RenderQueue::GeometryBits;
+	const uint32_t kPassShift = kPsoShift + RenderQueue::PsoBits;
+
+	uint64_t Field(uint32_t value, uint32_t bits, uint32_t shift)
+	{
+		return ((uint64_t)value & ((1ull << bits) - 1)) << shift;
+	}
+}
+
+uint64_t RenderQueue::MakeKey(uint32_t pass, uint32_t pso, uint32_t geometry, uint32_t material, uint32_t depth)
+{
+	return Field(pass, PassBits, kPassShift) |
+		Field(pso, PsoBits, kPsoShift) |
+		Field(geometry, GeometryBits, kGeometryShift) |
+		Field(material, MaterialBits, kMaterialShift) |
+		Field(depth, DepthBits, kDepthShift);
+}
+
+uint64_t RenderQueue::StateMask()
+{
+	return ~((1ull << DepthBits) - 1);
+}
+
+void RenderQueue::Build(const vector<uint32_t>& items, const DrawKey* drawKeys, const BoundsSoA& bounds,
+	const XMFLOAT3& eyePos, const XMFLOAT3& look, float nearZ, float farZ)
+{
+	auto start = chrono::high_resolution_clock::now();
+
+	uint32_t count = (uint32_t)items.size();
+	m_keys.resize(count);
+	m_items = items;
+
+	const float maxDepth = (float)((1u << DepthBits) - 1);
+	const float depthScale = maxDepth / (farZ - nearZ);
+
+	ParallelFor(count, kMinChunk, [&](uint32_t begin, uint32_t end)
+	{
+		for (uint32_t i = begin; i < end; ++i)
+		{
+			uint32_t item = items[i];
+			const DrawKey& draw = drawKeys[item];
+
+			// Distance of the bounds center along the view direction.
+			float viewZ = (bounds.CenterX[item] - eyePos.x)*look.x +
+				(bounds.CenterY[item] - eyePos.y)*look.y +
+				(bounds.CenterZ[item] - eyePos.z)*look.z;
+			float depth = min(max((viewZ - nearZ)*depthScale, 0.0f), maxDepth);
+
+			m_keys[i] = MakeKey(draw.Pass, draw.Pso, draw.Geometry, draw.Material, (uint32_t)depth);
+		}
+	});
+
+	auto end = chrono::high_resolution_clock::now();
+
+	m_stats.Items = count;
+	m_stats.BuildMicroseconds = chrono::duration<double, micro>(end - start).count();
+}
+
+void RenderQueue::Sort()
+{
+	auto start = chrono::high_resolution_clock::now();
+
+	uint32_t count = (uint32_t)m_keys.size();
+	m_tempKeys.resize(count);
+	m_tempItems.resize(count);
+
+	// Split the keys into one fixed range per thread. Ranges are scattered in
+	// order, which keeps every pass stable.
+	uint32_t chunkCount = max(1u, min(WorkerThreadCount(), count / kMinChunk));
+	uint32_t chunkSize = (count + chunkCount - 1) / max(1u, chunkCount);
+
+	vector<array<uint32_t, 256>> histograms(chunkCount);
+	vector<uint64_t> chunkDiffs(chunkCount, 0);
+
+	// Bits that differ from the first key; digits without any are already sorted.
+	ParallelFor(chunkCount, 1, [&](uint32_t begin, uint32_t end)
+	{
+		for (uint32_t c = begin; c < end; ++c)
+		{
+			uint64_t diff = 0;
+			for (uint32_t i = c*chunkSize; i < min(count, (c + 1)*chunkSize); ++i)
+				diff |= m_keys[i] ^ m_keys[0];
+			chunkDiffs[c] = diff;
+		}
+	});
+
+	uint64_t diff = 0;
+	for (uint64_t d : chunkDiffs)
+		diff |= d;
+
+	m_stats.SkippedPasses = 0;
+	for (uint32_t shift = 0; shift < 64; shift += 8)
+	{
+		if (((diff >> shift) & 0xFF) == 0)
+		{
+			m_stats.SkippedPasses++;
+			continue;
+		}
+
+		ParallelFor(chunkCount, 1, [&](uint32_t begin, uint32_t end)
+		{
+			for (uint32_t c = begin; c < end; ++c)
+			{
+				array<uint32_t, 256>& histogram = histograms[c];
+				histogram.fill(0);
+				for (uint32_t i = c*chunkSize; i < min(count, (c + 1)*chunkSize); ++i)
+					histogram[(m_keys[i] >> shift) & 0xFF]++;
+			}
+		});
+
+		// Turn the counts into the first output position of every digit in every chunk.
+		uint32_t offset = 0;
+		for (uint32_t digit = 0; digit < 256; ++digit)
+		{
+			for (uint32_t c = 0; c < chunkCount; ++c)
+			{
+				uint32_t digitCount = histograms[c][digit];
+				histograms[c][digit] = offset;
+				offset += digitCount;
+			}
+		}
+
+		ParallelFor(chunkCount, 1, [&](uint32_t begin, uint32_t end)
+		{
+			for (uint32_t c = begin; c < end; ++c)
+			{
+				array<uint32_t, 256>& positions = histograms[c];
+				for (uint32_t i = c*chunkSize; i < min(count, (c + 1)*chunkSize); ++i)
+				{
+					uint32_t dst = positions[(m_keys[i] >> shift) & 0xFF]++;
+					m_tempKeys[dst] = m_keys[i];
+					m_tempItems[dst] = m_items[i];
+				}
+			}
+		});
+
+		m_keys.swap(m_tempKeys);
+		m_items.swap(m_tempItems);
+	}
+
+	uint32_t stateChanges = 0;
+	for (uint32_t i = 1; i < count; ++i)
+	{
+		if ((m_keys[i] ^ m_keys[i - 1]) & StateMask())
+			stateChanges++;
+	}
+
+	auto end = chrono::high_resolution_clock::now();
+
+	m_stats.StateChanges = stateChanges;
+	m_stats.SortMicroseconds = chrono::duration<double, micro>(end - start).count();
+}
+
+const vector<uint32_t>& RenderQueue::GetSortedItems()const
+{
+	return m_items;
+}
+
+const vector<uint64_t>& RenderQueue::GetSortedKeys()const
+{
+	return m_keys;
+}
+
+const RenderQueueStats& RenderQueue::GetStats()const
+{
+	return m_stats;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <DirectXMath.h>
+#include "SceneStore.h"
+
+using namespace DirectX;
+using namespace std;
+
+
+struct RenderQueueStats
+{
+	uint32_t Items = 0;
+
+	// Adjacent draws in the sorted stream that differ in pass, PSO, geometry or material.
+	uint32_t StateChanges = 0;
+
+	// Radix passes skipped because every key had the same digit.
+	uint32_t SkippedPasses = 0;
+
+	double BuildMicroseconds = 0.0;
+	double SortMicroseconds = 0.0;
+};
+
+// Orders the visible items for drawing. Every item gets a 64-bit key
+//
+//   63..60 pass | 59..50 PSO | 49..38 geometry | 37..24 material | 23..0 view depth
+//
+// so that sorting the keys groups draws by state, most expensive change first,
+// and orders opaque draws within a group front to back. Keys are sorted with a
+// parallel LSD radix sort on 8-bit digits.
+class RenderQueue
+{
+public:
+
+	static const uint32_t PassBits = 4;
+	static const uint32_t PsoBits = 10;
+	static const uint32_t GeometryBits = 12;
+	static const uint32_t MaterialBits = 14;
+	static const uint32_t DepthBits = 24;
+
+	static uint64_t MakeKey(uint32_t pass, uint32_t pso, uint32_t geometry, uint32_t material, uint32_t depth);
+
+	// Mask of the key bits that select pipeline state, everything except depth.
+	static uint64_t StateMask();
+
+	// Builds the keys of the given items (dense indices into the scene arrays).
+	// View depth is the distance along the camera look vector quantized over [nearZ, farZ].
+	void Build(const vector<uint32_t>& items, const DrawKey* drawKeys, const BoundsSoA& bounds,
+		const XMFLOAT3& eyePos, const XMFLOAT3& look, float nearZ, float farZ);
+
+	void Sort();
+
+	// Items in draw order after Sort.
+	const vector<uint32_t>& GetSortedItems()const;
+	const vector<uint64_t>& GetSortedKeys()const;
+
+	const RenderQueueStats& GetStats()const;
+
+private:
+
+	vector<uint64_t> m_keys;
+	vector<uint32_t> m_items;
+
+	// Ping-pong buffers of the radix sort.
+	vector<uint64_t> m_tempKeys;
+	vector<uint32_t> m_tempItems;
+
+	RenderQueueStats m_stats;
+};
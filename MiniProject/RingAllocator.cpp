@@ -0,0 +1,96 @@
+
+#include "RingAllocator.h"
+#include <cassert>
+
+using namespace std;
+
+const uint64_t RingAllocator::InvalidOffset;
+
+
+RingAllocator::RingAllocator(uint64_t capacity) : m_capacity(capacity)
+{
+}
+
+uint64_t RingAllocator::Allocate(uint64_t size, uint64_t alignment)
+{
+	assert(alignment > 0 && (alignment & (alignment - 1)) == 0);
+
+	if (size == 0 || size > m_capacity || m_used == m_capacity)
+		return InvalidOffset;
+
+	uint64_t start = m_head;
+	uint64_t offset = (start + alignment - 1) & ~(alignment - 1);
+
+	// The free space is [head, capacity) + [0, tail) when the head is ahead of the
+	// tail or the ring is empty, and [head, tail) otherwise.
+	if (m_head >= m_tail)
+	{
+		if (offset + size > m_capacity)
+		{
+			// Skip the end of the buffer and start over at 0.
+			if (size > m_tail)
+				return InvalidOffset;
+
+			uint64_t padding = m_capacity - m_head;
+			m_used += padding;
+			m_frameBytes += padding;
+			start = 0;
+			offset = 0;
+		}
+	}
+	else if (offset + size > m_tail)
+	{
+		return InvalidOffset;
+	}
+
+	// Alignment padding counts as used.
+	uint64_t end = offset + size;
+	uint64_t bytes = end - start;
+
+	m_used += bytes;
+	m_frameBytes += bytes;
+	m_head = end == m_capacity ? 0 : end;
+
+	return offset;
+}
+
+void RingAllocator::FinishFrame(uint64_t fenceValue)
+{
+	Frame frame = { fenceValue, m_head, m_frameBytes };
+	m_frames.push_back(frame);
+	m_frameBytes = 0;
+}
+
+void RingAllocator::Reclaim(uint64_t completedFenceValue)
+{
+	while (!m_frames.empty() && m_frames.front().Fence <= completedFenceValue)
+	{
+		m_tail = m_frames.front().End;
+		m_used -= m_frames.front().Bytes;
+		m_frames.pop_front();
+	}
+
+	// Nothing left in use: start over at the beginning.
+	if (m_used == 0)
+		m_head = m_tail = 0;
+}
+
+uint64_t RingAllocator::OldestFence()const
+{
+	return m_frames.empty() ? 0 : m_frames.front().Fence;
+}
+
+uint64_t RingAllocator::GetCapacity()const
+{
+	return m_capacity;
+}
+
+uint64_t RingAllocator::GetUsed()const
+{
+	return m_used;
+}
+
+uint32_t RingAllocator::GetFramesInFlight()const
+{
+	return (uint32_t)m_frames.size();
+}
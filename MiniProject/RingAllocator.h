@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+
+using namespace std;
+
+
+// Bookkeeping of a ring buffer handing out per-frame memory. Allocations are made
+// at the head; FinishFrame tags everything allocated since the previous call with
+// the fence value signaled after that frame, and Reclaim moves the tail past the
+// frames whose fence has completed. It never touches the memory itself, so it can
+// be driven by a fake fence.
+class RingAllocator
+{
+public:
+
+	static const uint64_t InvalidOffset = UINT64_MAX;
+
+	explicit RingAllocator(uint64_t capacity = 0);
+
+	// Offset of size bytes aligned to alignment (a power of two), or InvalidOffset
+	// when the ring has no room until more frames are reclaimed.
+	uint64_t Allocate(uint64_t size, uint64_t alignment);
+
+	void FinishFrame(uint64_t fenceValue);
+
+	// Frees the frames whose fence value is at most completedFenceValue.
+	void Reclaim(uint64_t completedFenceValue);
+
+	// Fence value of the oldest frame still in use, or 0 if there is none.
+	uint64_t OldestFence()const;
+
+	uint64_t GetCapacity()const;
+
+	// Bytes in use, alignment and wrap-around padding included.
+	uint64_t GetUsed()const;
+
+	uint32_t GetFramesInFlight()const;
+
+private:
+
+	struct Frame
+	{
+		uint64_t Fence;
+		uint64_t End;
+		uint64_t Bytes;
+	};
+
+	uint64_t m_capacity;
+	uint64_t m_head = 0;
+	uint64_t m_tail = 0;
+	uint64_t m_used = 0;
+
+	// Bytes allocated since the last FinishFrame.
+	uint64_t m_frameBytes = 0;
+
+	deque<Frame> m_frames;
+};
@@ -0,0 +1,326 @@
+#include "SceneFile.h"
+#include <cstring>
+#include <fstream>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace DirectX;
+using namespace std;
+
+namespace
+{
+	uint64_t Align(uint64_t offset)
+	{
+		return (offset + SceneFileAlignment - 1) / SceneFileAlignment*SceneFileAlignment;
+	}
+
+	// Appends an array of size bytes at the next aligned offset and returns it.
+	uint64_t Place(uint64_t& end, uint64_t size)
+	{
+		uint64_t offset = Align(end);
+		end = offset + size;
+		return offset;
+	}
+
+	void Write(ofstream& out, uint64_t offset, const void* data, uint64_t size)
+	{
+		static const char zeros[SceneFileAlignment] = {};
+
+		uint64_t at = (uint64_t)out.tellp();
+		out.write(zeros, (streamsize)(offset - at));
+		out.write((const char*)data, (streamsize)size);
+	}
+
+	bool CopyName(const string& name, char (&destination)[SceneFileNameLength])
+	{
+		memset(destination, 0, SceneFileNameLength);
+		if (name.size() >= SceneFileNameLength)
+			return false;
+
+		memcpy(destination, name.c_str(), name.size());
+		return true;
+	}
+}
+
+
+uint32_t AddSceneFileMesh(SceneFileContents& contents, const string& geometry, const string& submesh)
+{
+	SceneFileMesh mesh;
+	CopyName(geometry, mesh.Geometry);
+	CopyName(submesh, mesh.Submesh);
+	contents.Meshes.push_back(mesh);
+
+	return (uint32_t)contents.Meshes.size() - 1;
+}
+
+void ComputeSceneWorldBounds(const SceneFileContents& contents, vector<float> (&worldBounds)[6])
+{
+	uint32_t count = (uint32_t)contents.Worlds.size();
+	for (vector<float>& component : worldBounds)
+		component.resize(count);
+
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		BoundingBox bounds;
+		contents.LocalBounds[i].Transform(bounds, XMLoadFloat3x4(&contents.Worlds[i]));
+
+		worldBounds[0][i] = bounds.Center.x;
+		worldBounds[1][i] = bounds.Center.y;
+		worldBounds[2][i] = bounds.Center.z;
+		worldBounds[3][i] = bounds.Extents.x;
+		worldBounds[4][i] = bounds.Extents.y;
+		worldBounds[5][i] = bounds.Extents.z;
+	}
+}
+
+bool WriteSceneFile(const string& path, const SceneFileContents& contents)
+{
+	for (const SceneFileMesh& mesh : contents.Meshes)
+	{
+		if (mesh.Geometry[0] == 0 || mesh.Submesh[0] == 0)
+			return false;
+	}
+
+	uint32_t count = (uint32_t)contents.Worlds.size();
+
+	// Culling reads the world bounds, so they are stored rather than computed
+	// every time the scene is loaded.
+	vector<float> worldBounds[6];
+	ComputeSceneWorldBounds(contents, worldBounds);
+
+	SceneFileHeader header = {};
+	header.Magic = SceneFileMagic;
+	header.Version = SceneFileVersion;
+	header.ItemCount = count;
+	header.MeshCount = (uint32_t)contents.Meshes.size();
+
+	uint64_t end = sizeof(SceneFileHeader);
+	header.Meshes = Place(end, contents.Meshes.size()*sizeof(SceneFileMesh));
+	header.Worlds = Place(end, count*sizeof(XMFLOAT3X4));
+	header.LocalBounds = Place(end, count*sizeof(BoundingBox));
+	for (int c = 0; c < 6; ++c)
+		header.WorldBounds[c] = Place(end, count*sizeof(float));
+	header.Colors = Place(end, count*sizeof(XMFLOAT4));
+	header.MeshIds = Place(end, count*sizeof(uint32_t));
+	header.MaterialIds = Place(end, count*sizeof(uint32_t));
+	header.Parents = Place(end, count*sizeof(uint32_t));
+	header.Flags = Place(end, count*sizeof(uint32_t));
+	header.FileSize = end;
+
+	ofstream out(path, ios::binary | ios::trunc);
+	if (!out)
+		return false;
+
+	out.write((const char*)&header, sizeof(header));
+	Write(out, header.Meshes, contents.Meshes.data(), contents.Meshes.size()*sizeof(SceneFileMesh));
+	Write(out, header.Worlds, contents.Worlds.data(), count*sizeof(XMFLOAT3X4));
+	Write(out, header.LocalBounds, contents.LocalBounds.data(), count*sizeof(BoundingBox));
+	for (int c = 0; c < 6; ++c)
+		Write(out, header.WorldBounds[c], worldBounds[c].data(), count*sizeof(float));
+	Write(out, header.Colors, contents.Colors.data(), count*sizeof(XMFLOAT4));
+	Write(out, header.MeshIds, contents.MeshIds.data(), count*sizeof(uint32_t));
+	Write(out, header.MaterialIds, contents.MaterialIds.data(), count*sizeof(uint32_t));
+	Write(out, header.Parents, contents.Parents.data(), count*sizeof(uint32_t));
+	Write(out, header.Flags, contents.Flags.data(), count*sizeof(uint32_t));
+
+	return (bool)out;
+}
+
+SceneFile::SceneFile()
+{
+	memset(&m_header, 0, sizeof(m_header));
+}
+
+SceneFile::~SceneFile()
+{
+	Close();
+}
+
+bool SceneFile::Open(const string& path)
+{
+	Close();
+
+	// The file and mapping handles can go as soon as the view exists; the view
+	// keeps the mapping alive until it is unmapped.
+#if defined(_WIN32)
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER size;
+	HANDLE mapping = nullptr;
+	if (GetFileSizeEx(file, &size) && size.QuadPart > 0)
+		mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	CloseHandle(file);
+	if (mapping == nullptr)
+		return false;
+
+	m_data = (const uint8_t*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	m_size = (size_t)size.QuadPart;
+	CloseHandle(mapping);
+#else
+	int file = open(path.c_str(), O_RDONLY);
+	if (file < 0)
+		return false;
+
+	struct stat status = {};
+	void* view = MAP_FAILED;
+	if (fstat(file, &status) == 0 && status.st_size > 0)
+		view = mmap(nullptr, (size_t)status.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+	close(file);
+
+	m_data = view != MAP_FAILED ? (const uint8_t*)view : nullptr;
+	m_size = (size_t)status.st_size;
+#endif
+
+	if (m_data == nullptr)
+	{
+		m_size = 0;
+		return false;
+	}
+
+	if (m_size >= sizeof(SceneFileHeader))
+		memcpy(&m_header, m_data, sizeof(SceneFileHeader));
+
+	if (m_size < sizeof(SceneFileHeader) || !Validate())
+	{
+		Close();
+		return false;
+	}
+
+	return true;
+}
+
+void SceneFile::Close()
+{
+	if (m_data != nullptr)
+	{
+#if defined(_WIN32)
+		UnmapViewOfFile(m_data);
+#else
+		munmap((void*)m_data, m_size);
+#endif
+	}
+
+	m_data = nullptr;
+	m_size = 0;
+	memset(&m_header, 0, sizeof(m_header));
+}
+
+bool SceneFile::IsOpen()const
+{
+	return m_data != nullptr;
+}
+
+size_t SceneFile::GetSize()const
+{
+	return m_size;
+}
+
+uint32_t SceneFile::GetItemCount()const
+{
+	return m_header.ItemCount;
+}
+
+uint32_t SceneFile::GetMeshCount()const
+{
+	return m_header.MeshCount;
+}
+
+const SceneFileMesh* SceneFile::Meshes()const
+{
+	return Array<SceneFileMesh>(m_header.Meshes);
+}
+
+const XMFLOAT3X4* SceneFile::Worlds()const
+{
+	return Array<XMFLOAT3X4>(m_header.Worlds);
+}
+
+const BoundingBox* SceneFile::LocalBounds()const
+{
+	return Array<BoundingBox>(m_header.LocalBounds);
+}
+
+const float* SceneFile::WorldBounds(int component)const
+{
+	return Array<float>(m_header.WorldBounds[component]);
+}
+
+const XMFLOAT4* SceneFile::Colors()const
+{
+	return Array<XMFLOAT4>(m_header.Colors);
+}
+
+const uint32_t* SceneFile::MeshIds()const
+{
+	return Array<uint32_t>(m_header.MeshIds);
+}
+
+const uint32_t* SceneFile::MaterialIds()const
+{
+	return Array<uint32_t>(m_header.MaterialIds);
+}
+
+const uint32_t* SceneFile::Parents()const
+{
+	return Array<uint32_t>(m_header.Parents);
+}
+
+const uint32_t* SceneFile::Flags()const
+{
+	return Array<uint32_t>(m_header.Flags);
+}
+
+bool SceneFile::Validate()const
+{
+	const SceneFileHeader& h = m_header;
+	if (h.Magic != SceneFileMagic || h.Version != SceneFileVersion || h.FileSize != m_size)
+		return false;
+
+	// Every array aligned and inside the file. The sizes cannot overflow, the
+	// counts are 32 bits.
+	uint64_t count = h.ItemCount;
+	auto fits = [this](uint64_t offset, uint64_t size)
+	{
+		return offset % SceneFileAlignment == 0 && offset >= sizeof(SceneFileHeader) && offset <= m_size && size <= m_size - offset;
+	};
+
+	bool valid = fits(h.Meshes, h.MeshCount*(uint64_t)sizeof(SceneFileMesh)) &&
+		fits(h.Worlds, count*sizeof(XMFLOAT3X4)) &&
+		fits(h.LocalBounds, count*sizeof(BoundingBox)) &&
+		fits(h.Colors, count*sizeof(XMFLOAT4)) &&
+		fits(h.MeshIds, count*sizeof(uint32_t)) &&
+		fits(h.MaterialIds, count*sizeof(uint32_t)) &&
+		fits(h.Parents, count*sizeof(uint32_t)) &&
+		fits(h.Flags, count*sizeof(uint32_t));
+	for (int c = 0; c < 6; ++c)
+		valid = valid && fits(h.WorldBounds[c], count*sizeof(float));
+	if (!valid)
+		return false;
+
+	const SceneFileMesh* meshes = Meshes();
+	for (uint32_t m = 0; m < h.MeshCount; ++m)
+	{
+		if (meshes[m].Geometry[SceneFileNameLength - 1] != 0 || meshes[m].Submesh[SceneFileNameLength - 1] != 0)
+			return false;
+	}
+
+	// The loader indexes the mesh table and the items already added with these.
+	const uint32_t* meshIds = MeshIds();
+	const uint32_t* parents = Parents();
+	for (uint32_t i = 0; i < h.ItemCount; ++i)
+	{
+		if (meshIds[i] >= h.MeshCount || (parents[i] != UINT32_MAX && parents[i] >= i))
+			return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <DirectXMath.h>
+#include <DirectXCollision.h>
+
+using namespace DirectX;
+using namespace std;
+
+
+// Binary scene files. A file is a header followed by flat arrays, each starting on
+// a SceneFileAlignment boundary at the offset the header gives, so a mapped file
+// is used in place: loading a scene is mapping it and copying whole arrays.
+const uint32_t SceneFileMagic = 0x4e435353;	// "SSCN"
+const uint32_t SceneFileVersion = 2;
+const uint32_t SceneFileAlignment = 64;
+const uint32_t SceneFileNameLength = 32;
+
+// Bits of an item's flags. Dynamic items are moved every frame, the others never.
+const uint32_t SceneItemDynamic = 1;
+
+// Submesh of a geometry, by name, resolved against the engine's geometries when
+// the scene is loaded. Names are zero terminated.
+struct SceneFileMesh
+{
+	char Geometry[SceneFileNameLength];
+	char Submesh[SceneFileNameLength];
+};
+
+struct SceneFileHeader
+{
+	uint32_t Magic;
+	uint32_t Version;
+	uint32_t ItemCount;
+	uint32_t MeshCount;
+	uint64_t FileSize;
+
+	// Byte offsets of the arrays, of MeshCount meshes and ItemCount elements for
+	// the others. The world bounds are six arrays, CenterX to ExtentZ as in
+	// BoundsSoA.
+	uint64_t Meshes;
+	uint64_t Worlds;
+	uint64_t LocalBounds;
+	uint64_t WorldBounds[6];
+	uint64_t Colors;
+	uint64_t MeshIds;
+	uint64_t MaterialIds;
+	uint64_t Parents;
+	uint64_t Flags;
+};
+
+// A scene to write, every array but Meshes with one element per item. An item's
+// parent is an earlier item whose transform it follows, or UINT32_MAX. Worlds are
+// world matrices, not relative to the parent.
+struct SceneFileContents
+{
+	vector<SceneFileMesh> Meshes;
+	vector<XMFLOAT3X4> Worlds;
+	vector<BoundingBox> LocalBounds;
+	vector<XMFLOAT4> Colors;
+	vector<uint32_t> MeshIds;
+	vector<uint32_t> MaterialIds;
+	vector<uint32_t> Parents;
+	vector<uint32_t> Flags;
+};
+
+// Appends a mesh to contents and returns its id.
+uint32_t AddSceneFileMesh(SceneFileContents& contents, const string& geometry, const string& submesh);
+
+// World bounds of the items of contents, in six arrays of CenterX to ExtentZ.
+void ComputeSceneWorldBounds(const SceneFileContents& contents, vector<float> (&worldBounds)[6]);
+
+// Writes contents to path, with the world bounds computed from the local ones.
+// Returns false if the file cannot be written or a name is too long.
+bool WriteSceneFile(const string& path, const SceneFileContents& contents);
+
+// A scene file mapped read-only. The arrays point into the mapping and stay valid
+// until the file is closed.
+class SceneFile
+{
+public:
+
+	SceneFile();
+	SceneFile(const SceneFile& rhs) = delete;
+	SceneFile& operator=(const SceneFile& rhs) = delete;
+	~SceneFile();
+
+	// Maps the file and checks that the header is valid, the arrays lie inside
+	// the file, the mesh ids are in range and parents come before their children.
+	// Returns false, with nothing mapped, otherwise.
+	bool Open(const string& path);
+	void Close();
+	bool IsOpen()const;
+
+	// Bytes mapped.
+	size_t GetSize()const;
+
+	uint32_t GetItemCount()const;
+	uint32_t GetMeshCount()const;
+
+	const SceneFileMesh* Meshes()const;
+	const XMFLOAT3X4* Worlds()const;
+	const BoundingBox* LocalBounds()const;
+	const float* WorldBounds(int component)const;
+	const XMFLOAT4* Colors()const;
+	const uint32_t* MeshIds()const;
+	const uint32_t* MaterialIds()const;
+	const uint32_t* Parents()const;
+	const uint32_t* Flags()const;
+
+private:
+
+	bool Validate()const;
+
+	template<typename T>
+	const T* Array(uint64_t offset)const { return reinterpret_cast<const T*>(m_data + offset); }
+
+private:
+
+	const uint8_t* m_data = nullptr;
+	size_t m_size = 0;
+	SceneFileHeader m_header;
+};
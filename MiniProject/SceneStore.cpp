@@ -0,0 +1,273 @@
+
+#include "SceneStore.h"
+#include <cassert>
+
+using namespace DirectX;
+using namespace std;
+
+
+SceneStore::SceneStore(int numFrameResources) : m_numFrameResources(numFrameResources),
+	m_dirtySlots(numFrameResources), m_dirtyBits(numFrameResources)
+{
+}
+
+RenderItemHandle SceneStore::Add(const RenderItem& item)
+{
+	// Reuse a reclaimed slot if there is one, so the object buffers do not grow.
+	uint32_t slot = m_slotAllocator.Allocate();
+	if (slot == m_slotToDense.size())
+	{
+		m_slotToDense.push_back(UINT32_MAX);
+		m_generations.push_back(0);
+	}
+
+	uint32_t denseIndex = (uint32_t)m_world.size();
+	m_slotToDense[slot] = denseIndex;
+
+	m_world.push_back(item.World);
+	m_colors.push_back(item.Color);
+	m_localBounds.push_back(item.LocalBounds);
+	m_drawKeys.push_back(item.Draw);
+	m_slots.push_back(slot);
+	m_lodGroups.push_back(item.LodGroupId);
+	m_lodLevels.push_back(0);
+	MarkDirty(slot);
+
+	m_worldBounds.CenterX.push_back(0.0f);
+	m_worldBounds.CenterY.push_back(0.0f);
+	m_worldBounds.CenterZ.push_back(0.0f);
+	m_worldBounds.ExtentX.push_back(0.0f);
+	m_worldBounds.ExtentY.push_back(0.0f);
+	m_worldBounds.ExtentZ.push_back(0.0f);
+	StoreWorldBounds(denseIndex);
+
+	RenderItemHandle handle;
+	handle.Index = slot;
+	handle.Generation = m_generations[slot];
+	return handle;
+}
+
+uint32_t SceneStore::AddRange(const RenderItemRange& range)
+{
+	uint32_t first = Size();
+	uint32_t count = range.Count;
+
+	m_world.insert(m_world.end(), range.Worlds, range.Worlds + count);
+	m_colors.insert(m_colors.end(), range.Colors, range.Colors + count);
+	m_localBounds.insert(m_localBounds.end(), range.LocalBounds, range.LocalBounds + count);
+
+	vector<float>* worldBounds[6] = { &m_worldBounds.CenterX, &m_worldBounds.CenterY, &m_worldBounds.CenterZ,
+		&m_worldBounds.ExtentX, &m_worldBounds.ExtentY, &m_worldBounds.ExtentZ };
+	for (int c = 0; c < 6; ++c)
+		worldBounds[c]->insert(worldBounds[c]->end(), range.WorldBounds[c], range.WorldBounds[c] + count);
+
+	m_drawKeys.resize(first + count);
+	m_lodGroups.resize(first + count);
+	m_lodLevels.resize(first + count, 0);
+	m_slots.resize(first + count);
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		uint32_t draw = range.DrawIds[i];
+		m_drawKeys[first + i] = range.Draws[draw];
+		m_drawKeys[first + i].Material = range.Materials[i];
+		m_lodGroups[first + i] = range.DrawLodGroups[draw];
+
+		uint32_t slot = m_slotAllocator.Allocate();
+		if (slot == m_slotToDense.size())
+		{
+			m_slotToDense.push_back(UINT32_MAX);
+			m_generations.push_back(0);
+		}
+
+		m_slotToDense[slot] = first + i;
+		m_slots[first + i] = slot;
+		MarkDirty(slot);
+	}
+
+	return first;
+}
+
+void SceneStore::Remove(RenderItemHandle handle)
+{
+	if (!IsAlive(handle))
+		return;
+
+	uint32_t denseIndex = m_slotToDense[handle.Index];
+	uint32_t last = Size() - 1;
+
+	// Move the last item into the hole so the arrays stay contiguous.
+	if (denseIndex != last)
+	{
+		m_world[denseIndex] = m_world[last];
+		m_colors[denseIndex] = m_colors[last];
+		m_localBounds[denseIndex] = m_localBounds[last];
+		m_drawKeys[denseIndex] = m_drawKeys[last];
+		m_slots[denseIndex] = m_slots[last];
+		m_lodGroups[denseIndex] = m_lodGroups[last];
+		m_lodLevels[denseIndex] = m_lodLevels[last];
+
+		m_worldBounds.CenterX[denseIndex] = m_worldBounds.CenterX[last];
+		m_worldBounds.CenterY[denseIndex] = m_worldBounds.CenterY[last];
+		m_worldBounds.CenterZ[denseIndex] = m_worldBounds.CenterZ[last];
+		m_worldBounds.ExtentX[denseIndex] = m_worldBounds.ExtentX[last];
+		m_worldBounds.ExtentY[denseIndex] = m_worldBounds.ExtentY[last];
+		m_worldBounds.ExtentZ[denseIndex] = m_worldBounds.ExtentZ[last];
+
+		m_slotToDense[m_slots[denseIndex]] = denseIndex;
+	}
+
+	m_world.pop_back();
+	m_colors.pop_back();
+	m_localBounds.pop_back();
+	m_drawKeys.pop_back();
+	m_slots.pop_back();
+	m_lodGroups.pop_back();
+	m_lodLevels.pop_back();
+
+	m_worldBounds.CenterX.pop_back();
+	m_worldBounds.CenterY.pop_back();
+	m_worldBounds.CenterZ.pop_back();
+	m_worldBounds.ExtentX.pop_back();
+	m_worldBounds.ExtentY.pop_back();
+	m_worldBounds.ExtentZ.pop_back();
+
+	// Invalidate outstanding handles to this slot before it gets reused.
+	m_slotToDense[handle.Index] = UINT32_MAX;
+	m_generations[handle.Index]++;
+	m_slotAllocator.Free(handle.Index);
+}
+
+bool SceneStore::IsAlive(RenderItemHandle handle)const
+{
+	return handle.Index < m_slotToDense.size() &&
+		m_generations[handle.Index] == handle.Generation &&
+		m_slotToDense[handle.Index] != UINT32_MAX;
+}
+
+void SceneStore::Clear()
+{
+	while (Size() > 0)
+		Remove(HandleAt(Size() - 1));
+}
+
+void SceneStore::SetWorld(RenderItemHandle handle, const XMFLOAT3X4& world)
+{
+	assert(IsAlive(handle));
+
+	uint32_t denseIndex = m_slotToDense[handle.Index];
+	m_world[denseIndex] = world;
+	MarkDirty(handle.Index);
+	StoreWorldBounds(denseIndex);
+}
+
+const XMFLOAT3X4& SceneStore::GetWorld(RenderItemHandle handle)const
+{
+	assert(IsAlive(handle));
+
+	return m_world[m_slotToDense[handle.Index]];
+}
+
+void SceneStore::SetDrawArgs(uint32_t denseIndex, uint32_t indexCount, uint32_t startIndexLocation, int32_t baseVertexLocation)
+{
+	assert(denseIndex < Size());
+
+	DrawKey& key = m_drawKeys[denseIndex];
+	key.IndexCount = indexCount;
+	key.StartIndexLocation = startIndexLocation;
+	key.BaseVertexLocation = baseVertexLocation;
+}
+
+uint32_t SceneStore::Size()const
+{
+	return (uint32_t)m_world.size();
+}
+
+uint32_t SceneStore::SlotCount()const
+{
+	return (uint32_t)m_slotToDense.size();
+}
+
+uint32_t SceneStore::RetiredSlotCount()const
+{
+	return m_slotAllocator.RetiredCount();
+}
+
+void SceneStore::FinishFrame(uint64_t fenceValue)
+{
+	m_slotAllocator.FinishFrame(fenceValue);
+}
+
+void SceneStore::Reclaim(uint64_t completedFenceValue)
+{
+	m_slotAllocator.Reclaim(completedFenceValue);
+}
+
+uint32_t SceneStore::DenseIndex(RenderItemHandle handle)const
+{
+	assert(IsAlive(handle));
+
+	return m_slotToDense[handle.Index];
+}
+
+uint32_t SceneStore::SlotToDense(uint32_t slot)const
+{
+	return m_slotToDense[slot];
+}
+
+RenderItemHandle SceneStore::HandleAt(uint32_t denseIndex)const
+{
+	RenderItemHandle handle;
+	handle.Index = m_slots[denseIndex];
+	handle.Generation = m_generations[handle.Index];
+	return handle;
+}
+
+const vector<uint32_t>& SceneStore::DirtySlots(int frameResource)const
+{
+	return m_dirtySlots[frameResource];
+}
+
+void SceneStore::ClearDirty(int frameResource)
+{
+	vector<uint64_t>& bits = m_dirtyBits[frameResource];
+	for (uint32_t slot : m_dirtySlots[frameResource])
+		bits[slot >> 6] &= ~(1ull << (slot & 63));
+
+	m_dirtySlots[frameResource].clear();
+}
+
+void SceneStore::MarkAllDirty()
+{
+	for (uint32_t slot : m_slots)
+		MarkDirty(slot);
+}
+
+void SceneStore::MarkDirty(uint32_t slot)
+{
+	for (int f = 0; f < m_numFrameResources; ++f)
+	{
+		vector<uint64_t>& bits = m_dirtyBits[f];
+		if (bits.size() <= (slot >> 6))
+			bits.resize((slot >> 6) + 1, 0);
+
+		uint64_t mask = 1ull << (slot & 63);
+		if ((bits[slot >> 6] & mask) == 0)
+		{
+			bits[slot >> 6] |= mask;
+			m_dirtySlots[f].push_back(slot);
+		}
+	}
+}
+
+void SceneStore::StoreWorldBounds(uint32_t denseIndex)
+{
+	BoundingBox worldBounds;
+	m_localBounds[denseIndex].Transform(worldBounds, XMLoadFloat3x4(&m_world[denseIndex]));
+
+	m_worldBounds.CenterX[denseIndex] = worldBounds.Center.x;
+	m_worldBounds.CenterY[denseIndex] = worldBounds.Center.y;
+	m_worldBounds.CenterZ[denseIndex] = worldBounds.Center.z;
+	m_worldBounds.ExtentX[denseIndex] = worldBounds.Extents.x;
+	m_worldBounds.ExtentY[denseIndex] = worldBounds.Extents.y;
+	m_worldBounds.ExtentZ[denseIndex] = worldBounds.Extents.z;
+}
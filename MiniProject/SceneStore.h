@@ -0,0 +1,195 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <DirectXMath.h>
+#include <DirectXCollision.h>
+#include "FencedFreeList.h"
+#include "AffineMath.h"
+
+using namespace DirectX;
+using namespace std;
+
+
+// Stable reference to a render item. The index addresses a slot that survives the
+// removal of other items, the generation detects handles to removed items.
+struct RenderItemHandle
+{
+	uint32_t Index = UINT32_MAX;
+	uint32_t Generation = 0;
+
+	bool IsValid()const { return Index != UINT32_MAX; }
+};
+
+// Geometry and DrawIndexedInstanced parameters of a render item.
+struct DrawKey
+{
+	// Index into the engine geometry table.
+	uint32_t Geometry = 0;
+
+	// D3D_PRIMITIVE_TOPOLOGY value (4 = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST).
+	uint32_t PrimitiveType = 4;
+
+	// Render pass, pipeline state and material the item is drawn with. They only
+	// feed the render queue sort keys, the engine has one of each so far.
+	uint32_t Pass = 0;
+	uint32_t Pso = 0;
+	uint32_t Material = 0;
+
+	uint32_t IndexCount = 0;
+	uint32_t StartIndexLocation = 0;
+	int32_t BaseVertexLocation = 0;
+};
+
+// Lightweight structure describing a shape to add to the scene. The scene copies it
+// into its arrays, so it is only used while building.
+struct RenderItem
+{
+	// World matrix of the shape that describes the object's local space
+	// relative to the world space, which defines the position, orientation,
+	// and scale of the object in the world. Affine, see AffineMath.h.
+	XMFLOAT3X4 World = Identity3x4();
+
+	// Bounds of the submesh in local space.
+	BoundingBox LocalBounds;
+
+	// Tint multiplied with the vertex colors.
+	XMFLOAT4 Color = XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
+
+	// Draw holds the finest level of detail. Items with levels name their LodGroup
+	// in the LodSelector, see LodSelection.h.
+	DrawKey Draw;
+	uint32_t LodGroupId = UINT32_MAX;
+};
+
+// Arrays of Count items added at once, such as a scene file mapped in memory. The
+// items draw from a table: item i draws Draws[DrawIds[i]] with material
+// Materials[i], in level of detail group DrawLodGroups[DrawIds[i]].
+struct RenderItemRange
+{
+	uint32_t Count = 0;
+	const XMFLOAT3X4* Worlds = nullptr;
+	const BoundingBox* LocalBounds = nullptr;
+
+	// World bounds of the items, CenterX to ExtentZ as in BoundsSoA.
+	const float* WorldBounds[6] = {};
+
+	const XMFLOAT4* Colors = nullptr;
+	const uint32_t* DrawIds = nullptr;
+	const uint32_t* Materials = nullptr;
+	const DrawKey* Draws = nullptr;
+	const uint32_t* DrawLodGroups = nullptr;
+};
+
+// World space bounds stored as separate component arrays so that culling can load
+// several items per SIMD register.
+struct BoundsSoA
+{
+	vector<float> CenterX;
+	vector<float> CenterY;
+	vector<float> CenterZ;
+	vector<float> ExtentX;
+	vector<float> ExtentY;
+	vector<float> ExtentZ;
+};
+
+// Data-oriented storage of all render items. Every property lives in its own
+// contiguous array indexed by a dense index in [0, Size()), so per-frame loops
+// only touch the arrays they need. Removing an item moves the last one into its
+// place; handles and slots stay valid across that move. The slot of a removed item
+// is only reused once the frames that could still read its constants completed.
+class SceneStore
+{
+public:
+
+	explicit SceneStore(int numFrameResources);
+
+	RenderItemHandle Add(const RenderItem& item);
+
+	// Adds the items of range with their arrays copied whole, and returns the
+	// dense index of the first. The others follow it.
+	uint32_t AddRange(const RenderItemRange& range);
+	void Remove(RenderItemHandle handle);
+	bool IsAlive(RenderItemHandle handle)const;
+	void Clear();
+
+	// Sets the world matrix, refreshes the world bounds and flags the item dirty
+	// for every frame resource.
+	void SetWorld(RenderItemHandle handle, const XMFLOAT3X4& world);
+	const XMFLOAT3X4& GetWorld(RenderItemHandle handle)const;
+
+	// Switches the submesh an item draws, for level of detail changes.
+	void SetDrawArgs(uint32_t denseIndex, uint32_t indexCount, uint32_t startIndexLocation, int32_t baseVertexLocation);
+
+	// Number of live items.
+	uint32_t Size()const;
+
+	// Number of slots ever handed out. Object buffers are sized by it.
+	uint32_t SlotCount()const;
+
+	// Slots of removed items waiting for their frame's fence.
+	uint32_t RetiredSlotCount()const;
+
+	// Tags the slots removed since the last call with the fence value signaled
+	// after the frame, and makes the slots of completed frames reusable.
+	void FinishFrame(uint64_t fenceValue);
+	void Reclaim(uint64_t completedFenceValue);
+
+	uint32_t DenseIndex(RenderItemHandle handle)const;
+	uint32_t SlotToDense(uint32_t slot)const;
+	RenderItemHandle HandleAt(uint32_t denseIndex)const;
+
+	// Dense arrays.
+	const XMFLOAT3X4* Worlds()const { return m_world.data(); }
+	const XMFLOAT4* Colors()const { return m_colors.data(); }
+	const BoundingBox* LocalBounds()const { return m_localBounds.data(); }
+	const BoundsSoA& WorldBounds()const { return m_worldBounds; }
+	const DrawKey* DrawKeys()const { return m_drawKeys.data(); }
+	const uint32_t* Slots()const { return m_slots.data(); }
+	const uint32_t* LodGroups()const { return m_lodGroups.data(); }
+	const uint8_t* LodLevels()const { return m_lodLevels.data(); }
+
+	// Written by the level of detail selection.
+	uint8_t* LodLevels() { return m_lodLevels.data(); }
+
+	// Slots whose constants changed since the last upload to the given frame
+	// resource, each listed once. Slots of removed items can appear in it, their
+	// SlotToDense is UINT32_MAX.
+	const vector<uint32_t>& DirtySlots(int frameResource)const;
+
+	// Call after uploading the dirty slots of a frame resource.
+	void ClearDirty(int frameResource);
+
+	// Flags every live slot dirty for every frame resource, for when the object
+	// buffers were recreated.
+	void MarkAllDirty();
+
+private:
+
+	void StoreWorldBounds(uint32_t denseIndex);
+	void MarkDirty(uint32_t slot);
+
+private:
+
+	int m_numFrameResources;
+
+	// Dense arrays, all of Size() elements.
+	vector<XMFLOAT3X4> m_world;
+	vector<XMFLOAT4> m_colors;
+	vector<BoundingBox> m_localBounds;
+	BoundsSoA m_worldBounds;
+	vector<DrawKey> m_drawKeys;
+	vector<uint32_t> m_slots;
+	vector<uint32_t> m_lodGroups;
+	vector<uint8_t> m_lodLevels;
+
+	// Slot tables, all of SlotCount() elements.
+	vector<uint32_t> m_slotToDense;
+	vector<uint32_t> m_generations;
+	FencedFreeList m_slotAllocator;
+
+	// Per frame resource, the dirty slot list and a bit per slot that keeps it
+	// free of duplicates.
+	vector<vector<uint32_t>> m_dirtySlots;
+	vector<vector<uint64_t>> m_dirtyBits;
+};
@@ -1,8 +1,19 @@
  
 
+// Per-object data of every object slot, matches ObjectData in Util.h.
+// World is affine, stored as three rows: mul(World, float4(p, 1)) transforms a point.
+struct ObjectData
+{
+	row_major float3x4 World;
+	float4 Color;
+};
+
+StructuredBuffer<ObjectData> gObjects : register(t0);
+
+// Slot of the object being drawn, set as a root constant per draw.
 cbuffer cbPerObject : register(b0)
 {
-	float4x4 gWorld; 
+	uint gObjectIndex;
 };
 
 cbuffer cbPass : register(b1)
@@ -47,6 +58,15 @@ struct VertexIn
 	float4 Color   : COLOR;
 };
 
+// Per-instance stream of the instanced draws, the rows of the 3x4 world matrix and a tint.
+struct InstanceIn
+{
+	float4 World0  : WORLD0;
+	float4 World1  : WORLD1;
+	float4 World2  : WORLD2;
+	float4 Color   : INSTANCECOLOR;
+};
+
 struct VertexOut
 {
 	float4 PosH    : SV_POSITION;
@@ -55,25 +75,39 @@ struct VertexOut
 	float4 Color   : COLOR;
 };
 
-VertexOut VS(VertexIn vin)
+VertexOut TransformVertex(VertexIn vin, float3x4 world, float4 color)
 {
 	VertexOut vout;
 	
-	// Transform to homogeneous clip space.
-	float4 posW = mul(float4(vin.PosL, 1.0f), gWorld);
-	vout.PosW = posW.xyz;
+	// Transform to homogeneous clip space. The world matrix multiplies column vectors.
+	float3 posW = mul(world, float4(vin.PosL, 1.0f));
+	vout.PosW = posW;
 	
 	// Assumes nonuniform scaling; otherwise, need to use inverse-transpose of world matrix.
-	vout.NormalW = mul(vin.NormalL, (float3x3)gWorld);
+	vout.NormalW = mul((float3x3)world, vin.NormalL);
 	
-	vout.PosH = mul(posW, gViewProj);
+	vout.PosH = mul(float4(posW, 1.0f), gViewProj);
 	
-	// Just pass vertex color into the pixel shader.
-	vout.Color = vin.Color;
+	// Pass the tinted vertex color into the pixel shader.
+	vout.Color = vin.Color * color;
 	
 	return vout;
 }
 
+VertexOut VS(VertexIn vin)
+{
+	ObjectData object = gObjects[gObjectIndex];
+
+	return TransformVertex(vin, object.World, object.Color);
+}
+
+VertexOut VSInstanced(VertexIn vin, InstanceIn iin)
+{
+	float3x4 world = float3x4(iin.World0, iin.World1, iin.World2);
+
+	return TransformVertex(vin, world, iin.Color);
+}
+
 float4 PS(VertexOut pin) : SV_Target
 {
 
@@ -0,0 +1,345 @@
+
+#include "StaticBatching.h"
+#include <algorithm>
+#include <cmath>
+#include <unordered_map>
+#include <unordered_set>
+
+using namespace DirectX;
+using namespace std;
+
+
+void StaticBatcher::SetCellSize(float cellSize)
+{
+	m_cellSize = cellSize;
+}
+
+void StaticBatcher::SetProxyResolution(uint32_t cellsPerAxis)
+{
+	m_proxyResolution = max(1u, cellsPerAxis);
+}
+
+void StaticBatcher::SetProxyDistances(float cluster, float group)
+{
+	m_clusterProxyDistance = cluster;
+	m_groupProxyDistance = group;
+}
+
+uint32_t StaticBatcher::AddMesh(const vector<BatchVertex>& vertices, const vector<uint32_t>& indices)
+{
+	SourceMesh mesh;
+	mesh.FirstVertex = (uint32_t)m_meshVertices.size();
+	mesh.VertexCount = (uint32_t)vertices.size();
+	mesh.FirstIndex = (uint32_t)m_meshIndices.size();
+	mesh.IndexCount = (uint32_t)indices.size();
+	BoundingBox::CreateFromPoints(mesh.Bounds, vertices.size(), &vertices[0].Pos, sizeof(BatchVertex));
+
+	m_meshVertices.insert(m_meshVertices.end(), vertices.begin(), vertices.end());
+	m_meshIndices.insert(m_meshIndices.end(), indices.begin(), indices.end());
+	m_meshes.push_back(mesh);
+
+	return (uint32_t)m_meshes.size() - 1;
+}
+
+void StaticBatcher::AddInstance(const StaticInstance& instance)
+{
+	m_instances.push_back(instance);
+}
+
+void StaticBatcher::Build()
+{
+	m_vertices.clear();
+	m_indices.clear();
+	m_nodes.clear();
+	m_groups.clear();
+	m_stats = StaticBatchStats();
+	m_stats.Instances = (uint32_t)m_instances.size();
+
+	// Cell of every instance from the center of its world bounds.
+	struct Placement
+	{
+		uint32_t Pso;
+		int32_t GroupX, GroupZ;
+		int32_t CellX, CellZ;
+		uint32_t Instance;
+	};
+
+	vector<Placement> placements(m_instances.size());
+	for (uint32_t i = 0; i < (uint32_t)m_instances.size(); ++i)
+	{
+		const StaticInstance& instance = m_instances[i];
+
+		BoundingBox bounds;
+		m_meshes[instance.Mesh].Bounds.Transform(bounds, XMLoadFloat3x4(&instance.World));
+
+		Placement& p = placements[i];
+		p.Pso = instance.Pso;
+		p.CellX = (int32_t)floor(bounds.Center.x / m_cellSize);
+		p.CellZ = (int32_t)floor(bounds.Center.z / m_cellSize);
+		p.GroupX = p.CellX >> 1;
+		p.GroupZ = p.CellZ >> 1;
+		p.Instance = i;
+	}
+
+	// Instances of a group, and within it of a cluster, become consecutive.
+	sort(placements.begin(), placements.end(), [](const Placement& a, const Placement& b)
+	{
+		if (a.Pso != b.Pso) return a.Pso < b.Pso;
+		if (a.GroupX != b.GroupX) return a.GroupX < b.GroupX;
+		if (a.GroupZ != b.GroupZ) return a.GroupZ < b.GroupZ;
+		if (a.CellX != b.CellX) return a.CellX < b.CellX;
+		if (a.CellZ != b.CellZ) return a.CellZ < b.CellZ;
+		return a.Instance < b.Instance;
+	});
+
+	auto sameGroup = [](const Placement& a, const Placement& b) { return a.Pso == b.Pso && a.GroupX == b.GroupX && a.GroupZ == b.GroupZ; };
+	auto sameCell = [](const Placement& a, const Placement& b) { return a.CellX == b.CellX && a.CellZ == b.CellZ; };
+
+	vector<uint32_t> proxySource;
+	size_t groupBegin = 0;
+	while (groupBegin < placements.size())
+	{
+		size_t groupEnd = groupBegin;
+		while (groupEnd < placements.size() && sameGroup(placements[groupBegin], placements[groupEnd]))
+			groupEnd++;
+
+		// The group comes first, its clusters right after it.
+		uint32_t groupIndex = (uint32_t)m_nodes.size();
+		m_nodes.push_back(HlodNode());
+		m_nodes[groupIndex].Pso = placements[groupBegin].Pso;
+		m_nodes[groupIndex].FirstChild = groupIndex + 1;
+		m_groups.push_back(groupIndex);
+
+		size_t clusterBegin = groupBegin;
+		while (clusterBegin < groupEnd)
+		{
+			size_t clusterEnd = clusterBegin;
+			while (clusterEnd < groupEnd && sameCell(placements[clusterBegin], placements[clusterEnd]))
+				clusterEnd++;
+
+			HlodNode cluster;
+			cluster.Pso = placements[clusterBegin].Pso;
+			cluster.StartIndex = (uint32_t)m_indices.size();
+
+			// Pre-transform the instances into world space.
+			uint32_t firstVertex = (uint32_t)m_vertices.size();
+			for (size_t p = clusterBegin; p < clusterEnd; ++p)
+			{
+				const StaticInstance& instance = m_instances[placements[p].Instance];
+				const SourceMesh& mesh = m_meshes[instance.Mesh];
+
+				XMMATRIX world = XMLoadFloat3x4(&instance.World);
+				XMVECTOR color = XMLoadFloat4(&instance.Color);
+				uint32_t base = (uint32_t)m_vertices.size();
+
+				for (uint32_t v = 0; v < mesh.VertexCount; ++v)
+				{
+					const BatchVertex& source = m_meshVertices[mesh.FirstVertex + v];
+
+					BatchVertex vertex;
+					XMStoreFloat3(&vertex.Pos, XMVector3Transform(XMLoadFloat3(&source.Pos), world));
+					XMStoreFloat3(&vertex.Normal, XMVector3Normalize(XMVector3TransformNormal(XMLoadFloat3(&source.Normal), world)));
+					XMStoreFloat4(&vertex.Color, XMVectorMultiply(XMLoadFloat4(&source.Color), color));
+					m_vertices.push_back(vertex);
+				}
+
+				for (uint32_t i = 0; i < mesh.IndexCount; ++i)
+					m_indices.push_back(base + m_meshIndices[mesh.FirstIndex + i]);
+			}
+
+			cluster.IndexCount = (uint32_t)m_indices.size() - cluster.StartIndex;
+			BoundingBox::CreateFromPoints(cluster.Bounds, m_vertices.size() - firstVertex, &m_vertices[firstVertex].Pos, sizeof(BatchVertex));
+
+			proxySource.assign(m_indices.begin() + cluster.StartIndex, m_indices.end());
+			AppendProxy(proxySource, cluster.Bounds, cluster);
+
+			m_stats.Clusters++;
+			m_stats.Triangles += cluster.IndexCount / 3;
+			m_nodes.push_back(cluster);
+
+			clusterBegin = clusterEnd;
+		}
+
+		// The group proxy is clustered from the proxies of its clusters.
+		HlodNode& group = m_nodes[groupIndex];
+		group.ChildCount = (uint32_t)m_nodes.size() - group.FirstChild;
+		group.Bounds = m_nodes[group.FirstChild].Bounds;
+
+		proxySource.clear();
+		for (uint32_t c = group.FirstChild; c < group.FirstChild + group.ChildCount; ++c)
+		{
+			const HlodNode& child = m_nodes[c];
+			BoundingBox::CreateMerged(group.Bounds, group.Bounds, child.Bounds);
+			proxySource.insert(proxySource.end(), m_indices.begin() + child.ProxyStartIndex,
+				m_indices.begin() + child.ProxyStartIndex + child.ProxyIndexCount);
+		}
+
+		AppendProxy(proxySource, group.Bounds, group);
+
+		m_stats.Groups++;
+		groupBegin = groupEnd;
+	}
+}
+
+void StaticBatcher::AppendProxy(const vector<uint32_t>& sourceIndices, const BoundingBox& bounds, HlodNode& node)
+{
+	const float res = (float)m_proxyResolution;
+	XMFLOAT3 minCorner(bounds.Center.x - bounds.Extents.x, bounds.Center.y - bounds.Extents.y, bounds.Center.z - bounds.Extents.z);
+	XMFLOAT3 scale(
+		res / max(2.0f*bounds.Extents.x, 1e-4f),
+		res / max(2.0f*bounds.Extents.y, 1e-4f),
+		res / max(2.0f*bounds.Extents.z, 1e-4f));
+
+	auto cellOf = [&](const XMFLOAT3& p) -> uint32_t
+	{
+		uint32_t x = (uint32_t)min(max((p.x - minCorner.x)*scale.x, 0.0f), res - 1.0f);
+		uint32_t y = (uint32_t)min(max((p.y - minCorner.y)*scale.y, 0.0f), res - 1.0f);
+		uint32_t z = (uint32_t)min(max((p.z - minCorner.z)*scale.z, 0.0f), res - 1.0f);
+		return (z*m_proxyResolution + y)*m_proxyResolution + x;
+	};
+
+	// One proxy vertex per occupied cell, the average of the vertices in it.
+	unordered_map<uint32_t, uint32_t> cellVertices;
+	vector<BatchVertex> sums;
+	vector<uint32_t> counts;
+	vector<uint32_t> remap(sourceIndices.size());
+
+	for (size_t i = 0; i < sourceIndices.size(); ++i)
+	{
+		const BatchVertex& v = m_vertices[sourceIndices[i]];
+
+		uint32_t cell = cellOf(v.Pos);
+		auto it = cellVertices.find(cell);
+		if (it == cellVertices.end())
+		{
+			it = cellVertices.emplace(cell, (uint32_t)sums.size()).first;
+			BatchVertex zero = { XMFLOAT3(0.0f, 0.0f, 0.0f), XMFLOAT3(0.0f, 0.0f, 0.0f), XMFLOAT4(0.0f, 0.0f, 0.0f, 0.0f) };
+			sums.push_back(zero);
+			counts.push_back(0);
+		}
+
+		// Vertices shared by several triangles are counted once per use, which
+		// weights the average toward well connected vertices.
+		BatchVertex& sum = sums[it->second];
+		XMStoreFloat3(&sum.Pos, XMVectorAdd(XMLoadFloat3(&sum.Pos), XMLoadFloat3(&v.Pos)));
+		XMStoreFloat3(&sum.Normal, XMVectorAdd(XMLoadFloat3(&sum.Normal), XMLoadFloat3(&v.Normal)));
+		XMStoreFloat4(&sum.Color, XMVectorAdd(XMLoadFloat4(&sum.Color), XMLoadFloat4(&v.Color)));
+		counts[it->second]++;
+		remap[i] = it->second;
+	}
+
+	// Keep the triangles whose corners landed in three different cells, once.
+	uint32_t firstVertex = (uint32_t)m_vertices.size();
+	node.ProxyStartIndex = (uint32_t)m_indices.size();
+
+	unordered_set<uint64_t> triangles;
+	for (size_t t = 0; t + 2 < sourceIndices.size(); t += 3)
+	{
+		uint32_t a = remap[t], b = remap[t + 1], c = remap[t + 2];
+		if (a == b || b == c || a == c)
+			continue;
+
+		uint64_t lo = min(a, min(b, c));
+		uint64_t hi = max(a, max(b, c));
+		uint64_t mid = (uint64_t)a + b + c - lo - hi;
+		if (!triangles.insert((lo << 42) | (mid << 21) | hi).second)
+			continue;
+
+		m_indices.push_back(firstVertex + a);
+		m_indices.push_back(firstVertex + b);
+		m_indices.push_back(firstVertex + c);
+	}
+
+	node.ProxyIndexCount = (uint32_t)m_indices.size() - node.ProxyStartIndex;
+	m_stats.ProxyTriangles += node.ProxyIndexCount / 3;
+
+	for (size_t i = 0; i < sums.size(); ++i)
+	{
+		float inv = 1.0f / counts[i];
+
+		BatchVertex v;
+		XMStoreFloat3(&v.Pos, XMVectorScale(XMLoadFloat3(&sums[i].Pos), inv));
+		XMStoreFloat3(&v.Normal, XMVector3Normalize(XMLoadFloat3(&sums[i].Normal)));
+		XMStoreFloat4(&v.Color, XMVectorScale(XMLoadFloat4(&sums[i].Color), inv));
+		m_vertices.push_back(v);
+	}
+}
+
+const vector<BatchVertex>& StaticBatcher::GetVertices()const
+{
+	return m_vertices;
+}
+
+const vector<uint32_t>& StaticBatcher::GetIndices()const
+{
+	return m_indices;
+}
+
+const vector<HlodNode>& StaticBatcher::GetNodes()const
+{
+	return m_nodes;
+}
+
+const vector<uint32_t>& StaticBatcher::GetGroups()const
+{
+	return m_groups;
+}
+
+void StaticBatcher::Select(const XMFLOAT3& eye, const XMFLOAT4 planes[6], vector<HlodDraw>& draws)
+{
+	m_culler.SetPlanes(planes);
+	draws.clear();
+
+	m_stats.Draws = 0;
+	m_stats.ProxyDraws = 0;
+	m_stats.TrianglesDrawn = 0;
+
+	auto emit = [&](const HlodNode& node, bool proxy)
+	{
+		HlodDraw draw;
+		draw.Pso = node.Pso;
+		draw.StartIndex = proxy ? node.ProxyStartIndex : node.StartIndex;
+		draw.IndexCount = proxy ? node.ProxyIndexCount : node.IndexCount;
+		if (draw.IndexCount == 0)
+			return;
+
+		draws.push_back(draw);
+		m_stats.Draws++;
+		m_stats.ProxyDraws += proxy ? 1 : 0;
+		m_stats.TrianglesDrawn += draw.IndexCount / 3;
+	};
+
+	for (uint32_t g : m_groups)
+	{
+		const HlodNode& group = m_nodes[g];
+		if (!m_culler.IsVisible(group.Bounds.Center, group.Bounds.Extents))
+			continue;
+
+		if (IsFar(group, eye, m_groupProxyDistance))
+		{
+			emit(group, true);
+			continue;
+		}
+
+		for (uint32_t c = group.FirstChild; c < group.FirstChild + group.ChildCount; ++c)
+		{
+			const HlodNode& cluster = m_nodes[c];
+			if (m_culler.IsVisible(cluster.Bounds.Center, cluster.Bounds.Extents))
+				emit(cluster, IsFar(cluster, eye, m_clusterProxyDistance));
+		}
+	}
+}
+
+const StaticBatchStats& StaticBatcher::GetStats()const
+{
+	return m_stats;
+}
+
+bool StaticBatcher::IsFar(const HlodNode& node, const XMFLOAT3& eye, float distance)const
+{
+	// Distance from the eye to the closest point of the bounds.
+	XMVECTOR offset = XMVectorSubtract(XMLoadFloat3(&eye), XMLoadFloat3(&node.Bounds.Center));
+	XMVECTOR outside = XMVectorMax(XMVectorSubtract(XMVectorAbs(offset), XMLoadFloat3(&node.Bounds.Extents)), XMVectorZero());
+
+	return XMVectorGetX(XMVector3LengthSq(outside)) > distance*distance;
+}
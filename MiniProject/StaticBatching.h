@@ -0,0 +1,152 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <DirectXMath.h>
+#include <DirectXCollision.h>
+#include "FrustumCulling.h"
+
+using namespace DirectX;
+using namespace std;
+
+
+// Vertex of the merged meshes, laid out like the engine Vertex.
+struct BatchVertex
+{
+	XMFLOAT3 Pos;
+	XMFLOAT3 Normal;
+	XMFLOAT4 Color;
+};
+
+// A static object: a mesh added with AddMesh placed in the world. Instances are
+// only merged with instances of the same Pso.
+struct StaticInstance
+{
+	uint32_t Mesh = 0;
+	uint32_t Pso = 0;
+	XMFLOAT3X4 World;
+	XMFLOAT4 Color = XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
+};
+
+// Node of the HLOD tree. Clusters hold the merged full detail mesh of the
+// instances in one grid cell, groups hold 2x2 clusters. Every node has a proxy,
+// a coarser mesh drawn instead of the node when it is far away. Index ranges
+// address GetIndices(), whose values are absolute vertex indices.
+struct HlodNode
+{
+	BoundingBox Bounds;
+	uint32_t Pso = 0;
+
+	// Full detail mesh, clusters only.
+	uint32_t StartIndex = 0;
+	uint32_t IndexCount = 0;
+
+	uint32_t ProxyStartIndex = 0;
+	uint32_t ProxyIndexCount = 0;
+
+	// Child clusters in GetNodes(), groups only.
+	uint32_t FirstChild = 0;
+	uint32_t ChildCount = 0;
+};
+
+// One draw of a node's mesh or proxy.
+struct HlodDraw
+{
+	uint32_t Pso;
+	uint32_t StartIndex;
+	uint32_t IndexCount;
+};
+
+struct StaticBatchStats
+{
+	uint32_t Instances = 0;
+	uint32_t Clusters = 0;
+	uint32_t Groups = 0;
+	uint32_t Triangles = 0;
+	uint32_t ProxyTriangles = 0;
+
+	// Of the last Select.
+	uint32_t Draws = 0;
+	uint32_t ProxyDraws = 0;
+	uint32_t TrianglesDrawn = 0;
+};
+
+// Build-time merging of static scenery. Instances are transformed into world
+// space and concatenated per grid cell and PSO, so a cell costs one draw instead
+// of one per object. Proxies are made by vertex clustering: the vertices of a
+// node are snapped to a coarse grid over its bounds and the triangles that
+// collapse are dropped. Group proxies are clustered from the proxies of their
+// children, so distant parts of the world fall to a handful of draws.
+class StaticBatcher
+{
+public:
+
+	// Side of the square cells on the xz plane that instances are clustered by.
+	void SetCellSize(float cellSize);
+
+	// Grid cells per axis of the vertex clustering that builds the proxies.
+	void SetProxyResolution(uint32_t cellsPerAxis);
+
+	// Distances from the eye to a node's bounds beyond which clusters and
+	// groups are drawn as their proxy.
+	void SetProxyDistances(float cluster, float group);
+
+	// Mesh in local space, indices relative to its first vertex. Returns its id.
+	uint32_t AddMesh(const vector<BatchVertex>& vertices, const vector<uint32_t>& indices);
+	void AddInstance(const StaticInstance& instance);
+
+	// Merges the instances into clusters, groups and proxies. The source meshes
+	// and instances are kept, so Build can be called again after adding more.
+	void Build();
+
+	const vector<BatchVertex>& GetVertices()const;
+	const vector<uint32_t>& GetIndices()const;
+	const vector<HlodNode>& GetNodes()const;
+
+	// Indices in GetNodes() of the groups.
+	const vector<uint32_t>& GetGroups()const;
+
+	// The draws of the visible nodes, each as its full mesh or its proxy by distance.
+	void Select(const XMFLOAT3& eye, const XMFLOAT4 planes[6], vector<HlodDraw>& draws);
+
+	const StaticBatchStats& GetStats()const;
+
+private:
+
+	struct SourceMesh
+	{
+		uint32_t FirstVertex;
+		uint32_t VertexCount;
+		uint32_t FirstIndex;
+		uint32_t IndexCount;
+		BoundingBox Bounds;
+	};
+
+	// Appends a vertex clustered copy of the triangles of sourceIndices, which
+	// index the merged vertices, and sets it as the node's proxy.
+	void AppendProxy(const vector<uint32_t>& sourceIndices, const BoundingBox& bounds, HlodNode& node);
+
+	bool IsFar(const HlodNode& node, const XMFLOAT3& eye, float distance)const;
+
+private:
+
+	float m_cellSize = 32.0f;
+	uint32_t m_proxyResolution = 8;
+	float m_clusterProxyDistance = 150.0f;
+	float m_groupProxyDistance = 300.0f;
+
+	// Source data.
+	vector<BatchVertex> m_meshVertices;
+	vector<uint32_t> m_meshIndices;
+	vector<SourceMesh> m_meshes;
+	vector<StaticInstance> m_instances;
+
+	// Merged data.
+	vector<BatchVertex> m_vertices;
+	vector<uint32_t> m_indices;
+	vector<HlodNode> m_nodes;
+	vector<uint32_t> m_groups;
+
+	FrustumCuller m_culler;
+	StaticBatchStats m_stats;
+};
@@ -0,0 +1,262 @@
+#include "StressScene.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+using namespace DirectX;
+using namespace std;
+
+namespace
+{
+	// Roots per spacing squared that a Poisson disk fill reaches.
+	const float PoissonDensity = 0.6f;
+
+	// Candidates tried around a point before it is given up on.
+	const uint32_t PoissonAttempts = 30;
+
+	// Footprint radius of a root as a share of the spacing, and the shrink of
+	// every level of a stack.
+	const float RootRadius = 0.4f;
+	const float StackShrink = 0.7f;
+
+	const float TwoPi = 6.28318531f;
+
+	// Uniform in [0, 1).
+	float Uniform(mt19937& random)
+	{
+		return (random() >> 8)*(1.0f / 16777216.0f);
+	}
+
+	// Uniform in [0, count).
+	uint32_t Pick(mt19937& random, uint32_t count)
+	{
+		return (uint32_t)(((uint64_t)random()*count) >> 32);
+	}
+}
+
+
+void StressSceneGenerator::AddMesh(const string& geometry, const string& submesh, const BoundingBox& bounds)
+{
+	m_meshes.push_back({ geometry, submesh, bounds });
+}
+
+void StressSceneGenerator::SetMeshVariety(uint32_t variety)
+{
+	m_variety = max(variety, 1u);
+}
+
+void StressSceneGenerator::SetMaterialCount(uint32_t count)
+{
+	m_materialCount = max(count, 1u);
+}
+
+void StressSceneGenerator::SetDistribution(StressDistribution distribution)
+{
+	m_distribution = distribution;
+}
+
+void StressSceneGenerator::SetSpacing(float spacing)
+{
+	m_spacing = spacing;
+}
+
+void StressSceneGenerator::SetClusters(uint32_t rootsPerCluster, float radius)
+{
+	m_rootsPerCluster = max(rootsPerCluster, 1u);
+	m_clusterRadius = radius;
+}
+
+void StressSceneGenerator::SetDynamicFraction(float fraction)
+{
+	m_dynamicFraction = fraction;
+}
+
+void StressSceneGenerator::SetHierarchyDepth(uint32_t depth)
+{
+	m_depth = max(depth, 1u);
+}
+
+void StressSceneGenerator::Generate(uint32_t count, uint32_t seed, SceneFileContents& scene)
+{
+	auto start = chrono::high_resolution_clock::now();
+
+	scene = SceneFileContents();
+	m_stats = StressSceneStats();
+
+	uint32_t meshCount = min(m_variety, (uint32_t)m_meshes.size());
+	if (count == 0 || meshCount == 0)
+		return;
+
+	for (uint32_t m = 0; m < meshCount; ++m)
+		AddSceneFileMesh(scene, m_meshes[m].Geometry, m_meshes[m].Submesh);
+
+	mt19937 random(seed);
+
+	uint32_t roots = (count + m_depth - 1) / m_depth;
+	float extent = m_spacing*sqrtf(roots / PoissonDensity);
+
+	vector<XMFLOAT2> points;
+	if (m_distribution == StressDistribution::PoissonDisk)
+		PoissonDisk(roots, extent, random, points);
+	else
+		Clustered(roots, extent, random, points);
+
+	scene.Worlds.reserve(count);
+	scene.LocalBounds.reserve(count);
+	scene.Colors.reserve(count);
+	scene.MeshIds.reserve(count);
+	scene.MaterialIds.reserve(count);
+	scene.Parents.reserve(count);
+	scene.Flags.reserve(count);
+
+	for (const XMFLOAT2& point : points)
+	{
+		uint32_t flags = Uniform(random) < m_dynamicFraction ? SceneItemDynamic : 0;
+		XMMATRIX rotation = XMMatrixRotationY(TwoPi*Uniform(random));
+		float radius = m_spacing*RootRadius*(0.5f + 0.5f*Uniform(random));
+
+		// Every item stands on the top of its parent's bounds.
+		float top = 0.0f;
+		uint32_t parent = UINT32_MAX;
+		for (uint32_t level = 0; level < m_depth && scene.Worlds.size() < count; ++level)
+		{
+			uint32_t mesh = Pick(random, meshCount);
+			const BoundingBox& bounds = m_meshes[mesh].Bounds;
+
+			float footprint = max(bounds.Extents.x, bounds.Extents.z);
+			float scale = footprint > 0.0f ? radius / footprint : 1.0f;
+			float y = top - scale*(bounds.Center.y - bounds.Extents.y);
+
+			XMFLOAT3X4 world;
+			XMStoreFloat3x4(&world, XMMatrixScaling(scale, scale, scale)*rotation*XMMatrixTranslation(point.x, y, point.y));
+
+			scene.Worlds.push_back(world);
+			scene.LocalBounds.push_back(bounds);
+			scene.Colors.push_back(XMFLOAT4(0.5f + 0.5f*Uniform(random), 0.5f + 0.5f*Uniform(random), 0.5f + 0.5f*Uniform(random), 1.0f));
+			scene.MeshIds.push_back(mesh);
+			scene.MaterialIds.push_back(Pick(random, m_materialCount));
+			scene.Parents.push_back(parent);
+			scene.Flags.push_back(flags);
+
+			parent = (uint32_t)scene.Worlds.size() - 1;
+			top += 2.0f*scale*bounds.Extents.y;
+			radius *= StackShrink;
+
+			if (flags & SceneItemDynamic)
+				m_stats.DynamicItems++;
+		}
+	}
+
+	m_stats.Items = (uint32_t)scene.Worlds.size();
+	m_stats.Roots = (uint32_t)points.size();
+	m_stats.Extent = extent;
+
+	auto end = chrono::high_resolution_clock::now();
+	m_stats.GenerateMilliseconds = chrono::duration<double, milli>(end - start).count();
+}
+
+const StressSceneStats& StressSceneGenerator::GetStats()const
+{
+	return m_stats;
+}
+
+void StressSceneGenerator::PoissonDisk(uint32_t count, float extent, mt19937& random, vector<XMFLOAT2>& points)const
+{
+	// Bridson's algorithm: new points are tried in the ring between one and two
+	// spacings around a random active point, and checked against the points of
+	// a background grid whose cells hold at most one point each.
+	float half = 0.5f*extent;
+	float cellSize = m_spacing / sqrtf(2.0f);
+	int side = max((int)ceilf(extent / cellSize), 1);
+	vector<uint32_t> grid((size_t)side*side, UINT32_MAX);
+
+	auto cellOf = [&](float v) { return min(max((int)((v + half) / cellSize), 0), side - 1); };
+
+	auto fits = [&](const XMFLOAT2& p)
+	{
+		if (p.x < -half || p.x >= half || p.y < -half || p.y >= half)
+			return false;
+
+		int cx = cellOf(p.x);
+		int cz = cellOf(p.y);
+		for (int z = max(cz - 2, 0); z <= min(cz + 2, side - 1); ++z)
+		{
+			for (int x = max(cx - 2, 0); x <= min(cx + 2, side - 1); ++x)
+			{
+				uint32_t other = grid[(size_t)z*side + x];
+				if (other == UINT32_MAX)
+					continue;
+
+				float dx = points[other].x - p.x;
+				float dz = points[other].y - p.y;
+				if (dx*dx + dz*dz < m_spacing*m_spacing)
+					return false;
+			}
+		}
+
+		return true;
+	};
+
+	auto add = [&](const XMFLOAT2& p)
+	{
+		grid[(size_t)cellOf(p.y)*side + cellOf(p.x)] = (uint32_t)points.size();
+		points.push_back(p);
+	};
+
+	points.clear();
+	points.reserve(count);
+
+	vector<uint32_t> active;
+	active.push_back(0);
+	add(XMFLOAT2((Uniform(random) - 0.5f)*extent, (Uniform(random) - 0.5f)*extent));
+
+	while (!active.empty() && points.size() < count)
+	{
+		uint32_t a = Pick(random, (uint32_t)active.size());
+		XMFLOAT2 center = points[active[a]];
+
+		bool found = false;
+		for (uint32_t attempt = 0; attempt < PoissonAttempts && !found; ++attempt)
+		{
+			float angle = TwoPi*Uniform(random);
+			float distance = m_spacing*(1.0f + Uniform(random));
+			XMFLOAT2 p(center.x + distance*cosf(angle), center.y + distance*sinf(angle));
+			if (fits(p))
+			{
+				active.push_back((uint32_t)points.size());
+				add(p);
+				found = true;
+			}
+		}
+
+		if (!found)
+		{
+			active[a] = active.back();
+			active.pop_back();
+		}
+	}
+}
+
+void StressSceneGenerator::Clustered(uint32_t count, float extent, mt19937& random, vector<XMFLOAT2>& points)const
+{
+	float half = 0.5f*extent;
+	uint32_t clusterCount = max(count / m_rootsPerCluster, 1u);
+
+	vector<XMFLOAT2> centers(clusterCount);
+	for (XMFLOAT2& center : centers)
+		center = XMFLOAT2((Uniform(random) - 0.5f)*extent, (Uniform(random) - 0.5f)*extent);
+
+	// Normal offsets by Box-Muller, two standard deviations to the radius.
+	float sigma = 0.5f*m_clusterRadius;
+
+	points.resize(count);
+	for (XMFLOAT2& p : points)
+	{
+		const XMFLOAT2& center = centers[Pick(random, clusterCount)];
+		float length = sigma*sqrtf(-2.0f*logf(1.0f - Uniform(random)));
+		float angle = TwoPi*Uniform(random);
+
+		p.x = min(max(center.x + length*cosf(angle), -half), half);
+		p.y = min(max(center.y + length*sinf(angle), -half), half);
+	}
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+#include <DirectXMath.h>
+#include <DirectXCollision.h>
+#include "SceneFile.h"
+
+using namespace DirectX;
+using namespace std;
+
+
+// How the roots of a stress scene are spread over the ground.
+enum class StressDistribution
+{
+	// No two roots closer than the spacing.
+	PoissonDisk,
+
+	// Roots gathered around cluster centers, with the same mean density.
+	Clustered
+};
+
+struct StressSceneStats
+{
+	uint32_t Items = 0;
+	uint32_t Roots = 0;
+	uint32_t DynamicItems = 0;
+
+	// Side of the square of ground the roots are spread over.
+	float Extent = 0.0f;
+
+	double GenerateMilliseconds = 0.0;
+};
+
+// Generates large scenes for scaling tests. Every root is a mesh standing on the
+// ground, with up to depth - 1 smaller items stacked on top of it, each the child
+// of the one below. A whole stack is either dynamic or static. The ground grows
+// with the item count so the density stays the same.
+//
+// The same seed and settings give the same scene with any compiler: the numbers
+// are drawn straight from mt19937, whose sequence the standard fixes, rather than
+// through the library's distributions.
+class StressSceneGenerator
+{
+public:
+
+	// Adds a mesh items pick from. Meshes are scaled to the spacing, so meshes of
+	// any size can be mixed.
+	void AddMesh(const string& geometry, const string& submesh, const BoundingBox& bounds);
+
+	// Meshes used, the first variety of the ones added.
+	void SetMeshVariety(uint32_t variety);
+	void SetMaterialCount(uint32_t count);
+
+	void SetDistribution(StressDistribution distribution);
+
+	// Least distance between roots, for PoissonDisk, and the mean one otherwise.
+	void SetSpacing(float spacing);
+
+	// Roots per cluster, on average, and the radius most of them fall within.
+	void SetClusters(uint32_t rootsPerCluster, float radius);
+
+	// Share of the stacks that are dynamic.
+	void SetDynamicFraction(float fraction);
+
+	// Items per stack, 1 for no hierarchy.
+	void SetHierarchyDepth(uint32_t depth);
+
+	// Replaces scene with count items generated from seed.
+	void Generate(uint32_t count, uint32_t seed, SceneFileContents& scene);
+
+	const StressSceneStats& GetStats()const;
+
+private:
+
+	void PoissonDisk(uint32_t count, float extent, mt19937& random, vector<XMFLOAT2>& points)const;
+	void Clustered(uint32_t count, float extent, mt19937& random, vector<XMFLOAT2>& points)const;
+
+private:
+
+	struct Mesh
+	{
+		string Geometry;
+		string Submesh;
+		BoundingBox Bounds;
+	};
+
+	vector<Mesh> m_meshes;
+	uint32_t m_variety = UINT32_MAX;
+	uint32_t m_materialCount = 1;
+
+	StressDistribution m_distribution = StressDistribution::PoissonDisk;
+	float m_spacing = 4.0f;
+	uint32_t m_rootsPerCluster = 64;
+	float m_clusterRadius = 16.0f;
+
+	float m_dynamicFraction = 0.1f;
+	uint32_t m_depth = 1;
+
+	StressSceneStats m_stats;
+};
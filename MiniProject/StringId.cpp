@@ -0,0 +1,96 @@
+#include "StringId.h"
+#include <cstring>
+
+using namespace std;
+
+
+StringTable& StringTable::Get()
+{
+	static StringTable table;
+	return table;
+}
+
+StringTable::StringTable() : m_slots(64, 0)
+{
+}
+
+StringId StringTable::Intern(const char* text, uint32_t hash)
+{
+	lock_guard<mutex> lock(m_mutex);
+
+	StringId id;
+	uint32_t slot = Probe(text, hash);
+	if (m_slots[slot] != 0)
+	{
+		id.Index = m_slots[slot] - 1;
+		return id;
+	}
+
+	id.Index = (uint32_t)m_strings.size();
+	m_slots[slot] = id.Index + 1;
+	m_hashes.push_back(hash);
+	m_strings.push_back(text);
+
+	if (2*m_strings.size() > m_slots.size())
+		Grow();
+
+	return id;
+}
+
+StringId StringTable::Intern(const string& text)
+{
+	return Intern(text.c_str(), HashString(text.c_str()));
+}
+
+StringId StringTable::Find(const string& text)const
+{
+	lock_guard<mutex> lock(m_mutex);
+
+	StringId id;
+	uint32_t slot = Probe(text.c_str(), HashString(text.c_str()));
+	if (m_slots[slot] != 0)
+		id.Index = m_slots[slot] - 1;
+	return id;
+}
+
+const string& StringTable::GetString(StringId id)const
+{
+	lock_guard<mutex> lock(m_mutex);
+	return m_strings.at(id.Index);
+}
+
+uint32_t StringTable::Size()const
+{
+	lock_guard<mutex> lock(m_mutex);
+	return (uint32_t)m_strings.size();
+}
+
+uint32_t StringTable::Probe(const char* text, uint32_t hash)const
+{
+	// Linear probing; the strings are only compared when the hashes match.
+	uint32_t mask = (uint32_t)m_slots.size() - 1;
+	for (uint32_t slot = hash & mask;; slot = (slot + 1) & mask)
+	{
+		uint32_t entry = m_slots[slot];
+		if (entry == 0)
+			return slot;
+
+		if (m_hashes[entry - 1] == hash && strcmp(m_strings[entry - 1].c_str(), text) == 0)
+			return slot;
+	}
+}
+
+void StringTable::Grow()
+{
+	vector<uint32_t> slots(2*m_slots.size(), 0);
+	uint32_t mask = (uint32_t)slots.size() - 1;
+	for (uint32_t id = 0; id < (uint32_t)m_strings.size(); ++id)
+	{
+		uint32_t slot = m_hashes[id] & mask;
+		while (slots[slot] != 0)
+			slot = (slot + 1) & mask;
+		slots[slot] = id + 1;
+	}
+
+	m_slots.swap(slots);
+}
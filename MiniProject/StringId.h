@@ -0,0 +1,139 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+using namespace std;
+
+
+// 32-bit FNV-1a, usable in constant expressions.
+constexpr uint32_t HashString(const char* text)
+{
+	uint32_t hash = 2166136261u;
+	for (; *text != 0; ++text)
+		hash = (hash ^ (uint8_t)*text)*16777619u;
+	return hash;
+}
+
+// An interned string. Equal strings get the same id, and ids are handed out from
+// 0 in the order strings are first interned, so they index flat tables.
+struct StringId
+{
+	static const uint32_t InvalidIndex = UINT32_MAX;
+
+	uint32_t Index = InvalidIndex;
+
+	bool IsValid()const { return Index != InvalidIndex; }
+	bool operator==(const StringId& rhs)const { return Index == rhs.Index; }
+	bool operator!=(const StringId& rhs)const { return Index != rhs.Index; }
+};
+
+// The interned strings of the process, safe to use from any thread. Strings are
+// found by hash in an open addressing table and compared, so two strings with
+// the same hash still get ids of their own.
+class StringTable
+{
+public:
+
+	static StringTable& Get();
+
+	StringTable(const StringTable& rhs) = delete;
+	StringTable& operator=(const StringTable& rhs) = delete;
+
+	// Id of text, interning it on first sight. hash must be HashString(text).
+	StringId Intern(const char* text, uint32_t hash);
+	StringId Intern(const string& text);
+
+	// Id of text if it was interned, otherwise an invalid id.
+	StringId Find(const string& text)const;
+
+	// The string of id. The reference stays valid for the life of the process.
+	const string& GetString(StringId id)const;
+
+	uint32_t Size()const;
+
+private:
+
+	StringTable();
+
+	// Slot of text in m_slots: the one holding it, or the empty one it goes in.
+	uint32_t Probe(const char* text, uint32_t hash)const;
+	void Grow();
+
+private:
+
+	mutable mutex m_mutex;
+
+	// Open addressing table of id + 1, 0 for an empty slot. Its size is a power
+	// of two, at most half full.
+	vector<uint32_t> m_slots;
+
+	// By id. A deque so that references to the strings survive growth.
+	vector<uint32_t> m_hashes;
+	deque<string> m_strings;
+};
+
+// Id of a string literal. The compiler computes the hash and every call site
+// interns its literal once, so later uses cost a load.
+#define STRING_ID(text) ([]() { static const StringId id__ = StringTable::Get().Intern(text, std::integral_constant<uint32_t, HashString(text)>::value); return id__; }())
+
+// Values keyed by StringId, stored in a flat array indexed by the id. An engine
+// interns few strings, so the tables stay small even when they hold a handful
+// of values with large ids.
+template<typename T>
+class StringIdTable
+{
+public:
+
+	// The value of id, default constructed if there was none.
+	T& operator[](StringId id)
+	{
+		if (id.Index >= m_values.size())
+		{
+			m_values.resize(id.Index + 1);
+			m_present.resize(id.Index + 1, 0);
+		}
+
+		m_present[id.Index] = 1;
+		return m_values[id.Index];
+	}
+
+	bool Contains(StringId id)const
+	{
+		return id.Index < m_present.size() && m_present[id.Index] != 0;
+	}
+
+	// The value of id, or null if there is none.
+	const T* Find(StringId id)const
+	{
+		return Contains(id) ? &m_values[id.Index] : nullptr;
+	}
+
+	// The value of id, which must be there.
+	const T& At(StringId id)const
+	{
+		if (!Contains(id))
+			throw out_of_range("StringIdTable::At: no value for " + (id.IsValid() ? StringTable::Get().GetString(id) : string("an invalid id")));
+
+		return m_values[id.Index];
+	}
+
+	void Erase(StringId id)
+	{
+		if (Contains(id))
+		{
+			m_values[id.Index] = T();
+			m_present[id.Index] = 0;
+		}
+	}
+
+private:
+
+	vector<T> m_values;
+	vector<uint8_t> m_present;
+};
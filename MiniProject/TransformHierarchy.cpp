@@ -0,0 +1,218 @@
+
+#include "TransformHierarchy.h"
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cstring>
+
+using namespace DirectX;
+using namespace std;
+
+const uint32_t TransformHierarchy::InvalidNode;
+
+
+uint32_t TransformHierarchy::AddNode(uint32_t parent, const XMFLOAT3X4& local, RenderItemHandle item)
+{
+	assert(parent == InvalidNode || parent < m_idToIndex.size());
+
+	// Append for now; Update moves the node into its parent's range.
+	uint32_t id = (uint32_t)m_idToIndex.size();
+	uint32_t index = (uint32_t)m_ids.size();
+	m_idToIndex.push_back(index);
+
+	m_ids.push_back(id);
+	m_parents.push_back(parent == InvalidNode ? InvalidNode : m_idToIndex[parent]);
+	m_subtreeEnds.push_back(index + 1);
+	m_locals.push_back(local);
+	m_worlds.push_back(local);
+	m_items.push_back(item);
+	m_dirty.push_back(Added);
+	m_changed.push_back(0);
+
+	m_dirtyIds.push_back(id);
+	if (parent != InvalidNode)
+		m_orderValid = false;
+
+	return id;
+}
+
+void TransformHierarchy::SetLocal(uint32_t node, const XMFLOAT3X4& local)
+{
+	uint32_t index = m_idToIndex[node];
+	m_locals[index] = local;
+
+	if (m_dirty[index] == Clean)
+	{
+		m_dirty[index] = LocalChanged;
+		m_dirtyIds.push_back(node);
+	}
+}
+
+const XMFLOAT3X4& TransformHierarchy::GetLocal(uint32_t node)const
+{
+	return m_locals[m_idToIndex[node]];
+}
+
+const XMFLOAT3X4& TransformHierarchy::GetWorld(uint32_t node)const
+{
+	return m_worlds[m_idToIndex[node]];
+}
+
+uint32_t TransformHierarchy::Size()const
+{
+	return (uint32_t)m_ids.size();
+}
+
+void TransformHierarchy::Update(const SetWorldFunc& setWorld)
+{
+	auto start = chrono::high_resolution_clock::now();
+
+	if (!m_orderValid)
+		Rebuild();
+
+	m_stats.Nodes = Size();
+	m_stats.NodesVisited = 0;
+	m_stats.NodesRecomputed = 0;
+	m_stats.WorldsChanged = 0;
+
+	// Visit the dirty nodes in depth-first order, so a dirty node inside a
+	// subtree that was already walked is skipped.
+	m_dirtyIndices.resize(m_dirtyIds.size());
+	for (size_t i = 0; i < m_dirtyIds.size(); ++i)
+		m_dirtyIndices[i] = m_idToIndex[m_dirtyIds[i]];
+	sort(m_dirtyIndices.begin(), m_dirtyIndices.end());
+	m_dirtyIds.clear();
+
+	uint32_t walkedEnd = 0;
+	for (uint32_t root : m_dirtyIndices)
+	{
+		if (root < walkedEnd)
+			continue;
+
+		uint32_t end = m_subtreeEnds[root];
+		for (uint32_t i = root; i < end; ++i)
+		{
+			uint32_t parent = m_parents[i];
+
+			// The subtree root is dirty; the other nodes follow their parent.
+			if (m_dirty[i] == Clean && (parent == InvalidNode || !m_changed[parent]))
+			{
+				m_changed[i] = 0;
+				continue;
+			}
+
+			XMFLOAT3X4 newWorld = m_locals[i];
+			if (parent != InvalidNode)
+				AffineCompose(m_locals[i], m_worlds[parent], newWorld);
+
+			bool changed = m_dirty[i] == Added || memcmp(&newWorld, &m_worlds[i], sizeof(XMFLOAT3X4)) != 0;
+			if (changed)
+			{
+				m_worlds[i] = newWorld;
+				if (m_items[i].IsValid())
+					setWorld(m_items[i], newWorld);
+				m_stats.WorldsChanged++;
+			}
+
+			m_changed[i] = changed ? 1 : 0;
+			m_dirty[i] = Clean;
+			m_stats.NodesRecomputed++;
+		}
+
+		m_stats.NodesVisited += end - root;
+		walkedEnd = end;
+	}
+
+	auto finish = chrono::high_resolution_clock::now();
+	m_stats.UpdateMicroseconds = chrono::duration<double, micro>(finish - start).count();
+}
+
+const TransformStats& TransformHierarchy::GetStats()const
+{
+	return m_stats;
+}
+
+void TransformHierarchy::Rebuild()
+{
+	uint32_t count = Size();
+
+	// Children of every node in index order, which keeps siblings in the order
+	// they were added.
+	vector<uint32_t> childOffsets(count + 1, 0);
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		if (m_parents[i] != InvalidNode)
+			childOffsets[m_parents[i] + 1]++;
+	}
+	for (uint32_t i = 0; i < count; ++i)
+		childOffsets[i + 1] += childOffsets[i];
+
+	vector<uint32_t> children(childOffsets[count]);
+	vector<uint32_t> fill(childOffsets.begin(), childOffsets.end() - 1);
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		if (m_parents[i] != InvalidNode)
+			children[fill[m_parents[i]]++] = i;
+	}
+
+	// Preorder walk from every root.
+	vector<uint32_t> order;
+	order.reserve(count);
+	vector<uint32_t> stack;
+	for (uint32_t r = 0; r < count; ++r)
+	{
+		if (m_parents[r] != InvalidNode)
+			continue;
+
+		stack.push_back(r);
+		while (!stack.empty())
+		{
+			uint32_t node = stack.back();
+			stack.pop_back();
+			order.push_back(node);
+
+			for (uint32_t c = childOffsets[node + 1]; c > childOffsets[node]; --c)
+				stack.push_back(children[c - 1]);
+		}
+	}
+
+	vector<uint32_t> newIndex(count);
+	for (uint32_t i = 0; i < count; ++i)
+		newIndex[order[i]] = i;
+
+	vector<uint32_t> ids(count);
+	vector<uint32_t> parents(count);
+	vector<XMFLOAT3X4> locals(count);
+	vector<XMFLOAT3X4> worlds(count);
+	vector<RenderItemHandle> items(count);
+	vector<uint8_t> dirty(count);
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		uint32_t old = order[i];
+		ids[i] = m_ids[old];
+		parents[i] = m_parents[old] == InvalidNode ? InvalidNode : newIndex[m_parents[old]];
+		locals[i] = m_locals[old];
+		worlds[i] = m_worlds[old];
+		items[i] = m_items[old];
+		dirty[i] = m_dirty[old];
+		m_idToIndex[ids[i]] = i;
+	}
+
+	m_ids.swap(ids);
+	m_parents.swap(parents);
+	m_locals.swap(locals);
+	m_worlds.swap(worlds);
+	m_items.swap(items);
+	m_dirty.swap(dirty);
+
+	// A subtree ends where the last of its descendants ends.
+	for (uint32_t i = 0; i < count; ++i)
+		m_subtreeEnds[i] = i + 1;
+	for (uint32_t i = count; i-- > 0;)
+	{
+		if (m_parents[i] != InvalidNode)
+			m_subtreeEnds[m_parents[i]] = max(m_subtreeEnds[m_parents[i]], m_subtreeEnds[i]);
+	}
+
+	m_orderValid = true;
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+#include <DirectXMath.h>
+#include "SceneStore.h"
+
+using namespace DirectX;
+using namespace std;
+
+
+struct TransformStats
+{
+	uint32_t Nodes = 0;
+
+	// Nodes inside the dirty subtrees, nodes whose world matrix was recomputed and
+	// nodes whose world matrix came out different during the last Update.
+	uint32_t NodesVisited = 0;
+	uint32_t NodesRecomputed = 0;
+	uint32_t WorldsChanged = 0;
+
+	double UpdateMicroseconds = 0.0;
+};
+
+// Parent/child transforms. Nodes are kept in depth-first order, so every subtree
+// is a contiguous range that starts with its root and parents come before their
+// children. Update walks only the subtrees of nodes whose local matrix was set,
+// recomputing a node when it is dirty itself or its parent's world changed, and
+// reports the world matrix of a linked render item only when it differs.
+class TransformHierarchy
+{
+public:
+
+	static const uint32_t InvalidNode = UINT32_MAX;
+
+	typedef function<void(RenderItemHandle item, const XMFLOAT3X4& world)> SetWorldFunc;
+
+	// Adds a node under parent, or a root when parent is InvalidNode, and returns
+	// its id. Ids stay valid when the nodes are reordered.
+	uint32_t AddNode(uint32_t parent, const XMFLOAT3X4& local, RenderItemHandle item = RenderItemHandle());
+
+	void SetLocal(uint32_t node, const XMFLOAT3X4& local);
+	const XMFLOAT3X4& GetLocal(uint32_t node)const;
+
+	// World matrix as of the last Update.
+	const XMFLOAT3X4& GetWorld(uint32_t node)const;
+
+	uint32_t Size()const;
+
+	// Recomputes the dirty subtrees and calls setWorld for every linked item whose
+	// world matrix changed.
+	void Update(const SetWorldFunc& setWorld);
+
+	const TransformStats& GetStats()const;
+
+private:
+
+	// Restores depth-first order after nodes were appended.
+	void Rebuild();
+
+private:
+
+	enum DirtyState : uint8_t
+	{
+		Clean,
+		LocalChanged,
+
+		// Never updated, the linked item gets its world even if it looks unchanged.
+		Added
+	};
+
+	// Depth-first arrays, all of Size() elements.
+	vector<uint32_t> m_ids;
+	vector<uint32_t> m_parents;
+	vector<uint32_t> m_subtreeEnds;
+	vector<XMFLOAT3X4> m_locals;
+	vector<XMFLOAT3X4> m_worlds;
+	vector<RenderItemHandle> m_items;
+	vector<uint8_t> m_dirty;
+	vector<uint8_t> m_changed;
+
+	// Depth-first index of every node id.
+	vector<uint32_t> m_idToIndex;
+
+	vector<uint32_t> m_dirtyIds;
+	vector<uint32_t> m_dirtyIndices;
+	bool m_orderValid = true;
+
+	TransformStats m_stats;
+};
@@ -0,0 +1,75 @@
+
+#include "UploadRing.h"
+
+
+UploadRing::UploadRing(ID3D12Device* device, UINT64 capacity) : m_allocator(capacity)
+{
+	ThrowIfFailed(device->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
+		D3D12_HEAP_FLAG_NONE,
+		&CD3DX12_RESOURCE_DESC::Buffer(capacity),
+		D3D12_RESOURCE_STATE_GENERIC_READ,
+		nullptr,
+		IID_PPV_ARGS(&m_buffer)));
+
+	// Mapped for the lifetime of the ring; the fences keep the CPU off the bytes
+	// the GPU still reads.
+	ThrowIfFailed(m_buffer->Map(0, nullptr, reinterpret_cast<void**>(&m_mappedData)));
+	m_gpuAddress = m_buffer->GetGPUVirtualAddress();
+}
+
+UploadRing::~UploadRing()
+{
+	if (m_buffer != nullptr)
+		m_buffer->Unmap(0, nullptr);
+
+	m_mappedData = nullptr;
+}
+
+bool UploadRing::Allocate(UINT64 size, UINT64 alignment, UploadAllocation& allocation)
+{
+	uint64_t offset;
+	{
+		lock_guard<mutex> lock(m_mutex);
+		offset = m_allocator.Allocate(size, alignment);
+	}
+
+	if (offset == RingAllocator::InvalidOffset)
+		return false;
+
+	allocation.CpuAddress = m_mappedData + offset;
+	allocation.GpuAddress = m_gpuAddress + offset;
+	allocation.Resource = m_buffer.Get();
+	allocation.Offset = offset;
+	return true;
+}
+
+void UploadRing::FinishFrame(UINT64 fenceValue)
+{
+	lock_guard<mutex> lock(m_mutex);
+	m_allocator.FinishFrame(fenceValue);
+}
+
+void UploadRing::Reclaim(UINT64 completedFenceValue)
+{
+	lock_guard<mutex> lock(m_mutex);
+	m_allocator.Reclaim(completedFenceValue);
+}
+
+UINT64 UploadRing::OldestFence()
+{
+	lock_guard<mutex> lock(m_mutex);
+	return m_allocator.OldestFence();
+}
+
+UINT64 UploadRing::GetCapacity()
+{
+	lock_guard<mutex> lock(m_mutex);
+	return m_allocator.GetCapacity();
+}
+
+UINT64 UploadRing::GetUsed()
+{
+	lock_guard<mutex> lock(m_mutex);
+	return m_allocator.GetUsed();
+}
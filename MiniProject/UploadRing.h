@@ -0,0 +1,49 @@
+#pragma once
+
+#include "Util.h"
+#include "RingAllocator.h"
+#include <mutex>
+
+
+// A chunk of the upload ring: where to write it and where the GPU reads it.
+struct UploadAllocation
+{
+	BYTE* CpuAddress = nullptr;
+	D3D12_GPU_VIRTUAL_ADDRESS GpuAddress = 0;
+
+	// The ring buffer and the offset in it, for the calls that take a resource.
+	ID3D12Resource* Resource = nullptr;
+	UINT64 Offset = 0;
+};
+
+// Persistently mapped upload buffer handing out per-frame memory through a
+// RingAllocator. Allocations can be made from any thread; FinishFrame and
+// Reclaim are called by the thread that signals and waits on the fence.
+class UploadRing
+{
+public:
+
+	UploadRing(ID3D12Device* device, UINT64 capacity);
+	UploadRing(const UploadRing& rhs) = delete;
+	UploadRing& operator=(const UploadRing& rhs) = delete;
+	~UploadRing();
+
+	// False when the ring is full until more frames are reclaimed.
+	bool Allocate(UINT64 size, UINT64 alignment, UploadAllocation& allocation);
+
+	void FinishFrame(UINT64 fenceValue);
+	void Reclaim(UINT64 completedFenceValue);
+
+	UINT64 OldestFence();
+	UINT64 GetCapacity();
+	UINT64 GetUsed();
+
+private:
+
+	ComPtr<ID3D12Resource> m_buffer;
+	BYTE* m_mappedData = nullptr;
+	D3D12_GPU_VIRTUAL_ADDRESS m_gpuAddress = 0;
+
+	mutex m_mutex;
+	RingAllocator m_allocator;
+};
@@ -132,14 +132,32 @@ const float UtilMath::Pi = 3.1415926535f;
 ///////// Resources
 
 
-Resource::Resource(ID3D12Device* device, UINT passCount, UINT objectCount)
+Resource::Resource(ID3D12Device* device, UINT objectCount, UINT workerCount)
 {
 	ThrowIfFailed(device->CreateCommandAllocator(
 		D3D12_COMMAND_LIST_TYPE_DIRECT,
 		IID_PPV_ARGS(CmdListAlloc.GetAddressOf())));
 
-	PassCB = std::make_unique<UploadBuffer<PassConstants>>(device, passCount, true);
-	ObjectCB = std::make_unique<UploadBuffer<ObjectConstants>>(device, objectCount, true);
+	WorkerCmdListAllocs.resize(workerCount);
+	WorkerCmdLists.resize(workerCount);
+	for (UINT i = 0; i < workerCount; ++i)
+	{
+		ThrowIfFailed(device->CreateCommandAllocator(
+			D3D12_COMMAND_LIST_TYPE_DIRECT,
+			IID_PPV_ARGS(WorkerCmdListAllocs[i].GetAddressOf())));
+
+		ThrowIfFailed(device->CreateCommandList(
+			0,
+			D3D12_COMMAND_LIST_TYPE_DIRECT,
+			WorkerCmdListAllocs[i].Get(),
+			nullptr,
+			IID_PPV_ARGS(WorkerCmdLists[i].GetAddressOf())));
+
+		// Lists are created open; close them so the first frame can reset them.
+		ThrowIfFailed(WorkerCmdLists[i]->Close());
+	}
+
+	ObjectBuffer = std::make_unique<UploadBuffer<ObjectData>>(device, objectCount, false);
 }
 
 Resource::~Resource()
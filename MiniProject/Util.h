@@ -21,6 +21,8 @@
 #include <sstream>
 #include <cassert>
 #include "d3dx12.h"
+#include "Instancing.h"
+#include "StringId.h"
 
 using namespace DirectX;
 using namespace Microsoft::WRL;
@@ -98,6 +100,8 @@ struct SubmeshGeometry
 	UINT StartIndexLocation = 0;
 	INT BaseVertexLocation = 0;
 
+	// Bounding box of the geometry defined by this submesh.
+	BoundingBox Bounds;
 };
 
 struct MeshGeometry
@@ -124,8 +128,8 @@ struct MeshGeometry
 
 	// A MeshGeometry may store multiple geometries in one vertex/index buffer.
 	// Use this container to define the Submesh geometries so we can draw
-	// the Submeshes individually.
-	unordered_map<string, SubmeshGeometry> DrawArgs;
+	// the Submeshes individually. Indexed by the interned submesh name.
+	StringIdTable<SubmeshGeometry> DrawArgs;
 
 	D3D12_VERTEX_BUFFER_VIEW VertexBufferView()const
 	{
@@ -236,6 +240,13 @@ public:
 		memcpy(&m_mappedData[elementIndex*m_elementByteSize], &data, sizeof(T));
 	}
 
+	// Copies count consecutive elements. Only valid for buffers that are not constant buffers.
+	void CopyData(int elementIndex, const T* data, UINT count)
+	{
+		assert(!m_isConstant);
+		memcpy(&m_mappedData[elementIndex*m_elementByteSize], data, sizeof(T)*count);
+	}
+
 private:
 	Microsoft::WRL::ComPtr<ID3D12Resource> m_uploadBuffer;
 	BYTE* m_mappedData = nullptr;
@@ -256,9 +267,12 @@ private:
 
 //define MaxLights 16
 
-struct ObjectConstants
+// Element of the per-object structured buffer, packed without the 256 byte
+// padding of a constant buffer. Matches ObjectData in color.hlsl.
+struct ObjectData
 {
-	XMFLOAT4X4 World = UtilMath::Identity4x4();
+	XMFLOAT3X4 World = Identity3x4();
+	XMFLOAT4 Color = { 1.0f, 1.0f, 1.0f, 1.0f };
 };
 
 struct PassConstants
@@ -306,7 +320,7 @@ struct Resource
 {
 public:
 
-	Resource(ID3D12Device* device, UINT passCount, UINT objectCount);
+	Resource(ID3D12Device* device, UINT objectCount, UINT workerCount);
 	Resource(const Resource& rhs) = delete;
 	Resource& operator=(const Resource& rhs) = delete;
 	~Resource();
@@ -315,10 +329,15 @@ public:
 	// So each frame needs their own allocator.
 	ComPtr<ID3D12CommandAllocator> CmdListAlloc;
 
-	// We cannot update a cbuffer until the GPU is done processing the commands
-	// that reference it.  So each frame needs their own cbuffers.
-	unique_ptr<UploadBuffer<PassConstants>> PassCB = nullptr;
-	unique_ptr<UploadBuffer<ObjectConstants>> ObjectCB = nullptr;
+	// Allocator and command list of every thread recording scene draws.
+	vector<ComPtr<ID3D12CommandAllocator>> WorkerCmdListAllocs;
+	vector<ComPtr<ID3D12GraphicsCommandList>> WorkerCmdLists;
+
+	// We cannot update a buffer until the GPU is done processing the commands
+	// that reference it.  So each frame needs their own object buffer, indexed by
+	// object slot in the shader. Data rewritten every frame comes from the
+	// engine's upload ring instead.
+	unique_ptr<UploadBuffer<ObjectData>> ObjectBuffer = nullptr;
 
 	// Fence value to mark commands up to this fence point.  This lets us
 	// check if these frame resources are still in use by the GPU.
@@ -0,0 +1,566 @@
+#include "VisibilityCache.h"
+#include <algorithm>
+#include <chrono>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+using namespace DirectX;
+using namespace std;
+
+namespace
+{
+	// Past this distance from the anchor the reaches, and with them the bounds,
+	// get too loose to be worth keeping, so the cache starts over.
+	const float MaxAnchorDistance = 512.0f;
+
+	// Covers the rounding of the plane distances, relative to the coordinates.
+	const float MarginEpsilon = 1e-5f;
+
+	// The queues are rid of their outdated entries once they hold this many
+	// entries per item.
+	const size_t MaxEntriesPerItem = 4;
+
+	// Slot width as a fraction of the largest reach of the range, so that a queue
+	// reaches about as far as the largest margin the range can have.
+	const double SlotsPerReach = 512.0;
+
+	// Cached items are fetched this many tests ahead.
+	const uint32_t PrefetchDistance = 8;
+
+	// After a reset the items join the cache over this many frames, so filling
+	// it does not hold up a frame. The others are tested by a full pass meanwhile.
+	const uint32_t FillFrames = 32;
+
+	// A retest costs about as much as testing this many items in a full pass. A
+	// frame with more retests than that takes of the cached items falls back to
+	// a full pass, and the cache starts over.
+	const uint32_t RetestCost = 16;
+
+	// After a fallback the cache waits this many frames before it fills again,
+	// twice as long after every further fallback until it is full once more.
+	const uint32_t FirstHoldFrames = 8;
+	const uint32_t MaxHoldFrames = 512;
+
+	float Length(float x, float y, float z)
+	{
+		return sqrtf(x*x + y*y + z*z);
+	}
+
+	float Distance(const XMFLOAT3& a, const XMFLOAT3& b)
+	{
+		return Length(a.x - b.x, a.y - b.y, a.z - b.z);
+	}
+
+	// The planes in every lane, for the signed distance of 4 boxes to the plane
+	// that rejects each of them most, positive inside. Summed in the order
+	// FrustumCuller uses so both agree on boxes touching a plane.
+	struct PlanesSse
+	{
+		__m128 X[6], Y[6], Z[6], W[6], AbsX[6], AbsY[6], AbsZ[6];
+
+		explicit PlanesSse(const XMFLOAT4 planes[6])
+		{
+			for (int p = 0; p < 6; ++p)
+			{
+				X[p] = _mm_set1_ps(planes[p].x);
+				Y[p] = _mm_set1_ps(planes[p].y);
+				Z[p] = _mm_set1_ps(planes[p].z);
+				W[p] = _mm_set1_ps(planes[p].w);
+				AbsX[p] = _mm_set1_ps(fabsf(planes[p].x));
+				AbsY[p] = _mm_set1_ps(fabsf(planes[p].y));
+				AbsZ[p] = _mm_set1_ps(fabsf(planes[p].z));
+			}
+		}
+
+		__m128 Distance(__m128 x, __m128 y, __m128 z, __m128 sx, __m128 sy, __m128 sz)const
+		{
+			__m128 distance = _mm_set1_ps(FLT_MAX);
+			for (int p = 0; p < 6; ++p)
+			{
+				__m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(X[p], x), _mm_mul_ps(Y[p], y)), _mm_add_ps(_mm_mul_ps(Z[p], z), W[p]));
+				__m128 r = _mm_add_ps(_mm_add_ps(_mm_mul_ps(AbsX[p], sx), _mm_mul_ps(AbsY[p], sy)), _mm_mul_ps(AbsZ[p], sz));
+				distance = _mm_min_ps(distance, _mm_add_ps(d, r));
+			}
+			return distance;
+		}
+	};
+
+	// Index of the lowest set bit of a non-zero word.
+	uint32_t LowestBit(uint64_t bits)
+	{
+#if defined(_MSC_VER)
+		unsigned long index;
+		_BitScanForward64(&index, bits);
+		return index;
+#else
+		return (uint32_t)__builtin_ctzll(bits);
+#endif
+	}
+
+	uint32_t BitCount(uint64_t bits)
+	{
+#if defined(_MSC_VER)
+		return (uint32_t)__popcnt64(bits);
+#else
+		return (uint32_t)__builtin_popcountll(bits);
+#endif
+	}
+
+	// Largest reach of a range, a power of sqrt(2), with the power of two put
+	// straight into the exponent.
+	double RangeReach(uint32_t range)
+	{
+		uint64_t bits = (uint64_t)(1023 + range / 2) << 52;
+		double scale;
+		memcpy(&scale, &bits, sizeof(scale));
+		return range % 2 ? 1.4142135623730951*scale : scale;
+	}
+}
+
+const uint32_t VisibilityCache::ReachRanges;
+const uint32_t VisibilityCache::QueueSlots;
+
+
+VisibilityCache::VisibilityCache(uint32_t refreshFrames) : m_refreshFrames(max(1u, refreshFrames)), m_nextHoldFrames(FirstHoldFrames)
+{
+}
+
+void VisibilityCache::Invalidate(uint32_t denseIndex)
+{
+	m_invalidated.push_back(denseIndex);
+}
+
+void VisibilityCache::InvalidateAll()
+{
+	m_reset = true;
+}
+
+void VisibilityCache::Cull(const XMFLOAT4 planes[6], const XMFLOAT3& eyePos, const BoundsSoA& bounds, uint32_t count, vector<uint32_t>& visible)
+{
+	auto start = chrono::high_resolution_clock::now();
+
+	BeginFrame(planes, eyePos);
+	Resize(count);
+
+	// Items join the cache in index order, a share per frame, unless it waits
+	// after a fallback.
+	uint32_t cached = m_count;
+	if (m_holdFrames > 0)
+		m_holdFrames--;
+	else
+		m_count = min(count, cached + (count + FillFrames - 1) / FillFrames);
+
+	// The copies grow with the cache, so their memory is first touched over the
+	// frames that fill it too.
+	if (m_count > m_items.size())
+	{
+		m_items.resize(m_count);
+		m_versions.resize(m_count, 0);
+	}
+
+	for (uint32_t i = cached; i < m_count; ++i)
+		MarkPending(i, true);
+
+	// This frame's share of the amortized refresh, so nothing rests on the
+	// bounds and the copies of the boxes alone for long. A contiguous run reads
+	// the bounds in order.
+	uint32_t share = (count + m_refreshFrames - 1) / m_refreshFrames;
+	uint32_t first = (m_frame % m_refreshFrames)*share;
+	for (uint32_t i = first; i < min(cached, first + share); ++i)
+		MarkPending(i, true);
+
+	vector<Expiry> retest;
+	retest.swap(m_retestNext);
+	for (const Expiry& expiry : retest)
+	{
+		if (IsCurrent(expiry))
+			MarkPending(expiry.Item, false);
+	}
+	m_queued -= retest.size();
+
+	for (uint32_t range = 0; range < ReachRanges; ++range)
+		TakeExpired(m_queues[range], m_motion[range]);
+
+	for (uint32_t item : m_invalidated)
+	{
+		if (item < m_count)
+			MarkPending(item, true);
+	}
+	m_invalidated.clear();
+
+	// Tested in index order so the bounds are read front to back.
+	m_pending.clear();
+	for (uint32_t word = 0; word < (uint32_t)m_pendingBits.size(); ++word)
+	{
+		uint64_t bits = m_pendingBits[word];
+		m_pendingBits[word] = 0;
+		while (bits != 0)
+		{
+			m_pending.push_back(word*64 + LowestBit(bits));
+			bits &= bits - 1;
+		}
+	}
+
+	// When the cached items would cost more to retest than to test them all,
+	// the camera moves too fast for the cache: the frame is a full pass and the
+	// cache waits before it fills again.
+	uint32_t retested = (uint32_t)m_pending.size();
+	uint32_t expired = retested - (m_count - cached);
+	bool fellBack = expired > TestBatch && (uint64_t)expired*RetestCost > m_count;
+	if (fellBack)
+	{
+		m_reset = true;
+		m_count = 0;
+		m_holdFrames = m_nextHoldFrames;
+		m_nextHoldFrames = min(2*m_nextHoldFrames, MaxHoldFrames);
+		retested = 0;
+	}
+	else
+	{
+		for (uint32_t first = 0; first < retested; first += TestBatch)
+			Test(bounds, m_pending.data() + first, min(TestBatch, retested - first));
+
+		if (m_queued > MaxEntriesPerItem*count + 1024)
+			Compact();
+
+		if (m_count == count)
+			m_nextHoldFrames = FirstHoldFrames;
+	}
+
+	TestUncached(bounds, m_count, count);
+
+	// Sized by the set bits first, so the list is written without checks. Bits
+	// past count are left over from items that are gone.
+	uint32_t words = (count + 63) / 64;
+	uint64_t lastWord = count % 64 ? (1ull << (count % 64)) - 1 : ~0ull;
+	size_t visibleCount = 0;
+	for (uint32_t word = 0; word < words; ++word)
+		visibleCount += BitCount(m_visibleBits[word] & (word + 1 < words ? ~0ull : lastWord));
+
+	visible.resize(visibleCount);
+	uint32_t* out = visible.data();
+	for (uint32_t word = 0; word < words; ++word)
+	{
+		uint64_t bits = m_visibleBits[word] & (word + 1 < words ? ~0ull : lastWord);
+		while (bits != 0)
+		{
+			*out++ = word*64 + LowestBit(bits);
+			bits &= bits - 1;
+		}
+	}
+
+	auto end = chrono::high_resolution_clock::now();
+
+	m_stats.Items = count;
+	m_stats.Visible = (uint32_t)visible.size();
+	m_stats.Retested = retested;
+	m_stats.Uncached = count - m_count;
+	m_stats.FellBack = fellBack;
+	m_stats.CullMicroseconds = chrono::duration<double, micro>(end - start).count();
+}
+
+const VisibilityCacheStats& VisibilityCache::GetStats()const
+{
+	return m_stats;
+}
+
+void VisibilityCache::BeginFrame(const XMFLOAT4 planes[6], const XMFLOAT3& eyePos)
+{
+	m_frame++;
+
+	if (!m_reset && Distance(eyePos, m_anchor) > MaxAnchorDistance)
+		m_reset = true;
+
+	if (m_reset)
+	{
+		m_anchor = eyePos;
+		for (uint32_t range = 0; range < ReachRanges; ++range)
+		{
+			ExpiryQueue& queue = m_queues[range];
+			queue.SlotsPerMotion = SlotsPerReach / RangeReach(range);
+			queue.NextSlot = 0;
+			for (vector<Expiry>& slot : queue.Slots)
+				slot.clear();
+
+			m_motion[range] = 0.0;
+		}
+
+		m_retestNext.clear();
+		m_queued = 0;
+		m_count = 0;
+		m_reset = false;
+	}
+	else
+	{
+		// The distance of a box to a plane, n.c + w + |n|.e, changes by at most
+		//   |dn| (|c - anchor| + |e|) + |d(n.anchor + w)|
+		// so with the reach of the range for the first factor, the largest of these
+		// over the planes bounds every item of the range.
+		double turned[6];
+		double moved[6];
+		for (int p = 0; p < 6; ++p)
+		{
+			const XMFLOAT4& a = m_planes[p];
+			const XMFLOAT4& b = planes[p];
+			turned[p] = Length(b.x - a.x, b.y - a.y, b.z - a.z);
+			moved[p] = fabs((b.x - a.x)*(double)m_anchor.x + (b.y - a.y)*(double)m_anchor.y + (b.z - a.z)*(double)m_anchor.z + (b.w - a.w));
+		}
+
+		for (uint32_t range = 0; range < ReachRanges; ++range)
+		{
+			double motion = 0.0;
+			for (int p = 0; p < 6; ++p)
+				motion = max(motion, turned[p]*RangeReach(range) + moved[p]);
+
+			m_motion[range] += motion;
+		}
+	}
+
+	copy(planes, planes + 6, m_planes);
+}
+
+void VisibilityCache::Resize(uint32_t count)
+{
+	// Items past the end are gone: outdate their queue entries.
+	for (uint32_t i = count; i < m_count; ++i)
+		m_versions[i]++;
+	m_count = min(m_count, count);
+
+	// Reserved without touching the memory, so the copies do not move as the
+	// cache fills.
+	if (count > m_items.capacity())
+	{
+		m_items.reserve(count);
+		m_versions.reserve(count);
+	}
+
+	if (count > m_visibleBits.size()*64)
+	{
+		m_pendingBits.resize((count + 63) / 64, 0);
+		m_reloadBits.resize((count + 63) / 64, 0);
+		m_visibleBits.resize((count + 63) / 64, 0);
+	}
+}
+
+void VisibilityCache::MarkPending(uint32_t item, bool reload)
+{
+	m_pendingBits[item / 64] |= 1ull << (item % 64);
+	if (reload)
+		m_reloadBits[item / 64] |= 1ull << (item % 64);
+}
+
+void VisibilityCache::TakeExpired(ExpiryQueue& queue, double motion)
+{
+	uint64_t last = (uint64_t)(motion*queue.SlotsPerMotion);
+	for (uint32_t taken = 0; queue.NextSlot <= last && taken < QueueSlots; ++taken)
+	{
+		vector<Expiry>& slot = queue.Slots[queue.NextSlot % QueueSlots];
+		for (size_t i = 0; i < slot.size(); ++i)
+		{
+			if (i + PrefetchDistance < slot.size())
+				_mm_prefetch((const char*)&m_versions[slot[i + PrefetchDistance].Item], _MM_HINT_T0);
+
+			if (IsCurrent(slot[i]))
+				MarkPending(slot[i].Item, false);
+		}
+
+		m_queued -= slot.size();
+		slot.clear();
+		queue.NextSlot++;
+	}
+
+	// All slots are empty if the motion passed them all at once.
+	queue.NextSlot = max(queue.NextSlot, last + 1);
+}
+
+vector<VisibilityCache::Expiry>& VisibilityCache::Destination(ExpiryQueue& queue, double motion)
+{
+	// Rounding down the slot only takes the item out early, and TakeExpired
+	// scales the motion the same way. A slot that was already taken out would be
+	// too late, so such items go to the next frame.
+	double slot = floor(motion*queue.SlotsPerMotion);
+	if (slot < (double)queue.NextSlot)
+		return m_retestNext;
+
+	uint64_t index = (uint64_t)min(slot, (double)(queue.NextSlot + QueueSlots - 1));
+	return queue.Slots[index % QueueSlots];
+}
+
+void VisibilityCache::Compact()
+{
+	auto outdated = [this](const Expiry& expiry) { return !IsCurrent(expiry); };
+
+	m_queued = 0;
+	for (ExpiryQueue& queue : m_queues)
+	{
+		for (vector<Expiry>& slot : queue.Slots)
+		{
+			slot.erase(remove_if(slot.begin(), slot.end(), outdated), slot.end());
+			m_queued += slot.size();
+		}
+	}
+
+	m_retestNext.erase(remove_if(m_retestNext.begin(), m_retestNext.end(), outdated), m_retestNext.end());
+	m_queued += m_retestNext.size();
+}
+
+bool VisibilityCache::IsCurrent(const Expiry& expiry)const
+{
+	return expiry.Item < m_count && expiry.Version == m_versions[expiry.Item];
+}
+
+void VisibilityCache::Test(const BoundsSoA& bounds, const uint32_t* items, uint32_t count)
+{
+	// The boxes of the batch, gathered into SoA with the cached items fetched a
+	// few items ahead. The lanes past count are zero and ignored.
+	alignas(16) float cx[TestBatch], cy[TestBatch], cz[TestBatch];
+	alignas(16) float ex[TestBatch], ey[TestBatch], ez[TestBatch];
+	for (uint32_t k = 0; k < count; ++k)
+	{
+		if (k + PrefetchDistance < count)
+			_mm_prefetch((const char*)&m_items[items[k + PrefetchDistance]], _MM_HINT_T0);
+
+		uint32_t item = items[k];
+		CachedItem& cached = m_items[item];
+		if ((m_reloadBits[item / 64] >> (item % 64)) & 1)
+		{
+			m_reloadBits[item / 64] &= ~(1ull << (item % 64));
+			cached.Center = XMFLOAT3(bounds.CenterX[item], bounds.CenterY[item], bounds.CenterZ[item]);
+			cached.Extents = XMFLOAT3(bounds.ExtentX[item], bounds.ExtentY[item], bounds.ExtentZ[item]);
+		}
+
+		cx[k] = cached.Center.x;
+		cy[k] = cached.Center.y;
+		cz[k] = cached.Center.z;
+		ex[k] = cached.Extents.x;
+		ey[k] = cached.Extents.y;
+		ez[k] = cached.Extents.z;
+	}
+
+	uint32_t padded = (count + 3) & ~3u;
+	for (uint32_t k = count; k < padded; ++k)
+		cx[k] = cy[k] = cz[k] = ex[k] = ey[k] = ez[k] = 0.0f;
+
+	// Signed distance of every box to the plane that rejects it most, positive
+	// inside, with the sums in the order FrustumCuller uses so both agree on boxes
+	// touching a plane. And the reach of the box.
+	// Distance of every box to the plane that rejects it most, and its reach.
+	alignas(16) float distances[TestBatch], reaches[TestBatch];
+	const PlanesSse planes(m_planes);
+	const __m128 anchorX = _mm_set1_ps(m_anchor.x);
+	const __m128 anchorY = _mm_set1_ps(m_anchor.y);
+	const __m128 anchorZ = _mm_set1_ps(m_anchor.z);
+	for (uint32_t k = 0; k < padded; k += 4)
+	{
+		__m128 x = _mm_load_ps(cx + k);
+		__m128 y = _mm_load_ps(cy + k);
+		__m128 z = _mm_load_ps(cz + k);
+		__m128 sx = _mm_load_ps(ex + k);
+		__m128 sy = _mm_load_ps(ey + k);
+		__m128 sz = _mm_load_ps(ez + k);
+		_mm_store_ps(distances + k, planes.Distance(x, y, z, sx, sy, sz));
+
+		__m128 dx = _mm_sub_ps(x, anchorX);
+		__m128 dy = _mm_sub_ps(y, anchorY);
+		__m128 dz = _mm_sub_ps(z, anchorZ);
+		__m128 center = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz)));
+		__m128 extent = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, sx), _mm_mul_ps(sy, sy)), _mm_mul_ps(sz, sz)));
+		_mm_store_ps(reaches + k, _mm_add_ps(center, extent));
+	}
+
+	// Where each item goes next. The ends of the queue slots are scattered, so
+	// they are all fetched before the first entry is written.
+	vector<Expiry>* destinations[TestBatch];
+	float anchorDistance = Length(m_anchor.x, m_anchor.y, m_anchor.z);
+	for (uint32_t k = 0; k < count; ++k)
+	{
+		uint32_t item = items[k];
+		float distance = distances[k];
+		float reach = reaches[k];
+
+		bool isVisible = distance >= 0.0f;
+		SetVisible(item, isVisible);
+
+		// The smallest range whose largest reach, a power of sqrt(2), is at least
+		// reach: from the exponent of reach squared, rounded up.
+		uint32_t range = 0;
+		float reachSquared = reach*reach;
+		if (reachSquared > 1.0f)
+		{
+			uint32_t bits;
+			memcpy(&bits, &reachSquared, sizeof(bits));
+			range = min((bits >> 23) - 127 + ((bits & 0x7fffff) != 0 ? 1 : 0), ReachRanges);
+		}
+		while (range < ReachRanges && RangeReach(range) < reach)
+			range++;
+
+		if (range == ReachRanges)
+		{
+			// Too far for the bounds to be of any use: test it again next frame.
+			destinations[k] = &m_retestNext;
+			continue;
+		}
+
+		// Visible until any plane passes the box, culled until the plane that
+		// rejects it most reaches the box.
+		float margin = isVisible ? distance : -distance;
+		float epsilon = MarginEpsilon*(1.0f + reach + anchorDistance);
+		destinations[k] = &Destination(m_queues[range], m_motion[range] + margin - epsilon);
+		_mm_prefetch((const char*)(destinations[k]->data() + destinations[k]->size()), _MM_HINT_T0);
+	}
+
+	for (uint32_t k = 0; k < count; ++k)
+	{
+		uint32_t item = items[k];
+		destinations[k]->push_back({ item, ++m_versions[item] });
+	}
+	m_queued += count;
+}
+
+void VisibilityCache::TestUncached(const BoundsSoA& bounds, uint32_t first, uint32_t count)
+{
+	const PlanesSse planes(m_planes);
+	auto testOne = [&](uint32_t i)
+	{
+		__m128 distance = planes.Distance(_mm_set1_ps(bounds.CenterX[i]), _mm_set1_ps(bounds.CenterY[i]), _mm_set1_ps(bounds.CenterZ[i]),
+			_mm_set1_ps(bounds.ExtentX[i]), _mm_set1_ps(bounds.ExtentY[i]), _mm_set1_ps(bounds.ExtentZ[i]));
+		SetVisible(i, _mm_cvtss_f32(distance) >= 0.0f);
+	};
+
+	// Whole words of visible bits 4 items per iteration, the items of the
+	// partial words at both ends one by one.
+	uint32_t wordsFirst = min(count, (first + 63) & ~63u);
+	uint32_t wordsEnd = max(wordsFirst, count & ~63u);
+	for (uint32_t i = first; i < wordsFirst; ++i)
+		testOne(i);
+	for (uint32_t i = wordsEnd; i < count; ++i)
+		testOne(i);
+
+	const __m128 zero = _mm_setzero_ps();
+	for (uint32_t word = wordsFirst / 64; word < wordsEnd / 64; ++word)
+	{
+		uint64_t bits = 0;
+		for (uint32_t k = 0; k < 64; k += 4)
+		{
+			uint32_t i = word*64 + k;
+			__m128 distance = planes.Distance(_mm_loadu_ps(&bounds.CenterX[i]), _mm_loadu_ps(&bounds.CenterY[i]), _mm_loadu_ps(&bounds.CenterZ[i]),
+				_mm_loadu_ps(&bounds.ExtentX[i]), _mm_loadu_ps(&bounds.ExtentY[i]), _mm_loadu_ps(&bounds.ExtentZ[i]));
+			bits |= (uint64_t)_mm_movemask_ps(_mm_cmpge_ps(distance, zero)) << k;
+		}
+		m_visibleBits[word] = bits;
+	}
+}
+
+void VisibilityCache::SetVisible(uint32_t item, bool visible)
+{
+	uint64_t bit = 1ull << (item % 64);
+	if (visible)
+		m_visibleBits[item / 64] |= bit;
+	else
+		m_visibleBits[item / 64] &= ~bit;
+}
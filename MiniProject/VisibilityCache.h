@@ -0,0 +1,163 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <DirectXMath.h>
+#include "SceneStore.h"
+
+using namespace DirectX;
+using namespace std;
+
+
+struct VisibilityCacheStats
+{
+	uint32_t Items = 0;
+	uint32_t Visible = 0;
+
+	// Items tested against the planes this frame, for having used up their margin,
+	// being new or moved, or for their turn in the amortized refresh.
+	uint32_t Retested = 0;
+
+	// Items tested by a full pass instead, for not having joined the cache yet
+	// after a reset, or all of them in a frame that fell back.
+	uint32_t Uncached = 0;
+	bool FellBack = false;
+
+	double CullMicroseconds = 0.0;
+};
+
+// Frustum culling that keeps the results of the previous frames. Testing an item
+// also records by how far it passed or failed the planes, and the result cannot
+// change before the planes moved that far at the item. From one frame to the next
+// a plane moves at a point by at most how much its normal turned times the
+// distance of the point to an anchor, plus how much it moved at the anchor. The
+// cache sums that bound per range of distances to the anchor, and keeps the items
+// in queues by the sum at which their margin runs out, so a frame only tests the
+// items whose margin did run out.
+//
+// The items join the cache a share per frame, after a reset too, and those
+// that did not yet are tested by a full SIMD pass. When the camera moves so fast
+// that retesting the cached items would cost more than the full pass, the cache
+// falls back to it and starts over after a while.
+//
+// Entries are indexed like the dense scene arrays: invalidate the items that
+// move, and the item moved into the place of a removed one.
+class VisibilityCache
+{
+public:
+
+	// Every item is retested at least once in refreshFrames frames, a contiguous
+	// share of them each frame.
+	explicit VisibilityCache(uint32_t refreshFrames = 512);
+
+	void Invalidate(uint32_t denseIndex);
+	void InvalidateAll();
+
+	// Fills visible with the dense indices of the first count items that
+	// intersect the frustum given by planes, in the order and convention of
+	// FrustumCuller::SetPlanes, seen from eyePos.
+	void Cull(const XMFLOAT4 planes[6], const XMFLOAT3& eyePos, const BoundsSoA& bounds, uint32_t count, vector<uint32_t>& visible);
+
+	const VisibilityCacheStats& GetStats()const;
+
+private:
+
+	// Items are grouped by reach, the distance of the box center to the anchor
+	// plus the length of the extents, in steps of sqrt(2).
+	static const uint32_t ReachRanges = 40;
+
+	// Slots of a queue. Expiries further ahead than the last slot are put in the
+	// last slot, so they are only tested early.
+	static const uint32_t QueueSlots = 512;
+
+	// Pending items are gathered and tested this many at a time, 4 per iteration.
+	static const uint32_t TestBatch = 64;
+
+	// What a test needs of an item, in one place: a copy of its box.
+	struct CachedItem
+	{
+		XMFLOAT3 Center;
+		XMFLOAT3 Extents;
+	};
+
+	struct Expiry
+	{
+		uint32_t Item;
+		uint32_t Version;
+	};
+
+	// Expiries of one reach range by the motion at which they run out, times
+	// SlotsPerMotion and rounded down. Slot NextSlot is the first one not taken
+	// out yet.
+	struct ExpiryQueue
+	{
+		double SlotsPerMotion = 1.0;
+		uint64_t NextSlot = 0;
+		vector<Expiry> Slots[QueueSlots];
+	};
+
+	void BeginFrame(const XMFLOAT4 planes[6], const XMFLOAT3& eyePos);
+	void Resize(uint32_t count);
+	void MarkPending(uint32_t item, bool reload);
+	void TakeExpired(ExpiryQueue& queue, double motion);
+	vector<Expiry>& Destination(ExpiryQueue& queue, double motion);
+	void Compact();
+	bool IsCurrent(const Expiry& expiry)const;
+	void Test(const BoundsSoA& bounds, const uint32_t* items, uint32_t count);
+	void TestUncached(const BoundsSoA& bounds, uint32_t first, uint32_t count);
+	void SetVisible(uint32_t item, bool visible);
+
+private:
+
+	uint32_t m_refreshFrames;
+	uint32_t m_frame = 0;
+
+	// Items in the cache, the first ones of the dense arrays. The others are
+	// tested by a full pass until they joined.
+	uint32_t m_count = 0;
+
+	// Frames left to wait before the cache fills again after a fallback, and how
+	// long the next fallback waits.
+	uint32_t m_holdFrames = 0;
+	uint32_t m_nextHoldFrames;
+
+	// Planes of the current frame, and the eye position at the last reset. The
+	// reaches are measured from there, so it is moved, at the cost of filling
+	// the cache again, once the eye wandered off too far.
+	XMFLOAT4 m_planes[6];
+	XMFLOAT3 m_anchor;
+	bool m_reset = true;
+
+	// Per reach range, the bound on how far any plane moved since the reset, at
+	// any item of the range, and its expiry queue. The sums are kept in double so
+	// they do not lose the small steps of a slow camera.
+	double m_motion[ReachRanges];
+	ExpiryQueue m_queues[ReachRanges];
+
+	// Items to test next frame whatever the motion, and the number of entries in
+	// all queues, outdated ones included.
+	vector<Expiry> m_retestNext;
+	size_t m_queued = 0;
+
+	// Copies of the boxes, and per item the count of its tests so that older
+	// queue entries are skipped, apart as most entries are checked without a
+	// test. Never shrunk, so an index that comes back does not match the entries
+	// it left behind.
+	vector<CachedItem> m_items;
+	vector<uint32_t> m_versions;
+
+	// One bit per item to test this frame, and per item whose box is read again
+	// from the bounds before: the new, invalidated and refreshed ones. The items
+	// whose margin ran out are tested with the copy.
+	vector<uint64_t> m_pendingBits;
+	vector<uint64_t> m_reloadBits;
+
+	// One bit per item found visible, scanned into the visible list in index order.
+	vector<uint64_t> m_visibleBits;
+
+	// Invalidated items, and the pending ones in index order.
+	vector<uint32_t> m_invalidated;
+	vector<uint32_t> m_pending;
+
+	VisibilityCacheStats m_stats;
+};
@@ -0,0 +1,249 @@
+#include "WorldPartition.h"
+#include <algorithm>
+#include <cmath>
+
+using namespace DirectX;
+using namespace std;
+
+namespace
+{
+	// Seconds over which the velocity estimate follows the camera.
+	const float VelocitySmoothing = 0.25f;
+}
+
+
+void WorldPartition::SetGrid(const XMFLOAT2& min, float cellSize, uint32_t cellsX, uint32_t cellsZ)
+{
+	m_min = min;
+	m_cellSize = cellSize;
+	m_cellsX = cellsX;
+	m_cellsZ = cellsZ;
+
+	uint32_t count = cellsX*cellsZ;
+	m_states.assign(count, Unloaded);
+	m_countedBytes.assign(count, 0);
+	m_knownBytes.assign(count, 0);
+	m_active.clear();
+
+	m_hasPosition = false;
+	m_stats = WorldPartitionStats();
+}
+
+void WorldPartition::SetRadii(float loadRadius, float unloadRadius)
+{
+	m_loadRadius = loadRadius;
+	m_unloadRadius = max(unloadRadius, loadRadius);
+}
+
+void WorldPartition::SetMemoryBudget(uint64_t bytes)
+{
+	m_budget = bytes;
+}
+
+void WorldPartition::SetCellEstimate(uint64_t bytes)
+{
+	m_cellEstimate = bytes;
+}
+
+void WorldPartition::SetPrefetchTime(float seconds)
+{
+	m_prefetchTime = seconds;
+}
+
+void WorldPartition::SetMaxLoadsInFlight(uint32_t count)
+{
+	m_maxLoadsInFlight = max(count, 1u);
+}
+
+void WorldPartition::Update(const XMFLOAT3& position, float deltaTime, vector<uint32_t>& loads, vector<uint32_t>& unloads)
+{
+	loads.clear();
+	unloads.clear();
+	m_stats.Deferred = 0;
+
+	XMFLOAT2 camera(position.x, position.z);
+
+	// A jump of more than a cell is a teleport, not movement.
+	XMFLOAT2& velocity = m_stats.Velocity;
+	if (m_hasPosition && deltaTime > 0.0f)
+	{
+		float dx = camera.x - m_position.x;
+		float dz = camera.y - m_position.y;
+		if (dx*dx + dz*dz > m_cellSize*m_cellSize)
+		{
+			velocity = XMFLOAT2(0.0f, 0.0f);
+		}
+		else
+		{
+			float t = min(deltaTime / VelocitySmoothing, 1.0f);
+			velocity.x += (dx / deltaTime - velocity.x)*t;
+			velocity.y += (dz / deltaTime - velocity.y)*t;
+		}
+	}
+	m_hasPosition = true;
+	m_position = camera;
+
+	XMFLOAT2 ahead(camera.x + velocity.x*m_prefetchTime, camera.y + velocity.y*m_prefetchTime);
+
+	// Resident cells beyond the unload radius of both points go.
+	for (size_t i = 0; i < m_active.size();)
+	{
+		uint32_t cell = m_active[i];
+		if (m_states[cell] == Resident && min(Distance(cell, camera), Distance(cell, ahead)) > m_unloadRadius)
+		{
+			unloads.push_back(cell);
+			Unload(cell);
+		}
+		else
+		{
+			++i;
+		}
+	}
+
+	if (m_stats.Loading >= m_maxLoadsInFlight)
+		return;
+
+	// Unloaded cells within the load radius of either point, over the cells of
+	// the box around both circles, by distance to the camera.
+	m_candidates.clear();
+	float minX = min(camera.x, ahead.x) - m_loadRadius;
+	float maxX = max(camera.x, ahead.x) + m_loadRadius;
+	float minZ = min(camera.y, ahead.y) - m_loadRadius;
+	float maxZ = max(camera.y, ahead.y) + m_loadRadius;
+
+	int firstX = max((int)floorf((minX - m_min.x) / m_cellSize), 0);
+	int lastX = min((int)floorf((maxX - m_min.x) / m_cellSize), (int)m_cellsX - 1);
+	int firstZ = max((int)floorf((minZ - m_min.y) / m_cellSize), 0);
+	int lastZ = min((int)floorf((maxZ - m_min.y) / m_cellSize), (int)m_cellsZ - 1);
+	for (int z = firstZ; z <= lastZ; ++z)
+	{
+		for (int x = firstX; x <= lastX; ++x)
+		{
+			uint32_t cell = (uint32_t)z*m_cellsX + x;
+			if (m_states[cell] != Unloaded)
+				continue;
+
+			float distance = Distance(cell, camera);
+			if (min(distance, Distance(cell, ahead)) <= m_loadRadius)
+				m_candidates.push_back(make_pair(distance, cell));
+		}
+	}
+
+	if (m_candidates.empty())
+		return;
+
+	sort(m_candidates.begin(), m_candidates.end());
+
+	// Resident cells that could make room, farthest last so they go first.
+	m_evictable.clear();
+	for (uint32_t cell : m_active)
+	{
+		if (m_states[cell] == Resident)
+			m_evictable.push_back(make_pair(Distance(cell, camera), cell));
+	}
+	sort(m_evictable.begin(), m_evictable.end());
+
+	for (const pair<float, uint32_t>& candidate : m_candidates)
+	{
+		if (m_stats.Loading >= m_maxLoadsInFlight)
+			break;
+
+		uint32_t cell = candidate.second;
+		uint64_t bytes = m_knownBytes[cell] != 0 ? m_knownBytes[cell] : m_cellEstimate;
+
+		// Only cells farther than the one to load are evicted for it. When that is
+		// not enough, the farther candidates will not fit either.
+		while (m_stats.UsedBytes + bytes > m_budget && !m_evictable.empty() && m_evictable.back().first > candidate.first)
+		{
+			uint32_t evicted = m_evictable.back().second;
+			m_evictable.pop_back();
+
+			unloads.push_back(evicted);
+			Unload(evicted);
+			m_stats.Evictions++;
+		}
+
+		if (m_stats.UsedBytes + bytes > m_budget)
+		{
+			m_stats.Deferred = (uint32_t)(m_candidates.size() - (&candidate - m_candidates.data()));
+			break;
+		}
+
+		m_states[cell] = Loading;
+		m_countedBytes[cell] = bytes;
+		m_active.push_back(cell);
+		m_stats.UsedBytes += bytes;
+		m_stats.Loading++;
+		m_stats.Loads++;
+		if (candidate.first > m_loadRadius)
+			m_stats.Prefetches++;
+
+		loads.push_back(cell);
+	}
+}
+
+void WorldPartition::FinishLoad(uint32_t cell, uint64_t bytes)
+{
+	if (m_states[cell] != Loading)
+		return;
+
+	m_stats.UsedBytes = m_stats.UsedBytes - m_countedBytes[cell] + bytes;
+	m_countedBytes[cell] = bytes;
+	m_knownBytes[cell] = max(bytes, (uint64_t)1);
+
+	m_states[cell] = Resident;
+	m_stats.Loading--;
+	m_stats.Resident++;
+}
+
+uint32_t WorldPartition::GetCellCount()const
+{
+	return m_cellsX*m_cellsZ;
+}
+
+WorldPartition::CellState WorldPartition::GetState(uint32_t cell)const
+{
+	return (CellState)m_states[cell];
+}
+
+void WorldPartition::GetCellCoords(uint32_t cell, uint32_t& x, uint32_t& z)const
+{
+	x = cell % m_cellsX;
+	z = cell / m_cellsX;
+}
+
+void WorldPartition::GetCellBounds(uint32_t cell, XMFLOAT2& min, XMFLOAT2& max)const
+{
+	uint32_t x, z;
+	GetCellCoords(cell, x, z);
+
+	min = XMFLOAT2(m_min.x + x*m_cellSize, m_min.y + z*m_cellSize);
+	max = XMFLOAT2(min.x + m_cellSize, min.y + m_cellSize);
+}
+
+const WorldPartitionStats& WorldPartition::GetStats()const
+{
+	return m_stats;
+}
+
+float WorldPartition::Distance(uint32_t cell, const XMFLOAT2& point)const
+{
+	XMFLOAT2 min, max;
+	GetCellBounds(cell, min, max);
+
+	float dx = std::max(std::max(min.x - point.x, point.x - max.x), 0.0f);
+	float dz = std::max(std::max(min.y - point.y, point.y - max.y), 0.0f);
+	return sqrtf(dx*dx + dz*dz);
+}
+
+void WorldPartition::Unload(uint32_t cell)
+{
+	m_stats.UsedBytes -= m_countedBytes[cell];
+	m_countedBytes[cell] = 0;
+
+	m_states[cell] = Unloaded;
+	m_stats.Resident--;
+	m_stats.Unloads++;
+
+	m_active.erase(find(m_active.begin(), m_active.end(), cell));
+}
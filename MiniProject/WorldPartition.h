@@ -0,0 +1,124 @@
+#pragma once
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include <DirectXMath.h>
+
+using namespace DirectX;
+using namespace std;
+
+
+struct WorldPartitionStats
+{
+	uint32_t Resident = 0;
+	uint32_t Loading = 0;
+
+	// Bytes of the resident cells, and the estimates of the loading ones.
+	uint64_t UsedBytes = 0;
+
+	// Since SetGrid. Prefetches are the loads started for cells only the look
+	// ahead reaches, evictions the unloads made to stay within the budget.
+	uint32_t Loads = 0;
+	uint32_t Unloads = 0;
+	uint32_t Prefetches = 0;
+	uint32_t Evictions = 0;
+
+	// Of the last Update: cells that should have been loaded but did not fit.
+	uint32_t Deferred = 0;
+
+	// Smoothed camera velocity on the ground, in units per second.
+	XMFLOAT2 Velocity = XMFLOAT2(0.0f, 0.0f);
+};
+
+// Decides which cells of a world split into a grid on the XZ plane are loaded.
+// Cells within the load radius of the camera are loaded, nearest first, and
+// resident cells are only unloaded beyond the larger unload radius, so a camera
+// moving back and forth over a border does not reload the same cells. Both radii
+// also apply around a point ahead of the camera along its velocity, so cells are
+// prefetched in the direction of movement.
+//
+// Loads are capped by a memory budget: when a cell does not fit, resident cells
+// farther from the camera are evicted for it, farthest first, or it waits. A cell
+// never loaded is assumed to take the estimate until FinishLoad reports its size.
+// The partition only keeps the books; loading and unloading are the caller's.
+class WorldPartition
+{
+public:
+
+	enum CellState : uint8_t
+	{
+		Unloaded,
+		Loading,
+		Resident
+	};
+
+	// Grid of cellsX by cellsZ square cells starting at min. Every cell is
+	// unloaded and the statistics start over.
+	void SetGrid(const XMFLOAT2& min, float cellSize, uint32_t cellsX, uint32_t cellsZ);
+
+	void SetRadii(float loadRadius, float unloadRadius);
+	void SetMemoryBudget(uint64_t bytes);
+	void SetCellEstimate(uint64_t bytes);
+
+	// Seconds of movement ahead of the camera the cells are loaded for.
+	void SetPrefetchTime(float seconds);
+
+	void SetMaxLoadsInFlight(uint32_t count);
+
+	// Moves the camera to position, deltaTime seconds after the last call. Fills
+	// unloads with the resident cells to drop and loads with the cells to start
+	// loading, most urgent first. The loads are Loading until FinishLoad.
+	void Update(const XMFLOAT3& position, float deltaTime, vector<uint32_t>& loads, vector<uint32_t>& unloads);
+
+	// The load of cell completed; bytes is what it takes while resident.
+	void FinishLoad(uint32_t cell, uint64_t bytes);
+
+	uint32_t GetCellCount()const;
+	CellState GetState(uint32_t cell)const;
+
+	// Grid coordinates and bounds of cell.
+	void GetCellCoords(uint32_t cell, uint32_t& x, uint32_t& z)const;
+	void GetCellBounds(uint32_t cell, XMFLOAT2& min, XMFLOAT2& max)const;
+
+	const WorldPartitionStats& GetStats()const;
+
+private:
+
+	// Distance from point to the nearest point of cell.
+	float Distance(uint32_t cell, const XMFLOAT2& point)const;
+
+	void Unload(uint32_t cell);
+
+private:
+
+	XMFLOAT2 m_min = XMFLOAT2(0.0f, 0.0f);
+	float m_cellSize = 64.0f;
+	uint32_t m_cellsX = 0;
+	uint32_t m_cellsZ = 0;
+
+	float m_loadRadius = 128.0f;
+	float m_unloadRadius = 192.0f;
+	uint64_t m_budget = UINT64_MAX;
+	uint64_t m_cellEstimate = 1 << 20;
+	float m_prefetchTime = 1.0f;
+	uint32_t m_maxLoadsInFlight = 4;
+
+	// By cell: the state, and the bytes counted in m_stats.UsedBytes for it, the
+	// estimate while it loads. m_knownBytes is 0 for cells never loaded.
+	vector<uint8_t> m_states;
+	vector<uint64_t> m_countedBytes;
+	vector<uint64_t> m_knownBytes;
+
+	// Cells loading or resident, in no particular order.
+	vector<uint32_t> m_active;
+
+	bool m_hasPosition = false;
+	XMFLOAT2 m_position = XMFLOAT2(0.0f, 0.0f);
+
+	// Scratch: candidates and eviction order, with their distance to the camera.
+	vector<pair<float, uint32_t>> m_candidates;
+	vector<pair<float, uint32_t>> m_evictable;
+
+	WorldPartitionStats m_stats;
+};
@@ -0,0 +1,331 @@
+#include "Test.h"
+#include "Bvh.h"
+#include "CameraDynamic.h"
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <random>
+#include <thread>
+
+using namespace DirectX;
+using namespace std;
+
+namespace
+{
+	// The boxes the Bvh was given, kept as it keeps them, and the queries run
+	// over all of them one by one.
+	struct Reference
+	{
+		vector<XMFLOAT3> Min;
+		vector<XMFLOAT3> Max;
+		vector<uint8_t> Alive;
+
+		void Set(Bvh& bvh, uint32_t id, const XMFLOAT3& center, const XMFLOAT3& extents)
+		{
+			if (id >= Alive.size())
+			{
+				Min.resize(id + 1);
+				Max.resize(id + 1);
+				Alive.resize(id + 1, 0);
+			}
+
+			Min[id] = XMFLOAT3(center.x - extents.x, center.y - extents.y, center.z - extents.z);
+			Max[id] = XMFLOAT3(center.x + extents.x, center.y + extents.y, center.z + extents.z);
+			Alive[id] = 1;
+			bvh.SetItem(id, center, extents);
+		}
+
+		void Remove(Bvh& bvh, uint32_t id)
+		{
+			Alive[id] = 0;
+			bvh.RemoveItem(id);
+		}
+
+		template<typename Overlaps>
+		vector<uint32_t> Query(Overlaps overlaps)const
+		{
+			vector<uint32_t> ids;
+			for (uint32_t id = 0; id < (uint32_t)Alive.size(); ++id)
+			{
+				if (Alive[id] && overlaps(Min[id], Max[id]))
+					ids.push_back(id);
+			}
+			return ids;
+		}
+
+		vector<uint32_t> Frustum(const XMFLOAT4 planes[6])const
+		{
+			return Query([planes](const XMFLOAT3& mn, const XMFLOAT3& mx)
+			{
+				XMFLOAT3 c(0.5f*(mn.x + mx.x), 0.5f*(mn.y + mx.y), 0.5f*(mn.z + mx.z));
+				XMFLOAT3 e(0.5f*(mx.x - mn.x), 0.5f*(mx.y - mn.y), 0.5f*(mx.z - mn.z));
+				for (int p = 0; p < 6; ++p)
+				{
+					float d = planes[p].x*c.x + planes[p].y*c.y + planes[p].z*c.z + planes[p].w;
+					float r = fabsf(planes[p].x)*e.x + fabsf(planes[p].y)*e.y + fabsf(planes[p].z)*e.z;
+					if (d + r < 0.0f)
+						return false;
+				}
+				return true;
+			});
+		}
+
+		vector<uint32_t> Aabb(const XMFLOAT3& center, const XMFLOAT3& extents)const
+		{
+			XMFLOAT3 qmin(center.x - extents.x, center.y - extents.y, center.z - extents.z);
+			XMFLOAT3 qmax(center.x + extents.x, center.y + extents.y, center.z + extents.z);
+			return Query([qmin, qmax](const XMFLOAT3& mn, const XMFLOAT3& mx)
+			{
+				return !(mx.x < qmin.x || mn.x > qmax.x || mx.y < qmin.y || mn.y > qmax.y || mx.z < qmin.z || mn.z > qmax.z);
+			});
+		}
+
+		vector<uint32_t> Sphere(const XMFLOAT3& center, float radius)const
+		{
+			return Query([center, radius](const XMFLOAT3& mn, const XMFLOAT3& mx)
+			{
+				float dx = max(max(mn.x - center.x, center.x - mx.x), 0.0f);
+				float dy = max(max(mn.y - center.y, center.y - mx.y), 0.0f);
+				float dz = max(max(mn.z - center.z, center.z - mx.z), 0.0f);
+				return dx*dx + dy*dy + dz*dz <= radius*radius;
+			});
+		}
+
+		// Distance to the nearest box the ray enters within maxDist, or FLT_MAX.
+		float Ray(const XMFLOAT3& origin, const XMFLOAT3& direction, float maxDist)const
+		{
+			XMFLOAT3 inv(1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z);
+
+			float best = FLT_MAX;
+			for (uint32_t id = 0; id < (uint32_t)Alive.size(); ++id)
+			{
+				float enter = Alive[id] ? Enter(origin, inv, Min[id], Max[id], maxDist) : FLT_MAX;
+				if (enter < maxDist)
+					best = min(best, enter);
+			}
+			return best;
+		}
+
+		static float Enter(const XMFLOAT3& origin, const XMFLOAT3& inv, const XMFLOAT3& mn, const XMFLOAT3& mx, float maxDist)
+		{
+			float tx1 = (mn.x - origin.x)*inv.x, tx2 = (mx.x - origin.x)*inv.x;
+			float ty1 = (mn.y - origin.y)*inv.y, ty2 = (mx.y - origin.y)*inv.y;
+			float tz1 = (mn.z - origin.z)*inv.z, tz2 = (mx.z - origin.z)*inv.z;
+
+			float enter = max(max(min(tx1, tx2), min(ty1, ty2)), max(min(tz1, tz2), 0.0f));
+			float leave = min(min(max(tx1, tx2), max(ty1, ty2)), min(max(tz1, tz2), maxDist));
+			return enter <= leave ? enter : FLT_MAX;
+		}
+	};
+
+	vector<uint32_t> Sorted(vector<uint32_t> ids)
+	{
+		sort(ids.begin(), ids.end());
+		return ids;
+	}
+
+	// Runs random queries of every kind against the Bvh and the reference.
+	void CheckQueries(Bvh& bvh, const Reference& reference, uint32_t seed)
+	{
+		mt19937 random(seed);
+		uniform_real_distribution<float> position(-120.0f, 120.0f);
+		uniform_real_distribution<float> size(1.0f, 40.0f);
+		uniform_real_distribution<float> angle(-XM_PI, XM_PI);
+
+		for (int q = 0; q < 20; ++q)
+		{
+			Camera camera;
+			camera.SetFrustum(XM_PIDIV4, 16.0f / 9.0f, 1.0f, 80.0f + size(random)*4.0f);
+			camera.SetPosition(position(random), 0.2f*position(random), position(random));
+			camera.Yaw(angle(random));
+			camera.Pitch(0.3f*angle(random));
+			camera.UpdateViewMatrix();
+
+			XMFLOAT4 planes[6];
+			camera.GetFrustumPlanes(planes);
+
+			vector<uint32_t> ids;
+			bvh.QueryFrustum(planes, ids);
+			CHECK(Sorted(ids) == reference.Frustum(planes));
+
+			XMFLOAT3 center(position(random), 0.2f*position(random), position(random));
+			XMFLOAT3 extents(size(random), size(random), size(random));
+			ids.clear();
+			bvh.QueryAabb(center, extents, ids);
+			CHECK(Sorted(ids) == reference.Aabb(center, extents));
+
+			float radius = size(random);
+			ids.clear();
+			bvh.QuerySphere(center, radius, ids);
+			CHECK(Sorted(ids) == reference.Sphere(center, radius));
+
+			// Ray cast: the nearest hit at the same distance, on a box that is hit there.
+			XMFLOAT3 direction;
+			XMStoreFloat3(&direction, XMVector3Normalize(XMVectorSet(position(random), 0.2f*position(random), position(random), 0.0f)));
+			XMFLOAT3 inv(1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z);
+
+			uint32_t hit = UINT32_MAX;
+			float dist = 0.0f;
+			float expected = reference.Ray(center, direction, 500.0f);
+			bool found = bvh.RayCast(center, direction, 500.0f, hit, dist);
+			CHECK_EQUAL(expected != FLT_MAX, found);
+			if (found)
+			{
+				CHECK_NEAR(expected, dist, 1e-4);
+				CHECK(hit < reference.Alive.size() && reference.Alive[hit]);
+				CHECK_NEAR(expected, Reference::Enter(center, inv, reference.Min[hit], reference.Max[hit], 500.0f), 1e-4);
+			}
+		}
+	}
+
+	void RandomBox(mt19937& random, XMFLOAT3& center, XMFLOAT3& extents)
+	{
+		uniform_real_distribution<float> position(-150.0f, 150.0f);
+		uniform_real_distribution<float> size(0.1f, 3.0f);
+		center = XMFLOAT3(position(random), 0.2f*position(random), position(random));
+		extents = XMFLOAT3(size(random), size(random), size(random));
+	}
+
+	// Moves, removes and adds some of the items, as a frame of the engine would.
+	void Churn(Bvh& bvh, Reference& reference, mt19937& random, uint32_t changes)
+	{
+		uniform_int_distribution<uint32_t> pick(0, (uint32_t)reference.Alive.size() + 50);
+		uniform_int_distribution<int> action(0, 3);
+
+		for (uint32_t c = 0; c < changes; ++c)
+		{
+			uint32_t id = pick(random);
+			XMFLOAT3 center, extents;
+			RandomBox(random, center, extents);
+
+			if (action(random) == 0 && id < reference.Alive.size() && reference.Alive[id])
+				reference.Remove(bvh, id);
+			else
+				reference.Set(bvh, id, center, extents);
+		}
+	}
+}
+
+
+TEST(Bvh, QueriesMatchBruteForce)
+{
+	mt19937 random(42);
+	Bvh bvh;
+	Reference reference;
+
+	// Everything pending before the first build, then in the tree.
+	for (uint32_t id = 0; id < 3000; ++id)
+	{
+		XMFLOAT3 center, extents;
+		RandomBox(random, center, extents);
+		reference.Set(bvh, id, center, extents);
+	}
+	CheckQueries(bvh, reference, 1);
+
+	bvh.Rebuild();
+	CHECK_EQUAL(0, bvh.GetStats().PendingItems);
+	CHECK(bvh.GetStats().NodeCount > 1000);
+	CheckQueries(bvh, reference, 2);
+
+	// Refitted after moves and removals, with new items pending.
+	Churn(bvh, reference, random, 500);
+	CheckQueries(bvh, reference, 3);
+
+	// A removed item that is added again goes back into its old leaf.
+	reference.Remove(bvh, 7);
+	CheckQueries(bvh, reference, 4);
+	reference.Set(bvh, 7, XMFLOAT3(0.0f, 0.0f, 0.0f), XMFLOAT3(1.0f, 1.0f, 1.0f));
+	CheckQueries(bvh, reference, 5);
+
+	bvh.Rebuild();
+	CheckQueries(bvh, reference, 6);
+}
+
+TEST(Bvh, BackgroundRebuildKeepsChanges)
+{
+	mt19937 random(7);
+	Bvh bvh;
+	Reference reference;
+	for (uint32_t id = 0; id < 20000; ++id)
+	{
+		XMFLOAT3 center, extents;
+		RandomBox(random, center, extents);
+		reference.Set(bvh, id, center, extents);
+	}
+	bvh.Rebuild();
+
+	// A refit with the interval passed starts a rebuild from a snapshot.
+	bvh.SetRebuildInterval(1);
+	Churn(bvh, reference, random, 10);
+	bvh.Tick();
+
+	// Everything changed until the next Tick happens while it runs, whether the
+	// worker has finished or not, and is replayed onto the new tree.
+	for (int frame = 0; frame < 3; ++frame)
+	{
+		Churn(bvh, reference, random, 400);
+		CheckQueries(bvh, reference, 10 + frame);
+	}
+
+	uint32_t rebuilds = bvh.GetStats().Rebuilds;
+	for (int wait = 0; wait < 2000 && bvh.GetStats().Rebuilds == rebuilds; ++wait)
+	{
+		this_thread::sleep_for(chrono::milliseconds(1));
+		bvh.Tick();
+	}
+	CHECK_EQUAL(rebuilds + 1, bvh.GetStats().Rebuilds);
+	CheckQueries(bvh, reference, 20);
+
+	// Removals of items that were pending when the snapshot was taken are kept.
+	Churn(bvh, reference, random, 300);
+	bvh.Tick();
+	for (uint32_t id = 0; id < (uint32_t)reference.Alive.size(); id += 3)
+	{
+		if (reference.Alive[id])
+			reference.Remove(bvh, id);
+	}
+	CheckQueries(bvh, reference, 21);
+
+	bvh.Rebuild();
+	CheckQueries(bvh, reference, 22);
+}
+
+TEST(Bvh, QueriesVisitFewNodes)
+{
+	mt19937 random(3);
+	Bvh bvh;
+	Reference reference;
+	for (uint32_t id = 0; id < 100000; ++id)
+	{
+		XMFLOAT3 center, extents;
+		RandomBox(random, center, extents);
+		reference.Set(bvh, id, center, extents);
+	}
+	bvh.Rebuild();
+
+	// A small box finds its few items through a small part of the tree.
+	vector<uint32_t> ids;
+	bvh.QueryAabb(XMFLOAT3(10.0f, 0.0f, 10.0f), XMFLOAT3(2.0f, 2.0f, 2.0f), ids);
+	CHECK(Sorted(ids) == reference.Aabb(XMFLOAT3(10.0f, 0.0f, 10.0f), XMFLOAT3(2.0f, 2.0f, 2.0f)));
+	CHECK(bvh.GetStats().NodesVisited < bvh.GetStats().NodeCount / 100);
+}
+
+TEST(Bvh, Clear)
+{
+	Bvh bvh;
+	bvh.SetItem(3, XMFLOAT3(0.0f, 0.0f, 0.0f), XMFLOAT3(1.0f, 1.0f, 1.0f));
+	bvh.SetItem(5, XMFLOAT3(10.0f, 0.0f, 0.0f), XMFLOAT3(1.0f, 1.0f, 1.0f));
+	bvh.Rebuild();
+	bvh.SetItem(9, XMFLOAT3(20.0f, 0.0f, 0.0f), XMFLOAT3(1.0f, 1.0f, 1.0f));
+
+	bvh.Clear();
+	vector<uint32_t> ids;
+	bvh.QuerySphere(XMFLOAT3(0.0f, 0.0f, 0.0f), 100.0f, ids);
+	CHECK(ids.empty());
+
+	// The ids are free to be used again.
+	bvh.SetItem(5, XMFLOAT3(-10.0f, 0.0f, 0.0f), XMFLOAT3(1.0f, 1.0f, 1.0f));
+	bvh.Rebuild();
+	bvh.QuerySphere(XMFLOAT3(0.0f, 0.0f, 0.0f), 100.0f, ids);
+	CHECK(ids == vector<uint32_t>(1, 5));
+}
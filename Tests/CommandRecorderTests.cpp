@@ -0,0 +1,218 @@
+#include "Test.h"
+#include "CommandRecorder.h"
+
+using namespace std;
+
+namespace
+{
+	VertexBufferBinding VertexBuffer(uint64_t location)
+	{
+		VertexBufferBinding binding;
+		binding.BufferLocation = location;
+		binding.SizeInBytes = 1024;
+		binding.StrideInBytes = 32;
+		return binding;
+	}
+
+	IndexBufferBinding IndexBuffer(uint64_t location)
+	{
+		IndexBufferBinding binding;
+		binding.BufferLocation = location;
+		binding.SizeInBytes = 512;
+		binding.Format = 42;
+		return binding;
+	}
+
+	void Draw(CommandRecorder& recorder)
+	{
+		recorder.DrawIndexedInstanced(36, 1, 0, 0, 0);
+	}
+}
+
+
+TEST(CommandRecorder, ElidesRepeatedState)
+{
+	RecordingBackend backend;
+	CommandRecorder recorder(&backend);
+
+	int pso = 0;
+	VertexBufferBinding vertexBuffer = VertexBuffer(0x1000);
+	for (int i = 0; i < 3; ++i)
+	{
+		recorder.SetPipelineState(&pso);
+		recorder.SetVertexBuffers(0, 1, &vertexBuffer);
+		recorder.SetIndexBuffer(IndexBuffer(0x2000));
+		recorder.SetPrimitiveTopology(4);
+		recorder.SetRootDescriptorTable(0, 0x3000);
+		recorder.SetRootConstantBufferView(1, 0x4000);
+		recorder.SetRootShaderResourceView(2, 0x5000);
+		recorder.SetRoot32BitConstant(3, 7, 0);
+		Draw(recorder);
+	}
+
+	// Every state once, every draw three times.
+	const CommandType states[] =
+	{
+		CommandType::SetPipelineState, CommandType::SetVertexBuffers, CommandType::SetIndexBuffer,
+		CommandType::SetPrimitiveTopology, CommandType::SetRootDescriptorTable, CommandType::SetRootConstantBufferView,
+		CommandType::SetRootShaderResourceView, CommandType::SetRoot32BitConstant
+	};
+	for (CommandType type : states)
+	{
+		CHECK_EQUAL(1, backend.CountOf(type));
+		CHECK_EQUAL(1, recorder.GetStats().Emitted[(uint32_t)type]);
+		CHECK_EQUAL(2, recorder.GetStats().Elided[(uint32_t)type]);
+	}
+	CHECK_EQUAL(3, backend.CountOf(CommandType::DrawIndexedInstanced));
+	CHECK_EQUAL(11, backend.GetCommands().size());
+	CHECK_EQUAL(11, recorder.GetStats().TotalEmitted());
+	CHECK_EQUAL(16, recorder.GetStats().TotalElided());
+}
+
+TEST(CommandRecorder, EmitsChangedState)
+{
+	RecordingBackend backend;
+	CommandRecorder recorder(&backend);
+
+	int psos[2];
+	recorder.SetPipelineState(&psos[0]);
+	recorder.SetPipelineState(&psos[1]);
+	recorder.SetPipelineState(&psos[1]);
+	CHECK_EQUAL(2, backend.CountOf(CommandType::SetPipelineState));
+
+	// A vertex buffer change in any slot of the range emits the whole range.
+	VertexBufferBinding views[2] = { VertexBuffer(0x1000), VertexBuffer(0x1100) };
+	recorder.SetVertexBuffers(0, 2, views);
+	recorder.SetVertexBuffers(0, 2, views);
+	views[1].SizeInBytes = 2048;
+	recorder.SetVertexBuffers(0, 2, views);
+	recorder.SetVertexBuffers(1, 1, &views[1]);
+	CHECK_EQUAL(2, backend.CountOf(CommandType::SetVertexBuffers));
+
+	// An index buffer differing only in format is another binding.
+	IndexBufferBinding indexBuffer = IndexBuffer(0x2000);
+	recorder.SetIndexBuffer(indexBuffer);
+	indexBuffer.Format = 57;
+	recorder.SetIndexBuffer(indexBuffer);
+	recorder.SetIndexBuffer(indexBuffer);
+	CHECK_EQUAL(2, backend.CountOf(CommandType::SetIndexBuffer));
+
+	recorder.SetPrimitiveTopology(4);
+	recorder.SetPrimitiveTopology(5);
+	recorder.SetPrimitiveTopology(4);
+	CHECK_EQUAL(3, backend.CountOf(CommandType::SetPrimitiveTopology));
+
+	// Root parameters are tracked per index.
+	recorder.SetRootConstantBufferView(0, 0x4000);
+	recorder.SetRootConstantBufferView(1, 0x4000);
+	recorder.SetRootConstantBufferView(0, 0x4000);
+	recorder.SetRootConstantBufferView(0, 0x4100);
+	CHECK_EQUAL(3, backend.CountOf(CommandType::SetRootConstantBufferView));
+
+	recorder.SetRootShaderResourceView(2, 0x5000);
+	recorder.SetRootShaderResourceView(2, 0x5100);
+	recorder.SetRootShaderResourceView(3, 0x5100);
+	recorder.SetRootShaderResourceView(2, 0x5100);
+	CHECK_EQUAL(3, backend.CountOf(CommandType::SetRootShaderResourceView));
+
+	// Root constants per index and offset, and a zero is bound like any value.
+	recorder.SetRoot32BitConstant(3, 0, 0);
+	recorder.SetRoot32BitConstant(3, 0, 1);
+	recorder.SetRoot32BitConstant(3, 0, 0);
+	recorder.SetRoot32BitConstant(3, 1, 0);
+	CHECK_EQUAL(3, backend.CountOf(CommandType::SetRoot32BitConstant));
+
+	// Draws are never dropped.
+	Draw(recorder);
+	Draw(recorder);
+	CHECK_EQUAL(2, backend.CountOf(CommandType::DrawIndexedInstanced));
+
+	const RecordingBackend::Command& last = backend.GetCommands().back();
+	CHECK(last.Type == CommandType::DrawIndexedInstanced);
+	CHECK_EQUAL(36, last.Args[0]);
+	CHECK_EQUAL(1, last.Args[1]);
+}
+
+TEST(CommandRecorder, BeginForgetsBoundState)
+{
+	RecordingBackend backend;
+	CommandRecorder recorder(&backend);
+
+	int pso = 0;
+	VertexBufferBinding vertexBuffer = VertexBuffer(0x1000);
+	auto record = [&]()
+	{
+		recorder.SetPipelineState(&pso);
+		recorder.SetVertexBuffers(0, 1, &vertexBuffer);
+		recorder.SetIndexBuffer(IndexBuffer(0x2000));
+		recorder.SetPrimitiveTopology(4);
+		recorder.SetRootDescriptorTable(0, 0x3000);
+		recorder.SetRootConstantBufferView(1, 0x4000);
+		recorder.SetRootShaderResourceView(2, 0x5000);
+		recorder.SetRoot32BitConstant(3, 7, 0);
+		Draw(recorder);
+	};
+
+	record();
+	vector<RecordingBackend::Command> first = backend.GetCommands();
+	CHECK_EQUAL(9, first.size());
+
+	// After Begin, as after a command list reset, the same state is set again in
+	// full, and the statistics start over.
+	backend.Clear();
+	recorder.Begin();
+	CHECK_EQUAL(0, recorder.GetStats().TotalEmitted());
+	CHECK_EQUAL(0, recorder.GetStats().TotalElided());
+
+	record();
+	CHECK(backend.GetCommands() == first);
+	CHECK_EQUAL(9, recorder.GetStats().TotalEmitted());
+	CHECK_EQUAL(0, recorder.GetStats().TotalElided());
+}
+
+TEST(CommandRecorder, ExecuteIndirectForgetsRootConstants)
+{
+	RecordingBackend backend;
+	CommandRecorder recorder(&backend);
+
+	int pso = 0;
+	int signature = 0;
+	int arguments = 0;
+	VertexBufferBinding vertexBuffer = VertexBuffer(0x1000);
+
+	recorder.SetPipelineState(&pso);
+	recorder.SetVertexBuffers(0, 1, &vertexBuffer);
+	recorder.SetRootConstantBufferView(1, 0x4000);
+	recorder.SetRoot32BitConstant(3, 7, 0);
+	recorder.SetRoot32BitConstant(3, 8, 1);
+	recorder.ExecuteIndirect(&signature, 16, &arguments, 256);
+
+	backend.Clear();
+
+	// The commands may have set the root constants, so they are emitted again;
+	// the rest of the state stays known.
+	recorder.SetPipelineState(&pso);
+	recorder.SetVertexBuffers(0, 1, &vertexBuffer);
+	recorder.SetRootConstantBufferView(1, 0x4000);
+	recorder.SetRoot32BitConstant(3, 7, 0);
+	recorder.SetRoot32BitConstant(3, 8, 1);
+	recorder.SetRoot32BitConstant(3, 8, 1);
+
+	CHECK_EQUAL(2, backend.GetCommands().size());
+	CHECK_EQUAL(2, backend.CountOf(CommandType::SetRoot32BitConstant));
+	CHECK_EQUAL(0, backend.CountOf(CommandType::SetPipelineState));
+	CHECK_EQUAL(0, backend.CountOf(CommandType::SetVertexBuffers));
+	CHECK_EQUAL(0, backend.CountOf(CommandType::SetRootConstantBufferView));
+
+	// Executes themselves are never dropped, and are forwarded as given.
+	recorder.ExecuteIndirect(&signature, 16, &arguments, 256);
+	recorder.ExecuteIndirect(&signature, 16, &arguments, 256);
+	CHECK_EQUAL(2, backend.CountOf(CommandType::ExecuteIndirect));
+	CHECK_EQUAL(3, recorder.GetStats().Emitted[(uint32_t)CommandType::ExecuteIndirect]);
+
+	const RecordingBackend::Command& last = backend.GetCommands().back();
+	CHECK_EQUAL((uintptr_t)&signature, last.Args[0]);
+	CHECK_EQUAL(16, last.Args[1]);
+	CHECK_EQUAL((uintptr_t)&arguments, last.Args[2]);
+	CHECK_EQUAL(256, last.Args[3]);
+}
@@ -0,0 +1,197 @@
+#include "Test.h"
+#include "CameraDynamic.h"
+#include "FrustumCulling.h"
+#include <algorithm>
+#include <cfloat>
+#include <random>
+
+using namespace DirectX;
+using namespace std;
+
+namespace
+{
+	// The planes of a camera at (10, 5, -20) turned a little, so none of them is
+	// axis aligned.
+	void CameraPlanes(XMFLOAT4 planes[6])
+	{
+		Camera camera;
+		camera.SetFrustum(XM_PIDIV4, 16.0f / 9.0f, 1.0f, 200.0f);
+		camera.SetPosition(10.0f, 5.0f, -20.0f);
+		camera.Yaw(0.3f);
+		camera.Pitch(-0.1f);
+		camera.UpdateViewMatrix();
+		camera.GetFrustumPlanes(planes);
+	}
+
+	// Box against planes, written out once more independently of FrustumCuller.
+	// Returns the smallest signed margin over the planes; negative is culled.
+	float Margin(const XMFLOAT4 planes[6], const XMFLOAT3& center, const XMFLOAT3& extents)
+	{
+		float margin = FLT_MAX;
+		for (int p = 0; p < 6; ++p)
+		{
+			const XMFLOAT4& n = planes[p];
+			float distance = n.x*center.x + n.y*center.y + n.z*center.z + n.w;
+			float radius = fabsf(n.x)*extents.x + fabsf(n.y)*extents.y + fabsf(n.z)*extents.z;
+			margin = min(margin, distance + radius);
+		}
+
+		return margin;
+	}
+
+	// Random boxes around the frustum, none of them within a millimeter of
+	// touching a plane, so the SIMD and scalar sums cannot round differently.
+	void RandomBoxes(const XMFLOAT4 planes[6], uint32_t count, uint32_t seed, BoundsSoA& bounds, vector<uint32_t>& expected)
+	{
+		mt19937 random(seed);
+		uniform_real_distribution<float> position(-150.0f, 150.0f);
+		uniform_real_distribution<float> size(0.1f, 8.0f);
+
+		bounds = BoundsSoA();
+		expected.clear();
+		while (bounds.CenterX.size() < count)
+		{
+			XMFLOAT3 center(10.0f + position(random), 5.0f + position(random) * 0.5f, 80.0f + position(random));
+			XMFLOAT3 extents(size(random), size(random), size(random));
+
+			float margin = Margin(planes, center, extents);
+			if (fabsf(margin) < 1e-3f)
+				continue;
+
+			if (margin >= 0.0f)
+				expected.push_back((uint32_t)bounds.CenterX.size());
+
+			bounds.CenterX.push_back(center.x);
+			bounds.CenterY.push_back(center.y);
+			bounds.CenterZ.push_back(center.z);
+			bounds.ExtentX.push_back(extents.x);
+			bounds.ExtentY.push_back(extents.y);
+			bounds.ExtentZ.push_back(extents.z);
+		}
+	}
+}
+
+
+TEST(FrustumCulling, MatchesScalarReference)
+{
+	XMFLOAT4 planes[6];
+	CameraPlanes(planes);
+
+	FrustumCuller culler;
+	culler.SetPlanes(planes);
+
+	// Counts below, at and between the 4 and 8 wide loops, so every item ends up
+	// in the AVX loop, the SSE loop or the scalar tail.
+	const uint32_t counts[] = { 0, 1, 3, 4, 5, 7, 8, 9, 11, 12, 13, 15, 16, 17, 23, 1000, 1003, 4101 };
+	for (uint32_t count : counts)
+	{
+		BoundsSoA bounds;
+		vector<uint32_t> expected;
+		RandomBoxes(planes, count, count + 1, bounds, expected);
+
+		vector<uint32_t> visible(3, 12345);
+		culler.Cull(bounds, count, visible);
+
+		CHECK(visible == expected);
+		CHECK_EQUAL(count, culler.GetStats().Tested);
+		CHECK_EQUAL(expected.size(), culler.GetStats().Visible);
+
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			XMFLOAT3 center(bounds.CenterX[i], bounds.CenterY[i], bounds.CenterZ[i]);
+			XMFLOAT3 extents(bounds.ExtentX[i], bounds.ExtentY[i], bounds.ExtentZ[i]);
+			CHECK_EQUAL(Margin(planes, center, extents) >= 0.0f, culler.IsVisible(center, extents));
+		}
+	}
+}
+
+TEST(FrustumCulling, CullsOnlyTheFirstCountItems)
+{
+	XMFLOAT4 planes[6];
+	CameraPlanes(planes);
+
+	BoundsSoA bounds;
+	vector<uint32_t> expected;
+	RandomBoxes(planes, 64, 7, bounds, expected);
+
+	FrustumCuller culler;
+	culler.SetPlanes(planes);
+
+	// The arrays hold more items than are culled, as SceneStore's do after removals.
+	vector<uint32_t> visible;
+	culler.Cull(bounds, 29, visible);
+
+	vector<uint32_t> expectedPrefix;
+	for (uint32_t index : expected)
+	{
+		if (index < 29)
+			expectedPrefix.push_back(index);
+	}
+
+	CHECK(visible == expectedPrefix);
+}
+
+TEST(FrustumCulling, CameraPlanes)
+{
+	// Camera at the origin looking down +z.
+	Camera camera;
+	camera.SetFrustum(XM_PIDIV2, 1.0f, 1.0f, 100.0f);
+	camera.SetPosition(0.0f, 0.0f, 0.0f);
+	camera.UpdateViewMatrix();
+
+	XMFLOAT4 planes[6];
+	camera.GetFrustumPlanes(planes);
+
+	// Normalized, with the normals pointing inside: the center of the view volume
+	// is at a positive distance from every plane.
+	for (int p = 0; p < 6; ++p)
+	{
+		CHECK_NEAR(1.0f, sqrtf(planes[p].x*planes[p].x + planes[p].y*planes[p].y + planes[p].z*planes[p].z), 1e-4f);
+		CHECK(planes[p].x*0.0f + planes[p].y*0.0f + planes[p].z*50.0f + planes[p].w > 0.0f);
+	}
+
+	// Near and far planes at z = 1 and z = 100.
+	CHECK_NEAR(1.0f, planes[4].z, 1e-4f);
+	CHECK_NEAR(-1.0f, planes[4].w, 1e-3f);
+	CHECK_NEAR(-1.0f, planes[5].z, 1e-4f);
+	CHECK_NEAR(100.0f, planes[5].w, 1e-2f);
+
+	FrustumCuller culler;
+	culler.SetPlanes(planes);
+
+	const XMFLOAT3 unit(0.5f, 0.5f, 0.5f);
+	CHECK(culler.IsVisible(XMFLOAT3(0.0f, 0.0f, 10.0f), unit));
+	CHECK(!culler.IsVisible(XMFLOAT3(0.0f, 0.0f, -10.0f), unit));
+	CHECK(!culler.IsVisible(XMFLOAT3(0.0f, 0.0f, 110.0f), unit));
+	CHECK(culler.IsVisible(XMFLOAT3(0.0f, 0.0f, 100.2f), unit));
+
+	// With a 90 degree field of view the side planes are x = +-z and y = +-z.
+	CHECK(!culler.IsVisible(XMFLOAT3(-12.0f, 0.0f, 10.0f), unit));
+	CHECK(culler.IsVisible(XMFLOAT3(-10.6f, 0.0f, 10.0f), unit));
+	CHECK(!culler.IsVisible(XMFLOAT3(12.0f, 0.0f, 10.0f), unit));
+	CHECK(!culler.IsVisible(XMFLOAT3(0.0f, -12.0f, 10.0f), unit));
+	CHECK(!culler.IsVisible(XMFLOAT3(0.0f, 12.0f, 10.0f), unit));
+	CHECK(culler.IsVisible(XMFLOAT3(0.0f, 10.6f, 10.0f), unit));
+
+	// The same boxes through Cull, padded past 8 items to reach the vector loops.
+	BoundsSoA bounds;
+	const XMFLOAT3 centers[] =
+	{
+		{ 0.0f, 0.0f, 10.0f }, { 0.0f, 0.0f, -10.0f }, { 0.0f, 0.0f, 110.0f }, { 0.0f, 0.0f, 100.2f },
+		{ -12.0f, 0.0f, 10.0f }, { -10.6f, 0.0f, 10.0f }, { 12.0f, 0.0f, 10.0f }, { 0.0f, -12.0f, 10.0f },
+		{ 0.0f, 12.0f, 10.0f }, { 0.0f, 10.6f, 10.0f }
+	};
+	for (const XMFLOAT3& center : centers)
+	{
+		bounds.CenterX.push_back(center.x);
+		bounds.CenterY.push_back(center.y);
+		bounds.CenterZ.push_back(center.z);
+		bounds.ExtentX.push_back(unit.x);
+		bounds.ExtentY.push_back(unit.y);
+		bounds.ExtentZ.push_back(unit.z);
+	}
+
+	vector<uint32_t> visible;
+	culler.Cull(bounds, (uint32_t)bounds.CenterX.size(), visible);
+	CHECK(visible == vector<uint32_t>({ 0, 3, 5, 9 }));
+}
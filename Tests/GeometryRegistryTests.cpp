@@ -0,0 +1,56 @@
+#include "Test.h"
+#include "GeometryRegistry.h"
+
+using namespace std;
+
+namespace
+{
+	// Records without a mesh; the registry never looks inside them.
+	GeometryRecord MakeRecord(const char* name, uint64_t vertexBuffer)
+	{
+		GeometryRecord record;
+		if (name != nullptr)
+			record.Name = StringTable::Get().Intern(name);
+		record.VertexBuffer.BufferLocation = vertexBuffer;
+		return record;
+	}
+}
+
+
+TEST(GeometryRegistry, NamedAndAnonymous)
+{
+	GeometryRegistry registry;
+
+	uint32_t named = registry.Publish(MakeRecord("registryTestShapes", 1));
+	CHECK(named != GeometryRegistry::InvalidId);
+	CHECK_EQUAL(named, registry.Find(StringTable::Get().Intern("registryTestShapes")));
+
+	// A name is published once.
+	CHECK_EQUAL(GeometryRegistry::InvalidId, registry.Publish(MakeRecord("registryTestShapes", 2)));
+
+	// Anonymous records take no name and are only reachable by id, however many
+	// of them there are.
+	uint32_t first = registry.Publish(MakeRecord(nullptr, 3));
+	uint32_t second = registry.Publish(MakeRecord(nullptr, 4));
+	CHECK(first != GeometryRegistry::InvalidId && second != GeometryRegistry::InvalidId);
+	CHECK(first != second && first != named && second != named);
+	CHECK_EQUAL(3, registry.Get(first)->VertexBuffer.BufferLocation);
+	CHECK_EQUAL(4, registry.Get(second)->VertexBuffer.BufferLocation);
+	CHECK_EQUAL(GeometryRegistry::InvalidId, registry.Find(StringId()));
+	CHECK_EQUAL(3, registry.GetStats().Live);
+
+	// Released records disappear at once; their ids come back once the frame
+	// they were released in has completed.
+	registry.Release(first);
+	CHECK(registry.Get(first) == nullptr);
+	CHECK_EQUAL(named, registry.Find(StringTable::Get().Intern("registryTestShapes")));
+	registry.FinishFrame(1);
+	CHECK_EQUAL(1, registry.GetStats().Retired);
+	registry.Reclaim(1);
+	CHECK_EQUAL(0, registry.GetStats().Retired);
+
+	registry.Release(named);
+	CHECK_EQUAL(GeometryRegistry::InvalidId, registry.Find(StringTable::Get().Intern("registryTestShapes")));
+	CHECK(registry.Publish(MakeRecord("registryTestShapes", 5)) != GeometryRegistry::InvalidId);
+	CHECK_EQUAL(2, registry.GetStats().Live);
+}
@@ -0,0 +1,178 @@
+#include "Test.h"
+#include "IndirectDraws.h"
+#include <algorithm>
+#include <cstring>
+#include <random>
+
+using namespace DirectX;
+using namespace std;
+
+namespace
+{
+	// Items of 3 pipelines, 8 geometries and 2 topologies in random order, and the
+	// draw list sorted by that state as the render queue sorts it.
+	struct TestScene
+	{
+		vector<DrawKey> DrawKeys;
+		vector<XMFLOAT3X4> Worlds;
+		vector<XMFLOAT4> Colors;
+		vector<uint32_t> Items;
+	};
+
+	TestScene MakeScene(uint32_t count)
+	{
+		mt19937 random(77);
+		uniform_int_distribution<uint32_t> pick(0, 47);
+
+		TestScene scene;
+		scene.DrawKeys.resize(count);
+		scene.Worlds.resize(count);
+		scene.Colors.resize(count);
+		scene.Items.resize(count);
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			uint32_t state = pick(random);
+			DrawKey& key = scene.DrawKeys[i];
+			key.Pso = state % 3;
+			key.Geometry = (state / 3) % 8;
+			key.PrimitiveType = state / 24 ? 5 : 4;
+			key.IndexCount = 6 + 3 * (i % 5);
+			key.StartIndexLocation = 12 * key.Geometry;
+			key.BaseVertexLocation = -(int32_t)(i % 3);
+
+			XMStoreFloat3x4(&scene.Worlds[i], XMMatrixTranslation((float)i, 2.0f, -(float)i));
+			scene.Colors[i] = XMFLOAT4((float)i, 0.5f, 0.25f, 1.0f);
+			scene.Items[i] = i;
+		}
+
+		const vector<DrawKey>& keys = scene.DrawKeys;
+		stable_sort(scene.Items.begin(), scene.Items.end(), [&keys](uint32_t a, uint32_t b)
+		{
+			if (keys[a].Pso != keys[b].Pso)
+				return keys[a].Pso < keys[b].Pso;
+			if (keys[a].Geometry != keys[b].Geometry)
+				return keys[a].Geometry < keys[b].Geometry;
+			return keys[a].PrimitiveType < keys[b].PrimitiveType;
+		});
+
+		return scene;
+	}
+}
+
+
+TEST(IndirectDraws, ObjectDrawSignature)
+{
+	IndirectSignatureLayout layout = ObjectDrawSignature(0);
+
+	string error;
+	CHECK(layout.Validate(error));
+	CHECK_EQUAL(sizeof(IndirectCommand), layout.ByteStride);
+	CHECK_EQUAL(2, layout.Arguments.size());
+
+	// The offsets match the members of IndirectCommand.
+	CHECK_EQUAL(offsetof(IndirectCommand, ObjectIndex), layout.OffsetOf(0));
+	CHECK_EQUAL(offsetof(IndirectCommand, Draw), layout.OffsetOf(1));
+	CHECK_EQUAL(sizeof(IndirectCommand), layout.OffsetOf(2));
+
+	// Layouts D3D12 would reject.
+	IndirectSignatureLayout shortStride = layout;
+	shortStride.ByteStride = 20;
+	CHECK(!shortStride.Validate(error));
+
+	IndirectSignatureLayout unalignedStride = layout;
+	unalignedStride.ByteStride = 26;
+	CHECK(!unalignedStride.Validate(error));
+
+	IndirectSignatureLayout drawFirst = layout;
+	swap(drawFirst.Arguments[0], drawFirst.Arguments[1]);
+	CHECK(!drawFirst.Validate(error));
+
+	CHECK(!ObjectDrawSignature(CommandRecorder::MaxRootParameters).Validate(error));
+
+	IndirectSignatureLayout noDraw;
+	noDraw.ByteStride = 4;
+	CHECK(!noDraw.Validate(error));
+}
+
+TEST(IndirectDraws, PackSortedList)
+{
+	const uint32_t count = 10000;
+	TestScene scene = MakeScene(count);
+
+	vector<IndirectCommand> commands(count);
+	vector<IndirectDrawData> drawData(count);
+
+	IndirectDrawPacker packer;
+	packer.Pack(scene.Items, scene.DrawKeys.data(), scene.Worlds.data(), scene.Colors.data(), commands.data(), drawData.data());
+
+	CHECK_EQUAL(count, packer.GetStats().Commands);
+
+	// Command i draws item i of the list and reads data i.
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		const uint32_t item = scene.Items[i];
+		const DrawKey& key = scene.DrawKeys[item];
+
+		CHECK_EQUAL(i, commands[i].ObjectIndex);
+		CHECK_EQUAL(key.IndexCount, commands[i].Draw.IndexCountPerInstance);
+		CHECK_EQUAL(1, commands[i].Draw.InstanceCount);
+		CHECK_EQUAL(key.StartIndexLocation, commands[i].Draw.StartIndexLocation);
+		CHECK_EQUAL(key.BaseVertexLocation, commands[i].Draw.BaseVertexLocation);
+		CHECK_EQUAL(0, commands[i].Draw.StartInstanceLocation);
+		CHECK(memcmp(&drawData[i].World, &scene.Worlds[item], sizeof(XMFLOAT3X4)) == 0);
+		CHECK(memcmp(&drawData[i].Color, &scene.Colors[item], sizeof(XMFLOAT4)) == 0);
+	}
+
+	// One batch per distinct pipeline, geometry and topology of the sorted list,
+	// contiguous and covering all the commands.
+	const vector<IndirectBatch>& batches = packer.GetBatches();
+	CHECK_EQUAL(48, batches.size());
+	CHECK_EQUAL(batches.size(), packer.GetStats().Batches);
+
+	uint32_t next = 0;
+	for (const IndirectBatch& batch : batches)
+	{
+		CHECK_EQUAL(next, batch.FirstCommand);
+		CHECK(batch.CommandCount > 0);
+		for (uint32_t i = batch.FirstCommand; i < batch.FirstCommand + batch.CommandCount; ++i)
+		{
+			const DrawKey& key = scene.DrawKeys[scene.Items[i]];
+			CHECK(key.Pso == batch.Pso && key.Geometry == batch.Geometry && key.PrimitiveType == batch.PrimitiveType);
+		}
+		next = batch.FirstCommand + batch.CommandCount;
+	}
+	CHECK_EQUAL(count, next);
+}
+
+TEST(IndirectDraws, ReplayMatchesDirectRecording)
+{
+	const uint32_t count = 3000;
+	TestScene scene = MakeScene(count);
+
+	vector<IndirectCommand> commands(count);
+	vector<IndirectDrawData> drawData(count);
+
+	IndirectDrawPacker packer;
+	packer.Pack(scene.Items, scene.DrawKeys.data(), scene.Worlds.data(), scene.Colors.data(), commands.data(), drawData.data());
+
+	// Each batch replayed as its ExecuteIndirect would run it.
+	const IndirectSignatureLayout layout = ObjectDrawSignature(0);
+	RecordingBackend replayed;
+	CommandRecorder replay(&replayed);
+	for (const IndirectBatch& batch : packer.GetBatches())
+		ReplayIndirect(layout, commands.data() + batch.FirstCommand, batch.CommandCount, replay);
+
+	// The same draws recorded one by one, the object index as a root constant.
+	RecordingBackend direct;
+	CommandRecorder recorder(&direct);
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		const DrawKey& key = scene.DrawKeys[scene.Items[i]];
+		recorder.SetRoot32BitConstant(0, i, 0);
+		recorder.DrawIndexedInstanced(key.IndexCount, 1, key.StartIndexLocation, key.BaseVertexLocation, 0);
+	}
+
+	CHECK_EQUAL(2 * count, replayed.GetCommands().size());
+	CHECK_EQUAL(count, replayed.CountOf(CommandType::DrawIndexedInstanced));
+	CHECK(replayed.GetCommands() == direct.GetCommands());
+}
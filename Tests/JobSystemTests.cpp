@@ -0,0 +1,194 @@
+#include "Test.h"
+#include "JobSystem.h"
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <string>
+#include <thread>
+
+using namespace std;
+
+namespace
+{
+	// Spins, letting other threads run, until flag is set.
+	void WaitFor(const atomic<bool>& flag)
+	{
+		while (!flag.load())
+			this_thread::yield();
+	}
+}
+
+
+TEST(JobSystem, DependentJobsRunOnceAfterTheirCounter)
+{
+	JobSystem jobs(4);
+
+	// Jobs parked on a counter that is still running start once it is done,
+	// each of them once.
+	atomic<bool> release(false);
+	atomic<uint32_t> firstDone(0);
+	atomic<uint32_t> secondRuns(0);
+	atomic<bool> secondTooEarly(false);
+
+	JobCounter first, second;
+	for (int i = 0; i < 3; ++i)
+		jobs.Run("first", [&]() { WaitFor(release); firstDone++; }, &first);
+	for (int i = 0; i < 5; ++i)
+	{
+		jobs.Run("second", [&]()
+		{
+			if (firstDone.load() != 3)
+				secondTooEarly = true;
+			secondRuns++;
+		}, &second, &first);
+	}
+
+	this_thread::sleep_for(chrono::milliseconds(5));
+	CHECK_EQUAL(0, secondRuns.load());
+	CHECK(!second.IsDone());
+
+	release = true;
+	jobs.Wait(&second);
+	CHECK(first.IsDone());
+	CHECK_EQUAL(5, secondRuns.load());
+	CHECK(!secondTooEarly.load());
+
+	// A dependency that is already done does not hold the job back.
+	JobCounter third;
+	jobs.Run("third", [&]() { secondRuns++; }, &third, &first);
+	jobs.Wait(&third);
+	CHECK_EQUAL(6, secondRuns.load());
+}
+
+TEST(JobSystem, WaitReturnsAfterEveryJob)
+{
+	JobSystem jobs(4);
+
+	for (int round = 0; round < 20; ++round)
+	{
+		// Jobs of the counter queue more jobs on it while they run.
+		atomic<uint32_t> done(0);
+		JobCounter counter;
+		for (int i = 0; i < 50; ++i)
+		{
+			jobs.Run("outer", [&]()
+			{
+				for (int j = 0; j < 3; ++j)
+					jobs.Run("inner", [&]() { this_thread::yield(); done++; }, &counter);
+				done++;
+			}, &counter);
+		}
+
+		jobs.Wait(&counter);
+		CHECK(counter.IsDone());
+		CHECK_EQUAL(200, done.load());
+	}
+
+	// Waiting on a counter nothing was counted on returns at once.
+	JobCounter idle;
+	jobs.Wait(&idle);
+}
+
+TEST(JobSystem, ParallelForCoversTheRangeOnce)
+{
+	JobSystem jobs(4);
+
+	const uint32_t counts[] = { 0, 1, 7, 64, 1000, 12345 };
+	const uint32_t chunks[] = { 0, 1, 16, 1000, 100000 };
+	for (uint32_t count : counts)
+	{
+		for (uint32_t minChunk : chunks)
+		{
+			vector<atomic<uint32_t>> hits(count);
+			for (atomic<uint32_t>& hit : hits)
+				hit = 0;
+
+			atomic<bool> badRange(false);
+			jobs.ParallelFor("cover", count, minChunk, [&](uint32_t begin, uint32_t end)
+			{
+				if (begin >= end || end > count || (end - begin < minChunk && end != count))
+					badRange = true;
+				for (uint32_t i = begin; i < end; ++i)
+					hits[i]++;
+			});
+
+			CHECK(!badRange.load());
+			uint32_t once = 0;
+			for (const atomic<uint32_t>& hit : hits)
+				once += hit.load() == 1 ? 1 : 0;
+			CHECK_EQUAL(count, once);
+		}
+	}
+}
+
+TEST(JobSystem, NestedParallelFor)
+{
+	JobSystem jobs(4);
+
+	// From jobs and from inside the ranges of another ParallelFor.
+	atomic<uint64_t> sum(0);
+	JobCounter counter;
+	for (int j = 0; j < 4; ++j)
+	{
+		jobs.Run("outer", [&]()
+		{
+			jobs.ParallelFor("middle", 64, 1, [&](uint32_t begin, uint32_t end)
+			{
+				for (uint32_t i = begin; i < end; ++i)
+				{
+					jobs.ParallelFor("inner", 100, 8, [&](uint32_t innerBegin, uint32_t innerEnd)
+					{
+						uint64_t local = 0;
+						for (uint32_t k = innerBegin; k < innerEnd; ++k)
+							local += k;
+						sum += local;
+					});
+				}
+			});
+		}, &counter);
+	}
+
+	jobs.Wait(&counter);
+	CHECK_EQUAL(4ull * 64 * 4950, sum.load());
+}
+
+TEST(JobSystem, TraceOncePerJob)
+{
+	JobSystem jobs(4);
+
+	mutex traceMutex;
+	map<string, uint32_t> traced;
+	bool badEvent = false;
+	jobs.SetTraceCallback([&](const JobTraceEvent& event)
+	{
+		lock_guard<mutex> lock(traceMutex);
+		traced[event.Name]++;
+		badEvent = badEvent || event.Worker >= 4 || event.EndNs < event.StartNs;
+	});
+
+	vector<WorkerStats> stats;
+	jobs.SampleWorkerStats(stats);
+
+	JobCounter counter;
+	for (int i = 0; i < 100; ++i)
+		jobs.Run(i % 2 ? "odd" : "even", []() { this_thread::yield(); }, &counter);
+	jobs.Wait(&counter);
+
+	// Every job is traced once, whichever worker ran or stole it.
+	{
+		lock_guard<mutex> lock(traceMutex);
+		CHECK_EQUAL(2, traced.size());
+		CHECK_EQUAL(50, traced["odd"]);
+		CHECK_EQUAL(50, traced["even"]);
+		CHECK(!badEvent);
+	}
+
+	jobs.SampleWorkerStats(stats);
+	CHECK_EQUAL(4, stats.size());
+	uint32_t ran = 0;
+	for (const WorkerStats& worker : stats)
+		ran += worker.Jobs;
+	CHECK_EQUAL(100, ran);
+
+	jobs.SetTraceCallback(JobSystem::TraceFunc());
+}
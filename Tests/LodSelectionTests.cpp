@@ -0,0 +1,184 @@
+#include "Test.h"
+#include "LodSelection.h"
+#include <random>
+
+using namespace DirectX;
+using namespace std;
+
+namespace
+{
+	// Seen over 1000 pixels with a 90 degree field of view, an item with extents
+	// (1, 0, 0) at distance d is 1000/d pixels across.
+	const float kFovY = XM_PIDIV2;
+	const float kViewportHeight = 1000.0f;
+
+	// Three levels, drawn from 100 and 40 pixels across, and below.
+	LodGroup ThreeLevels()
+	{
+		LodGroup group;
+		group.LevelCount = 3;
+		group.MinScreenSize[0] = 100.0f;
+		group.MinScreenSize[1] = 40.0f;
+		for (uint32_t l = 0; l < group.LevelCount; ++l)
+			group.Levels[l].IndexCount = 300 / (l + 1);
+		return group;
+	}
+
+	void SetItem(BoundsSoA& bounds, uint32_t i, const XMFLOAT3& center, const XMFLOAT3& extents)
+	{
+		bounds.CenterX[i] = center.x;
+		bounds.CenterY[i] = center.y;
+		bounds.CenterZ[i] = center.z;
+		bounds.ExtentX[i] = extents.x;
+		bounds.ExtentY[i] = extents.y;
+		bounds.ExtentZ[i] = extents.z;
+	}
+
+	void Resize(BoundsSoA& bounds, uint32_t count)
+	{
+		bounds.CenterX.resize(count);
+		bounds.CenterY.resize(count);
+		bounds.CenterZ.resize(count);
+		bounds.ExtentX.resize(count);
+		bounds.ExtentY.resize(count);
+		bounds.ExtentZ.resize(count);
+	}
+
+	// Level of the single item at pixels across seen from the origin, after
+	// starting from level.
+	uint8_t LevelAt(LodSelector& selector, float pixels, uint8_t level)
+	{
+		BoundsSoA bounds;
+		Resize(bounds, 1);
+		SetItem(bounds, 0, XMFLOAT3(0.0f, 0.0f, 1000.0f / pixels), XMFLOAT3(1.0f, 0.0f, 0.0f));
+
+		uint32_t group = 0;
+		uint8_t before = level;
+		vector<uint32_t> changed;
+		selector.Select(bounds, &group, &level, 1, XMFLOAT3(0.0f, 0.0f, 0.0f), kFovY, kViewportHeight, changed);
+		CHECK_EQUAL(level != before ? 1 : 0, changed.size());
+		return level;
+	}
+}
+
+
+TEST(LodSelection, HysteresisHoldsTheLevelOnAThreshold)
+{
+	LodSelector selector;
+	selector.AddGroup(ThreeLevels());
+	selector.SetHysteresis(0.1f);
+
+	// Around 100 pixels, within the 10% margin, an item keeps whichever level it
+	// had, frame after frame.
+	const float jitter[] = { 100.0f, 95.0f, 104.0f, 91.0f, 109.0f, 100.0f };
+	uint8_t fine = 0, coarse = 1;
+	for (float pixels : jitter)
+	{
+		fine = LevelAt(selector, pixels, fine);
+		coarse = LevelAt(selector, pixels, coarse);
+		CHECK_EQUAL(0, fine);
+		CHECK_EQUAL(1, coarse);
+	}
+
+	// Past the margins it steps down and back up, one threshold at a time.
+	uint8_t level = 0;
+	level = LevelAt(selector, 89.0f, level);
+	CHECK_EQUAL(1, level);
+	level = LevelAt(selector, 100.0f, level);
+	CHECK_EQUAL(1, level);
+	level = LevelAt(selector, 37.0f, level);
+	CHECK_EQUAL(1, level);
+	level = LevelAt(selector, 35.0f, level);
+	CHECK_EQUAL(2, level);
+	level = LevelAt(selector, 43.0f, level);
+	CHECK_EQUAL(2, level);
+	level = LevelAt(selector, 45.0f, level);
+	CHECK_EQUAL(1, level);
+	level = LevelAt(selector, 111.0f, level);
+	CHECK_EQUAL(0, level);
+
+	// Large jumps cross several levels at once; the coarsest has no minimum.
+	CHECK_EQUAL(2, LevelAt(selector, 1.0f, 0));
+	CHECK_EQUAL(0, LevelAt(selector, 500.0f, 2));
+
+	// Without hysteresis the thresholds are exact.
+	selector.SetHysteresis(0.0f);
+	CHECK_EQUAL(1, LevelAt(selector, 99.0f, 0));
+	CHECK_EQUAL(0, LevelAt(selector, 101.0f, 1));
+}
+
+TEST(LodSelection, BiasScalesTheSize)
+{
+	LodSelector selector;
+	selector.AddGroup(ThreeLevels());
+
+	CHECK_EQUAL(1, LevelAt(selector, 60.0f, 1));
+
+	// Twice the bias draws the item as if it were 120 pixels across.
+	selector.SetBias(2.0f);
+	CHECK_NEAR(2.0f, selector.GetBias(), 0.0);
+	CHECK_EQUAL(0, LevelAt(selector, 60.0f, 1));
+
+	// A quarter of it as if it were 15.
+	selector.SetBias(0.25f);
+	CHECK_EQUAL(2, LevelAt(selector, 60.0f, 1));
+}
+
+TEST(LodSelection, FourWideAndTailAgree)
+{
+	LodSelector selector;
+	selector.AddGroup(ThreeLevels());
+	LodGroup two;
+	two.LevelCount = 2;
+	two.MinScreenSize[0] = 60.0f;
+	selector.AddGroup(two);
+
+	mt19937 random(11);
+	uniform_real_distribution<float> position(-60.0f, 60.0f);
+	uniform_real_distribution<float> extent(0.0f, 2.0f);
+	uniform_int_distribution<uint32_t> pick(0, 3);
+
+	for (uint32_t count = 1; count <= 19; ++count)
+	{
+		BoundsSoA bounds;
+		Resize(bounds, count);
+		vector<uint32_t> groups(count);
+		vector<uint8_t> levels(count);
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			SetItem(bounds, i, XMFLOAT3(position(random), position(random), position(random)), XMFLOAT3(extent(random), extent(random), extent(random)));
+			groups[i] = pick(random) == 3 ? LodSelector::NoGroup : pick(random) % 2;
+			levels[i] = (uint8_t)pick(random) % 3;
+		}
+
+		// One item placed on the eye, where the distance is clamped.
+		SetItem(bounds, count / 2, XMFLOAT3(1.0f, 2.0f, 3.0f), XMFLOAT3(1.0f, 1.0f, 1.0f));
+
+		vector<uint8_t> selected = levels;
+		vector<uint32_t> changed;
+		selector.Select(bounds, groups.data(), selected.data(), count, XMFLOAT3(1.0f, 2.0f, 3.0f), kFovY, kViewportHeight, changed);
+
+		// Every item alone goes through the scalar tail; the levels must match
+		// whichever path the item took in the full run.
+		vector<uint32_t> expectedChanged;
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			BoundsSoA one;
+			Resize(one, 1);
+			SetItem(one, 0, XMFLOAT3(bounds.CenterX[i], bounds.CenterY[i], bounds.CenterZ[i]),
+				XMFLOAT3(bounds.ExtentX[i], bounds.ExtentY[i], bounds.ExtentZ[i]));
+
+			uint8_t level = levels[i];
+			vector<uint32_t> oneChanged;
+			selector.Select(one, &groups[i], &level, 1, XMFLOAT3(1.0f, 2.0f, 3.0f), kFovY, kViewportHeight, oneChanged);
+
+			CHECK_EQUAL(level, selected[i]);
+			if (groups[i] == LodSelector::NoGroup)
+				CHECK_EQUAL(levels[i], selected[i]);
+			if (level != levels[i])
+				expectedChanged.push_back(i);
+		}
+
+		CHECK(changed == expectedChanged);
+	}
+}
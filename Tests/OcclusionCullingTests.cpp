@@ -0,0 +1,162 @@
+#include "Test.h"
+#include "CameraDynamic.h"
+#include "OcclusionCulling.h"
+#include <cstring>
+#include <random>
+
+using namespace DirectX;
+using namespace std;
+
+namespace
+{
+	// A camera at the origin looking down +z over a 256 x 128 buffer, 90 degrees
+	// high and 2:1 wide, so a point at depth z is on screen while |x| < 2z and |y| < z.
+	XMFLOAT4X4 ViewProj()
+	{
+		Camera camera;
+		camera.SetFrustum(XM_PIDIV2, 2.0f, 1.0f, 100.0f);
+		camera.UpdateViewMatrix();
+
+		XMFLOAT4X4 viewProj;
+		XMStoreFloat4x4(&viewProj, XMMatrixMultiply(camera.GetView(), camera.GetProj()));
+		return viewProj;
+	}
+
+	// The box from -1 to 1 on every axis, closed.
+	uint32_t AddCube(OcclusionCuller& culler)
+	{
+		vector<XMFLOAT3> positions;
+		for (int i = 0; i < 8; ++i)
+			positions.push_back(XMFLOAT3((i & 1) ? 1.0f : -1.0f, (i & 2) ? 1.0f : -1.0f, (i & 4) ? 1.0f : -1.0f));
+
+		const uint32_t faces[6][4] = { { 0, 2, 3, 1 }, { 4, 5, 7, 6 }, { 0, 1, 5, 4 }, { 2, 6, 7, 3 }, { 0, 4, 6, 2 }, { 1, 3, 7, 5 } };
+		vector<uint32_t> indices;
+		for (const uint32_t* face : faces)
+		{
+			const uint32_t corners[6] = { face[0], face[1], face[2], face[0], face[2], face[3] };
+			indices.insert(indices.end(), corners, corners + 6);
+		}
+
+		return culler.AddOccluderMesh(positions, indices);
+	}
+
+	void AddBox(OcclusionCuller& culler, uint32_t cube, const XMFLOAT3& center, const XMFLOAT3& extents, float yaw = 0.0f)
+	{
+		XMFLOAT3X4 world;
+		XMStoreFloat3x4(&world, XMMatrixMultiply(XMMatrixMultiply(XMMatrixScaling(extents.x, extents.y, extents.z), XMMatrixRotationY(yaw)),
+			XMMatrixTranslation(center.x, center.y, center.z)));
+		culler.AddOccluder(cube, world);
+	}
+
+	// Random boxes of all sizes and turns in front of the camera, some partly off
+	// screen, some crossing the near plane.
+	void AddRandomBoxes(OcclusionCuller& culler, uint32_t cube, uint32_t count, uint32_t seed)
+	{
+		mt19937 random(seed);
+		uniform_real_distribution<float> unit(0.0f, 1.0f);
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			float z = 0.5f + 60.0f*unit(random);
+			XMFLOAT3 center((unit(random) - 0.5f)*5.0f*z, (unit(random) - 0.5f)*2.5f*z, z);
+			XMFLOAT3 extents(0.1f + 6.0f*unit(random), 0.1f + 4.0f*unit(random), 0.1f + 2.0f*unit(random));
+			AddBox(culler, cube, center, extents, XM_2PI*unit(random));
+		}
+	}
+}
+
+
+TEST(OcclusionCulling, Avx2MatchesScalar)
+{
+	OcclusionCuller avx2;
+	OcclusionCuller scalar;
+	scalar.SetUseAvx2(false);
+	CHECK(!scalar.GetUseAvx2());
+
+	uint32_t avx2Cube = AddCube(avx2);
+	uint32_t scalarCube = AddCube(scalar);
+
+	for (uint32_t seed = 1; seed <= 8; ++seed)
+	{
+		avx2.BeginFrame(ViewProj());
+		scalar.BeginFrame(ViewProj());
+		AddRandomBoxes(avx2, avx2Cube, 40, seed);
+		AddRandomBoxes(scalar, scalarCube, 40, seed);
+		avx2.RasterizeOccluders();
+		scalar.RasterizeOccluders();
+
+		// The same pixels written with the same depths, bit for bit.
+		const size_t bytes = avx2.GetWidth()*avx2.GetHeight()*sizeof(float);
+		CHECK(avx2.GetStats().Triangles > 0);
+		CHECK_EQUAL(avx2.GetStats().Triangles, scalar.GetStats().Triangles);
+		CHECK(memcmp(avx2.GetDepthBuffer(), scalar.GetDepthBuffer(), bytes) == 0);
+	}
+}
+
+TEST(OcclusionCulling, WallHidesWhatIsBehindIt)
+{
+	OcclusionCuller culler;
+	uint32_t cube = AddCube(culler);
+
+	// A wall 16 m wide and 8 m high, 10 m ahead.
+	culler.BeginFrame(ViewProj());
+	AddBox(culler, cube, XMFLOAT3(0.0f, 0.0f, 10.0f), XMFLOAT3(8.0f, 4.0f, 0.25f));
+	culler.RasterizeOccluders();
+
+	// Behind it, straight back and toward a corner.
+	CHECK(culler.IsOccluded(XMFLOAT3(0.0f, 0.0f, 20.0f), XMFLOAT3(1.0f, 1.0f, 1.0f)));
+	CHECK(culler.IsOccluded(XMFLOAT3(-6.0f, 3.0f, 14.0f), XMFLOAT3(1.0f, 1.0f, 1.0f)));
+
+	// Beside it, above it, straddling its edge, in front of it and passing through it.
+	CHECK(!culler.IsOccluded(XMFLOAT3(30.0f, 0.0f, 20.0f), XMFLOAT3(1.0f, 1.0f, 1.0f)));
+	CHECK(!culler.IsOccluded(XMFLOAT3(0.0f, 12.0f, 20.0f), XMFLOAT3(1.0f, 1.0f, 1.0f)));
+	CHECK(!culler.IsOccluded(XMFLOAT3(16.0f, 0.0f, 20.0f), XMFLOAT3(1.0f, 1.0f, 1.0f)));
+	CHECK(!culler.IsOccluded(XMFLOAT3(0.0f, 0.0f, 5.0f), XMFLOAT3(1.0f, 1.0f, 1.0f)));
+	CHECK(!culler.IsOccluded(XMFLOAT3(0.0f, 0.0f, 10.0f), XMFLOAT3(1.0f, 1.0f, 3.0f)));
+
+	// Boxes around the eye are never occluded.
+	CHECK(!culler.IsOccluded(XMFLOAT3(0.0f, 0.0f, 0.0f), XMFLOAT3(2.0f, 2.0f, 2.0f)));
+
+	// CullOccludees keeps the visible items in order.
+	BoundsSoA bounds;
+	const float boxes[4][3] = { { 0.0f, 0.0f, 20.0f }, { 30.0f, 0.0f, 20.0f }, { 2.0f, -2.0f, 40.0f }, { 0.0f, 0.0f, 5.0f } };
+	for (const float* box : boxes)
+	{
+		bounds.CenterX.push_back(box[0]);
+		bounds.CenterY.push_back(box[1]);
+		bounds.CenterZ.push_back(box[2]);
+		bounds.ExtentX.push_back(1.0f);
+		bounds.ExtentY.push_back(1.0f);
+		bounds.ExtentZ.push_back(1.0f);
+	}
+
+	vector<uint32_t> items = { 0, 1, 2, 3 };
+	culler.CullOccludees(bounds, items);
+	CHECK(items == vector<uint32_t>({ 1, 3 }));
+	CHECK_EQUAL(4, culler.GetStats().Tested);
+	CHECK_EQUAL(2, culler.GetStats().Occluded);
+}
+
+TEST(OcclusionCulling, OccludersNeverHideThemselves)
+{
+	for (int path = 0; path < 2; ++path)
+	{
+		OcclusionCuller culler;
+		culler.SetUseAvx2(path == 0);
+		uint32_t cube = AddCube(culler);
+
+		mt19937 random(17);
+		uniform_real_distribution<float> unit(0.0f, 1.0f);
+		for (int i = 0; i < 500; ++i)
+		{
+			// Unturned, so the world bounds are the box itself.
+			float z = 2.0f + 60.0f*unit(random);
+			XMFLOAT3 center((unit(random) - 0.5f)*5.0f*z, (unit(random) - 0.5f)*2.5f*z, z);
+			XMFLOAT3 extents(0.1f + 8.0f*unit(random), 0.1f + 6.0f*unit(random), 0.1f + 1.5f*unit(random));
+
+			culler.BeginFrame(ViewProj());
+			AddBox(culler, cube, center, extents);
+			culler.RasterizeOccluders();
+			CHECK(!culler.IsOccluded(center, extents));
+		}
+	}
+}
@@ -0,0 +1,219 @@
+#include "Test.h"
+#include "ParallelRecorder.h"
+#include <algorithm>
+#include <random>
+
+using namespace std;
+
+namespace
+{
+	struct TestDraw
+	{
+		uint32_t Pso;
+		uint32_t Geometry;
+		uint32_t Topology;
+		uint32_t Slot;
+		uint32_t IndexCount;
+	};
+
+	const int g_psos[2] = {};
+
+	// Sorted draws, so consecutive ones share most of their state.
+	vector<TestDraw> MakeDraws(uint32_t count)
+	{
+		mt19937 random(99);
+		uniform_int_distribution<uint32_t> pick(0, 7);
+
+		vector<TestDraw> draws(count);
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			uint32_t key = (uint32_t)((uint64_t)i * 16 / max(1u, count));
+			draws[i].Pso = key / 8;
+			draws[i].Geometry = key % 4;
+			draws[i].Topology = (key / 4) % 2 ? 5 : 4;
+			draws[i].Slot = i;
+			draws[i].IndexCount = 36 + 3 * pick(random);
+		}
+		return draws;
+	}
+
+	// Records draws [begin, end) as the engine's DrawRenderItems does.
+	void RecordDraws(CommandRecorder& recorder, const vector<TestDraw>& draws, uint32_t begin, uint32_t end)
+	{
+		for (uint32_t i = begin; i < end; ++i)
+		{
+			const TestDraw& draw = draws[i];
+
+			VertexBufferBinding vertexBuffer;
+			vertexBuffer.BufferLocation = 0x10000 + draw.Geometry * 0x1000;
+			vertexBuffer.SizeInBytes = 0x1000;
+			vertexBuffer.StrideInBytes = 32;
+
+			recorder.SetPipelineState(&g_psos[draw.Pso]);
+			recorder.SetRootConstantBufferView(1, 0x80000);
+			recorder.SetVertexBuffers(0, 1, &vertexBuffer);
+			recorder.SetPrimitiveTopology(draw.Topology);
+			recorder.SetRoot32BitConstant(0, draw.Slot, 0);
+			recorder.DrawIndexedInstanced(draw.IndexCount, 1, 0, 0, 0);
+		}
+	}
+
+	// The state every draw of a stream runs with: the last command of every type
+	// before it, and the draw itself.
+	vector<vector<RecordingBackend::Command>> StateAtDraws(const vector<RecordingBackend::Command>& commands)
+	{
+		RecordingBackend::Command unset = { CommandType::Count, {} };
+		vector<RecordingBackend::Command> state((size_t)CommandType::Count, unset);
+
+		vector<vector<RecordingBackend::Command>> states;
+		for (const RecordingBackend::Command& command : commands)
+		{
+			state[(uint32_t)command.Type] = command;
+			if (command.Type == CommandType::DrawIndexedInstanced)
+				states.push_back(state);
+		}
+		return states;
+	}
+
+	vector<RecordingBackend::Command> RecordSingleThreaded(const vector<TestDraw>& draws)
+	{
+		RecordingBackend backend;
+		CommandRecorder recorder(&backend);
+		RecordDraws(recorder, draws, 0, (uint32_t)draws.size());
+		return backend.GetCommands();
+	}
+
+	// Records draws with parallel, one RecordingBackend per chunk, and returns the
+	// chunk streams in chunk order.
+	vector<vector<RecordingBackend::Command>> RecordParallel(ParallelRecorder& parallel, const vector<TestDraw>& draws, vector<uint8_t>& ended)
+	{
+		uint32_t chunks = (uint32_t)parallel.GetChunks().size();
+		vector<RecordingBackend> backends(chunks);
+		ended.assign(chunks, 0);
+
+		parallel.Record(
+			[&](uint32_t chunk) { return &backends[chunk]; },
+			[&](uint32_t, CommandRecorder& recorder, uint32_t begin, uint32_t end) { RecordDraws(recorder, draws, begin, end); },
+			[&](uint32_t chunk) { ended[chunk] = 1; });
+
+		vector<vector<RecordingBackend::Command>> streams;
+		for (const RecordingBackend& backend : backends)
+			streams.push_back(backend.GetCommands());
+		return streams;
+	}
+}
+
+
+TEST(ParallelRecorder, PlanCoversTheDraws)
+{
+	ParallelRecorder parallel;
+
+	// No draws still plan one empty chunk.
+	parallel.Plan(0, 8, 256);
+	CHECK_EQUAL(1, parallel.GetChunks().size());
+	CHECK_EQUAL(0, parallel.GetChunks()[0].Begin);
+	CHECK_EQUAL(0, parallel.GetChunks()[0].End);
+
+	// Fewer draws than minDraws stay in one chunk.
+	parallel.Plan(100, 8, 256);
+	CHECK_EQUAL(1, parallel.GetChunks().size());
+	CHECK_EQUAL(100, parallel.GetChunks()[0].End);
+
+	const uint32_t counts[] = { 256, 257, 511, 1000, 2048, 2049, 100000 };
+	for (uint32_t count : counts)
+	{
+		parallel.Plan(count, 8, 256);
+		const vector<RecordChunk>& chunks = parallel.GetChunks();
+		CHECK(chunks.size() >= 1 && chunks.size() <= 8);
+
+		// Contiguous, in order, covering [0, count), every chunk of at least minDraws.
+		uint32_t next = 0;
+		for (size_t c = 0; c < chunks.size(); ++c)
+		{
+			CHECK_EQUAL(next, chunks[c].Begin);
+			CHECK(chunks[c].End - chunks[c].Begin >= 256);
+			next = chunks[c].End;
+		}
+		CHECK_EQUAL(count, next);
+	}
+
+	parallel.Plan(511, 8, 256);
+	CHECK_EQUAL(1, parallel.GetChunks().size());
+	parallel.Plan(100000, 8, 256);
+	CHECK_EQUAL(8, parallel.GetChunks().size());
+
+	// More chunks than draws allowed leave none empty.
+	parallel.Plan(10, 8, 1);
+	CHECK_EQUAL(8, parallel.GetChunks().size());
+	for (const RecordChunk& chunk : parallel.GetChunks())
+		CHECK(chunk.End > chunk.Begin);
+}
+
+TEST(ParallelRecorder, ConcatenatedChunksMatchSingleThreaded)
+{
+	vector<TestDraw> draws = MakeDraws(5000);
+	vector<RecordingBackend::Command> single = RecordSingleThreaded(draws);
+
+	ParallelRecorder parallel;
+	parallel.Plan((uint32_t)draws.size(), 6, 256);
+	CHECK_EQUAL(6, parallel.GetChunks().size());
+
+	vector<uint8_t> ended;
+	vector<vector<RecordingBackend::Command>> streams = RecordParallel(parallel, draws, ended);
+
+	vector<RecordingBackend::Command> concatenated;
+	for (size_t c = 0; c < streams.size(); ++c)
+	{
+		CHECK(ended[c]);
+
+		// Each chunk is recorded as a fresh recorder alone would record it.
+		RecordingBackend alone;
+		CommandRecorder recorder(&alone);
+		RecordDraws(recorder, draws, parallel.GetChunks()[c].Begin, parallel.GetChunks()[c].End);
+		CHECK(streams[c] == alone.GetCommands());
+
+		concatenated.insert(concatenated.end(), streams[c].begin(), streams[c].end());
+	}
+
+	// The same draws in the same order with the same state; only the state set
+	// again at the start of every chunk is extra.
+	vector<vector<RecordingBackend::Command>> singleStates = StateAtDraws(single);
+	CHECK_EQUAL(draws.size(), singleStates.size());
+	CHECK(StateAtDraws(concatenated) == singleStates);
+	CHECK(concatenated.size() >= single.size());
+	CHECK(concatenated.size() <= single.size() + 4 * (streams.size() - 1));
+
+	// Statistics add up over the chunks.
+	CHECK_EQUAL(concatenated.size(), parallel.GetStats().TotalEmitted());
+	CHECK_EQUAL(draws.size(), parallel.GetStats().Emitted[(uint32_t)CommandType::DrawIndexedInstanced]);
+}
+
+TEST(ParallelRecorder, ChunksStartFromResetState)
+{
+	vector<TestDraw> draws = MakeDraws(3000);
+
+	ParallelRecorder parallel;
+	parallel.Plan((uint32_t)draws.size(), 4, 256);
+
+	vector<uint8_t> ended;
+	vector<vector<RecordingBackend::Command>> first = RecordParallel(parallel, draws, ended);
+
+	// The chunk recorders are kept from the last Record and still hold the state
+	// they bound; recording the same frame again must not elide any of it.
+	vector<vector<RecordingBackend::Command>> second = RecordParallel(parallel, draws, ended);
+	CHECK(first == second);
+
+	for (const vector<RecordingBackend::Command>& stream : second)
+	{
+		// The first draw of every chunk is preceded by all the state it needs.
+		uint32_t before = 0;
+		for (const RecordingBackend::Command& command : stream)
+		{
+			if (command.Type == CommandType::DrawIndexedInstanced)
+				break;
+			before++;
+		}
+		CHECK_EQUAL(5, before);
+		CHECK(stream[0].Type == CommandType::SetPipelineState);
+	}
+}
@@ -0,0 +1,104 @@
+#include "Test.h"
+#include "CameraDynamic.h"
+#include "PotentiallyVisibleSet.h"
+#include <algorithm>
+
+using namespace DirectX;
+using namespace std;
+
+namespace
+{
+	void AddBox(BoundsSoA& bounds, const XMFLOAT3& min, const XMFLOAT3& max)
+	{
+		bounds.CenterX.push_back(0.5f*(min.x + max.x));
+		bounds.CenterY.push_back(0.5f*(min.y + max.y));
+		bounds.CenterZ.push_back(0.5f*(min.z + max.z));
+		bounds.ExtentX.push_back(0.5f*(max.x - min.x));
+		bounds.ExtentY.push_back(0.5f*(max.y - min.y));
+		bounds.ExtentZ.push_back(0.5f*(max.z - min.z));
+	}
+
+	// Planes of a camera at position looking down +x, far enough to see everything.
+	void LookDownX(const XMFLOAT3& position, XMFLOAT4 planes[6])
+	{
+		Camera camera;
+		camera.SetFrustum(XM_PIDIV2, 1.0f, 0.1f, 1000.0f);
+		camera.SetPosition(position.x, position.y, position.z);
+		camera.Yaw(XM_PIDIV2);
+		camera.UpdateViewMatrix();
+		camera.GetFrustumPlanes(planes);
+	}
+
+	vector<uint32_t> Sorted(vector<uint32_t> items)
+	{
+		sort(items.begin(), items.end());
+		return items;
+	}
+}
+
+
+TEST(PotentiallyVisibleSet, WallHidesTheOtherSide)
+{
+	// A 20 x 4 x 4 m corridor cut in two by a wall at x = 10 reaching past the
+	// grid, a box on either side, and one far outside the grid.
+	BoundsSoA bounds;
+	AddBox(bounds, XMFLOAT3(9.8f, -1.0f, -1.0f), XMFLOAT3(10.2f, 5.0f, 5.0f));
+	AddBox(bounds, XMFLOAT3(2.5f, 1.5f, 1.5f), XMFLOAT3(3.5f, 2.5f, 2.5f));
+	AddBox(bounds, XMFLOAT3(16.5f, 1.5f, 1.5f), XMFLOAT3(17.5f, 2.5f, 2.5f));
+	AddBox(bounds, XMFLOAT3(49.5f, 1.5f, 1.5f), XMFLOAT3(50.5f, 2.5f, 2.5f));
+	AddBox(bounds, XMFLOAT3(4.5f, 1.5f, 1.5f), XMFLOAT3(5.5f, 2.5f, 2.5f));
+	const uint8_t occluders[] = { 1, 0, 0, 0, 0 };
+
+	PotentiallyVisibleSet pvs;
+	pvs.SetGrid(XMFLOAT3(0.0f, 0.0f, 0.0f), XMFLOAT3(20.0f, 4.0f, 4.0f), 2.0f);
+	pvs.SetSampling(2, 256);
+	pvs.Build(bounds, occluders, 4);
+	CHECK_EQUAL(40, pvs.GetCellCount());
+
+	// The item outside the grid is in the sets on both sides of the wall.
+	vector<uint32_t> set;
+	pvs.Decode(pvs.FindCell(XMFLOAT3(1.0f, 2.0f, 2.0f)), set);
+	CHECK(set == vector<uint32_t>({ 0, 1, 3 }));
+	pvs.Decode(pvs.FindCell(XMFLOAT3(19.0f, 2.0f, 2.0f)), set);
+	CHECK(set == vector<uint32_t>({ 0, 2, 3 }));
+
+	XMFLOAT4 planes[6];
+	LookDownX(XMFLOAT3(1.0f, 2.0f, 2.0f), planes);
+
+	vector<uint32_t> visible;
+	pvs.Cull(XMFLOAT3(1.0f, 2.0f, 2.0f), planes, bounds, 4, visible);
+	CHECK(Sorted(visible) == vector<uint32_t>({ 0, 1, 3 }));
+
+	// An item moved or replaced since Build is tested from every cell, and so is
+	// one added since.
+	pvs.Invalidate(2);
+	pvs.Cull(XMFLOAT3(1.0f, 2.0f, 2.0f), planes, bounds, 5, visible);
+	CHECK(Sorted(visible) == vector<uint32_t>({ 0, 1, 2, 3, 4 }));
+	CHECK_EQUAL(5, pvs.GetStats().Candidates);
+
+	// Items removed since Build are left out.
+	pvs.Cull(XMFLOAT3(1.0f, 2.0f, 2.0f), planes, bounds, 2, visible);
+	CHECK(Sorted(visible) == vector<uint32_t>({ 0, 1 }));
+
+	// Outside the grid the eye sees everything in the frustum.
+	LookDownX(XMFLOAT3(-5.0f, 2.0f, 2.0f), planes);
+	pvs.Cull(XMFLOAT3(-5.0f, 2.0f, 2.0f), planes, bounds, 4, visible);
+	CHECK(Sorted(visible) == vector<uint32_t>({ 0, 1, 2, 3 }));
+}
+
+TEST(PotentiallyVisibleSet, GridIsCapped)
+{
+	PotentiallyVisibleSet pvs;
+	pvs.SetGrid(XMFLOAT3(0.0f, 0.0f, 0.0f), XMFLOAT3(1000.0f, 50.0f, 1000.0f), 1.0f);
+	CHECK(pvs.GetCellCount() <= PotentiallyVisibleSet::MaxCells);
+	CHECK(pvs.GetCellSize() > 1.0f);
+
+	// Every corner of the box is still inside the grid.
+	CHECK(pvs.FindCell(XMFLOAT3(0.5f, 0.5f, 0.5f)) != UINT32_MAX);
+	CHECK(pvs.FindCell(XMFLOAT3(999.5f, 49.5f, 999.5f)) != UINT32_MAX);
+
+	// Grids within the cap keep their cell size.
+	pvs.SetGrid(XMFLOAT3(0.0f, 0.0f, 0.0f), XMFLOAT3(100.0f, 4.0f, 100.0f), 4.0f);
+	CHECK_EQUAL(25 * 1 * 25, pvs.GetCellCount());
+	CHECK_NEAR(4.0f, pvs.GetCellSize(), 0.0f);
+}
@@ -0,0 +1,116 @@
+#include "Test.h"
+#include "RingAllocator.h"
+
+using namespace std;
+
+
+// The fence is faked: FinishFrame takes the value a frame would signal and
+// Reclaim the value the GPU would have reached.
+
+TEST(RingAllocator, AlignsAndTracksFrames)
+{
+	RingAllocator ring(1024);
+	CHECK_EQUAL(0, ring.OldestFence());
+	CHECK_EQUAL(0, ring.GetUsed());
+
+	// Alignment padding counts as used.
+	CHECK_EQUAL(0, ring.Allocate(100, 1));
+	CHECK_EQUAL(112, ring.Allocate(50, 16));
+	CHECK_EQUAL(162, ring.GetUsed());
+	ring.FinishFrame(1);
+
+	CHECK_EQUAL(162, ring.Allocate(300, 1));
+	ring.FinishFrame(2);
+	CHECK_EQUAL(462, ring.Allocate(400, 1));
+	ring.FinishFrame(3);
+
+	CHECK_EQUAL(3, ring.GetFramesInFlight());
+	CHECK_EQUAL(1, ring.OldestFence());
+	CHECK_EQUAL(862, ring.GetUsed());
+
+	// Nothing fits that is larger than the ring or empty.
+	CHECK_EQUAL(RingAllocator::InvalidOffset, ring.Allocate(2048, 1));
+	CHECK_EQUAL(RingAllocator::InvalidOffset, ring.Allocate(0, 1));
+	CHECK_EQUAL(862, ring.GetUsed());
+}
+
+TEST(RingAllocator, ReclaimsInFenceOrder)
+{
+	RingAllocator ring(1024);
+	ring.Allocate(100, 1);
+	ring.FinishFrame(5);
+	ring.Allocate(200, 1);
+	ring.FinishFrame(6);
+	ring.Allocate(300, 1);
+	ring.FinishFrame(7);
+
+	// A fence before the oldest frame frees nothing.
+	ring.Reclaim(4);
+	CHECK_EQUAL(3, ring.GetFramesInFlight());
+	CHECK_EQUAL(600, ring.GetUsed());
+
+	// Only the frames up to the completed fence, oldest first.
+	ring.Reclaim(5);
+	CHECK_EQUAL(2, ring.GetFramesInFlight());
+	CHECK_EQUAL(6, ring.OldestFence());
+	CHECK_EQUAL(500, ring.GetUsed());
+
+	ring.Reclaim(6);
+	CHECK_EQUAL(7, ring.OldestFence());
+	CHECK_EQUAL(300, ring.GetUsed());
+
+	// Everything reclaimed starts over at 0 with the whole ring free.
+	ring.Reclaim(7);
+	CHECK_EQUAL(0, ring.OldestFence());
+	CHECK_EQUAL(0, ring.GetFramesInFlight());
+	CHECK_EQUAL(0, ring.GetUsed());
+	CHECK_EQUAL(0, ring.Allocate(1024, 1));
+	CHECK_EQUAL(1024, ring.GetUsed());
+}
+
+TEST(RingAllocator, WrapsAroundWithPadding)
+{
+	RingAllocator ring(1024);
+	ring.Allocate(200, 1);
+	ring.FinishFrame(1);
+	ring.Allocate(300, 1);
+	ring.FinishFrame(2);
+	ring.Allocate(400, 1);
+	ring.FinishFrame(3);
+
+	// 124 bytes left at the end and none at the start until frame 1 completes.
+	CHECK_EQUAL(RingAllocator::InvalidOffset, ring.Allocate(150, 1));
+	CHECK_EQUAL(900, ring.GetUsed());
+
+	ring.Reclaim(1);
+	CHECK_EQUAL(700, ring.GetUsed());
+
+	// Too large for the 200 bytes at the start either.
+	CHECK_EQUAL(RingAllocator::InvalidOffset, ring.Allocate(250, 1));
+	CHECK_EQUAL(700, ring.GetUsed());
+
+	// Skips the end of the buffer, which counts as used by this frame.
+	CHECK_EQUAL(0, ring.Allocate(150, 1));
+	CHECK_EQUAL(700 + 124 + 150, ring.GetUsed());
+
+	// Now the head is behind the tail: only [150, 200) is free.
+	CHECK_EQUAL(RingAllocator::InvalidOffset, ring.Allocate(60, 1));
+	CHECK_EQUAL(150, ring.Allocate(50, 1));
+	CHECK_EQUAL(1024, ring.GetUsed());
+	CHECK_EQUAL(RingAllocator::InvalidOffset, ring.Allocate(1, 1));
+	ring.FinishFrame(4);
+
+	// Frames 2 and 3 give back their bytes; frame 4 keeps its padding until it
+	// is reclaimed itself.
+	ring.Reclaim(3);
+	CHECK_EQUAL(4, ring.OldestFence());
+	CHECK_EQUAL(124 + 150 + 50, ring.GetUsed());
+	CHECK_EQUAL(200, ring.Allocate(700, 1));
+	CHECK_EQUAL(RingAllocator::InvalidOffset, ring.Allocate(1, 1));
+	ring.FinishFrame(5);
+
+	ring.Reclaim(4);
+	CHECK_EQUAL(700, ring.GetUsed());
+	ring.Reclaim(5);
+	CHECK_EQUAL(0, ring.GetUsed());
+}
@@ -0,0 +1,253 @@
+#include "Test.h"
+#include "SceneFile.h"
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+using namespace DirectX;
+using namespace std;
+
+namespace
+{
+	// Written next to the test binary, like the bench's scene.
+	const char* kPath = "SceneFileTest.scene";
+
+	// count items over three meshes, every fourth one a root and the others
+	// children of an earlier item.
+	SceneFileContents MakeContents(uint32_t count)
+	{
+		SceneFileContents contents;
+		AddSceneFileMesh(contents, "shapeGeo", "box");
+		AddSceneFileMesh(contents, "shapeGeo", "sphere");
+		AddSceneFileMesh(contents, "skullGeo", "skull");
+
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			XMFLOAT3X4 world;
+			XMStoreFloat3x4(&world, XMMatrixMultiply(XMMatrixScaling(1.0f + i % 3, 1.0f, 2.0f), XMMatrixTranslation(i*3.0f, 1.0f, -(float)i)));
+			contents.Worlds.push_back(world);
+			contents.LocalBounds.push_back(BoundingBox(XMFLOAT3(0.0f, 0.5f*i, 0.0f), XMFLOAT3(1.0f, 2.0f, 0.5f + i)));
+			contents.Colors.push_back(XMFLOAT4(i / (float)count, 0.5f, 0.25f, 1.0f));
+			contents.MeshIds.push_back(i % 3);
+			contents.MaterialIds.push_back(i % 5);
+			contents.Parents.push_back(i % 4 == 0 ? UINT32_MAX : i / 2);
+			contents.Flags.push_back(i % 2 ? SceneItemDynamic : 0);
+		}
+
+		return contents;
+	}
+
+	vector<char> ReadBytes(const char* path)
+	{
+		ifstream in(path, ios::binary);
+		return vector<char>(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+	}
+
+	// Writes bytes as the scene file and opens it.
+	bool Opens(const vector<char>& bytes)
+	{
+		{
+			ofstream out(kPath, ios::binary | ios::trunc);
+			out.write(bytes.data(), (streamsize)bytes.size());
+		}
+
+		SceneFile file;
+		bool opened = file.Open(kPath);
+		CHECK_EQUAL(opened ? 1 : 0, file.IsOpen() ? 1 : 0);
+		if (!opened)
+			CHECK_EQUAL(0, file.GetSize());
+		return opened;
+	}
+
+	SceneFileHeader GetHeader(const vector<char>& bytes)
+	{
+		SceneFileHeader header;
+		memcpy(&header, bytes.data(), sizeof(header));
+		return header;
+	}
+
+	void SetHeader(vector<char>& bytes, const SceneFileHeader& header)
+	{
+		memcpy(bytes.data(), &header, sizeof(header));
+	}
+
+	// The bytes of a valid file with a uint32_t array element patched.
+	vector<char> WithElement(const vector<char>& bytes, uint64_t offset, uint32_t index, uint32_t value)
+	{
+		vector<char> patched = bytes;
+		memcpy(patched.data() + offset + index*sizeof(uint32_t), &value, sizeof(value));
+		return patched;
+	}
+}
+
+
+TEST(SceneFile, RoundTripKeepsEveryArray)
+{
+	const uint32_t counts[] = { 0, 1, 37 };
+	for (uint32_t count : counts)
+	{
+		SceneFileContents contents = MakeContents(count);
+		CHECK(WriteSceneFile(kPath, contents));
+
+		SceneFile file;
+		CHECK(file.Open(kPath));
+		CHECK(file.IsOpen());
+		CHECK_EQUAL(count, file.GetItemCount());
+		CHECK_EQUAL(3, file.GetMeshCount());
+		CHECK_EQUAL(ReadBytes(kPath).size(), file.GetSize());
+
+		CHECK(memcmp(file.Meshes(), contents.Meshes.data(), 3*sizeof(SceneFileMesh)) == 0);
+		CHECK(strcmp(file.Meshes()[2].Geometry, "skullGeo") == 0);
+		CHECK(strcmp(file.Meshes()[1].Submesh, "sphere") == 0);
+		if (count > 0)
+		{
+			CHECK(memcmp(file.Worlds(), contents.Worlds.data(), count*sizeof(XMFLOAT3X4)) == 0);
+			CHECK(memcmp(file.LocalBounds(), contents.LocalBounds.data(), count*sizeof(BoundingBox)) == 0);
+			CHECK(memcmp(file.Colors(), contents.Colors.data(), count*sizeof(XMFLOAT4)) == 0);
+			CHECK(memcmp(file.MeshIds(), contents.MeshIds.data(), count*sizeof(uint32_t)) == 0);
+			CHECK(memcmp(file.MaterialIds(), contents.MaterialIds.data(), count*sizeof(uint32_t)) == 0);
+			CHECK(memcmp(file.Parents(), contents.Parents.data(), count*sizeof(uint32_t)) == 0);
+			CHECK(memcmp(file.Flags(), contents.Flags.data(), count*sizeof(uint32_t)) == 0);
+
+			// The world bounds are stored as computed from the local ones.
+			vector<float> worldBounds[6];
+			ComputeSceneWorldBounds(contents, worldBounds);
+			for (int c = 0; c < 6; ++c)
+				CHECK(memcmp(file.WorldBounds(c), worldBounds[c].data(), count*sizeof(float)) == 0);
+		}
+
+		// Every array starts on an alignment boundary of the mapping.
+		const void* arrays[] = { file.Meshes(), file.Worlds(), file.LocalBounds(), file.WorldBounds(0), file.WorldBounds(5),
+			file.Colors(), file.MeshIds(), file.MaterialIds(), file.Parents(), file.Flags() };
+		for (const void* array : arrays)
+			CHECK_EQUAL(0, (uintptr_t)array % SceneFileAlignment);
+
+		file.Close();
+		CHECK(!file.IsOpen());
+		CHECK_EQUAL(0, file.GetSize());
+	}
+
+	remove(kPath);
+}
+
+TEST(SceneFile, WriteRejectsBadNames)
+{
+	// Too long for the fixed size names, or empty.
+	SceneFileContents contents = MakeContents(4);
+	AddSceneFileMesh(contents, string(SceneFileNameLength, 'g'), "box");
+	CHECK(!WriteSceneFile(kPath, contents));
+
+	contents = MakeContents(4);
+	AddSceneFileMesh(contents, "shapeGeo", "");
+	CHECK(!WriteSceneFile(kPath, contents));
+
+	contents = MakeContents(4);
+	AddSceneFileMesh(contents, string(SceneFileNameLength - 1, 'g'), "box");
+	CHECK(WriteSceneFile(kPath, contents));
+
+	remove(kPath);
+}
+
+TEST(SceneFile, OpenRejectsDamagedFiles)
+{
+	CHECK(WriteSceneFile(kPath, MakeContents(20)));
+	const vector<char> valid = ReadBytes(kPath);
+	const SceneFileHeader header = GetHeader(valid);
+	CHECK(Opens(valid));
+
+	SceneFile missing;
+	CHECK(!missing.Open("NoSuchSceneFile.scene"));
+
+	// Truncated: empty, inside the header, and one byte short.
+	CHECK(!Opens(vector<char>()));
+	CHECK(!Opens(vector<char>(valid.begin(), valid.begin() + sizeof(SceneFileHeader) / 2)));
+	CHECK(!Opens(vector<char>(valid.begin(), valid.end() - 1)));
+
+	// A FileSize that is not the size of the file, either way.
+	vector<char> longer = valid;
+	longer.resize(valid.size() + SceneFileAlignment, 0);
+	CHECK(!Opens(longer));
+
+	vector<char> bytes = valid;
+	SceneFileHeader h = header;
+	h.FileSize -= SceneFileAlignment;
+	SetHeader(bytes, h);
+	CHECK(!Opens(bytes));
+
+	// Wrong magic or version.
+	h = header;
+	h.Magic++;
+	SetHeader(bytes, h);
+	CHECK(!Opens(bytes));
+
+	h = header;
+	h.Version++;
+	SetHeader(bytes, h);
+	CHECK(!Opens(bytes));
+
+	// Misaligned offsets, offsets into the header, past the end, and arrays that
+	// run past the end, including by wrapping around.
+	uint64_t SceneFileHeader::* offsets[] = { &SceneFileHeader::Meshes, &SceneFileHeader::Worlds, &SceneFileHeader::LocalBounds,
+		&SceneFileHeader::Colors, &SceneFileHeader::MeshIds, &SceneFileHeader::MaterialIds, &SceneFileHeader::Parents, &SceneFileHeader::Flags };
+	for (uint64_t SceneFileHeader::* offset : offsets)
+	{
+		const uint64_t bad[] = { header.*offset + 4, 0, header.FileSize, header.FileSize + SceneFileAlignment,
+			header.FileSize - SceneFileAlignment, ~(uint64_t)(SceneFileAlignment - 1) };
+		for (uint64_t value : bad)
+		{
+			h = header;
+			h.*offset = value;
+			SetHeader(bytes, h);
+			CHECK(!Opens(bytes));
+		}
+	}
+	for (int c = 0; c < 6; ++c)
+	{
+		h = header;
+		h.WorldBounds[c] += 4;
+		SetHeader(bytes, h);
+		CHECK(!Opens(bytes));
+
+		h = header;
+		h.WorldBounds[c] = header.FileSize;
+		SetHeader(bytes, h);
+		CHECK(!Opens(bytes));
+	}
+
+	// More items or meshes than the arrays hold.
+	h = header;
+	h.ItemCount = 0x7fffffff;
+	SetHeader(bytes, h);
+	CHECK(!Opens(bytes));
+
+	h = header;
+	h.MeshCount = 0x7fffffff;
+	SetHeader(bytes, h);
+	CHECK(!Opens(bytes));
+
+	// Mesh ids past the mesh table.
+	CHECK(Opens(WithElement(valid, header.MeshIds, 7, header.MeshCount - 1)));
+	CHECK(!Opens(WithElement(valid, header.MeshIds, 7, header.MeshCount)));
+	CHECK(!Opens(WithElement(valid, header.MeshIds, 19, UINT32_MAX)));
+
+	// Parents that are the item itself or come after it.
+	CHECK(Opens(WithElement(valid, header.Parents, 7, 6)));
+	CHECK(!Opens(WithElement(valid, header.Parents, 7, 7)));
+	CHECK(!Opens(WithElement(valid, header.Parents, 7, 8)));
+	CHECK(!Opens(WithElement(valid, header.Parents, 0, 19)));
+
+	// Names that fill their field without a terminating zero.
+	for (size_t field = 0; field < 2; ++field)
+	{
+		bytes = valid;
+		char* name = bytes.data() + header.Meshes + sizeof(SceneFileMesh) + field*SceneFileNameLength;
+		memset(name, 'n', SceneFileNameLength);
+		CHECK(!Opens(bytes));
+
+		name[SceneFileNameLength - 1] = 0;
+		CHECK(Opens(bytes));
+	}
+
+	remove(kPath);
+}
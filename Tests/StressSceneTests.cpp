@@ -0,0 +1,199 @@
+#include "Test.h"
+#include "StressScene.h"
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+
+using namespace DirectX;
+using namespace std;
+
+namespace
+{
+	StressSceneGenerator MakeGenerator(StressDistribution distribution)
+	{
+		StressSceneGenerator generator;
+		generator.AddMesh("shapeGeo", "box", BoundingBox(XMFLOAT3(0.0f, 0.0f, 0.0f), XMFLOAT3(0.5f, 0.5f, 0.5f)));
+		generator.AddMesh("shapeGeo", "cylinder", BoundingBox(XMFLOAT3(0.0f, 1.5f, 0.0f), XMFLOAT3(1.0f, 1.5f, 1.0f)));
+		generator.AddMesh("skullGeo", "skull", BoundingBox(XMFLOAT3(0.2f, 3.0f, -0.1f), XMFLOAT3(4.0f, 3.0f, 5.0f)));
+		generator.SetMaterialCount(5);
+		generator.SetDistribution(distribution);
+		generator.SetSpacing(3.0f);
+		generator.SetClusters(32, 10.0f);
+		generator.SetDynamicFraction(0.2f);
+		generator.SetHierarchyDepth(3);
+		return generator;
+	}
+
+	template<typename T>
+	bool SameBytes(const vector<T>& a, const vector<T>& b)
+	{
+		return a.size() == b.size() && (a.empty() || memcmp(a.data(), b.data(), a.size()*sizeof(T)) == 0);
+	}
+
+	bool SameScene(const SceneFileContents& a, const SceneFileContents& b)
+	{
+		return SameBytes(a.Meshes, b.Meshes) && SameBytes(a.Worlds, b.Worlds) && SameBytes(a.LocalBounds, b.LocalBounds) &&
+			SameBytes(a.Colors, b.Colors) && SameBytes(a.MeshIds, b.MeshIds) && SameBytes(a.MaterialIds, b.MaterialIds) &&
+			SameBytes(a.Parents, b.Parents) && SameBytes(a.Flags, b.Flags);
+	}
+
+	// Where an item stands on the ground: the translation of its world.
+	XMFLOAT2 GroundPosition(const SceneFileContents& scene, uint32_t item)
+	{
+		const XMFLOAT3X4& world = scene.Worlds[item];
+		return XMFLOAT2(world._14, world._34);
+	}
+}
+
+
+TEST(StressScene, SameSeedSameScene)
+{
+	const StressDistribution distributions[] = { StressDistribution::PoissonDisk, StressDistribution::Clustered };
+	for (StressDistribution distribution : distributions)
+	{
+		StressSceneGenerator generator = MakeGenerator(distribution);
+		SceneFileContents first, second, third, other;
+		generator.Generate(5000, 42, first);
+		generator.Generate(5000, 42, second);
+		CHECK_EQUAL(5000, first.Worlds.size());
+		CHECK(SameScene(first, second));
+
+		// From a generator of its own, after another scene.
+		StressSceneGenerator fresh = MakeGenerator(distribution);
+		fresh.Generate(100, 7, other);
+		fresh.Generate(5000, 42, third);
+		CHECK(SameScene(first, third));
+
+		// Another seed moves and colors every item differently.
+		generator.Generate(5000, 43, other);
+		CHECK_EQUAL(5000, other.Worlds.size());
+		CHECK(!SameScene(first, other));
+		CHECK(!SameBytes(first.Worlds, other.Worlds));
+		CHECK(!SameBytes(first.Colors, other.Colors));
+	}
+
+	// Other settings make another scene from the same seed.
+	StressSceneGenerator generator = MakeGenerator(StressDistribution::PoissonDisk);
+	SceneFileContents first, second;
+	generator.Generate(5000, 42, first);
+	generator.SetSpacing(3.5f);
+	generator.Generate(5000, 42, second);
+	CHECK(!SameBytes(first.Worlds, second.Worlds));
+}
+
+TEST(StressScene, PoissonDiskKeepsTheSpacing)
+{
+	StressSceneGenerator generator = MakeGenerator(StressDistribution::PoissonDisk);
+	generator.SetHierarchyDepth(1);
+
+	const float spacings[] = { 1.0f, 3.0f, 10.0f };
+	for (float spacing : spacings)
+	{
+		generator.SetSpacing(spacing);
+		SceneFileContents scene;
+		generator.Generate(3000, 5, scene);
+		CHECK_EQUAL(3000, generator.GetStats().Roots);
+		CHECK_EQUAL(3000, scene.Worlds.size());
+
+		// Every root on the ground square, and no two closer than the spacing.
+		float half = 0.5f*generator.GetStats().Extent;
+		uint32_t tooClose = 0, outside = 0;
+		float nearest = FLT_MAX;
+		for (uint32_t i = 0; i < 3000; ++i)
+		{
+			XMFLOAT2 a = GroundPosition(scene, i);
+			outside += fabsf(a.x) > half || fabsf(a.y) > half ? 1 : 0;
+			for (uint32_t j = i + 1; j < 3000; ++j)
+			{
+				XMFLOAT2 b = GroundPosition(scene, j);
+				float distance = sqrtf((a.x - b.x)*(a.x - b.x) + (a.y - b.y)*(a.y - b.y));
+				nearest = min(nearest, distance);
+				tooClose += distance < spacing*(1.0f - 1e-4f) ? 1 : 0;
+			}
+		}
+
+		CHECK_EQUAL(0, tooClose);
+		CHECK_EQUAL(0, outside);
+
+		// A fill, not a sparse scatter: some pairs come close to the spacing.
+		CHECK(nearest < 1.05f*spacing);
+	}
+}
+
+TEST(StressScene, DynamicFractionPerStack)
+{
+	const float fractions[] = { 0.0f, 0.1f, 0.5f, 1.0f };
+	for (float fraction : fractions)
+	{
+		StressSceneGenerator generator = MakeGenerator(StressDistribution::Clustered);
+		generator.SetDynamicFraction(fraction);
+		SceneFileContents scene;
+		generator.Generate(12000, 9, scene);
+
+		// Whole stacks are dynamic or static, the share of them as set.
+		uint32_t dynamicItems = 0, dynamicRoots = 0, roots = 0, mixed = 0;
+		for (uint32_t i = 0; i < 12000; ++i)
+		{
+			bool dynamic = (scene.Flags[i] & SceneItemDynamic) != 0;
+			dynamicItems += dynamic ? 1 : 0;
+			if (scene.Parents[i] == UINT32_MAX)
+			{
+				roots++;
+				dynamicRoots += dynamic ? 1 : 0;
+			}
+			else if (scene.Flags[i] != scene.Flags[scene.Parents[i]])
+			{
+				mixed++;
+			}
+		}
+
+		CHECK_EQUAL(4000, roots);
+		CHECK_EQUAL(0, mixed);
+		CHECK_EQUAL(dynamicItems, generator.GetStats().DynamicItems);
+		CHECK_NEAR(fraction, dynamicRoots / (float)roots, 0.025);
+		if (fraction == 0.0f || fraction == 1.0f)
+			CHECK_EQUAL(fraction*12000, dynamicItems);
+	}
+}
+
+TEST(StressScene, HierarchyDepthMakesStacks)
+{
+	const uint32_t depths[] = { 1, 2, 5 };
+	for (uint32_t depth : depths)
+	{
+		StressSceneGenerator generator = MakeGenerator(StressDistribution::PoissonDisk);
+		generator.SetHierarchyDepth(depth);
+
+		// A count that leaves the last stack short.
+		const uint32_t count = 1001;
+		SceneFileContents scene;
+		generator.Generate(count, 3, scene);
+		CHECK_EQUAL(count, scene.Worlds.size());
+		CHECK_EQUAL(count, generator.GetStats().Items);
+		CHECK_EQUAL((count + depth - 1) / depth, generator.GetStats().Roots);
+
+		// Every item is the child of the one before it up to depth levels, on the
+		// same spot of the ground and above it.
+		vector<uint32_t> levels(count);
+		uint32_t fullStacks = 0, badStack = 0;
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			uint32_t parent = scene.Parents[i];
+			if (parent == UINT32_MAX)
+			{
+				levels[i] = 0;
+				continue;
+			}
+
+			levels[i] = levels[parent] + 1;
+			XMFLOAT2 at = GroundPosition(scene, i);
+			XMFLOAT2 below = GroundPosition(scene, parent);
+			badStack += parent != i - 1 || levels[i] >= depth || at.x != below.x || at.y != below.y ||
+				scene.Worlds[i]._24 <= scene.Worlds[parent]._24 ? 1 : 0;
+			fullStacks += levels[i] == depth - 1 ? 1 : 0;
+		}
+
+		CHECK_EQUAL(0, badStack);
+		CHECK_EQUAL(depth > 1 ? count / depth : 0, fullStacks);
+	}
+}
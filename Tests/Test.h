@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+
+using namespace std;
+
+
+// Tests of the engine modules, run by MiniProjectTests. A test is a function
+// defined with TEST(Suite, Name); it registers itself at startup, and a failed
+// CHECK reports the file and line and marks the test failed without stopping it.
+
+typedef void(*TestFunction)();
+
+struct TestRegistration
+{
+	TestRegistration(const char* suite, const char* name, TestFunction function);
+};
+
+// Counts a failed check of the running test.
+void ReportFailure(const char* file, int line, const char* message);
+
+#define TEST(suite, name) \
+	static void suite##_##name(); \
+	static TestRegistration suite##_##name##_registration(#suite, #name, suite##_##name); \
+	static void suite##_##name()
+
+#define CHECK(condition) \
+	do { if (!(condition)) ReportFailure(__FILE__, __LINE__, "CHECK(" #condition ")"); } while (0)
+
+// Compares integers, printing both values on failure.
+#define CHECK_EQUAL(expected, actual) \
+	do { \
+		long long expectedValue = (long long)(expected); \
+		long long actualValue = (long long)(actual); \
+		if (expectedValue != actualValue) \
+		{ \
+			char message[256]; \
+			snprintf(message, sizeof(message), "CHECK_EQUAL(%s, %s): %lld != %lld", #expected, #actual, expectedValue, actualValue); \
+			ReportFailure(__FILE__, __LINE__, message); \
+		} \
+	} while (0)
+
+#define CHECK_NEAR(expected, actual, tolerance) \
+	do { \
+		double expectedValue = (double)(expected); \
+		double actualValue = (double)(actual); \
+		if (!(fabs(expectedValue - actualValue) <= (tolerance))) \
+		{ \
+			char message[256]; \
+			snprintf(message, sizeof(message), "CHECK_NEAR(%s, %s): %g != %g", #expected, #actual, expectedValue, actualValue); \
+			ReportFailure(__FILE__, __LINE__, message); \
+		} \
+	} while (0)
@@ -0,0 +1,71 @@
+#include "Test.h"
+#include <cstring>
+#include <vector>
+
+using namespace std;
+
+namespace
+{
+	struct RegisteredTest
+	{
+		const char* Suite;
+		const char* Name;
+		TestFunction Function;
+	};
+
+	// A function local so registrations from any file find it constructed.
+	vector<RegisteredTest>& Tests()
+	{
+		static vector<RegisteredTest> tests;
+		return tests;
+	}
+
+	int g_failures = 0;
+}
+
+
+TestRegistration::TestRegistration(const char* suite, const char* name, TestFunction function)
+{
+	Tests().push_back({ suite, name, function });
+}
+
+void ReportFailure(const char* file, int line, const char* message)
+{
+	printf("%s(%d): %s\n", file, line, message);
+	g_failures++;
+}
+
+// Runs the tests of the suites named on the command line, or all of them.
+// Returns the number of failed tests.
+int main(int argc, char** argv)
+{
+	int run = 0;
+	int failed = 0;
+	for (const RegisteredTest& test : Tests())
+	{
+		bool selected = argc == 1;
+		for (int a = 1; a < argc; ++a)
+			selected = selected || strcmp(argv[a], test.Suite) == 0;
+
+		if (!selected)
+			continue;
+
+		int failures = g_failures;
+		test.Function();
+		run++;
+
+		bool passed = g_failures == failures;
+		failed += passed ? 0 : 1;
+		printf("%s %s.%s\n", passed ? "passed" : "FAILED", test.Suite, test.Name);
+		fflush(stdout);
+	}
+
+	if (run == 0)
+	{
+		printf("No test suite named so.\n");
+		return 1;
+	}
+
+	printf("%d of %d tests passed\n", run - failed, run);
+	return failed;
+}
@@ -0,0 +1,139 @@
+#include "Test.h"
+#include "CameraDynamic.h"
+#include "FrustumCulling.h"
+#include "VisibilityCache.h"
+#include <cmath>
+#include <random>
+
+using namespace DirectX;
+using namespace std;
+
+namespace
+{
+	void AddRandomBoxes(BoundsSoA& bounds, uint32_t count, mt19937& random)
+	{
+		uniform_real_distribution<float> position(-200.0f, 200.0f);
+		uniform_real_distribution<float> extent(0.1f, 4.0f);
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			bounds.CenterX.push_back(position(random));
+			bounds.CenterY.push_back(0.1f*position(random));
+			bounds.CenterZ.push_back(position(random));
+			bounds.ExtentX.push_back(extent(random));
+			bounds.ExtentY.push_back(extent(random));
+			bounds.ExtentZ.push_back(extent(random));
+		}
+	}
+
+	// Culls the first count boxes with both and checks they agree.
+	void CheckFrame(VisibilityCache& cache, const Camera& camera, const BoundsSoA& bounds, uint32_t count)
+	{
+		XMFLOAT4 planes[6];
+		camera.GetFrustumPlanes(planes);
+
+		FrustumCuller culler;
+		vector<uint32_t> full;
+		culler.SetPlanes(planes);
+		culler.Cull(bounds, count, full);
+
+		vector<uint32_t> cached;
+		cache.Cull(planes, camera.GetPosition(), bounds, count, cached);
+		CHECK(cached == full);
+		CHECK_EQUAL(full.size(), cache.GetStats().Visible);
+	}
+}
+
+
+TEST(VisibilityCache, MatchesFrustumCuller)
+{
+	mt19937 random(99);
+	BoundsSoA bounds;
+	AddRandomBoxes(bounds, 20000, random);
+
+	Camera camera;
+	camera.SetFrustum(XM_PIDIV4, 16.0f / 9.0f, 1.0f, 150.0f);
+	camera.SetPosition(0.0f, 2.0f, -100.0f);
+
+	VisibilityCache cache(64);
+	uniform_int_distribution<uint32_t> pick(0, 19999);
+	uniform_real_distribution<float> step(-1.0f, 1.0f);
+	uint32_t count = 20000;
+	bool fellBack = false;
+
+	for (uint32_t frame = 0; frame < 400; ++frame)
+	{
+		// Slow and fast turns, a spin, and a jump far enough to move the anchor.
+		float turn = frame < 100 ? 0.002f : frame < 150 ? 0.05f : frame < 200 ? 0.6f : 0.01f;
+		camera.ForwardAndBackward(0.3f);
+		camera.Yaw(turn*sinf(0.05f*frame));
+		camera.Pitch(0.2f*turn*cosf(0.07f*frame));
+		if (frame == 300)
+			camera.SetPosition(0.0f, 2.0f, 100.0f);
+		camera.UpdateViewMatrix();
+
+		// Some boxes move, and the scene shrinks and grows back.
+		for (int m = 0; m < 20; ++m)
+		{
+			uint32_t item = pick(random);
+			bounds.CenterX[item] += 5.0f*step(random);
+			bounds.CenterZ[item] += 5.0f*step(random);
+			cache.Invalidate(item);
+		}
+		if (frame == 250)
+			count = 12345;
+		if (frame == 270)
+			count = 20000;
+
+		CheckFrame(cache, camera, bounds, count);
+		fellBack = fellBack || cache.GetStats().FellBack;
+	}
+
+	CHECK(fellBack);
+
+	// Everything is dropped and refilled after InvalidateAll.
+	for (uint32_t i = 0; i < count; ++i)
+		bounds.CenterY[i] += 1.0f;
+	cache.InvalidateAll();
+	CheckFrame(cache, camera, bounds, count);
+}
+
+TEST(VisibilityCache, FillsOverFramesAndFallsBack)
+{
+	mt19937 random(7);
+	BoundsSoA bounds;
+	AddRandomBoxes(bounds, 6400, random);
+
+	Camera camera;
+	camera.SetFrustum(XM_PIDIV4, 16.0f / 9.0f, 1.0f, 150.0f);
+	camera.UpdateViewMatrix();
+
+	// The items join a 32nd per frame, the others are tested by the full pass.
+	VisibilityCache cache;
+	for (uint32_t frame = 1; frame <= 32; ++frame)
+	{
+		CheckFrame(cache, camera, bounds, 6400);
+		CHECK_EQUAL(6400 - 200*frame, cache.GetStats().Uncached);
+		CHECK(!cache.GetStats().FellBack);
+	}
+
+	// Once it is full a still camera retests a few items: the refresh share and
+	// the ones right on a plane.
+	CheckFrame(cache, camera, bounds, 6400);
+	CHECK_EQUAL(0, cache.GetStats().Uncached);
+	CHECK(cache.GetStats().Retested < 64);
+
+	// Turned around at once, every item is due: the frame is a full pass and the
+	// cache waits before it fills again.
+	camera.Yaw(XM_PI);
+	camera.UpdateViewMatrix();
+	CheckFrame(cache, camera, bounds, 6400);
+	CHECK(cache.GetStats().FellBack);
+	CHECK_EQUAL(0, cache.GetStats().Retested);
+	CHECK_EQUAL(6400, cache.GetStats().Uncached);
+
+	uint32_t held = 0;
+	for (; held < 100 && cache.GetStats().Uncached == 6400; ++held)
+		CheckFrame(cache, camera, bounds, 6400);
+	CHECK_EQUAL(9, held);
+	CHECK_EQUAL(6200, cache.GetStats().Uncached);
+}
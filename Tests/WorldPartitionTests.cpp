@@ -0,0 +1,211 @@
+#include "Test.h"
+#include "WorldPartition.h"
+#include <cmath>
+
+using namespace DirectX;
+using namespace std;
+
+namespace
+{
+	// Moves the camera on the ground and finishes every load it starts, at 100
+	// bytes a cell.
+	void Step(WorldPartition& partition, float x, float z, float deltaTime, vector<uint32_t>& loads, vector<uint32_t>& unloads)
+	{
+		partition.Update(XMFLOAT3(x, 2.0f, z), deltaTime, loads, unloads);
+		for (uint32_t cell : loads)
+			partition.FinishLoad(cell, 100);
+	}
+
+	float Distance(const WorldPartition& partition, uint32_t cell, float x, float z)
+	{
+		XMFLOAT2 min, max;
+		partition.GetCellBounds(cell, min, max);
+		float dx = fmaxf(fmaxf(min.x - x, x - max.x), 0.0f);
+		float dz = fmaxf(fmaxf(min.y - z, z - max.y), 0.0f);
+		return sqrtf(dx*dx + dz*dz);
+	}
+
+	// Counts the cells within the load radius of (x, z) that are not resident,
+	// and the cells beyond the unload radius that are not unloaded.
+	uint32_t WrongStates(const WorldPartition& partition, float x, float z, float loadRadius, float unloadRadius)
+	{
+		uint32_t wrong = 0;
+		for (uint32_t cell = 0; cell < partition.GetCellCount(); ++cell)
+		{
+			float distance = Distance(partition, cell, x, z);
+			if (distance <= loadRadius)
+				wrong += partition.GetState(cell) != WorldPartition::Resident ? 1 : 0;
+			else if (distance > unloadRadius)
+				wrong += partition.GetState(cell) != WorldPartition::Unloaded ? 1 : 0;
+		}
+		return wrong;
+	}
+}
+
+
+TEST(WorldPartition, HysteresisKeepsCellsOverABorder)
+{
+	WorldPartition partition;
+	partition.SetGrid(XMFLOAT2(0.0f, 0.0f), 10.0f, 16, 16);
+	partition.SetRadii(10.0f, 25.0f);
+	partition.SetPrefetchTime(0.0f);
+	partition.SetMaxLoadsInFlight(1000);
+
+	vector<uint32_t> loads, unloads;
+	Step(partition, 85.0f, 85.0f, 0.0f, loads, unloads);
+	CHECK_EQUAL(0, WrongStates(partition, 85.0f, 85.0f, 10.0f, 25.0f));
+	CHECK_EQUAL(loads.size(), partition.GetStats().Resident);
+	CHECK_EQUAL(100*loads.size(), partition.GetStats().UsedBytes);
+	CHECK_EQUAL(0, unloads.size());
+
+	// Back and forth over the border of x = 90: the cells ahead are loaded on the
+	// first crossing, and after that nothing is loaded or unloaded again.
+	Step(partition, 95.0f, 85.0f, 0.1f, loads, unloads);
+	CHECK(!loads.empty());
+	CHECK_EQUAL(0, unloads.size());
+	uint32_t settledLoads = partition.GetStats().Loads;
+	for (int frame = 0; frame < 20; ++frame)
+	{
+		float x = frame % 2 ? 95.0f : 85.0f;
+		Step(partition, x, 85.0f, 0.1f, loads, unloads);
+		CHECK_EQUAL(0, loads.size());
+		CHECK_EQUAL(0, unloads.size());
+		CHECK_EQUAL(0, WrongStates(partition, x, 85.0f, 10.0f, 25.0f));
+	}
+	CHECK_EQUAL(settledLoads, partition.GetStats().Loads);
+	CHECK_EQUAL(0, partition.GetStats().Unloads);
+
+	// Far enough, the cells behind go, and only those beyond the unload radius.
+	Step(partition, 120.0f, 85.0f, 0.1f, loads, unloads);
+	CHECK(!unloads.empty());
+	CHECK_EQUAL(0, WrongStates(partition, 120.0f, 85.0f, 10.0f, 25.0f));
+	for (uint32_t cell : unloads)
+		CHECK(Distance(partition, cell, 120.0f, 85.0f) > 25.0f);
+	CHECK_EQUAL(100*partition.GetStats().Resident, partition.GetStats().UsedBytes);
+}
+
+TEST(WorldPartition, BudgetEvictsOnlyFartherCells)
+{
+	// A row of cells, three of which fit in the budget.
+	WorldPartition partition;
+	partition.SetGrid(XMFLOAT2(0.0f, 0.0f), 10.0f, 16, 1);
+	partition.SetRadii(15.0f, 1000.0f);
+	partition.SetPrefetchTime(0.0f);
+	partition.SetMaxLoadsInFlight(1000);
+	partition.SetCellEstimate(100);
+	partition.SetMemoryBudget(300);
+
+	vector<uint32_t> loads, unloads;
+	Step(partition, 5.0f, 5.0f, 0.0f, loads, unloads);
+	CHECK(loads == vector<uint32_t>({ 0, 1, 2 }));
+	CHECK_EQUAL(300, partition.GetStats().UsedBytes);
+
+	// Moved to cell 3, the cells 3, 4 and 5 are wanted, at 0, 5 and 15. Cells 0
+	// and 1, at 25 and 15, make room for the first two; cell 2, at 5, is nearer
+	// than cell 5 and stays, so cell 5 waits.
+	Step(partition, 35.0f, 5.0f, 0.1f, loads, unloads);
+	CHECK(loads == vector<uint32_t>({ 3, 4 }));
+	CHECK(unloads == vector<uint32_t>({ 0, 1 }));
+	CHECK_EQUAL(2, partition.GetStats().Evictions);
+	CHECK_EQUAL(1, partition.GetStats().Deferred);
+	CHECK_EQUAL(WorldPartition::Resident, partition.GetState(2));
+	CHECK_EQUAL(WorldPartition::Unloaded, partition.GetState(5));
+	CHECK_EQUAL(300, partition.GetStats().UsedBytes);
+
+	// Nothing farther is left to evict, so the camera standing still changes
+	// nothing.
+	Step(partition, 35.0f, 5.0f, 0.1f, loads, unloads);
+	CHECK_EQUAL(0, loads.size());
+	CHECK_EQUAL(0, unloads.size());
+	CHECK_EQUAL(1, partition.GetStats().Deferred);
+
+	// Coming back, cells 3 and 4 are the farthest and make room, farthest first.
+	Step(partition, 5.0f, 5.0f, 0.1f, loads, unloads);
+	CHECK(loads == vector<uint32_t>({ 0, 1 }));
+	CHECK(unloads == vector<uint32_t>({ 4, 3 }));
+	CHECK_EQUAL(4, partition.GetStats().Evictions);
+	CHECK_EQUAL(WorldPartition::Resident, partition.GetState(2));
+}
+
+TEST(WorldPartition, PrefetchAlongTheVelocity)
+{
+	// A row of cells, loaded within 10 of the camera and of the point it will be
+	// at in two seconds, and never unloaded.
+	WorldPartition partition;
+	partition.SetGrid(XMFLOAT2(0.0f, 0.0f), 10.0f, 32, 1);
+	partition.SetRadii(10.0f, 1000.0f);
+	partition.SetPrefetchTime(2.0f);
+	partition.SetMaxLoadsInFlight(1000);
+
+	// Standing still nothing is prefetched.
+	vector<uint32_t> loads, unloads;
+	for (int frame = 0; frame < 10; ++frame)
+		Step(partition, 5.0f, 5.0f, 0.1f, loads, unloads);
+	CHECK_EQUAL(0, partition.GetStats().Prefetches);
+	CHECK_EQUAL(WorldPartition::Unloaded, partition.GetState(2));
+
+	// At 10 units a second up to x = 45, the point ahead is x = 65: cells 6 and 7
+	// are loaded for it, cell 8 is not.
+	for (int frame = 1; frame <= 40; ++frame)
+		Step(partition, 5.0f + frame, 5.0f, 0.1f, loads, unloads);
+	CHECK_NEAR(10.0f, partition.GetStats().Velocity.x, 0.01);
+	CHECK_NEAR(0.0f, partition.GetStats().Velocity.y, 0.01);
+	CHECK(partition.GetStats().Prefetches > 0);
+	CHECK_EQUAL(WorldPartition::Resident, partition.GetState(7));
+	CHECK_EQUAL(WorldPartition::Unloaded, partition.GetState(8));
+
+	// A jump is not movement: the velocity starts over.
+	Step(partition, 275.0f, 5.0f, 0.1f, loads, unloads);
+	CHECK_NEAR(0.0f, partition.GetStats().Velocity.x, 0.0);
+
+	// Backwards from x = 275 to 235, the point ahead is x = 215: cell 20 is
+	// loaded, cell 19 is not, and neither is cell 29 behind.
+	uint32_t prefetches = partition.GetStats().Prefetches;
+	for (int frame = 1; frame <= 40; ++frame)
+		Step(partition, 275.0f - frame, 5.0f, 0.1f, loads, unloads);
+	CHECK_NEAR(-10.0f, partition.GetStats().Velocity.x, 0.01);
+	CHECK(partition.GetStats().Prefetches > prefetches);
+	CHECK_EQUAL(WorldPartition::Resident, partition.GetState(20));
+	CHECK_EQUAL(WorldPartition::Unloaded, partition.GetState(19));
+	CHECK_EQUAL(WorldPartition::Unloaded, partition.GetState(29));
+}
+
+TEST(WorldPartition, FinishLoadOnlyForLoadingCells)
+{
+	WorldPartition partition;
+	partition.SetGrid(XMFLOAT2(0.0f, 0.0f), 10.0f, 8, 8);
+	partition.SetRadii(4.0f, 10.0f);
+	partition.SetCellEstimate(100);
+
+	vector<uint32_t> loads, unloads;
+	partition.Update(XMFLOAT3(15.0f, 0.0f, 15.0f), 0.0f, loads, unloads);
+	CHECK(loads == vector<uint32_t>({ 9 }));
+	CHECK_EQUAL(WorldPartition::Loading, partition.GetState(9));
+	CHECK_EQUAL(1, partition.GetStats().Loading);
+	CHECK_EQUAL(100, partition.GetStats().UsedBytes);
+
+	// A cell never asked for stays unloaded.
+	partition.FinishLoad(0, 50);
+	CHECK_EQUAL(WorldPartition::Unloaded, partition.GetState(0));
+	CHECK_EQUAL(100, partition.GetStats().UsedBytes);
+	CHECK_EQUAL(0, partition.GetStats().Resident);
+
+	// The load finishing counts the cell at its size, once.
+	partition.FinishLoad(9, 70);
+	CHECK_EQUAL(WorldPartition::Resident, partition.GetState(9));
+	CHECK_EQUAL(70, partition.GetStats().UsedBytes);
+	partition.FinishLoad(9, 500);
+	CHECK_EQUAL(70, partition.GetStats().UsedBytes);
+	CHECK_EQUAL(0, partition.GetStats().Loading);
+	CHECK_EQUAL(1, partition.GetStats().Resident);
+
+	// A load from before SetGrid finishing afterwards is dropped.
+	partition.Update(XMFLOAT3(45.0f, 0.0f, 45.0f), 0.0f, loads, unloads);
+	CHECK(loads == vector<uint32_t>({ 36 }));
+	partition.SetGrid(XMFLOAT2(0.0f, 0.0f), 10.0f, 8, 8);
+	partition.FinishLoad(36, 70);
+	CHECK_EQUAL(WorldPartition::Unloaded, partition.GetState(36));
+	CHECK_EQUAL(0, partition.GetStats().UsedBytes);
+	CHECK_EQUAL(0, partition.GetStats().Resident);
+	CHECK_EQUAL(0, partition.GetStats().Loading);
+}